@@ -26,11 +26,47 @@
 #pragma alloc_text(PAGE, BalloonEvtDeviceD0ExitPreInterruptsDisabled)
 #pragma alloc_text(PAGE, BalloonDeviceAdd)
 #pragma alloc_text(PAGE, BalloonCloseWorkerThread)
+#pragma alloc_text(PAGE, BalloonQueryConfig)
 #endif
 
 #define LOMEMEVENTNAME L"\\KernelObjects\\LowMemoryCondition"
 DECLARE_CONST_UNICODE_STRING(evLowMemString, LOMEMEVENTNAME);
 
+VOID
+BalloonQueryConfig(
+    IN WDFDEVICE Device
+    )
+{
+    PDEVICE_CONTEXT     devCtx = GetDeviceContext(Device);
+    WDFKEY              hKey;
+    ULONG               value;
+    DECLARE_CONST_UNICODE_STRING(hugeName, L"HugePageChunks");
+
+    PAGED_CODE();
+
+    /*
+     * Huge chunks are mapped in system space while in the balloon, only
+     * use them by default where there is plenty of it.
+     */
+#if defined(_WIN64)
+    devCtx->bHugeChunks = TRUE;
+#else
+    devCtx->bHugeChunks = FALSE;
+#endif
+
+    if (NT_SUCCESS(WdfDeviceOpenRegistryKey(Device, PLUGPLAY_REGKEY_DEVICE,
+        KEY_READ, WDF_NO_OBJECT_ATTRIBUTES, &hKey)))
+    {
+        if (NT_SUCCESS(WdfRegistryQueryULong(hKey, &hugeName, &value)))
+        {
+            devCtx->bHugeChunks = (value != 0);
+        }
+        WdfRegistryClose(hKey);
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP, "Huge page chunks %s\n",
+        devCtx->bHugeChunks ? "enabled" : "disabled");
+}
 
 NTSTATUS
 BalloonDeviceAdd(
@@ -43,6 +79,7 @@ BalloonDeviceAdd(
     WDF_INTERRUPT_CONFIG         interruptConfig;
     WDF_OBJECT_ATTRIBUTES        attributes;
     WDF_PNPPOWER_EVENT_CALLBACKS pnpPowerCallbacks;
+    ULONG                        i;
 
     UNREFERENCED_PARAMETER(Driver);
     PAGED_CODE();
@@ -112,7 +149,7 @@ BalloonDeviceAdd(
     devCtx->pfns_table = (PPFN_NUMBER)
               ExAllocatePoolWithTag(
                       NonPagedPool,
-                      PAGE_SIZE,
+                      BALLOON_PFN_BATCHES * PAGE_SIZE,
                       BALLOON_MGMT_POOL_TAG
                       );
 
@@ -123,6 +160,16 @@ BalloonDeviceAdd(
         return status;
     }
 
+    /* each batch takes one page of the table, so it never crosses a page */
+    for (i = 0; i < BALLOON_PFN_BATCHES; i++)
+    {
+        devCtx->PfnBatches[i].pfns = devCtx->pfns_table + i * BALLOON_PFNS_PER_BATCH;
+        devCtx->PfnBatches[i].num_pfns = 0;
+        devCtx->PfnBatches[i].InFlight = 0;
+    }
+    devCtx->BatchesInFlight = 0;
+    KeInitializeSpinLock(&devCtx->VqLock);
+
     devCtx->MemStats = (PBALLOON_STAT)
               ExAllocatePoolWithTag(
                       NonPagedPool,
@@ -144,6 +191,13 @@ BalloonDeviceAdd(
                       FALSE
                       );
 
+    KeInitializeEvent(&devCtx->ReportAckEvent,
+                      SynchronizationEvent,
+                      FALSE
+                      );
+    BalloonQueryConfig(device);
+    ReportQueryConfig(device);
+
     status = StatInitializeWorkItem(device);
     if(!NT_SUCCESS(status))
     {
@@ -228,7 +282,7 @@ BalloonEvtDevicePrepareHardware(
         ResourceListTranslated,
         NULL,
         BALLOON_MGMT_POOL_TAG,
-        3 /* nMaxQueues */);
+        5 /* nMaxQueues */);
     if (!NT_SUCCESS(status))
     {
         TraceEvents(TRACE_LEVEL_ERROR, DBG_POWER, "VirtIOWdfInitialize failed with %x\n", status);
@@ -455,28 +509,29 @@ BalloonInterruptDpc(
 {
     unsigned int          len;
     PDEVICE_CONTEXT       devCtx = GetDeviceContext(WdfDevice);
+    BOOLEAN               bStatsRequest = FALSE;
 
-    BOOLEAN               bHostAck = FALSE;
     UNREFERENCED_PARAMETER( WdfInterrupt );
 
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_DPC, "--> %s\n", __FUNCTION__);
 
-    if (virtqueue_get_buf(devCtx->InfVirtQueue, &len))
-    {
-        bHostAck = TRUE;
-    }
-    if (virtqueue_get_buf(devCtx->DefVirtQueue, &len))
+    BalloonHostAck(WdfDevice, devCtx->InfVirtQueue);
+    BalloonHostAck(WdfDevice, devCtx->DefVirtQueue);
+
+    if (devCtx->ReportVirtQueue)
     {
-        bHostAck = TRUE;
+        ReportHostAck(WdfDevice);
     }
 
-    if(bHostAck)
+    if (devCtx->StatVirtQueue)
     {
-        KeSetEvent (&devCtx->HostAckEvent, IO_NO_INCREMENT, FALSE);
+        /* the host hands the only stats buffer back to ask for new stats */
+        KeAcquireSpinLockAtDpcLevel(&devCtx->VqLock);
+        bStatsRequest = (virtqueue_get_buf(devCtx->StatVirtQueue, &len) != NULL);
+        KeReleaseSpinLockFromDpcLevel(&devCtx->VqLock);
     }
 
-    if (devCtx->StatVirtQueue &&
-        virtqueue_get_buf(devCtx->StatVirtQueue, &len))
+    if (bStatsRequest)
     {
         /*
          * According to MSDN 'Using Framework Work Items' article:
@@ -571,14 +626,49 @@ BalloonRoutine(
 
     NTSTATUS            status = STATUS_SUCCESS;
     LONGLONG            diff;
+    ULONG               pages;
+    LARGE_INTEGER       timeout;
+    PLARGE_INTEGER      pTimeout;
+    ULONGLONG           now;
+    PVOID               waitObjects[2];
+    ULONG               nWaitObjects;
 
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP, "Balloon thread started....\n");
 
     for (;;)
     {
-        status = KeWaitForSingleObject(&devCtx->WakeUpThread, Executive,
-                                       KernelMode, FALSE, NULL);
-        if(STATUS_WAIT_0 == status)
+        /* free pages are reported between the resize requests */
+        pTimeout = NULL;
+        if (devCtx->ReportVirtQueue && !devCtx->bReportStalled &&
+            !devCtx->bShutDown)
+        {
+            now = KeQueryInterruptTime();
+            if (now >= devCtx->ReportDue)
+            {
+                ReportFreePages(Device);
+                now = KeQueryInterruptTime();
+            }
+            timeout.QuadPart = (devCtx->ReportDue > now) ?
+                -(LONGLONG)(devCtx->ReportDue - now) : 0;
+            pTimeout = &timeout;
+        }
+
+        /* with deflate on OOM, low memory wakes the thread as well */
+        waitObjects[0] = &devCtx->WakeUpThread;
+        nWaitObjects = 1;
+        if (devCtx->bDeflateOnOom && devCtx->evLowMem && devCtx->num_pages > 0)
+        {
+            waitObjects[nWaitObjects++] = devCtx->evLowMem;
+        }
+
+        status = KeWaitForMultipleObjects(nWaitObjects, waitObjects, WaitAny,
+                                          Executive, KernelMode, FALSE,
+                                          pTimeout, NULL);
+        if(STATUS_WAIT_1 == status && !devCtx->bShutDown)
+        {
+            BalloonDeflateOnOom(Device);
+        }
+        else if(STATUS_WAIT_0 == status)
         {
             if(devCtx->bShutDown)
             {
@@ -587,16 +677,26 @@ BalloonRoutine(
             }
             else
             {
-                diff = BalloonGetSize(Device);
-                if (diff > 0)
-                {
-                    BalloonFill(Device, (size_t)(diff));
-                }
-                else if (diff < 0)
+                /*
+                 * Keep going until the target is reached, it may move while
+                 * the balloon is being resized. Stop when no progress is made
+                 * (low memory, no answer from the host).
+                 */
+                do
                 {
-                    BalloonLeak(Device, (size_t)(-diff));
-                }
-                BalloonSetSize(Device, devCtx->num_pages);
+                    pages = devCtx->num_pages;
+                    diff = BalloonGetSize(Device);
+                    if (diff > 0)
+                    {
+                        BalloonFill(Device, (size_t)(diff));
+                    }
+                    else if (diff < 0)
+                    {
+                        BalloonLeak(Device, (size_t)(-diff));
+                    }
+                    BalloonSetSize(Device, devCtx->num_pages);
+                } while (diff != 0 && pages != devCtx->num_pages &&
+                         !devCtx->bShutDown);
             }
         }
     }
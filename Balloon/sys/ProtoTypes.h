@@ -25,6 +25,9 @@
 /* The feature bitmap for virtio balloon */
 #define VIRTIO_BALLOON_F_MUST_TELL_HOST    0 /* Tell before reclaiming pages */
 #define VIRTIO_BALLOON_F_STATS_VQ    1 /* Memory status virtqueue */
+#define VIRTIO_BALLOON_F_DEFLATE_ON_OOM 2 /* Deflate balloon on OOM */
+#define VIRTIO_BALLOON_F_FREE_PAGE_HINT 3 /* VQ to report free pages */
+#define VIRTIO_BALLOON_F_REPORTING   5 /* Free page reporting virtqueue */
 
 typedef struct _VIRTIO_BALLOON_CONFIG
 {
@@ -41,8 +44,45 @@ typedef struct VirtIOBufferDescriptor VIO_SG, *PVIO_SG;
 typedef struct {
     SINGLE_LIST_ENTRY       SingleListEntry;
     PMDL                    PageMdl;
+    /* mapping of a huge chunk, NULL for small pages */
+    PVOID                   HugeVa;
 } PAGE_LIST_ENTRY, *PPAGE_LIST_ENTRY;
 
+/* the balloon is inflated in huge page sized chunks when possible */
+#define BALLOON_HUGE_PAGE_SIZE    (2 * 1024 * 1024)
+#define BALLOON_HUGE_PAGE_PFNS    (BALLOON_HUGE_PAGE_SIZE / PAGE_SIZE)
+
+/* PFN arrays which may be on the inflate and deflate queues at the same time */
+#define BALLOON_PFN_BATCHES       8
+#define BALLOON_PFNS_PER_BATCH    (PAGE_SIZE / sizeof(PFN_NUMBER))
+
+/* Pages given back per step while the system is low on memory */
+#define BALLOON_OOM_DEFLATE_PAGES ((64 * 1024 * 1024) / PAGE_SIZE)
+
+/* How long to wait for the host to return a PFN array, in ms */
+#define BALLOON_HOST_ACK_TIMEOUT  1000
+
+typedef struct {
+    PPFN_NUMBER             pfns;
+    ULONG                   num_pfns;
+    volatile LONG           InFlight;
+} PFN_BATCH, *PPFN_BATCH;
+
+/*
+ * Free page reporting. Every ReportInterval ms up to ReportChunks chunks of
+ * 2^ReportOrder free pages are allocated, reported to the host and freed,
+ * at most BALLOON_REPORT_SG_MAX of them per request.
+ */
+#define BALLOON_REPORT_SG_MAX           16
+#define BALLOON_REPORT_MAX_ORDER        10
+#define BALLOON_REPORT_DEFAULT_ORDER    9
+#define BALLOON_REPORT_DEFAULT_CHUNKS   64
+#define BALLOON_REPORT_DEFAULT_INTERVAL 2000
+/* the interval doubles up to this while the system is low on memory, in ms */
+#define BALLOON_REPORT_MAX_INTERVAL     60000
+/* a report the host hasn't returned after this many ack timeouts is given up */
+#define BALLOON_REPORT_ACK_RETRIES      30
+
 typedef struct _DEVICE_CONTEXT {
     WDFINTERRUPT            WdfInterrupt;
     WDFWORKITEM             StatWorkItem;
@@ -56,17 +96,46 @@ typedef struct _DEVICE_CONTEXT {
     PVIOQUEUE               InfVirtQueue;
     PVIOQUEUE               DefVirtQueue;
     PVIOQUEUE               StatVirtQueue;
+    PVIOQUEUE               ReportVirtQueue;
 
     KEVENT                  HostAckEvent;
+    /* protects the virtqueues */
+    KSPIN_LOCK              VqLock;
 
     volatile ULONG          num_pages;
-    ULONG                   num_pfns;
     PPFN_NUMBER             pfns_table;
+    PFN_BATCH               PfnBatches[BALLOON_PFN_BATCHES];
+    volatile LONG           BatchesInFlight;
+
+    /* pages per second achieved by the last inflation and deflation */
+    ULONGLONG               InflateRate;
+    ULONGLONG               DeflateRate;
+
+    /* deflation on low memory, without waiting for a new target */
+    BOOLEAN                 bDeflateOnOom;
+    ULONGLONG               OomDeflatedPages;
+
+    /* chunks currently in the balloon */
+    BOOLEAN                 bHugeChunks;
+    ULONG                   HugeChunks;
+    ULONG                   SmallChunks;
     NPAGED_LOOKASIDE_LIST   LookAsideList;
     BOOLEAN                 bListInitialized;
     SINGLE_LIST_ENTRY       PageListHead;
     PBALLOON_STAT           MemStats;
 
+    BOOLEAN                 bReportingEnabled;
+    ULONG                   ReportOrder;
+    ULONG                   ReportChunks;
+    ULONG                   ReportInterval;
+    ULONG                   ReportBackoff;
+    ULONGLONG               ReportDue;
+    ULONGLONG               ReportedPages;
+    BOOLEAN                 bReportStalled;
+    KEVENT                  ReportAckEvent;
+    VIO_SG                  ReportSg[BALLOON_REPORT_SG_MAX];
+    PMDL                    ReportMdls[BALLOON_REPORT_SG_MAX];
+
     KEVENT                  WakeUpThread;
     PKTHREAD                Thread;
     BOOLEAN                 bShutDown;
@@ -140,12 +209,24 @@ BalloonLeak(
     );
 
 VOID
-BalloonMemStats(
+BalloonDeflateOnOom(
     IN WDFOBJECT WdfDevice
     );
 
 VOID
+BalloonMemStats(
+    IN WDFOBJECT WdfDevice
+    );
+
+BOOLEAN
 BalloonTellHost(
+    IN WDFOBJECT WdfDevice,
+    IN PVIOQUEUE vq,
+    IN PPFN_BATCH batch
+    );
+
+VOID
+BalloonHostAck(
     IN WDFOBJECT WdfDevice,
     IN PVIOQUEUE vq
     );
@@ -170,6 +251,11 @@ EnableInterrupt(
        virtqueue_enable_cb(devCtx->StatVirtQueue);
        virtqueue_kick(devCtx->StatVirtQueue);
     }
+    if (devCtx->ReportVirtQueue)
+    {
+       virtqueue_enable_cb(devCtx->ReportVirtQueue);
+       virtqueue_kick(devCtx->ReportVirtQueue);
+    }
 }
 
 __inline
@@ -184,6 +270,10 @@ DisableInterrupt(
     {
         virtqueue_disable_cb(devCtx->StatVirtQueue);
     }
+    if (devCtx->ReportVirtQueue)
+    {
+        virtqueue_disable_cb(devCtx->ReportVirtQueue);
+    }
 }
 
 VOID
@@ -197,6 +287,11 @@ BalloonGetSize(
     IN WDFOBJECT WdfDevice
     );
 
+VOID
+BalloonQueryConfig(
+    IN WDFDEVICE Device
+    );
+
 NTSTATUS
 BalloonCloseWorkerThread(
     IN WDFDEVICE  Device
@@ -232,4 +327,19 @@ StatInitializeWorkItem(
     IN WDFDEVICE Device
     );
 
+VOID
+ReportQueryConfig(
+    IN WDFDEVICE Device
+    );
+
+VOID
+ReportFreePages(
+    IN WDFOBJECT WdfDevice
+    );
+
+VOID
+ReportHostAck(
+    IN WDFOBJECT WdfDevice
+    );
+
 #endif  // _PROTOTYPES_H_
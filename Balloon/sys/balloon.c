@@ -28,9 +28,11 @@ BalloonInit(
     u64 u64HostFeatures;
     u64 u64GuestFeatures = 0;
     bool notify_stat_queue = false;
-    VIRTIO_WDF_QUEUE_PARAM params[3];
-    PVIOQUEUE vqs[3];
+    VIRTIO_WDF_QUEUE_PARAM params[5];
+    PVIOQUEUE vqs[5];
     ULONG nvqs;
+    ULONG reportvq;
+    ULONG i;
 
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP, "--> BalloonInit\n");
 
@@ -42,9 +44,12 @@ BalloonInit(
     params[1].bEnableInterruptSuppression = false;
     params[1].Interrupt = devCtx->WdfInterrupt;
 
-    // stats
-    params[2].bEnableInterruptSuppression = false;
-    params[2].Interrupt = devCtx->WdfInterrupt;
+    // stats, free page hinting and reporting
+    for (i = 2; i < 5; i++)
+    {
+        params[i].bEnableInterruptSuppression = false;
+        params[i].Interrupt = devCtx->WdfInterrupt;
+    }
 
     u64HostFeatures = VirtIOWdfGetDeviceFeatures(&devCtx->VDevice);
 
@@ -56,6 +61,15 @@ BalloonInit(
     {
         virtio_feature_enable(u64GuestFeatures, VIRTIO_F_ANY_LAYOUT);
     }
+    devCtx->bDeflateOnOom = FALSE;
+    if (virtio_is_feature_enabled(u64HostFeatures, VIRTIO_BALLOON_F_DEFLATE_ON_OOM))
+    {
+        TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP,
+            "Enable deflate on OOM feature.\n");
+
+        virtio_feature_enable(u64GuestFeatures, VIRTIO_BALLOON_F_DEFLATE_ON_OOM);
+        devCtx->bDeflateOnOom = TRUE;
+    }
     if (virtio_is_feature_enabled(u64HostFeatures, VIRTIO_BALLOON_F_STATS_VQ))
     {
         TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP,
@@ -68,18 +82,45 @@ BalloonInit(
     {
         nvqs = 2;
     }
+    // The device lays its queues out whether or not the features are
+    // negotiated: the stats queue is always queue 2, the free page hinting
+    // queue follows if the host offers that feature and the reporting
+    // queue comes last. All the queues up to it are initialized.
+    reportvq = 3;
+    if (virtio_is_feature_enabled(u64HostFeatures, VIRTIO_BALLOON_F_FREE_PAGE_HINT))
+    {
+        reportvq++;
+    }
+    if (devCtx->bReportingEnabled &&
+        virtio_is_feature_enabled(u64HostFeatures, VIRTIO_BALLOON_F_REPORTING))
+    {
+        TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP,
+            "Enable free page reporting feature.\n");
+
+        virtio_feature_enable(u64GuestFeatures, VIRTIO_BALLOON_F_REPORTING);
+        nvqs = reportvq + 1;
+    }
 
     status = VirtIOWdfSetDriverFeatures(&devCtx->VDevice, u64GuestFeatures);
     if (NT_SUCCESS(status))
     {
-        // initialize 2 or 3 queues
+        // initialize 2 to 5 queues
         status = VirtIOWdfInitQueues(&devCtx->VDevice, nvqs, vqs, params);
         if (NT_SUCCESS(status))
         {
             devCtx->InfVirtQueue = vqs[0];
             devCtx->DefVirtQueue = vqs[1];
 
-            if (nvqs == 3)
+            if (virtio_is_feature_enabled(u64GuestFeatures, VIRTIO_BALLOON_F_REPORTING))
+            {
+                devCtx->ReportVirtQueue = vqs[reportvq];
+                devCtx->bReportStalled = FALSE;
+                devCtx->ReportBackoff = devCtx->ReportInterval;
+                devCtx->ReportDue = KeQueryInterruptTime() +
+                    (ULONGLONG)devCtx->ReportInterval * 10000;
+            }
+
+            if (virtio_is_feature_enabled(u64GuestFeatures, VIRTIO_BALLOON_F_STATS_VQ))
             {
                 VIO_SG  sg;
 
@@ -125,6 +166,150 @@ BalloonInit(
     return status;
 }
 
+/*
+ * Returns a PFN array which is not on any queue, waiting for the host to
+ * return one if all of them are in flight. NULL if the host doesn't answer.
+ */
+static
+PPFN_BATCH
+BalloonGetFreeBatch(
+    IN WDFOBJECT WdfDevice
+    )
+{
+    PDEVICE_CONTEXT     devCtx = GetDeviceContext(WdfDevice);
+    LARGE_INTEGER       timeout = {0};
+    NTSTATUS            status;
+    ULONG               i;
+
+    for (;;)
+    {
+        for (i = 0; i < BALLOON_PFN_BATCHES; i++)
+        {
+            if (devCtx->PfnBatches[i].InFlight == 0)
+            {
+                return &devCtx->PfnBatches[i];
+            }
+        }
+
+        timeout.QuadPart = Int32x32To64(BALLOON_HOST_ACK_TIMEOUT, -10000);
+        status = KeWaitForSingleObject (
+                    &devCtx->HostAckEvent,
+                    Executive,
+                    KernelMode,
+                    FALSE,
+                    &timeout);
+        if(STATUS_TIMEOUT == status)
+        {
+            TraceEvents(TRACE_LEVEL_WARNING, DBG_HW_ACCESS, "<--> TimeOut\n");
+            return NULL;
+        }
+    }
+}
+
+/*
+ * Waits until the host has returned all the PFN arrays, so that the page
+ * count reported to it matches what it has actually seen.
+ */
+static
+VOID
+BalloonWaitForHost(
+    IN WDFOBJECT WdfDevice
+    )
+{
+    PDEVICE_CONTEXT     devCtx = GetDeviceContext(WdfDevice);
+    LARGE_INTEGER       timeout = {0};
+    NTSTATUS            status;
+
+    while (devCtx->BatchesInFlight > 0)
+    {
+        timeout.QuadPart = Int32x32To64(BALLOON_HOST_ACK_TIMEOUT, -10000);
+        status = KeWaitForSingleObject (
+                    &devCtx->HostAckEvent,
+                    Executive,
+                    KernelMode,
+                    FALSE,
+                    &timeout);
+        if(STATUS_TIMEOUT == status)
+        {
+            TraceEvents(TRACE_LEVEL_WARNING, DBG_HW_ACCESS,
+                "<--> TimeOut, %d arrays in flight\n", devCtx->BatchesInFlight);
+            break;
+        }
+    }
+}
+
+static
+ULONGLONG
+BalloonPagesPerSecond(
+    IN size_t pages,
+    IN ULONGLONG start
+    )
+{
+    ULONGLONG elapsed = KeQueryInterruptTime() - start;
+
+    /* interrupt time is in 100ns units */
+    return elapsed ? (ULONGLONG)pages * 10000000 / elapsed : 0;
+}
+
+/*
+ * Allocates one physically contiguous, BALLOON_HUGE_PAGE_SIZE aligned chunk.
+ * It doesn't cross a BALLOON_HUGE_PAGE_SIZE boundary so the host can release
+ * the whole huge page backing it.
+ */
+static
+PMDL
+BalloonAllocHugeChunk(
+    OUT PVOID *pVa
+    )
+{
+    PHYSICAL_ADDRESS LowAddress;
+    PHYSICAL_ADDRESS HighAddress;
+    PHYSICAL_ADDRESS Boundary;
+    PVOID va;
+    PMDL pPageMdl;
+
+    LowAddress.QuadPart = 0;
+    HighAddress.QuadPart = (ULONGLONG)-1;
+    Boundary.QuadPart = BALLOON_HUGE_PAGE_SIZE;
+
+    va = MmAllocateContiguousMemorySpecifyCache(BALLOON_HUGE_PAGE_SIZE,
+        LowAddress, HighAddress, Boundary, MmCached);
+    if (va == NULL)
+    {
+        return NULL;
+    }
+
+    pPageMdl = IoAllocateMdl(va, BALLOON_HUGE_PAGE_SIZE, FALSE, FALSE, NULL);
+    if (pPageMdl == NULL)
+    {
+        MmFreeContiguousMemorySpecifyCache(va, BALLOON_HUGE_PAGE_SIZE, MmCached);
+        return NULL;
+    }
+    MmBuildMdlForNonPagedPool(pPageMdl);
+
+    *pVa = va;
+    return pPageMdl;
+}
+
+static
+VOID
+BalloonFreeChunk(
+    IN PMDL pPageMdl,
+    IN PVOID HugeVa
+    )
+{
+    if (HugeVa != NULL)
+    {
+        IoFreeMdl(pPageMdl);
+        MmFreeContiguousMemorySpecifyCache(HugeVa, BALLOON_HUGE_PAGE_SIZE, MmCached);
+    }
+    else
+    {
+        MmFreePagesFromMdl(pPageMdl);
+        ExFreePool(pPageMdl);
+    }
+}
+
 VOID
 BalloonFill(
     IN WDFOBJECT WdfDevice,
@@ -136,19 +321,15 @@ BalloonFill(
     PHYSICAL_ADDRESS SkipBytes;
     PPAGE_LIST_ENTRY pNewPageListEntry;
     PMDL pPageMdl;
+    PVOID pHugeVa;
+    BOOLEAN bFragmented = !ctx->bHugeChunks;
+    PPFN_BATCH batch;
+    ULONGLONG start = KeQueryInterruptTime();
+    size_t done = 0;
+    size_t step;
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_HW_ACCESS, "--> %s\n", __FUNCTION__);
 
-    ctx->num_pfns = 0;
-
-    if (IsLowMemory(WdfDevice))
-    {
-        TraceEvents(TRACE_LEVEL_WARNING, DBG_HW_ACCESS,
-            "Low memory. Allocated pages: %d\n", ctx->num_pages);
-        return;
-    }
-
-    num = min(num, PAGE_SIZE / sizeof(PFN_NUMBER));
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_HW_ACCESS,
         "Inflate balloon with %d pages.\n", num);
 
@@ -156,53 +337,121 @@ BalloonFill(
     HighAddress.QuadPart = (ULONGLONG)-1;
     SkipBytes.QuadPart = 0;
 
+    /*
+     * Keep up to BALLOON_PFN_BATCHES arrays on the inflate queue, the host
+     * works on one while the next is being allocated.
+     */
+    while (done < num && !ctx->bShutDown)
+    {
+        if (IsLowMemory(WdfDevice))
+        {
+            TraceEvents(TRACE_LEVEL_WARNING, DBG_HW_ACCESS,
+                "Low memory. Allocated pages: %d\n", ctx->num_pages);
+            break;
+        }
+
+        batch = BalloonGetFreeBatch(WdfDevice);
+        if (batch == NULL)
+        {
+            break;
+        }
+
+        /*
+         * Prefer whole huge pages, once none is left fall back to small
+         * pages for the rest of this inflation.
+         */
+        pHugeVa = NULL;
+        pPageMdl = NULL;
+        if (!bFragmented && (num - done) >= BALLOON_HUGE_PAGE_PFNS)
+        {
+            pPageMdl = BalloonAllocHugeChunk(&pHugeVa);
+            if (pPageMdl == NULL)
+            {
+                TraceEvents(TRACE_LEVEL_INFORMATION, DBG_HW_ACCESS,
+                    "No huge chunk left, using small pages.\n");
+                bFragmented = TRUE;
+            }
+        }
+
+        if (pPageMdl != NULL)
+        {
+            step = BALLOON_HUGE_PAGE_PFNS;
+        }
+        else
+        {
+            step = min(num - done, BALLOON_PFNS_PER_BATCH);
+
 #if (NTDDI_VERSION < NTDDI_WS03SP1)
-    pPageMdl = MmAllocatePagesForMdl(LowAddress, HighAddress, SkipBytes,
-        num * PAGE_SIZE);
+            pPageMdl = MmAllocatePagesForMdl(LowAddress, HighAddress, SkipBytes,
+                step * PAGE_SIZE);
 #else
-    pPageMdl = MmAllocatePagesForMdlEx(LowAddress, HighAddress, SkipBytes,
-        num * PAGE_SIZE, MmNonCached, MM_DONT_ZERO_ALLOCATION);
+            pPageMdl = MmAllocatePagesForMdlEx(LowAddress, HighAddress, SkipBytes,
+                step * PAGE_SIZE, MmNonCached, MM_DONT_ZERO_ALLOCATION);
 #endif
 
-    if (pPageMdl == NULL)
-    {
-        TraceEvents(TRACE_LEVEL_WARNING, DBG_HW_ACCESS,
-            "Failed to allocate pages.\n");
-        return;
-    }
+            if (pPageMdl == NULL)
+            {
+                TraceEvents(TRACE_LEVEL_WARNING, DBG_HW_ACCESS,
+                    "Failed to allocate pages.\n");
+                break;
+            }
 
-    if (MmGetMdlByteCount(pPageMdl) != (num * PAGE_SIZE))
-    {
-        TraceEvents(TRACE_LEVEL_WARNING, DBG_HW_ACCESS,
-            "Not all requested memory was allocated (%d/%d).\n",
-            MmGetMdlByteCount(pPageMdl), num * PAGE_SIZE);
-        MmFreePagesFromMdl(pPageMdl);
-        ExFreePool(pPageMdl);
-        return;
-    }
+            if (MmGetMdlByteCount(pPageMdl) != (step * PAGE_SIZE))
+            {
+                TraceEvents(TRACE_LEVEL_WARNING, DBG_HW_ACCESS,
+                    "Not all requested memory was allocated (%d/%d).\n",
+                    MmGetMdlByteCount(pPageMdl), step * PAGE_SIZE);
+                MmFreePagesFromMdl(pPageMdl);
+                ExFreePool(pPageMdl);
+                break;
+            }
+        }
 
-    pNewPageListEntry = (PPAGE_LIST_ENTRY)ExAllocateFromNPagedLookasideList(
-        &ctx->LookAsideList);
+        pNewPageListEntry = (PPAGE_LIST_ENTRY)ExAllocateFromNPagedLookasideList(
+            &ctx->LookAsideList);
 
-    if (pNewPageListEntry == NULL)
-    {
-        TraceEvents(TRACE_LEVEL_ERROR, DBG_HW_ACCESS,
-            "Failed to allocate list entry.\n");
-        MmFreePagesFromMdl(pPageMdl);
-        ExFreePool(pPageMdl);
-        return;
-    }
+        if (pNewPageListEntry == NULL)
+        {
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_HW_ACCESS,
+                "Failed to allocate list entry.\n");
+            BalloonFreeChunk(pPageMdl, pHugeVa);
+            break;
+        }
 
-    pNewPageListEntry->PageMdl = pPageMdl;
-    PushEntryList(&ctx->PageListHead, &(pNewPageListEntry->SingleListEntry));
+        batch->num_pfns = (ULONG)step;
+        RtlCopyMemory(batch->pfns, MmGetMdlPfnArray(pPageMdl),
+            batch->num_pfns * sizeof(PFN_NUMBER));
 
-    ctx->num_pfns = (ULONG)num;
-    ctx->num_pages += ctx->num_pfns;
+        if (!BalloonTellHost(WdfDevice, ctx->InfVirtQueue, batch))
+        {
+            BalloonFreeChunk(pPageMdl, pHugeVa);
+            ExFreeToNPagedLookasideList(&ctx->LookAsideList, pNewPageListEntry);
+            break;
+        }
+
+        pNewPageListEntry->PageMdl = pPageMdl;
+        pNewPageListEntry->HugeVa = pHugeVa;
+        if (pHugeVa != NULL)
+        {
+            ctx->HugeChunks++;
+        }
+        else
+        {
+            ctx->SmallChunks++;
+        }
+        PushEntryList(&ctx->PageListHead, &(pNewPageListEntry->SingleListEntry));
+
+        ctx->num_pages += batch->num_pfns;
+        done += step;
+    }
 
-    RtlCopyMemory(ctx->pfns_table, MmGetMdlPfnArray(pPageMdl),
-        ctx->num_pfns * sizeof(PFN_NUMBER));
+    BalloonWaitForHost(WdfDevice);
 
-    BalloonTellHost(WdfDevice, ctx->InfVirtQueue);
+    ctx->InflateRate = BalloonPagesPerSecond(done, start);
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_HW_ACCESS,
+        "Inflated by %Iu pages, %I64u pages/s.\n", done, ctx->InflateRate);
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_HW_ACCESS,
+        "Huge chunks %u, small chunks %u.\n", ctx->HugeChunks, ctx->SmallChunks);
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_HW_ACCESS, "<-- %s\n", __FUNCTION__);
 }
@@ -216,74 +465,180 @@ BalloonLeak(
     PDEVICE_CONTEXT ctx = GetDeviceContext(WdfDevice);
     PPAGE_LIST_ENTRY pPageListEntry;
     PMDL pPageMdl;
+    PPFN_BATCH batch;
+    ULONGLONG start = KeQueryInterruptTime();
+    size_t done = 0;
+    size_t step;
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_HW_ACCESS, "--> %s\n", __FUNCTION__);
 
-    pPageListEntry = (PPAGE_LIST_ENTRY)PopEntryList(&ctx->PageListHead);
-    if (pPageListEntry == NULL)
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_HW_ACCESS,
+        "Deflate balloon with %d pages.\n", num);
+
+    while (done < num)
     {
-        TraceEvents(TRACE_LEVEL_WARNING, DBG_HW_ACCESS, "No list entries.\n");
-        return;
+        batch = BalloonGetFreeBatch(WdfDevice);
+        if (batch == NULL)
+        {
+            break;
+        }
+
+        pPageListEntry = (PPAGE_LIST_ENTRY)PopEntryList(&ctx->PageListHead);
+        if (pPageListEntry == NULL)
+        {
+            TraceEvents(TRACE_LEVEL_WARNING, DBG_HW_ACCESS, "No list entries.\n");
+            break;
+        }
+
+        pPageMdl = pPageListEntry->PageMdl;
+
+        step = MmGetMdlByteCount(pPageMdl) / PAGE_SIZE;
+        ASSERT(step <= BALLOON_PFNS_PER_BATCH);
+
+        batch->num_pfns = (ULONG)step;
+        ctx->num_pages -= batch->num_pfns;
+
+        RtlCopyMemory(batch->pfns, MmGetMdlPfnArray(pPageMdl),
+            batch->num_pfns * sizeof(PFN_NUMBER));
+
+        /* a huge chunk goes back as a whole, even past the target */
+        if (pPageListEntry->HugeVa != NULL)
+        {
+            ctx->HugeChunks--;
+        }
+        else
+        {
+            ctx->SmallChunks--;
+        }
+        BalloonFreeChunk(pPageMdl, pPageListEntry->HugeVa);
+        ExFreeToNPagedLookasideList(&ctx->LookAsideList, pPageListEntry);
+
+        BalloonTellHost(WdfDevice, ctx->DefVirtQueue, batch);
+        done += step;
     }
 
-    pPageMdl = pPageListEntry->PageMdl;
+    BalloonWaitForHost(WdfDevice);
 
-    num = MmGetMdlByteCount(pPageMdl) / PAGE_SIZE;
+    ctx->DeflateRate = BalloonPagesPerSecond(done, start);
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_HW_ACCESS,
-        "Deflate balloon with %d pages.\n", num);
+        "Deflated by %Iu pages, %I64u pages/s.\n", done, ctx->DeflateRate);
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_HW_ACCESS,
+        "Huge chunks %u, small chunks %u.\n", ctx->HugeChunks, ctx->SmallChunks);
 
-    ctx->num_pfns = (ULONG)num;
-    ctx->num_pages -= ctx->num_pfns;
+    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_HW_ACCESS, "<-- %s\n", __FUNCTION__);
+}
 
-    RtlCopyMemory(ctx->pfns_table, MmGetMdlPfnArray(pPageMdl),
-        ctx->num_pfns * sizeof(PFN_NUMBER));
+/*
+ * Gives memory back to the system in BALLOON_OOM_DEFLATE_PAGES steps for as
+ * long as it is low on memory. Inflation stops while the condition lasts and
+ * the balloon grows back to the target once it is over.
+ */
+VOID
+BalloonDeflateOnOom(
+    IN WDFOBJECT WdfDevice
+    )
+{
+    PDEVICE_CONTEXT ctx = GetDeviceContext(WdfDevice);
+    ULONGLONG start = KeQueryInterruptTime();
+    ULONG before = ctx->num_pages;
+    ULONG pages;
+    ULONGLONG rate;
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_HW_ACCESS, "--> %s\n", __FUNCTION__);
+
+    while (ctx->num_pages > 0 && !ctx->bShutDown && IsLowMemory(WdfDevice))
+    {
+        pages = ctx->num_pages;
+        BalloonLeak(WdfDevice, min(ctx->num_pages, BALLOON_OOM_DEFLATE_PAGES));
+        if (pages == ctx->num_pages)
+        {
+            break;
+        }
+    }
+    BalloonSetSize(WdfDevice, ctx->num_pages);
 
-    MmFreePagesFromMdl(pPageMdl);
-    ExFreePool(pPageMdl);
-    ExFreeToNPagedLookasideList(&ctx->LookAsideList, pPageListEntry);
+    pages = before - ctx->num_pages;
+    ctx->OomDeflatedPages += pages;
+    rate = BalloonPagesPerSecond(pages, start);
 
-    BalloonTellHost(WdfDevice, ctx->DefVirtQueue);
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_HW_ACCESS,
+        "Low memory, deflated by %u pages, %I64u pages/s, %I64u in total.\n",
+        pages, rate, ctx->OomDeflatedPages);
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_HW_ACCESS, "<-- %s\n", __FUNCTION__);
 }
 
-VOID
+/*
+ * Puts a PFN array on the inflate or deflate queue. It doesn't wait for the
+ * host, the array is handed back by BalloonHostAck when the host is done.
+ */
+BOOLEAN
 BalloonTellHost(
     IN WDFOBJECT WdfDevice,
-    IN PVIOQUEUE vq
+    IN PVIOQUEUE vq,
+    IN PPFN_BATCH batch
     )
 {
     VIO_SG              sg;
     PDEVICE_CONTEXT     devCtx = GetDeviceContext(WdfDevice);
-    NTSTATUS            status;
-    LARGE_INTEGER       timeout = {0};
+    KIRQL               irql;
+    bool                notify;
+    int                 ret;
 
-    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_HW_ACCESS, "--> %s\n", __FUNCTION__);
+    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_HW_ACCESS, "--> %s\n", __FUNCTION__);
+
+    sg.physAddr = MmGetPhysicalAddress(batch->pfns);
+    sg.length = sizeof(batch->pfns[0]) * batch->num_pfns;
+
+    InterlockedExchange(&batch->InFlight, 1);
+    InterlockedIncrement(&devCtx->BatchesInFlight);
 
-    sg.physAddr = MmGetPhysicalAddress(devCtx->pfns_table);
-    sg.length = sizeof(devCtx->pfns_table[0]) * devCtx->num_pfns;
+    KeAcquireSpinLock(&devCtx->VqLock, &irql);
+    ret = virtqueue_add_buf(vq, &sg, 1, 0, batch, NULL, 0);
+    notify = (ret >= 0) && virtqueue_kick_prepare(vq);
+    KeReleaseSpinLock(&devCtx->VqLock, irql);
 
-    if (virtqueue_add_buf(vq, &sg, 1, 0, devCtx, NULL, 0) < 0)
+    if (ret < 0)
     {
         TraceEvents(TRACE_LEVEL_ERROR, DBG_HW_ACCESS, "<-> %s :: Cannot add buffer\n", __FUNCTION__);
-        return;
+        InterlockedDecrement(&devCtx->BatchesInFlight);
+        InterlockedExchange(&batch->InFlight, 0);
+        return FALSE;
     }
-    virtqueue_kick(vq);
-
-    timeout.QuadPart = Int32x32To64(1000, -10000);
-    status = KeWaitForSingleObject (
-                &devCtx->HostAckEvent,
-                Executive,
-                KernelMode,
-                FALSE,
-                &timeout);
-    ASSERT(NT_SUCCESS(status));
-    if(STATUS_TIMEOUT == status)
+
+    if (notify)
     {
-        TraceEvents(TRACE_LEVEL_WARNING, DBG_HW_ACCESS, "<--> TimeOut\n");
+        virtqueue_notify(vq);
     }
+    return TRUE;
 }
 
+/* Takes the PFN arrays the host is done with off the queue, called from the DPC. */
+VOID
+BalloonHostAck(
+    IN WDFOBJECT WdfDevice,
+    IN PVIOQUEUE vq
+    )
+{
+    PDEVICE_CONTEXT     devCtx = GetDeviceContext(WdfDevice);
+    PPFN_BATCH          batch;
+    unsigned int        len;
+    BOOLEAN             bHostAck = FALSE;
+
+    KeAcquireSpinLockAtDpcLevel(&devCtx->VqLock);
+    while ((batch = (PPFN_BATCH)virtqueue_get_buf(vq, &len)) != NULL)
+    {
+        InterlockedExchange(&batch->InFlight, 0);
+        InterlockedDecrement(&devCtx->BatchesInFlight);
+        bHostAck = TRUE;
+    }
+    KeReleaseSpinLockFromDpcLevel(&devCtx->VqLock);
+
+    if(bHostAck)
+    {
+        KeSetEvent (&devCtx->HostAckEvent, IO_NO_INCREMENT, FALSE);
+    }
+}
 
 VOID
 BalloonTerm(
@@ -296,10 +651,15 @@ BalloonTerm(
 
     VirtIOWdfDestroyQueues(&devCtx->VDevice);
     devCtx->StatVirtQueue = NULL;
+    devCtx->ReportVirtQueue = NULL;
 
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP, "<-- BalloonTerm\n");
 }
 
+/*
+ * Hands the stats buffer back to the host. There is only ever one buffer
+ * on the stats queue, it is filled in while the host doesn't own it.
+ */
 VOID
 BalloonMemStats(
     IN WDFOBJECT WdfDevice
@@ -307,17 +667,27 @@ BalloonMemStats(
 {
     VIO_SG              sg;
     PDEVICE_CONTEXT     devCtx = GetDeviceContext(WdfDevice);
+    KIRQL               irql;
+    bool                notify;
+    int                 ret;
 
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_HW_ACCESS, "--> %s\n", __FUNCTION__);
 
     sg.physAddr = MmGetPhysicalAddress(devCtx->MemStats);
     sg.length = sizeof(BALLOON_STAT) * VIRTIO_BALLOON_S_NR;
 
-    if (virtqueue_add_buf(devCtx->StatVirtQueue, &sg, 1, 0, devCtx, NULL, 0) < 0)
+    KeAcquireSpinLock(&devCtx->VqLock, &irql);
+    ret = virtqueue_add_buf(devCtx->StatVirtQueue, &sg, 1, 0, devCtx, NULL, 0);
+    notify = virtqueue_kick_prepare(devCtx->StatVirtQueue);
+    KeReleaseSpinLock(&devCtx->VqLock, irql);
+
+    if (ret < 0)
     {
         TraceEvents(TRACE_LEVEL_ERROR, DBG_HW_ACCESS, "<-> %s :: Cannot add buffer\n", __FUNCTION__);
     }
-
-    virtqueue_kick(devCtx->StatVirtQueue);
+    if (notify)
+    {
+        virtqueue_notify(devCtx->StatVirtQueue);
+    }
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_HW_ACCESS, "<-- %s\n", __FUNCTION__);
 }
@@ -78,14 +78,65 @@ static ULARGE_INTEGER Counters[_LastCounter];
  */
 static BOOLEAN bBasicInfoWarning = FALSE;
 static BOOLEAN bPerfInfoWarning = FALSE;
+
+/*
+ * Sum of the pages in use in all the pagefiles, (UINT64)-1 if it can't be
+ * queried.
+ */
+static
+UINT64
+GatherPageFileUsage(VOID)
+{
+    PSYSTEM_PAGEFILE_INFORMATION pageFileInfo;
+    PUCHAR buffer;
+    ULONG outLen = 0;
+    NTSTATUS ntStatus;
+    UINT64 inUse = 0;
+
+    buffer = (PUCHAR)ExAllocatePoolWithTag(PagedPool, PAGE_SIZE, BALLOON_MGMT_POOL_TAG);
+    if (buffer == NULL)
+    {
+        return (UINT64)-1;
+    }
+
+    ntStatus = ZwQuerySystemInformation(SystemPageFileInformation, buffer, PAGE_SIZE, &outLen);
+    if (NT_SUCCESS(ntStatus) && outLen >= sizeof(SYSTEM_PAGEFILE_INFORMATION))
+    {
+        pageFileInfo = (PSYSTEM_PAGEFILE_INFORMATION)buffer;
+        for (;;)
+        {
+            inUse += pageFileInfo->TotalInUse;
+            if (pageFileInfo->NextEntryOffset == 0)
+            {
+                break;
+            }
+            pageFileInfo = (PSYSTEM_PAGEFILE_INFORMATION)
+                ((PUCHAR)pageFileInfo + pageFileInfo->NextEntryOffset);
+        }
+    }
+    else if (!NT_SUCCESS(ntStatus))
+    {
+        inUse = (UINT64)-1;
+    }
+
+    ExFreePoolWithTag(buffer, BALLOON_MGMT_POOL_TAG);
+    return inUse;
+}
+
 NTSTATUS GatherKernelStats(BALLOON_STAT stats[VIRTIO_BALLOON_S_NR])
 {
     SYSTEM_BASIC_INFORMATION basicInfo;
     SYSTEM_PERFORMANCE_INFORMATION perfInfo;
+    SYSTEM_MEMORY_LIST_INFORMATION memListInfo;
+    BOOLEAN bMemList;
     ULONG outLen = 0;
     NTSTATUS ntStatus;
     ULONG idx = 0;
+    ULONG i;
     UINT64 SoftFaults;
+    UINT64 FreePages;
+    UINT64 StandbyPages = 0;
+    UINT64 PageFilePages;
 
     RtlZeroMemory(&basicInfo,sizeof(basicInfo));
     RtlZeroMemory(&perfInfo,sizeof(perfInfo));
@@ -120,6 +171,25 @@ NTSTATUS GatherKernelStats(BALLOON_STAT stats[VIRTIO_BALLOON_S_NR])
             sizeof(perfInfo), outLen);
     }
 
+    /* zero, free and standby lists, not available before Vista */
+    RtlZeroMemory(&memListInfo, sizeof(memListInfo));
+    bMemList = NT_SUCCESS(ZwQuerySystemInformation(SystemMemoryListInformation,
+        &memListInfo, sizeof(memListInfo), &outLen));
+    if (bMemList)
+    {
+        for (i = 0; i < ARRAYSIZE(memListInfo.PageCountByPriority); i++)
+        {
+            StandbyPages += memListInfo.PageCountByPriority[i];
+        }
+        FreePages = (UINT64)memListInfo.ZeroPageCount + memListInfo.FreePageCount;
+    }
+    else
+    {
+        FreePages = perfInfo.AvailablePages;
+    }
+
+    PageFilePages = GatherPageFileUsage();
+
     #define UpdateNoOverflow(x) UpdateOverflowFreeCounter(&Counters[_##x],perfInfo.##x)
     UpdateStat(&stats[idx++], VIRTIO_BALLOON_S_SWAP_IN,  UpdateNoOverflow(PageReadCount) << PAGE_SHIFT);
     UpdateStat(&stats[idx++], VIRTIO_BALLOON_S_SWAP_OUT,
@@ -128,9 +198,19 @@ NTSTATUS GatherKernelStats(BALLOON_STAT stats[VIRTIO_BALLOON_S_NR])
                  UpdateNoOverflow(CacheTransitionCount) + UpdateNoOverflow(DemandZeroCount);
     UpdateStat(&stats[idx++], VIRTIO_BALLOON_S_MAJFLT,   UpdateNoOverflow(PageReadCount));
     UpdateStat(&stats[idx++], VIRTIO_BALLOON_S_MINFLT,   SoftFaults);
-    UpdateStat(&stats[idx++], VIRTIO_BALLOON_S_MEMFREE,  U32_2_S64(perfInfo.AvailablePages) << PAGE_SHIFT);
+    UpdateStat(&stats[idx++], VIRTIO_BALLOON_S_MEMFREE,  FreePages << PAGE_SHIFT);
     UpdateStat(&stats[idx++], VIRTIO_BALLOON_S_MEMTOT,   U32_2_S64(basicInfo.NumberOfPhysicalPages) << PAGE_SHIFT);
+    UpdateStat(&stats[idx++], VIRTIO_BALLOON_S_AVAIL,    U32_2_S64(perfInfo.AvailablePages) << PAGE_SHIFT);
+    UpdateStat(&stats[idx++], VIRTIO_BALLOON_S_CACHES,
+        (bMemList ? StandbyPages : U32_2_S64(perfInfo.ResidentSystemCachePage)) << PAGE_SHIFT);
+    UpdateStat(&stats[idx++], VIRTIO_BALLOON_S_COMMITTED, U32_2_S64(perfInfo.CommittedPages) << PAGE_SHIFT);
+    UpdateStat(&stats[idx++], VIRTIO_BALLOON_S_COMMIT_LIMIT, U32_2_S64(perfInfo.CommitLimit) << PAGE_SHIFT);
+    UpdateStat(&stats[idx++], VIRTIO_BALLOON_S_STANDBY,
+        bMemList ? StandbyPages << PAGE_SHIFT : (UINT64)-1);
+    UpdateStat(&stats[idx++], VIRTIO_BALLOON_S_PAGEFILE,
+        (PageFilePages != (UINT64)-1) ? PageFilePages << PAGE_SHIFT : (UINT64)-1);
     #undef UpdateNoOverflow
+    ASSERT(idx == VIRTIO_BALLOON_S_NR);
 
     return ntStatus;
 }
@@ -12,7 +12,17 @@ DEFINE_GUID(GUID_DEVINTERFACE_BALLOON,
 #define VIRTIO_BALLOON_S_MINFLT   3   /* Number of minor faults */
 #define VIRTIO_BALLOON_S_MEMFREE  4   /* Total amount of free memory */
 #define VIRTIO_BALLOON_S_MEMTOT   5   /* Total amount of memory */
-#define VIRTIO_BALLOON_S_NR       6
+#define VIRTIO_BALLOON_S_AVAIL    6   /* Available memory, free and standby */
+#define VIRTIO_BALLOON_S_CACHES   7   /* File cache */
+
+/* Windows specific, hosts ignore tags they don't know */
+#define VIRTIO_BALLOON_S_COMMITTED    0x100 /* Committed memory */
+#define VIRTIO_BALLOON_S_COMMIT_LIMIT 0x101 /* Commit limit */
+#define VIRTIO_BALLOON_S_STANDBY      0x102 /* Standby list */
+#define VIRTIO_BALLOON_S_PAGEFILE     0x103 /* Pagefile usage */
+
+/* number of stats sent to the host */
+#define VIRTIO_BALLOON_S_NR       12
 
 #pragma pack (push)
 #pragma pack (1)
@@ -0,0 +1,348 @@
+/**********************************************************************
+ * Copyright (c) 2009-2016  Red Hat, Inc.
+ *
+ * File: report.c
+ *
+ * This file contains free page reporting routines
+ *
+ * Chunks of free memory are periodically taken from the system, handed
+ * to the host on the reporting queue so it can discard their backing and
+ * given back to the system once the host is done with them.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#include "precomp.h"
+
+#if defined(EVENT_TRACING)
+#include "report.tmh"
+#endif
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text (PAGE, ReportQueryConfig)
+#endif
+
+VOID
+ReportQueryConfig(
+    IN WDFDEVICE Device
+    )
+{
+    PDEVICE_CONTEXT     devCtx = GetDeviceContext(Device);
+    WDFKEY              hKey;
+    ULONG               value;
+    DECLARE_CONST_UNICODE_STRING(enableName, L"FreePageReporting");
+    DECLARE_CONST_UNICODE_STRING(orderName, L"ReportingOrder");
+    DECLARE_CONST_UNICODE_STRING(chunksName, L"ReportingChunks");
+    DECLARE_CONST_UNICODE_STRING(intervalName, L"ReportingInterval");
+
+    PAGED_CODE();
+
+    devCtx->bReportingEnabled = TRUE;
+    devCtx->ReportOrder = BALLOON_REPORT_DEFAULT_ORDER;
+    devCtx->ReportChunks = BALLOON_REPORT_DEFAULT_CHUNKS;
+    devCtx->ReportInterval = BALLOON_REPORT_DEFAULT_INTERVAL;
+
+    if (NT_SUCCESS(WdfDeviceOpenRegistryKey(Device, PLUGPLAY_REGKEY_DEVICE,
+        KEY_READ, WDF_NO_OBJECT_ATTRIBUTES, &hKey)))
+    {
+        if (NT_SUCCESS(WdfRegistryQueryULong(hKey, &enableName, &value)))
+        {
+            devCtx->bReportingEnabled = (value != 0);
+        }
+        if (NT_SUCCESS(WdfRegistryQueryULong(hKey, &orderName, &value)))
+        {
+            devCtx->ReportOrder = min(value, BALLOON_REPORT_MAX_ORDER);
+        }
+        if (NT_SUCCESS(WdfRegistryQueryULong(hKey, &chunksName, &value)))
+        {
+            devCtx->ReportChunks = max(value, 1);
+        }
+        if (NT_SUCCESS(WdfRegistryQueryULong(hKey, &intervalName, &value)))
+        {
+            devCtx->ReportInterval = min(max(value, 100), BALLOON_REPORT_MAX_INTERVAL);
+        }
+        WdfRegistryClose(hKey);
+    }
+
+    devCtx->ReportBackoff = devCtx->ReportInterval;
+    devCtx->ReportedPages = 0;
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP,
+        "Free page reporting %s: order %u, %u chunks every %u ms\n",
+        devCtx->bReportingEnabled ? "enabled" : "disabled",
+        devCtx->ReportOrder, devCtx->ReportChunks, devCtx->ReportInterval);
+}
+
+static
+VOID
+ReportFreeChunks(
+    IN PDEVICE_CONTEXT devCtx,
+    IN ULONG nChunks
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < nChunks; i++)
+    {
+        MmFreePagesFromMdl(devCtx->ReportMdls[i]);
+        ExFreePool(devCtx->ReportMdls[i]);
+        devCtx->ReportMdls[i] = NULL;
+    }
+}
+
+/*
+ * Appends the physically contiguous runs of the chunk to the request.
+ * FALSE if they don't fit.
+ */
+static
+BOOLEAN
+ReportAddChunk(
+    IN PDEVICE_CONTEXT devCtx,
+    IN PMDL pMdl,
+    IN OUT PULONG nsg
+    )
+{
+    PPFN_NUMBER pfns = MmGetMdlPfnArray(pMdl);
+    ULONG       npfns = MmGetMdlByteCount(pMdl) / PAGE_SIZE;
+    ULONG       runs = 1;
+    ULONG       i;
+
+    for (i = 1; i < npfns; i++)
+    {
+        if (pfns[i] != pfns[i - 1] + 1)
+        {
+            runs++;
+        }
+    }
+    if (*nsg + runs > BALLOON_REPORT_SG_MAX)
+    {
+        return FALSE;
+    }
+
+    for (i = 0; i < npfns; i++)
+    {
+        if (i > 0 && pfns[i] == pfns[i - 1] + 1)
+        {
+            devCtx->ReportSg[*nsg - 1].length += PAGE_SIZE;
+        }
+        else
+        {
+            devCtx->ReportSg[*nsg].physAddr.QuadPart =
+                (LONGLONG)pfns[i] << PAGE_SHIFT;
+            devCtx->ReportSg[*nsg].length = PAGE_SIZE;
+            (*nsg)++;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Leaves the chunks to the host which hasn't returned them. The pages are
+ * never given back to the system, the host may still write to them.
+ */
+static
+VOID
+ReportAbandonChunks(
+    IN PDEVICE_CONTEXT devCtx,
+    IN ULONG nChunks
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < nChunks; i++)
+    {
+        devCtx->ReportMdls[i] = NULL;
+    }
+}
+
+/*
+ * STATUS_SUCCESS once the host has returned the chunks, STATUS_IO_TIMEOUT
+ * if it still owns them after the wait was given up.
+ */
+static
+NTSTATUS
+ReportTellHost(
+    IN PDEVICE_CONTEXT devCtx,
+    IN ULONG nsg
+    )
+{
+    LARGE_INTEGER       timeout = {0};
+    NTSTATUS            status;
+    KIRQL               irql;
+    bool                notify;
+    int                 ret;
+    ULONG               retries;
+
+    KeAcquireSpinLock(&devCtx->VqLock, &irql);
+    ret = virtqueue_add_buf(devCtx->ReportVirtQueue, devCtx->ReportSg,
+        0, nsg, devCtx, NULL, 0);
+    notify = (ret >= 0) && virtqueue_kick_prepare(devCtx->ReportVirtQueue);
+    KeReleaseSpinLock(&devCtx->VqLock, irql);
+
+    if (ret < 0)
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_HW_ACCESS, "<-> %s :: Cannot add buffer\n", __FUNCTION__);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    if (notify)
+    {
+        virtqueue_notify(devCtx->ReportVirtQueue);
+    }
+
+    /* the pages belong to the host until it returns the buffer */
+    for (retries = 0; retries < BALLOON_REPORT_ACK_RETRIES; retries++)
+    {
+        timeout.QuadPart = Int32x32To64(BALLOON_HOST_ACK_TIMEOUT, -10000);
+        status = KeWaitForSingleObject (
+                    &devCtx->ReportAckEvent,
+                    Executive,
+                    KernelMode,
+                    FALSE,
+                    &timeout);
+        if (STATUS_WAIT_0 == status)
+        {
+            return STATUS_SUCCESS;
+        }
+        TraceEvents(TRACE_LEVEL_WARNING, DBG_HW_ACCESS, "<--> TimeOut\n");
+        if (devCtx->bShutDown)
+        {
+            break;
+        }
+    }
+
+    TraceEvents(TRACE_LEVEL_ERROR, DBG_HW_ACCESS,
+        "<-> %s :: Host kept the reported pages\n", __FUNCTION__);
+    return STATUS_IO_TIMEOUT;
+}
+
+VOID
+ReportFreePages(
+    IN WDFOBJECT WdfDevice
+    )
+{
+    PDEVICE_CONTEXT     devCtx = GetDeviceContext(WdfDevice);
+    PHYSICAL_ADDRESS    LowAddress;
+    PHYSICAL_ADDRESS    HighAddress;
+    PHYSICAL_ADDRESS    SkipBytes;
+    SIZE_T              chunkSize = (SIZE_T)PAGE_SIZE << devCtx->ReportOrder;
+    BOOLEAN             bLowMemory = FALSE;
+    BOOLEAN             bExhausted = FALSE;
+    NTSTATUS            status;
+    ULONG               reported = 0;
+    ULONG               nChunks;
+    ULONG               nsg;
+    PMDL                pMdl;
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_HW_ACCESS, "--> %s\n", __FUNCTION__);
+
+    LowAddress.QuadPart = 0;
+    HighAddress.QuadPart = (ULONGLONG)-1;
+    SkipBytes.QuadPart = 0;
+
+    while (reported < devCtx->ReportChunks && !devCtx->bShutDown &&
+           !devCtx->bReportStalled && !bLowMemory && !bExhausted)
+    {
+        nChunks = 0;
+        nsg = 0;
+
+        while (nChunks < BALLOON_REPORT_SG_MAX &&
+               reported + nChunks < devCtx->ReportChunks)
+        {
+            if (IsLowMemory(WdfDevice))
+            {
+                bLowMemory = TRUE;
+                break;
+            }
+
+#if (NTDDI_VERSION < NTDDI_WIN7)
+            pMdl = MmAllocatePagesForMdlEx(LowAddress, HighAddress, SkipBytes,
+                chunkSize, MmCached, MM_DONT_ZERO_ALLOCATION);
+#else
+            pMdl = MmAllocatePagesForMdlEx(LowAddress, HighAddress, SkipBytes,
+                chunkSize, MmCached,
+                MM_DONT_ZERO_ALLOCATION | MM_ALLOCATE_REQUIRE_CONTIGUOUS_CHUNKS);
+#endif
+            if (pMdl == NULL)
+            {
+                bExhausted = TRUE;
+                break;
+            }
+            if (MmGetMdlByteCount(pMdl) != chunkSize ||
+                !ReportAddChunk(devCtx, pMdl, &nsg))
+            {
+                MmFreePagesFromMdl(pMdl);
+                ExFreePool(pMdl);
+                bExhausted = (nChunks == 0);
+                break;
+            }
+            devCtx->ReportMdls[nChunks++] = pMdl;
+        }
+
+        if (nChunks == 0)
+        {
+            break;
+        }
+
+        status = ReportTellHost(devCtx, nsg);
+        if (status == STATUS_IO_TIMEOUT)
+        {
+            /* a late ack would end the wait of the next report early */
+            ReportAbandonChunks(devCtx, nChunks);
+            devCtx->bReportStalled = TRUE;
+            break;
+        }
+        ReportFreeChunks(devCtx, nChunks);
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+
+        reported += nChunks;
+        devCtx->ReportedPages += (ULONGLONG)nChunks << devCtx->ReportOrder;
+    }
+
+    /* back off while the system is short on memory */
+    if (bLowMemory)
+    {
+        devCtx->ReportBackoff = min(devCtx->ReportBackoff * 2,
+            BALLOON_REPORT_MAX_INTERVAL);
+        TraceEvents(TRACE_LEVEL_WARNING, DBG_HW_ACCESS,
+            "Low memory, next report in %u ms\n", devCtx->ReportBackoff);
+    }
+    else
+    {
+        devCtx->ReportBackoff = devCtx->ReportInterval;
+    }
+    devCtx->ReportDue = KeQueryInterruptTime() +
+        (ULONGLONG)devCtx->ReportBackoff * 10000;
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_HW_ACCESS,
+        "Reported %u chunks, %I64u pages in total\n",
+        reported, devCtx->ReportedPages);
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_HW_ACCESS, "<-- %s\n", __FUNCTION__);
+}
+
+/* Called from the DPC when the host has returned the reported chunks. */
+VOID
+ReportHostAck(
+    IN WDFOBJECT WdfDevice
+    )
+{
+    PDEVICE_CONTEXT     devCtx = GetDeviceContext(WdfDevice);
+    unsigned int        len;
+    BOOLEAN             bHostAck = FALSE;
+
+    KeAcquireSpinLockAtDpcLevel(&devCtx->VqLock);
+    while (virtqueue_get_buf(devCtx->ReportVirtQueue, &len))
+    {
+        bHostAck = TRUE;
+    }
+    KeReleaseSpinLockFromDpcLevel(&devCtx->VqLock);
+
+    if (bHostAck)
+    {
+        KeSetEvent(&devCtx->ReportAckEvent, IO_NO_INCREMENT, FALSE);
+    }
+}
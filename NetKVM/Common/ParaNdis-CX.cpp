@@ -4,8 +4,11 @@
 
 CParaNdisCX::CParaNdisCX()
 {
-    m_ControlData.size = 512;
+    m_ControlData.size = PARANDIS_CX_MAX_COMMANDS * PARANDIS_CX_COMMAND_SIZE;
     m_ControlData.Virtual = nullptr;
+    m_nPending = 0;
+    NdisZeroMemory(m_Commands, sizeof(m_Commands));
+    NdisZeroMemory(&Statistics, sizeof(Statistics));
 }
 
 CParaNdisCX::~CParaNdisCX()
@@ -35,97 +38,326 @@ bool CParaNdisCX::Create(PPARANDIS_ADAPTER Context, UINT DeviceQueueIndex)
         m_Context->bDoPublishIndices ? true : false);
 }
 
-BOOLEAN CParaNdisCX::SendControlMessage(
+void CParaNdisCX::Shutdown()
+{
+    TSpinLocker LockedContext(m_Lock);
+    m_VirtQueue.Shutdown();
+
+    /* whatever was in flight is lost together with the ring */
+    for (UINT i = 0; i < PARANDIS_CX_MAX_COMMANDS; i++)
+    {
+        if (m_Commands[i].bInUse && !m_Commands[i].bDone)
+        {
+            CompleteCommand(&m_Commands[i], false);
+        }
+    }
+}
+
+/* Called under m_Lock. Returns nullptr when no slot or no ring space is available */
+CParaNdisCX::tCommand *CParaNdisCX::AddCommand(
     UCHAR cls,
     UCHAR cmd,
     PVOID buffer1,
     ULONG size1,
     PVOID buffer2,
     ULONG size2,
-    int levelIfOK
+    int levelIfOK,
+    bool bDetached
     )
 {
-    BOOLEAN bOK = FALSE;
-    CLockedContext<CNdisSpinLock> autoLock(m_Lock);
+    struct VirtIOBufferDescriptor sg[4];
+    tCommand *pCommand;
+    PUCHAR pBase;
+    PHYSICAL_ADDRESS phBase;
+    ULONG offset = 0;
+    UINT nOut = 1;
+    UINT index;
 
-    if (m_ControlData.Virtual && m_ControlData.size > (size1 + size2 + 16))
+    for (index = 0; index < PARANDIS_CX_MAX_COMMANDS; index++)
     {
-        struct VirtIOBufferDescriptor sg[4];
-        PUCHAR pBase = (PUCHAR)m_ControlData.Virtual;
-        PHYSICAL_ADDRESS phBase = m_ControlData.Physical;
-        ULONG offset = 0;
-        UINT nOut = 1;
+        if (!m_Commands[index].bInUse)
+        {
+            break;
+        }
+    }
+    if (index == PARANDIS_CX_MAX_COMMANDS)
+    {
+        return nullptr;
+    }
+
+    pCommand = &m_Commands[index];
+    pBase = (PUCHAR)m_ControlData.Virtual + index * PARANDIS_CX_COMMAND_SIZE;
+    phBase = m_ControlData.Physical;
+    phBase.QuadPart += index * PARANDIS_CX_COMMAND_SIZE;
 
-        ((virtio_net_ctrl_hdr *)pBase)->class_of_command = cls;
-        ((virtio_net_ctrl_hdr *)pBase)->cmd = cmd;
-        sg[0].physAddr = phBase;
-        sg[0].length = sizeof(virtio_net_ctrl_hdr);
-        offset += sg[0].length;
+    ((virtio_net_ctrl_hdr *)pBase)->class_of_command = cls;
+    ((virtio_net_ctrl_hdr *)pBase)->cmd = cmd;
+    sg[0].physAddr = phBase;
+    sg[0].length = sizeof(virtio_net_ctrl_hdr);
+    offset += sg[0].length;
+    offset = (offset + 3) & ~3;
+    if (size1)
+    {
+        NdisMoveMemory(pBase + offset, buffer1, size1);
+        sg[nOut].physAddr = phBase;
+        sg[nOut].physAddr.QuadPart += offset;
+        sg[nOut].length = size1;
+        offset += size1;
         offset = (offset + 3) & ~3;
-        if (size1)
-        {
-            NdisMoveMemory(pBase + offset, buffer1, size1);
-            sg[nOut].physAddr = phBase;
-            sg[nOut].physAddr.QuadPart += offset;
-            sg[nOut].length = size1;
-            offset += size1;
-            offset = (offset + 3) & ~3;
-            nOut++;
-        }
-        if (size2)
-        {
-            NdisMoveMemory(pBase + offset, buffer2, size2);
-            sg[nOut].physAddr = phBase;
-            sg[nOut].physAddr.QuadPart += offset;
-            sg[nOut].length = size2;
-            offset += size2;
-            offset = (offset + 3) & ~3;
-            nOut++;
-        }
+        nOut++;
+    }
+    if (size2)
+    {
+        NdisMoveMemory(pBase + offset, buffer2, size2);
         sg[nOut].physAddr = phBase;
         sg[nOut].physAddr.QuadPart += offset;
-        sg[nOut].length = sizeof(virtio_net_ctrl_ack);
-        *(virtio_net_ctrl_ack *)(pBase + offset) = VIRTIO_NET_ERR;
-
-        if (0 <= m_VirtQueue.AddBuf(sg, nOut, 1, (PVOID)1, NULL, 0))
-        {
-            UINT len;
-            void *p;
-            /* Control messages are processed synchronously in QEMU, so upon kick_buf return, the response message
-              has been already inserted in the queue */
-            m_VirtQueue.Kick();
-            p = m_VirtQueue.GetBuf(&len);
-            if (!p)
-            {
-                DPrintf(0, ("%s - ERROR: get_buf failed\n", __FUNCTION__));
-            }
-            else if (len != sizeof(virtio_net_ctrl_ack))
-            {
-                DPrintf(0, ("%s - ERROR: wrong len %d\n", __FUNCTION__, len));
-            }
-            else if (*(virtio_net_ctrl_ack *)(pBase + offset) != VIRTIO_NET_OK)
+        sg[nOut].length = size2;
+        offset += size2;
+        offset = (offset + 3) & ~3;
+        nOut++;
+    }
+    sg[nOut].physAddr = phBase;
+    sg[nOut].physAddr.QuadPart += offset;
+    sg[nOut].length = sizeof(virtio_net_ctrl_ack);
+    *(virtio_net_ctrl_ack *)(pBase + offset) = VIRTIO_NET_ERR;
+
+    if (0 > m_VirtQueue.AddBuf(sg, nOut, 1, pCommand, NULL, 0))
+    {
+        return nullptr;
+    }
+
+    pCommand->bInUse = true;
+    pCommand->bDone = false;
+    pCommand->bOK = false;
+    pCommand->bDetached = bDetached;
+    pCommand->cls = cls;
+    pCommand->cmd = cmd;
+    pCommand->levelIfOK = levelIfOK;
+    pCommand->ackOffset = offset;
+    pCommand->SubmitTime = KeQueryInterruptTime();
+    m_nPending++;
+    Statistics.Commands++;
+
+    m_VirtQueue.Kick();
+    return pCommand;
+}
+
+/* Called under m_Lock */
+void CParaNdisCX::CompleteCommand(tCommand *pCommand, bool bOK)
+{
+    pCommand->bOK = bOK;
+    pCommand->bDone = true;
+    m_nPending--;
+    if (!bOK)
+    {
+        Statistics.Failures++;
+    }
+    if (pCommand->bDetached)
+    {
+        pCommand->bInUse = false;
+    }
+}
+
+/* Called under m_Lock */
+void CParaNdisCX::ReapCompletions()
+{
+    tCommand *pCommand;
+    UINT len;
+    bool bCompleted = false;
+
+    while (nullptr != (pCommand = (tCommand *)m_VirtQueue.GetBuf(&len)))
+    {
+        PUCHAR pBase = (PUCHAR)m_ControlData.Virtual +
+            (pCommand - m_Commands) * PARANDIS_CX_COMMAND_SIZE;
+        virtio_net_ctrl_ack ack = *(virtio_net_ctrl_ack *)(pBase + pCommand->ackOffset);
+        ULONG64 latency = KeQueryInterruptTime() - pCommand->SubmitTime;
+        bool bOK = false;
+
+        if (len != sizeof(virtio_net_ctrl_ack))
+        {
+            DPrintf(0, ("%s - ERROR: wrong len %d\n", __FUNCTION__, len));
+        }
+        else if (ack != VIRTIO_NET_OK)
+        {
+            DPrintf(0, ("%s - ERROR: error %d returned for class %d\n", __FUNCTION__, ack, pCommand->cls));
+        }
+        else
+        {
+            // everything is OK
+            DPrintf(pCommand->levelIfOK, ("%s OK(%d.%d) in %I64u us\n", __FUNCTION__,
+                pCommand->cls, pCommand->cmd, latency / 10));
+            bOK = true;
+        }
+
+        Statistics.TotalLatency += latency;
+        if (latency > Statistics.MaxLatency)
+        {
+            Statistics.MaxLatency = latency;
+        }
+        CompleteCommand(pCommand, bOK);
+        bCompleted = true;
+    }
+
+    if (bCompleted)
+    {
+        m_CompletionEvent.Notify();
+    }
+}
+
+/* Waits until the command completes or, without a command, until no more
+   than maxPending commands are in flight. At PASSIVE_LEVEL the control queue
+   interrupt wakes the waiter, above it the queue is polled */
+bool CParaNdisCX::WaitForCompletion(tCommand *pCommand, ULONG maxPending)
+{
+    ULONG64 deadline = KeQueryInterruptTime() + PARANDIS_CX_COMMAND_TIMEOUT;
+    bool bPassive = ParaNdis_IsPassive();
+
+    for (;;)
+    {
+        {
+            CLockedContext<CNdisSpinLock> autoLock(m_Lock);
+            ReapCompletions();
+            if (pCommand ? pCommand->bDone : m_nPending <= maxPending)
             {
-                DPrintf(0, ("%s - ERROR: error %d returned for class %d\n", __FUNCTION__, *(virtio_net_ctrl_ack *)(pBase + offset), cls));
+                return true;
             }
-            else
+            /* completions reaped after this point set the event again */
+            if (bPassive)
             {
-                // everything is OK
-                DPrintf(levelIfOK, ("%s OK(%d.%d,buffers of %d and %d) \n", __FUNCTION__, cls, cmd, size1, size2));
-                bOK = TRUE;
+                m_CompletionEvent.Clear();
             }
         }
+        if (KeQueryInterruptTime() > deadline)
+        {
+            return false;
+        }
+        if (bPassive)
+        {
+            /* the slice covers another waiter clearing our wakeup */
+            m_CompletionEvent.Wait(PARANDIS_CX_WAIT_SLICE);
+        }
         else
         {
-            DPrintf(0, ("%s - ERROR: add_buf failed\n", __FUNCTION__));
+            NdisStallExecution(PARANDIS_CX_POLL_INTERVAL);
         }
     }
-    else
+}
+
+CParaNdisCX::tCommand *CParaNdisCX::SubmitCommand(
+    UCHAR cls,
+    UCHAR cmd,
+    PVOID buffer1,
+    ULONG size1,
+    PVOID buffer2,
+    ULONG size2,
+    int levelIfOK,
+    bool bDetached
+    )
+{
+    if (!m_ControlData.Virtual || PARANDIS_CX_COMMAND_SIZE <= (size1 + size2 + 16))
     {
         DPrintf(0, ("%s (buffer %d,%d) - ERROR: message too LARGE\n", __FUNCTION__, size1, size2));
+        return nullptr;
+    }
+
+    for (;;)
+    {
+        tCommand *pCommand;
+        ULONG nPending;
+        {
+            CLockedContext<CNdisSpinLock> autoLock(m_Lock);
+            ReapCompletions();
+            pCommand = AddCommand(cls, cmd, buffer1, size1, buffer2, size2, levelIfOK, bDetached);
+            nPending = m_nPending;
+        }
+        if (pCommand)
+        {
+            return pCommand;
+        }
+        /* out of slots or ring space, wait until one of the commands in flight completes */
+        if (!nPending)
+        {
+            DPrintf(0, ("%s - ERROR: add_buf failed\n", __FUNCTION__));
+            return nullptr;
+        }
+        if (!WaitForCompletion(nullptr, nPending - 1))
+        {
+            DPrintf(0, ("%s - ERROR: no free command slot\n", __FUNCTION__));
+            return nullptr;
+        }
+    }
+}
+
+BOOLEAN CParaNdisCX::SendControlMessage(
+    UCHAR cls,
+    UCHAR cmd,
+    PVOID buffer1,
+    ULONG size1,
+    PVOID buffer2,
+    ULONG size2,
+    int levelIfOK
+    )
+{
+    BOOLEAN bOK = FALSE;
+    tCommand *pCommand = SubmitCommand(cls, cmd, buffer1, size1, buffer2, size2, levelIfOK, false);
+
+    if (pCommand)
+    {
+        WaitForCompletion(pCommand, 0);
+
+        CLockedContext<CNdisSpinLock> autoLock(m_Lock);
+        if (pCommand->bDone)
+        {
+            bOK = pCommand->bOK ? TRUE : FALSE;
+            pCommand->bInUse = false;
+        }
+        else
+        {
+            /* let the completion free the slot if the device ever answers */
+            DPrintf(0, ("%s - ERROR: timeout for class %d\n", __FUNCTION__, cls));
+            pCommand->bDetached = true;
+            Statistics.Timeouts++;
+        }
     }
     return bOK;
 }
 
+BOOLEAN CParaNdisCX::SubmitControlMessage(
+    UCHAR cls,
+    UCHAR cmd,
+    PVOID buffer1,
+    ULONG size1,
+    PVOID buffer2,
+    ULONG size2,
+    int levelIfOK
+    )
+{
+    return SubmitCommand(cls, cmd, buffer1, size1, buffer2, size2, levelIfOK, true) ? TRUE : FALSE;
+}
+
+BOOLEAN CParaNdisCX::WaitForPendingCommands()
+{
+    if (WaitForCompletion(nullptr, 0))
+    {
+        return TRUE;
+    }
+
+    CLockedContext<CNdisSpinLock> autoLock(m_Lock);
+    DPrintf(0, ("%s - ERROR: %d commands did not complete\n", __FUNCTION__, m_nPending));
+    Statistics.Timeouts++;
+    return FALSE;
+}
+
+void CParaNdisCX::ProcessCompletions()
+{
+    CLockedContext<CNdisSpinLock> autoLock(m_Lock);
+
+    do
+    {
+        ReapCompletions();
+    } while (!m_VirtQueue.Restart());
+}
+
 NDIS_STATUS CParaNdisCX::SetupMessageIndex(u16 vector)
 {
     virtio_set_config_vector(&m_Context->IODevice, vector);
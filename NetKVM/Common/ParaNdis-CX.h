@@ -3,6 +3,15 @@
 #include "ndis56common.h"
 #include "ParaNdis-AbstractPath.h"
 
+#define PARANDIS_CX_MAX_COMMANDS        32
+#define PARANDIS_CX_COMMAND_SIZE        512
+// in 100ns units
+#define PARANDIS_CX_COMMAND_TIMEOUT     (1000 * 10000)
+// in microseconds, polling above PASSIVE_LEVEL
+#define PARANDIS_CX_POLL_INTERVAL       50
+// in milliseconds, bounds a wait for the completion event
+#define PARANDIS_CX_WAIT_SLICE          10
+
 class CParaNdisCX : public CParaNdisTemplatePath<CVirtQueue>, public CPlacementAllocatable {
 public:
     CParaNdisCX();
@@ -12,6 +21,9 @@ public:
 
     virtual NDIS_STATUS SetupMessageIndex(u16 vector);
 
+    void Shutdown();
+
+    // submits the command and waits for its result
     BOOLEAN CParaNdisCX::SendControlMessage(
         UCHAR cls,
         UCHAR cmd,
@@ -22,6 +34,58 @@ public:
         int levelIfOK
         );
 
+    // submits the command without waiting, the result is only logged
+    BOOLEAN SubmitControlMessage(
+        UCHAR cls,
+        UCHAR cmd,
+        PVOID buffer1,
+        ULONG size1,
+        PVOID buffer2,
+        ULONG size2,
+        int levelIfOK
+        );
+
+    BOOLEAN WaitForPendingCommands();
+
+    // called from the DPC on the control queue interrupt
+    void ProcessCompletions();
+
+    struct tStatistics
+    {
+        ULONG64 Commands;
+        ULONG64 Failures;
+        ULONG64 Timeouts;
+        // in 100ns units
+        ULONG64 TotalLatency;
+        ULONG64 MaxLatency;
+    } Statistics;
+
 protected:
+    struct tCommand
+    {
+        bool bInUse;
+        bool bDone;
+        bool bOK;
+        // nobody waits for the result, the slot is freed on completion
+        bool bDetached;
+        UCHAR cls;
+        UCHAR cmd;
+        int levelIfOK;
+        ULONG ackOffset;
+        ULONG64 SubmitTime;
+    };
+
+    tCommand *SubmitCommand(UCHAR cls, UCHAR cmd, PVOID buffer1, ULONG size1,
+        PVOID buffer2, ULONG size2, int levelIfOK, bool bDetached);
+    tCommand *AddCommand(UCHAR cls, UCHAR cmd, PVOID buffer1, ULONG size1,
+        PVOID buffer2, ULONG size2, int levelIfOK, bool bDetached);
+    void CompleteCommand(tCommand *pCommand, bool bOK);
+    void ReapCompletions();
+    bool WaitForCompletion(tCommand *pCommand, ULONG maxPending);
+
     tCompletePhysicalAddress m_ControlData;
+    tCommand m_Commands[PARANDIS_CX_MAX_COMMANDS];
+    ULONG m_nPending;
+    // set whenever commands complete, wakes the waiters at PASSIVE_LEVEL
+    CNdisEvent m_CompletionEvent;
 };
@@ -453,6 +453,13 @@ static void PrintStatistics(PARANDIS_ADAPTER *pContext)
         DPrintf(0, ("[Diag!] RxHwCS mistakes: missed bad %d, missed good %d\n",
             pContext->extraStatistics.framesRxCSHwMissedBad, pContext->extraStatistics.framesRxCSHwMissedGood));
     }
+    if (pContext->bCXPathCreated && pContext->CXPath.Statistics.Commands)
+    {
+        CParaNdisCX::tStatistics *pCXStats = &pContext->CXPath.Statistics;
+        DPrintf(0, ("[Diag!] Control commands %I64u, failed %I64u, timed out %I64u, latency avg %I64u us, max %I64u us\n",
+            pCXStats->Commands, pCXStats->Failures, pCXStats->Timeouts,
+            pCXStats->TotalLatency / pCXStats->Commands / 10, pCXStats->MaxLatency / 10));
+    }
 }
 
 static
@@ -1351,9 +1358,36 @@ VOID ParaNdis_OnShutdown(PARANDIS_ADAPTER *pContext)
     pContext->m_StateMachine.NotifyShutdown();
 }
 
+/* Called from the serialized OID path. Builds the copy ShallPassPacket does not
+   use and publishes it by bumping the generation, so the receive DPC never
+   sees a half built table or a table that doesn't match its list. */
+static VOID BuildMulticastHash(PARANDIS_ADAPTER *pContext)
+{
+    ParaNdis_BuildMulticastHash(&pContext->MulticastHash[(pContext->MulticastHashGeneration + 1) & 1],
+        pContext->MulticastData.MulticastList, pContext->MulticastData.nofMulticastEntries);
+    InterlockedIncrement(&pContext->MulticastHashGeneration);
+}
+
+static BOOLEAN IsMulticastListed(PARANDIS_ADAPTER *pContext, const UCHAR *pAddr)
+{
+    LONG generation;
+    BOOLEAN bListed;
+
+    // the copy may be rebuilt under us by the second list change after
+    // we picked it; any new generation means the answer can't be trusted
+    do
+    {
+        generation = *(volatile LONG *)&pContext->MulticastHashGeneration;
+        KeMemoryBarrier();
+        bListed = ParaNdis_LookupMulticastHash(&pContext->MulticastHash[generation & 1], pAddr);
+        KeMemoryBarrier();
+    } while (generation != *(volatile LONG *)&pContext->MulticastHashGeneration);
+
+    return bListed;
+}
+
 static ULONG ShallPassPacket(PARANDIS_ADAPTER *pContext, PNET_PACKET_INFO pPacketInfo)
 {
-    ULONG i;
 
     if (pPacketInfo->dataLength > pContext->MaxPacketSize.nMaxFullSizeOsRx + ETH_PRIORITY_HEADER_SIZE)
         return FALSE;
@@ -1394,18 +1428,7 @@ static ULONG ShallPassPacket(PARANDIS_ADAPTER *pContext, PNET_PACKET_INFO pPacke
     if(!(pContext->PacketFilter & NDIS_PACKET_TYPE_MULTICAST))
         return FALSE;
 
-    for (i = 0; i < pContext->MulticastData.nofMulticastEntries; i++)
-    {
-        ULONG Res;
-        PUCHAR CurrMcastAddr = &pContext->MulticastData.MulticastList[i*ETH_ALEN];
-
-        ETH_COMPARE_NETWORK_ADDRESSES_EQ(pPacketInfo->ethDestAddr, CurrMcastAddr, &Res);
-
-        if(!Res)
-            return TRUE;
-    }
-
-    return FALSE;
+    return IsMulticastListed(pContext, pPacketInfo->ethDestAddr);
 }
 
 BOOLEAN ParaNdis_PerformPacketAnalyzis(
@@ -1726,11 +1749,18 @@ bool ParaNdis_DPCWorkBody(PARANDIS_ADAPTER *pContext, ULONG ulMaxPacketsToIndica
             stillRequiresProcessing = true;
         }
 
-        if (pContext->CXPath.WasInterruptReported() && pContext->bLinkDetectSupported)
+        if (pContext->CXPath.WasInterruptReported())
         {
-            ReadLinkState(pContext);
-            ParaNdis_SynchronizeLinkState(pContext);
+            if (pContext->bLinkDetectSupported)
+            {
+                ReadLinkState(pContext);
+                ParaNdis_SynchronizeLinkState(pContext);
+            }
             pContext->CXPath.ClearInterruptReport();
+            if (pContext->bCXPathCreated)
+            {
+                pContext->CXPath.ProcessCompletions();
+            }
         }
 
         if (pathBundle != nullptr)
@@ -1804,6 +1834,7 @@ NDIS_STATUS ParaNdis_SetMulticastList(
         if (length)
             NdisMoveMemory(pContext->MulticastData.MulticastList, Buffer, length);
         pContext->MulticastData.nofMulticastEntries = length / ETH_ALEN;
+        BuildMulticastHash(pContext);
         DPrintf(1, ("[%s] New multicast list of %d bytes\n", __FUNCTION__, length));
         *pBytesRead = length;
         status = NDIS_STATUS_SUCCESS;
@@ -1856,13 +1887,25 @@ VOID ParaNdis_OnPnPEvent(
         pContext->nPnpEventIndex = 0;
 }
 
+// the longest multicast table one control command carries next to the empty
+// unicast table; the device passes all multicast for a longer list and
+// ShallPassPacket filters it against the whole list
+#define PARANDIS_MULTICAST_DEVICE_ENTRIES \
+    ((PARANDIS_CX_COMMAND_SIZE - 16 - 2 * sizeof(u32) - 1) / ETH_ALEN)
+
+static BOOLEAN IsMulticastTableOverflow(PARANDIS_ADAPTER *pContext)
+{
+    return pContext->MulticastData.nofMulticastEntries > PARANDIS_MULTICAST_DEVICE_ENTRIES;
+}
+
 static VOID ParaNdis_DeviceFiltersUpdateRxMode(PARANDIS_ADAPTER *pContext)
 {
     u8 val;
     ULONG f = pContext->PacketFilter;
     val = (f & NDIS_PACKET_TYPE_PROMISCUOUS) ? 1 : 0;
     pContext->CXPath.SendControlMessage(VIRTIO_NET_CTRL_RX, VIRTIO_NET_CTRL_RX_PROMISC, &val, sizeof(val), NULL, 0, 2);
-    val = (f & NDIS_PACKET_TYPE_ALL_MULTICAST) ? 1 : 0;
+    val = ((f & NDIS_PACKET_TYPE_ALL_MULTICAST) ||
+           ((f & NDIS_PACKET_TYPE_MULTICAST) && IsMulticastTableOverflow(pContext))) ? 1 : 0;
     pContext->CXPath.SendControlMessage(VIRTIO_NET_CTRL_RX, VIRTIO_NET_CTRL_RX_ALLMULTI, &val, sizeof(val), NULL, 0, 2);
 
     if (pContext->bCtrlRXExtraFiltersSupported)
@@ -1879,6 +1922,18 @@ static VOID ParaNdis_DeviceFiltersUpdateRxMode(PARANDIS_ADAPTER *pContext)
 static VOID ParaNdis_DeviceFiltersUpdateAddresses(PARANDIS_ADAPTER *pContext)
 {
     u32 u32UniCastEntries = 0;
+    u32 u32MultiCastEntries = 0;
+    if (IsMulticastTableOverflow(pContext))
+    {
+        // the device is in all-multicast mode, see ParaNdis_DeviceFiltersUpdateRxMode
+        pContext->CXPath.SendControlMessage(VIRTIO_NET_CTRL_MAC, VIRTIO_NET_CTRL_MAC_TABLE_SET,
+                            &u32UniCastEntries,
+                            sizeof(u32UniCastEntries),
+                            &u32MultiCastEntries,
+                            sizeof(u32MultiCastEntries),
+                            2);
+        return;
+    }
     pContext->CXPath.SendControlMessage(VIRTIO_NET_CTRL_MAC, VIRTIO_NET_CTRL_MAC_TABLE_SET,
                         &u32UniCastEntries,
                         sizeof(u32UniCastEntries),
@@ -1887,18 +1942,9 @@ static VOID ParaNdis_DeviceFiltersUpdateAddresses(PARANDIS_ADAPTER *pContext)
                         2);
 }
 
-static VOID SetSingleVlanFilter(PARANDIS_ADAPTER *pContext, ULONG vlanId, BOOLEAN bOn, int levelIfOK)
+static BOOLEAN IsVlanInFilterSet(ULONG filterSet, ULONG vlanId)
 {
-    u16 val = vlanId & 0xfff;
-    UCHAR cmd = bOn ? VIRTIO_NET_CTRL_VLAN_ADD : VIRTIO_NET_CTRL_VLAN_DEL;
-    pContext->CXPath.SendControlMessage(VIRTIO_NET_CTRL_VLAN, cmd, &val, sizeof(val), NULL, 0, levelIfOK);
-}
-
-static VOID SetAllVlanFilters(PARANDIS_ADAPTER *pContext, BOOLEAN bOn)
-{
-    ULONG i;
-    for (i = 0; i <= MAX_VLAN_ID; ++i)
-        SetSingleVlanFilter(pContext, i, bOn, 7);
+    return filterSet > MAX_VLAN_ID || (filterSet && filterSet == vlanId);
 }
 
 /*
@@ -1907,6 +1953,8 @@ static VOID SetAllVlanFilters(PARANDIS_ADAPTER *pContext, BOOLEAN bOn)
     1..4095 - one selected enabled
     4096 - all enabled
     Note that only 0th vlan can't be enabled
+    Only the VLANs that change state are sent to the device, all the
+    commands are queued at once and completed together
 */
 VOID ParaNdis_DeviceFiltersUpdateVlanId(PARANDIS_ADAPTER *pContext)
 {
@@ -1919,17 +1967,27 @@ VOID ParaNdis_DeviceFiltersUpdateVlanId(PARANDIS_ADAPTER *pContext)
             newFilterSet = IsPrioritySupported(pContext) ? (MAX_VLAN_ID + 1) : 0;
         if (newFilterSet != pContext->ulCurrentVlansFilterSet)
         {
-            if (pContext->ulCurrentVlansFilterSet > MAX_VLAN_ID)
-                SetAllVlanFilters(pContext, FALSE);
-            else if (pContext->ulCurrentVlansFilterSet)
-                SetSingleVlanFilter(pContext, pContext->ulCurrentVlansFilterSet, FALSE, 2);
+            ULONG64 startTime = KeQueryInterruptTime();
+            ULONG nChanges = 0;
+            ULONG i;
 
-            pContext->ulCurrentVlansFilterSet = newFilterSet;
+            for (i = 0; i <= MAX_VLAN_ID; ++i)
+            {
+                BOOLEAN bOn = IsVlanInFilterSet(newFilterSet, i);
+                if (bOn != IsVlanInFilterSet(pContext->ulCurrentVlansFilterSet, i))
+                {
+                    u16 val = i & 0xfff;
+                    UCHAR cmd = bOn ? VIRTIO_NET_CTRL_VLAN_ADD : VIRTIO_NET_CTRL_VLAN_DEL;
+                    pContext->CXPath.SubmitControlMessage(VIRTIO_NET_CTRL_VLAN, cmd, &val, sizeof(val), NULL, 0, 7);
+                    nChanges++;
+                }
+            }
+            pContext->CXPath.WaitForPendingCommands();
 
-            if (pContext->ulCurrentVlansFilterSet > MAX_VLAN_ID)
-                SetAllVlanFilters(pContext, TRUE);
-            else if (pContext->ulCurrentVlansFilterSet)
-                SetSingleVlanFilter(pContext, pContext->ulCurrentVlansFilterSet, TRUE, 2);
+            DPrintf(0, ("[%s] filter set %d -> %d, %d commands in %I64u us\n", __FUNCTION__,
+                pContext->ulCurrentVlansFilterSet, newFilterSet, nChanges,
+                (KeQueryInterruptTime() - startTime) / 10));
+            pContext->ulCurrentVlansFilterSet = newFilterSet;
         }
     }
 }
@@ -0,0 +1,95 @@
+/**********************************************************************
+ * Copyright (c) 2008-2016 Red Hat, Inc.
+ *
+ * File: ParaNdis-Multicast.h
+ *
+ * Receive side multicast filter: an open addressing table over a copy of
+ * the multicast list, looked up for every multicast packet the host
+ * passes up while the list is longer than the device's MAC table.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#ifndef PARANDIS_MULTICAST_H
+#define PARANDIS_MULTICAST_H
+
+// assuming <ndis.h> included
+#include "ethernetutils.h"
+
+#define PARANDIS_MULTICAST_LIST_SIZE        1024
+// the smallest power of two holding twice the list size; 0 (too long
+// list) fails the C_ASSERT below
+#define PARANDIS_MULTICAST_HASH_NEED        (2 * PARANDIS_MULTICAST_LIST_SIZE)
+#define PARANDIS_MULTICAST_HASH_BITS        \
+    (PARANDIS_MULTICAST_HASH_NEED <= (1 << 4)  ? 4  : \
+     PARANDIS_MULTICAST_HASH_NEED <= (1 << 5)  ? 5  : \
+     PARANDIS_MULTICAST_HASH_NEED <= (1 << 6)  ? 6  : \
+     PARANDIS_MULTICAST_HASH_NEED <= (1 << 7)  ? 7  : \
+     PARANDIS_MULTICAST_HASH_NEED <= (1 << 8)  ? 8  : \
+     PARANDIS_MULTICAST_HASH_NEED <= (1 << 9)  ? 9  : \
+     PARANDIS_MULTICAST_HASH_NEED <= (1 << 10) ? 10 : \
+     PARANDIS_MULTICAST_HASH_NEED <= (1 << 11) ? 11 : \
+     PARANDIS_MULTICAST_HASH_NEED <= (1 << 12) ? 12 : 0)
+#define PARANDIS_MULTICAST_HASH_SIZE        (1 << PARANDIS_MULTICAST_HASH_BITS)
+
+// receive side copy of the multicast list with the table over it;
+// slots hold 1-based indices into List, 0 for empty
+typedef struct _tagMulticastHash
+{
+    UCHAR                   List[ETH_ALEN * PARANDIS_MULTICAST_LIST_SIZE];
+    USHORT                  Slots[PARANDIS_MULTICAST_HASH_SIZE];
+}tMulticastHash;
+
+// the table never fills up, so the probe loops always find an empty slot
+C_ASSERT(PARANDIS_MULTICAST_HASH_SIZE >= 2 * PARANDIS_MULTICAST_LIST_SIZE);
+
+static __inline ULONG ParaNdis_MulticastHash(const UCHAR *pAddr)
+{
+    // the group bits live in the low bytes of multicast addresses
+    ULONG key = (pAddr[2] << 24) | (pAddr[3] << 16) | (pAddr[4] << 8) | pAddr[5];
+    key ^= pAddr[1];
+    return (key * 0x9E3779B1) >> (32 - PARANDIS_MULTICAST_HASH_BITS);
+}
+
+static __inline VOID ParaNdis_BuildMulticastHash(tMulticastHash *pHash, const UCHAR *pList, ULONG nEntries)
+{
+    ULONG i;
+
+    NdisZeroMemory(pHash, sizeof(*pHash));
+    NdisMoveMemory(pHash->List, pList, nEntries * ETH_ALEN);
+    for (i = 0; i < nEntries; i++)
+    {
+        ULONG slot = ParaNdis_MulticastHash(&pHash->List[i * ETH_ALEN]);
+        while (pHash->Slots[slot])
+        {
+            slot = (slot + 1) & (PARANDIS_MULTICAST_HASH_SIZE - 1);
+        }
+        pHash->Slots[slot] = (USHORT)(i + 1);
+    }
+}
+
+static __inline BOOLEAN ParaNdis_LookupMulticastHash(const tMulticastHash *pHash, const UCHAR *pAddr)
+{
+    ULONG slot = ParaNdis_MulticastHash(pAddr);
+    ULONG i;
+
+    // bounded by the table size, a copy being rebuilt may be full of garbage
+    for (i = 0; i < PARANDIS_MULTICAST_HASH_SIZE; i++)
+    {
+        ULONG Res;
+        ULONG index = pHash->Slots[slot];
+
+        if (!index || index > PARANDIS_MULTICAST_LIST_SIZE)
+            return FALSE;
+
+        ETH_COMPARE_NETWORK_ADDRESSES_EQ(pAddr, &pHash->List[(index - 1) * ETH_ALEN], &Res);
+        if (!Res)
+            return TRUE;
+
+        slot = (slot + 1) & (PARANDIS_MULTICAST_HASH_SIZE - 1);
+    }
+    return FALSE;
+}
+
+#endif
@@ -67,6 +67,7 @@ extern "C"
 #define _Function_class_(x)
 #endif
 
+#include "ParaNdis-Multicast.h"
 #include "ParaNdis-SM.h"
 #include "ParaNdis-RSS.h"
 
@@ -131,7 +132,6 @@ struct CPUPathesBundle : public CPlacementAllocatable {
 
 #define VIRTIO_NET_INVALID_INTERRUPT_STATUS     0xFF
 
-#define PARANDIS_MULTICAST_LIST_SIZE        32
 #define PARANDIS_MEMORY_TAG                 '5muQ'
 #define PARANDIS_FORMAL_LINK_SPEED          (pContext->ulFormalLinkSpeed)
 #define PARANDIS_MAXIMUM_RECEIVE_SPEED      PARANDIS_FORMAL_LINK_SPEED
@@ -361,6 +361,10 @@ typedef struct _tagPARANDIS_ADAPTER
     USHORT                  nHardwareQueues;
     ULONG                   ulCurrentVlansFilterSet;
     tMulticastData          MulticastData;
+    // ShallPassPacket reads MulticastHash[MulticastHashGeneration & 1],
+    // the other copy is rebuilt on the next multicast list change
+    tMulticastHash          MulticastHash[2];
+    LONG                    MulticastHashGeneration;
     UINT                    uNumberOfHandledRXPacketsInDPC;
     LONG                    counterDPCInside;
     ULONG                   ulPriorityVlanSetting;
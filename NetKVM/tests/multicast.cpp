@@ -0,0 +1,189 @@
+/**********************************************************************
+ * Copyright (c) 2008-2016 Red Hat, Inc.
+ *
+ * File: multicast.cpp
+ *
+ * Host-side microbenchmark of the receive side multicast filter. For
+ * lists of 1 to PARANDIS_MULTICAST_LIST_SIZE groups the table is checked
+ * against a scan of the list, then the lookup of a mix of listed and
+ * unlisted groups is timed against that scan, which is how packets were
+ * filtered before the table.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ParaNdis-Multicast.h"
+
+#define NUM_PROBES      4096
+#define LOOKUPS         (8 * 1024 * 1024)
+#define BUILDS          256
+
+typedef struct _MULTICAST_RESULT
+{
+    ULONG Groups;
+    double BuildUs;
+    double HashNs;
+    double ScanNs;
+} MULTICAST_RESULT;
+
+static UCHAR List[ETH_ALEN * PARANDIS_MULTICAST_LIST_SIZE];
+static UCHAR Probes[ETH_ALEN * NUM_PROBES];
+static tMulticastHash Hash;
+static ULONG Seed = 2463534242UL;
+
+static ULONG Random(void)
+{
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 17;
+    Seed ^= Seed << 5;
+    return Seed;
+}
+
+static double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// the filter before the table: a scan of the multicast list
+static BOOLEAN ScanList(const UCHAR *pList, ULONG nEntries, const UCHAR *pAddr)
+{
+    ULONG i;
+
+    for (i = 0; i < nEntries; i++)
+    {
+        ULONG Res;
+
+        ETH_COMPARE_NETWORK_ADDRESSES_EQ(pAddr, &pList[i * ETH_ALEN], &Res);
+        if (!Res)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+// IPv4 and IPv6 group addresses, as the stacks join them
+static void RandomGroup(UCHAR *pAddr)
+{
+    ULONG r = Random();
+
+    if (r & 1)
+    {
+        pAddr[0] = 0x01;
+        pAddr[1] = 0x00;
+        pAddr[2] = 0x5e;
+        pAddr[3] = (UCHAR)((r >> 8) & 0x7f);
+    }
+    else
+    {
+        pAddr[0] = 0x33;
+        pAddr[1] = 0x33;
+        pAddr[2] = (UCHAR)(r >> 24);
+        pAddr[3] = (UCHAR)(r >> 8);
+    }
+    r = Random();
+    pAddr[4] = (UCHAR)r;
+    pAddr[5] = (UCHAR)(r >> 8);
+}
+
+static int RunCase(ULONG nGroups, MULTICAST_RESULT *pResult)
+{
+    ULONG i, hits = 0;
+    volatile ULONG sink = 0;
+    double start;
+
+    // distinct groups
+    for (i = 0; i < nGroups; i++)
+    {
+        do
+        {
+            RandomGroup(&List[i * ETH_ALEN]);
+        } while (ScanList(List, i, &List[i * ETH_ALEN]));
+    }
+
+    // half of the probes are listed, the rest mostly aren't
+    for (i = 0; i < NUM_PROBES; i++)
+    {
+        if (i & 1)
+            memcpy(&Probes[i * ETH_ALEN], &List[(Random() % nGroups) * ETH_ALEN], ETH_ALEN);
+        else
+            RandomGroup(&Probes[i * ETH_ALEN]);
+    }
+
+    ParaNdis_BuildMulticastHash(&Hash, List, nGroups);
+    for (i = 0; i < nGroups; i++)
+    {
+        if (!ParaNdis_LookupMulticastHash(&Hash, &List[i * ETH_ALEN]))
+            return printf("FAIL %u groups: group %u not found\n", nGroups, i), 1;
+    }
+    for (i = 0; i < NUM_PROBES; i++)
+    {
+        BOOLEAN listed = ScanList(List, nGroups, &Probes[i * ETH_ALEN]);
+        if (ParaNdis_LookupMulticastHash(&Hash, &Probes[i * ETH_ALEN]) != listed)
+            return printf("FAIL %u groups: probe %u %s\n", nGroups, i,
+                listed ? "not found" : "found"), 1;
+        hits += listed;
+    }
+
+    start = Now();
+    for (i = 0; i < BUILDS; i++)
+    {
+        ParaNdis_BuildMulticastHash(&Hash, List, nGroups);
+    }
+    pResult->BuildUs = (Now() - start) / BUILDS / 1000;
+
+    start = Now();
+    for (i = 0; i < LOOKUPS; i++)
+    {
+        sink += ParaNdis_LookupMulticastHash(&Hash, &Probes[(i % NUM_PROBES) * ETH_ALEN]);
+    }
+    pResult->HashNs = (Now() - start) / LOOKUPS;
+
+    // the scan is linear in the list, fewer rounds do for long lists
+    ULONG scans = LOOKUPS / (nGroups < 64 ? 1 : nGroups / 64);
+    start = Now();
+    for (i = 0; i < scans; i++)
+    {
+        sink += ScanList(List, nGroups, &Probes[(i % NUM_PROBES) * ETH_ALEN]);
+    }
+    pResult->ScanNs = (Now() - start) / scans;
+
+    pResult->Groups = nGroups;
+    printf("PASS %4u groups, %u of %u probes listed\n", nGroups, hits, NUM_PROBES);
+    return 0;
+}
+
+int main()
+{
+    MULTICAST_RESULT Results[16];
+    ULONG nResults = 0, nFailed = 0, nGroups, i;
+
+    for (nGroups = 1; nGroups <= PARANDIS_MULTICAST_LIST_SIZE; nGroups *= 2)
+    {
+        if (RunCase(nGroups, &Results[nResults]))
+            nFailed++;
+        else
+            nResults++;
+    }
+
+    printf("\n%8s %10s %10s %10s\n", "Groups", "Build us", "Hash ns", "Scan ns");
+    for (i = 0; i < nResults; i++)
+    {
+        printf("%8u %10.2f %10.2f %10.2f\n", Results[i].Groups, Results[i].BuildUs,
+            Results[i].HashNs, Results[i].ScanNs);
+    }
+
+    if (nFailed)
+    {
+        printf("%u cases failed\n", nFailed);
+        return 1;
+    }
+    return 0;
+}
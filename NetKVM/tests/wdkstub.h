@@ -0,0 +1,50 @@
+/**********************************************************************
+ * Copyright (c) 2008-2016 Red Hat, Inc.
+ *
+ * File: wdkstub.h
+ *
+ * Minimal subset of the NDIS headers needed to build the NetKVM
+ * receive side multicast filter (ParaNdis-Multicast.h) as a Linux
+ * program. It is force-included ahead of the sources; the WDK headers
+ * they include resolve to empty files generated by the Makefile.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// basic types
+#define VOID void
+#define UNALIGNED
+typedef unsigned char UCHAR, *PUCHAR;
+typedef uint16_t USHORT, *PUSHORT;
+typedef int32_t LONG, *PLONG;
+typedef uint32_t ULONG, *PULONG;
+typedef uint64_t ULONGLONG;
+typedef UCHAR BOOLEAN, *PBOOLEAN;
+
+#define TRUE  1
+#define FALSE 0
+
+#define C_ASSERT(e) static_assert(e, #e)
+
+// NDIS
+#define NdisZeroMemory(Destination, Length) memset(Destination, 0, Length)
+#define NdisMoveMemory(Destination, Source, Length) memcpy(Destination, Source, Length)
+
+// nonzero if the addresses differ, loads as unaligned as the NDIS macro's
+#define ETH_COMPARE_NETWORK_ADDRESSES_EQ(_A, _B, _Result)          \
+{                                                                  \
+    ULONG _a4, _b4;                                                \
+    USHORT _a2, _b2;                                               \
+    memcpy(&_a4, (const UCHAR *)(_A) + 2, sizeof(_a4));            \
+    memcpy(&_b4, (const UCHAR *)(_B) + 2, sizeof(_b4));            \
+    memcpy(&_a2, (_A), sizeof(_a2));                               \
+    memcpy(&_b2, (_B), sizeof(_b2));                               \
+    *(_Result) = (_a4 != _b4) || (_a2 != _b2);                     \
+}
@@ -230,6 +230,36 @@ VIOInputEvtDevicePrepareHardware(
     }
     VirtIOWdfSetDriverFeatures(&pContext->VDevice, guestFeatures);
 
+    if (pContext->EventRing == NULL)
+    {
+        pContext->EventRing = (PVIRTIO_INPUT_EVENT)VIOInputAlloc(PAGE_SIZE);
+        if (pContext->EventRing == NULL)
+        {
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_HW_ACCESS, "Event ring alloc failed\n");
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+        pContext->EventRingPA = MmGetPhysicalAddress(pContext->EventRing);
+    }
+
+    if (pContext->StatusPool == NULL)
+    {
+        ULONG i;
+
+        pContext->StatusPool = (PVIRTIO_INPUT_EVENT_WITH_REQUEST)VIOInputAlloc(PAGE_SIZE);
+        if (pContext->StatusPool == NULL)
+        {
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_HW_ACCESS, "Status pool alloc failed\n");
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+        pContext->StatusPoolPA = MmGetPhysicalAddress(pContext->StatusPool);
+
+        pContext->StatusFreeList.Next = NULL;
+        for (i = 0; i < VIOINPUT_STATUS_POOL_SIZE; i++)
+        {
+            PushEntryList(&pContext->StatusFreeList, &pContext->StatusPool[i].ListEntry);
+        }
+    }
+
     // Figure out what kind of input device this is and build a
     // corresponding HID report descriptor.
     status = VIOInputBuildReportDescriptor(pContext);
@@ -262,10 +292,13 @@ VIOInputEvtDeviceReleaseHardware(
             pClass->CleanupFunc(pClass);
         }
         VIOInputFree(&pClass->pHidReport);
+        VIOInputFree(&pClass->pReportFifo);
         VIOInputFree(&pClass);
     }
 
     VIOInputFree(&pContext->HidReportDescriptor);
+    VIOInputFree(&pContext->EventRing);
+    VIOInputFree(&pContext->StatusPool);
 
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_HW_ACCESS, "<-- %s\n", __FUNCTION__);
     return STATUS_SUCCESS;
@@ -321,36 +354,33 @@ VIOInputShutDownAllQueues(IN WDFOBJECT WdfDevice)
 
 NTSTATUS
 VIOInputFillQueue(
-    IN struct virtqueue *vq,
-    IN WDFSPINLOCK Lock)
+    IN PINPUT_DEVICE pContext)
 {
     NTSTATUS status = STATUS_SUCCESS;
-    PVIRTIO_INPUT_EVENT buf = NULL;
+    bool notify;
+    ULONG i;
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_INIT, "--> %s\n", __FUNCTION__);
 
-    for (;;)
+    // post as much of the event ring as fits in the queue and kick once
+    WdfSpinLockAcquire(pContext->EventQLock);
+    for (i = 0; i < VIOINPUT_EVENT_RING_SIZE; i++)
     {
-        buf = (PVIRTIO_INPUT_EVENT)ExAllocatePoolWithTag(
-            NonPagedPool,
-            sizeof(VIRTIO_INPUT_EVENT),
-            VIOINPUT_DRIVER_MEMORY_TAG
-            );
-        if (buf == NULL)
-        {
-            TraceEvents(TRACE_LEVEL_ERROR, DBG_INIT, "VIRTIO_INPUT_EVENT alloc failed\n");
-            return STATUS_INSUFFICIENT_RESOURCES;
-        }
-
-        WdfSpinLockAcquire(Lock);
-        status = VIOInputAddInBuf(vq, buf);
-        WdfSpinLockRelease(Lock);
+        status = VIOInputAddEventBuf(pContext, &pContext->EventRing[i]);
         if (!NT_SUCCESS(status))
         {
-            ExFreePoolWithTag(buf, VIOINPUT_DRIVER_MEMORY_TAG);
             break;
         }
     }
+    notify = virtqueue_kick_prepare(pContext->EventQ);
+    WdfSpinLockRelease(pContext->EventQLock);
+
+    if (notify)
+    {
+        virtqueue_notify(pContext->EventQ);
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_INIT, "Posted %d event buffers\n", i);
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_INIT, "<-- %s\n", __FUNCTION__);
     return STATUS_SUCCESS;
 }
@@ -359,6 +389,7 @@ static NTSTATUS
 VIOInputAddBuf(
     IN struct virtqueue *vq,
     IN PVIRTIO_INPUT_EVENT buf,
+    IN PHYSICAL_ADDRESS pa,
     IN BOOLEAN out)
 {
     NTSTATUS  status = STATUS_SUCCESS;
@@ -376,34 +407,108 @@ VIOInputAddBuf(
         return STATUS_INSUFFICIENT_RESOURCES;
     }
 
-    sg.physAddr = MmGetPhysicalAddress(buf);
+    sg.physAddr = pa;
     sg.length = sizeof(VIRTIO_INPUT_EVENT);
 
     if (0 > virtqueue_add_buf(vq, &sg, (out ? 1 : 0), (out ? 0 : 1), buf, NULL, 0))
     {
-        TraceEvents(TRACE_LEVEL_ERROR, DBG_QUEUEING, "<-- %s cannot add_buf\n", __FUNCTION__);
+        TraceEvents(TRACE_LEVEL_VERBOSE, DBG_QUEUEING, "<-- %s cannot add_buf\n", __FUNCTION__);
         status = STATUS_INSUFFICIENT_RESOURCES;
     }
 
-    virtqueue_kick(vq);
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_QUEUEING, "<-- %s\n", __FUNCTION__);
     return status;
 }
 
+// Adds an event ring slot to the event queue. The caller holds EventQLock
+// and kicks the queue once it is done adding buffers.
 NTSTATUS
-VIOInputAddInBuf(
-    IN struct virtqueue *vq,
+VIOInputAddEventBuf(
+    IN PINPUT_DEVICE pContext,
     IN PVIRTIO_INPUT_EVENT buf)
 {
-    return VIOInputAddBuf(vq, buf, FALSE);
+    PHYSICAL_ADDRESS pa;
+
+    pa.QuadPart = pContext->EventRingPA.QuadPart +
+        (LONGLONG)((PUCHAR)buf - (PUCHAR)pContext->EventRing);
+
+    return VIOInputAddBuf(pContext->EventQ, buf, pa, FALSE);
 }
 
+// Sends a batch of events to the host and kicks the status queue once.
+// Either all events are queued or none is. The request, if any, is
+// completed once the host has processed the last event.
 NTSTATUS
-VIOInputAddOutBuf(
-    IN struct virtqueue *vq,
-    IN PVIRTIO_INPUT_EVENT buf)
+VIOInputSendStatus(
+    IN PINPUT_DEVICE pContext,
+    IN PVIRTIO_INPUT_EVENT pEvents,
+    IN ULONG nEvents,
+    IN WDFREQUEST Request)
 {
-    return VIOInputAddBuf(vq, buf, TRUE);
+    PVIRTIO_INPUT_EVENT_WITH_REQUEST pEntries[LED_CNT];
+    PSINGLE_LIST_ENTRY entry;
+    PHYSICAL_ADDRESS pa;
+    NTSTATUS status = STATUS_SUCCESS;
+    bool notify;
+    ULONG i, nTaken;
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_WRITE, "--> %s %d events\n", __FUNCTION__, nEvents);
+
+    if (nEvents == 0 || nEvents > LED_CNT)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    WdfSpinLockAcquire(pContext->StatusQLock);
+
+    // every event is a separate buffer, make sure they all fit
+    if (pContext->StatusQ->num_free < nEvents)
+    {
+        WdfSpinLockRelease(pContext->StatusQLock);
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE, "<-- %s status queue full\n", __FUNCTION__);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    for (nTaken = 0; nTaken < nEvents; nTaken++)
+    {
+        entry = PopEntryList(&pContext->StatusFreeList);
+        if (entry == NULL)
+        {
+            break;
+        }
+        pEntries[nTaken] = CONTAINING_RECORD(entry, VIRTIO_INPUT_EVENT_WITH_REQUEST, ListEntry);
+    }
+    if (nTaken < nEvents)
+    {
+        while (nTaken > 0)
+        {
+            PushEntryList(&pContext->StatusFreeList, &pEntries[--nTaken]->ListEntry);
+        }
+        WdfSpinLockRelease(pContext->StatusQLock);
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE, "<-- %s status pool empty\n", __FUNCTION__);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    for (i = 0; i < nEvents; i++)
+    {
+        pEntries[i]->Event = pEvents[i];
+        pEntries[i]->Request = (i == nEvents - 1 ? Request : NULL);
+
+        pa.QuadPart = pContext->StatusPoolPA.QuadPart +
+            (LONGLONG)((PUCHAR)pEntries[i] - (PUCHAR)pContext->StatusPool);
+        status = VIOInputAddBuf(pContext->StatusQ, &pEntries[i]->Event, pa, TRUE);
+        ASSERT(NT_SUCCESS(status));
+    }
+    notify = virtqueue_kick_prepare(pContext->StatusQ);
+
+    WdfSpinLockRelease(pContext->StatusQLock);
+
+    if (notify)
+    {
+        virtqueue_notify(pContext->StatusQ);
+    }
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_WRITE, "<-- %s\n", __FUNCTION__);
+    return status;
 }
 
 NTSTATUS
@@ -422,7 +527,7 @@ VIOInputEvtDeviceD0Entry(
     if (NT_SUCCESS(status))
     {
         VirtIOWdfSetDriverOK(&pContext->VDevice);
-        VIOInputFillQueue(pContext->EventQ, pContext->EventQLock);
+        VIOInputFillQueue(pContext);
     }
     else
     {
@@ -440,7 +545,6 @@ VIOInputEvtDeviceD0Exit(
     IN  WDF_POWER_DEVICE_STATE TargetState)
 {
     PINPUT_DEVICE pContext = GetDeviceContext(Device);
-    PVIRTIO_INPUT_EVENT buf;
 
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP,"--> %s TargetState: %d\n",
         __FUNCTION__, TargetState);
@@ -449,9 +553,23 @@ VIOInputEvtDeviceD0Exit(
 
     if (pContext->EventQ)
     {
-        while (buf = (PVIRTIO_INPUT_EVENT)virtqueue_detach_unused_buf(pContext->EventQ))
+        // the buffers belong to the event ring, just take them back
+        while (virtqueue_detach_unused_buf(pContext->EventQ) != NULL)
+        {
+        }
+    }
+    if (pContext->StatusQ)
+    {
+        PVIRTIO_INPUT_EVENT_WITH_REQUEST pEventReq;
+
+        // return the status buffers to the pool
+        while ((pEventReq = virtqueue_detach_unused_buf(pContext->StatusQ)) != NULL)
         {
-            ExFreePoolWithTag(buf, VIOINPUT_DRIVER_MEMORY_TAG);
+            if (pEventReq->Request != NULL)
+            {
+                WdfRequestComplete(pEventReq->Request, STATUS_CANCELLED);
+            }
+            PushEntryList(&pContext->StatusFreeList, &pEventReq->ListEntry);
         }
     }
     VIOInputShutDownAllQueues(Device);
@@ -96,22 +96,29 @@ EvtIoDeviceControl(
     case IOCTL_HID_READ_REPORT:
         TraceEvents(TRACE_LEVEL_VERBOSE, DBG_IOCTLS, "IOCTL_HID_READ_REPORT\n");
         //
-        // Queue up a report request. We'll complete it when we actually
-        // receive data from the device.
+        // Complete the request with a queued report if we have one, queue
+        // it up otherwise. We'll complete it when we actually receive data
+        // from the device. The check and the forwarding are atomic with
+        // respect to the DPC which fills the report FIFOs.
         //
 
-        status = WdfRequestForwardToIoQueue(
-            Request,
-            pContext->HidQueue);
-        if (NT_SUCCESS(status))
-        {
-            completeRequest = FALSE;
-        }
-        else
+        WdfSpinLockAcquire(pContext->EventQLock);
+        if (!ReportFifoRead(pContext, Request, &status))
         {
-            TraceEvents(TRACE_LEVEL_ERROR, DBG_IOCTLS,
-                        "WdfRequestForwardToIoQueue failed with 0x%x\n", status);
+            status = WdfRequestForwardToIoQueue(
+                Request,
+                pContext->HidQueue);
+            if (NT_SUCCESS(status))
+            {
+                completeRequest = FALSE;
+            }
+            else
+            {
+                TraceEvents(TRACE_LEVEL_ERROR, DBG_IOCTLS,
+                            "WdfRequestForwardToIoQueue failed with 0x%x\n", status);
+            }
         }
+        WdfSpinLockRelease(pContext->EventQLock);
         break;
 
     case IOCTL_HID_WRITE_REPORT:
@@ -158,6 +165,74 @@ EvtIoDeviceControl(
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_IOCTLS, "<-- %s\n", __FUNCTION__);
 }
 
+static PUCHAR
+ReportFifoEntry(
+    PINPUT_CLASS_COMMON pClass,
+    ULONG uIndex)
+{
+    return pClass->pReportFifo +
+        ((pClass->uFifoHead + uIndex) % HID_REPORT_FIFO_LENGTH) * pClass->cbHidReportSize;
+}
+
+// Keeps the class's current report until a read request arrives. Called
+// with EventQLock held.
+static VOID
+ReportFifoWrite(
+    PINPUT_CLASS_COMMON pClass)
+{
+    if (pClass->uFifoCount == HID_REPORT_FIFO_LENGTH)
+    {
+        if (pClass->CoalesceReportFunc != NULL &&
+            pClass->CoalesceReportFunc(
+                pClass,
+                ReportFifoEntry(pClass, pClass->uFifoCount - 1),
+                pClass->pHidReport))
+        {
+            pClass->uReportsCoalesced++;
+            return;
+        }
+
+        // make room by dropping the oldest report
+        pClass->uFifoHead = (pClass->uFifoHead + 1) % HID_REPORT_FIFO_LENGTH;
+        pClass->uFifoCount--;
+        pClass->uReportsDropped++;
+        TraceEvents(TRACE_LEVEL_WARNING, DBG_READ,
+                    "Report ID %d FIFO full, %I64u reports dropped\n",
+                    pClass->uReportID, pClass->uReportsDropped);
+    }
+
+    RtlCopyMemory(
+        ReportFifoEntry(pClass, pClass->uFifoCount),
+        pClass->pHidReport,
+        pClass->cbHidReportSize);
+    pClass->uFifoCount++;
+}
+
+BOOLEAN
+ReportFifoRead(
+    PINPUT_DEVICE pContext,
+    WDFREQUEST Request,
+    NTSTATUS *pStatus)
+{
+    ULONG i;
+
+    for (i = 0; i < pContext->uNumOfClasses; i++)
+    {
+        PINPUT_CLASS_COMMON pClass = pContext->InputClasses[i];
+        if (pClass->uFifoCount > 0)
+        {
+            *pStatus = RequestCopyFromBuffer(
+                Request,
+                ReportFifoEntry(pClass, 0),
+                pClass->cbHidReportSize);
+            pClass->uFifoHead = (pClass->uFifoHead + 1) % HID_REPORT_FIFO_LENGTH;
+            pClass->uFifoCount--;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
 static VOID
 CompleteHIDQueueRequest(
     PINPUT_DEVICE pContext,
@@ -172,6 +247,7 @@ CompleteHIDQueueRequest(
         return;
     }
 
+    // a read request is only pending if there are no queued reports
     status = WdfIoQueueRetrieveNextRequest(pContext->HidQueue, &request);
     if (NT_SUCCESS(status))
     {
@@ -185,6 +261,40 @@ CompleteHIDQueueRequest(
             pClass->bDirty = FALSE;
         }
     }
+    else
+    {
+        ReportFifoWrite(pClass);
+        pClass->bDirty = FALSE;
+    }
+}
+
+static UCHAR
+GetEventClass(
+    PINPUT_DEVICE pContext,
+    PVIRTIO_INPUT_EVENT pEvent)
+{
+    switch (pEvent->type)
+    {
+    case EV_KEY:
+        if (pEvent->code < KEY_CNT)
+        {
+            return pContext->KeyClassMap[pEvent->code];
+        }
+        break;
+    case EV_REL:
+        if (pEvent->code < REL_CNT)
+        {
+            return pContext->RelClassMap[pEvent->code];
+        }
+        break;
+    case EV_ABS:
+        if (pEvent->code < ABS_CNT)
+        {
+            return pContext->AbsClassMap[pEvent->code];
+        }
+        break;
+    }
+    return INPUT_CLASS_NONE;
 }
 
 VOID
@@ -193,6 +303,7 @@ ProcessInputEvent(
     PVIRTIO_INPUT_EVENT pEvent)
 {
     ULONG i;
+    UCHAR uClass;
 
     TraceEvents(
         TRACE_LEVEL_VERBOSE,
@@ -210,14 +321,25 @@ ProcessInputEvent(
         {
             CompleteHIDQueueRequest(pContext, pContext->InputClasses[i]);
         }
-    }
 
-    // ask each class to translate the input event into a HID report
-    for (i = 0; i < pContext->uNumOfClasses; i++)
+        // let each class know that the report has been sent
+        for (i = 0; i < pContext->uNumOfClasses; i++)
+        {
+            pContext->InputClasses[i]->EventToReportFunc(
+                pContext->InputClasses[i],
+                pEvent);
+        }
+    }
+    else
     {
-        pContext->InputClasses[i]->EventToReportFunc(
-            pContext->InputClasses[i],
-            pEvent);
+        // ask the class owning the event code to translate it into a HID report
+        uClass = GetEventClass(pContext, pEvent);
+        if (uClass < pContext->uNumOfClasses)
+        {
+            pContext->InputClasses[uClass]->EventToReportFunc(
+                pContext->InputClasses[uClass],
+                pEvent);
+        }
     }
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ, "<-- %s\n", __FUNCTION__);
@@ -353,6 +475,69 @@ static u8 SelectInputConfig(PINPUT_DEVICE pContext, u8 cfgSelect, u8 cfgSubSel)
     return size;
 }
 
+// Event codes are claimed by clearing them from the config bitmaps while
+// probing. The codes that disappeared belong to the class just registered,
+// or go back to the bitmaps for the next probes if no class was registered.
+static VOID ClaimEventCodes(
+    PUCHAR pClassMap,
+    ULONG uMapLen,
+    PVIRTIO_INPUT_CFG_DATA pBefore,
+    PVIRTIO_INPUT_CFG_DATA pAfter,
+    UCHAR uClass)
+{
+    UCHAR i, uBits, uValue;
+    ULONG uCode;
+
+    for (i = 0; i < pBefore->size; i++)
+    {
+        uBits = pBefore->u.bitmap[i] & ~pAfter->u.bitmap[i];
+        while (DecodeNextBit(&uBits, &uValue))
+        {
+            uCode = uValue + 8 * i;
+            if (uCode < uMapLen)
+            {
+                pClassMap[uCode] = uClass;
+            }
+        }
+    }
+}
+
+static VOID ClaimEvents(
+    PINPUT_DEVICE pContext,
+    ULONG uNumOfClasses,
+    PVIRTIO_INPUT_CFG_DATA pSaved,
+    PVIRTIO_INPUT_CFG_DATA pKeyData,
+    PVIRTIO_INPUT_CFG_DATA pRelData,
+    PVIRTIO_INPUT_CFG_DATA pAbsData)
+{
+    UCHAR uClass;
+
+    if (pContext->uNumOfClasses == uNumOfClasses)
+    {
+        // the probe did not register a class, release the codes it cleared
+        *pKeyData = pSaved[0];
+        *pRelData = pSaved[1];
+        *pAbsData = pSaved[2];
+        return;
+    }
+    uClass = (UCHAR)(pContext->uNumOfClasses - 1);
+
+    ClaimEventCodes(pContext->KeyClassMap, KEY_CNT, &pSaved[0], pKeyData, uClass);
+    ClaimEventCodes(pContext->RelClassMap, REL_CNT, &pSaved[1], pRelData, uClass);
+    ClaimEventCodes(pContext->AbsClassMap, ABS_CNT, &pSaved[2], pAbsData, uClass);
+}
+
+static VOID SaveEvents(
+    PVIRTIO_INPUT_CFG_DATA pSaved,
+    PVIRTIO_INPUT_CFG_DATA pKeyData,
+    PVIRTIO_INPUT_CFG_DATA pRelData,
+    PVIRTIO_INPUT_CFG_DATA pAbsData)
+{
+    pSaved[0] = *pKeyData;
+    pSaved[1] = *pRelData;
+    pSaved[2] = *pAbsData;
+}
+
 static BOOLEAN InputCfgDataEmpty(PVIRTIO_INPUT_CFG_DATA pCfgData)
 {
     UCHAR i;
@@ -372,11 +557,17 @@ VIOInputBuildReportDescriptor(PINPUT_DEVICE pContext)
     DYNAMIC_ARRAY ReportDescriptor = { NULL };
     NTSTATUS status = STATUS_SUCCESS;
     VIRTIO_INPUT_CFG_DATA KeyData, RelData, AbsData, LedData;
+    VIRTIO_INPUT_CFG_DATA Saved[3];
     SIZE_T cbReportDescriptor;
+    ULONG uNumOfClasses;
     UCHAR i, uReportID = 0;
 
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_INIT, "--> %s\n", __FUNCTION__);
 
+    RtlFillMemory(pContext->KeyClassMap, sizeof(pContext->KeyClassMap), INPUT_CLASS_NONE);
+    RtlFillMemory(pContext->RelClassMap, sizeof(pContext->RelClassMap), INPUT_CLASS_NONE);
+    RtlFillMemory(pContext->AbsClassMap, sizeof(pContext->AbsClassMap), INPUT_CLASS_NONE);
+
     // key/button config
     KeyData.size = SelectInputConfig(pContext, VIRTIO_INPUT_CFG_EV_BITS, EV_KEY);
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_INIT, "Got EV_KEY bits size %d\n", KeyData.size);
@@ -411,6 +602,8 @@ VIOInputBuildReportDescriptor(PINPUT_DEVICE pContext)
     // if we have any absolute axes, we may expose a mouse as well
     if (!InputCfgDataEmpty(&RelData) || !InputCfgDataEmpty(&AbsData))
     {
+        SaveEvents(Saved, &KeyData, &RelData, &AbsData);
+        uNumOfClasses = pContext->uNumOfClasses;
         status = HIDMouseProbe(
             pContext,
             &ReportDescriptor,
@@ -421,11 +614,14 @@ VIOInputBuildReportDescriptor(PINPUT_DEVICE pContext)
         {
             goto Exit;
         }
+        ClaimEvents(pContext, uNumOfClasses, Saved, &KeyData, &RelData, &AbsData);
     }
 
     // if we have any absolute axes left, we may expose a joystick
     if (!InputCfgDataEmpty(&AbsData))
     {
+        SaveEvents(Saved, &KeyData, &RelData, &AbsData);
+        uNumOfClasses = pContext->uNumOfClasses;
         status = HIDJoystickProbe(
             pContext,
             &ReportDescriptor,
@@ -435,11 +631,14 @@ VIOInputBuildReportDescriptor(PINPUT_DEVICE pContext)
         {
             goto Exit;
         }
+        ClaimEvents(pContext, uNumOfClasses, Saved, &KeyData, &RelData, &AbsData);
     }
 
     // if we have any absolute axes left, we'll expose a table device
     if (!InputCfgDataEmpty(&AbsData))
     {
+        SaveEvents(Saved, &KeyData, &RelData, &AbsData);
+        uNumOfClasses = pContext->uNumOfClasses;
         status = HIDTabletProbe(
             pContext,
             &ReportDescriptor,
@@ -449,6 +648,7 @@ VIOInputBuildReportDescriptor(PINPUT_DEVICE pContext)
         {
             goto Exit;
         }
+        ClaimEvents(pContext, uNumOfClasses, Saved, &KeyData, &RelData, &AbsData);
     }
 
     // if we have any keys left, we'll expose a keyboard device
@@ -464,6 +664,8 @@ VIOInputBuildReportDescriptor(PINPUT_DEVICE pContext)
                 &LedData.u.bitmap[i], 1);
         }
 
+        SaveEvents(Saved, &KeyData, &RelData, &AbsData);
+        uNumOfClasses = pContext->uNumOfClasses;
         status = HIDKeyboardProbe(
             pContext,
             &ReportDescriptor,
@@ -473,11 +675,14 @@ VIOInputBuildReportDescriptor(PINPUT_DEVICE pContext)
         {
             goto Exit;
         }
+        ClaimEvents(pContext, uNumOfClasses, Saved, &KeyData, &RelData, &AbsData);
     }
 
     // if we still have any keys left, we'll check for a consumer device
     if (!InputCfgDataEmpty(&KeyData))
     {
+        SaveEvents(Saved, &KeyData, &RelData, &AbsData);
+        uNumOfClasses = pContext->uNumOfClasses;
         status = HIDConsumerProbe(
             pContext,
             &ReportDescriptor,
@@ -486,6 +691,7 @@ VIOInputBuildReportDescriptor(PINPUT_DEVICE pContext)
         {
             goto Exit;
         }
+        ClaimEvents(pContext, uNumOfClasses, Saved, &KeyData, &RelData, &AbsData);
     }
 
     // initialize the HID descriptor
@@ -551,6 +757,13 @@ RegisterClass(
         }
     }
 
+    // allocate the report FIFO
+    pClass->pReportFifo = VIOInputAlloc(HID_REPORT_FIFO_LENGTH * pClass->cbHidReportSize);
+    if (pClass->pReportFifo == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
     // insert the class into our array
     pContext->InputClasses[pContext->uNumOfClasses++] = pClass;
     return STATUS_SUCCESS;
@@ -42,6 +42,8 @@ typedef struct _tagInputClassJoystick
     SIZE_T cbAxisLen;
     // mapping from EVDEV axis codes to HID axis offsets
     PULONG pAxisMap;
+    // the same mapping indexed by EVDEV codes, (ULONG)-1 if not mapped
+    ULONG  AbsAxisMap[ABS_CNT];
 } INPUT_CLASS_JOYSTICK, *PINPUT_CLASS_JOYSTICK;
 
 static NTSTATUS
@@ -58,19 +60,13 @@ HIDJoystickEventToReport(
     switch (pEvent->type)
     {
     case EV_ABS:
-        if (pJoystickDesc->pAxisMap)
+        if (pEvent->code < ABS_CNT && pJoystickDesc->AbsAxisMap[pEvent->code] != (ULONG)-1)
         {
-            PULONG pMap;
-            for (pMap = pJoystickDesc->pAxisMap; pMap[0] != (ULONG)-1; pMap += 2)
-            {
-                if (pMap[0] == ((pEvent->type << 16) | pEvent->code))
-                {
-                    // 4 bytes per absolute axis
-                    PULONG pAxisPtr = (PULONG)&pReport[HID_REPORT_DATA_OFFSET + pMap[1]];
-                    *pAxisPtr = pEvent->value;
-                    pClass->bDirty = TRUE;
-                }
-            }
+            // 4 bytes per absolute axis
+            PULONG pAxisPtr = (PULONG)&pReport[HID_REPORT_DATA_OFFSET +
+                                               pJoystickDesc->AbsAxisMap[pEvent->code]];
+            *pAxisPtr = pEvent->value;
+            pClass->bDirty = TRUE;
         }
         break;
     case EV_KEY:
@@ -134,6 +130,7 @@ HIDJoystickProbe(
     SIZE_T cbButtonBytes;
     ULONG uNumOfAbsAxes = 0, uNumOfButtons = 0;
     DYNAMIC_ARRAY AxisMap = { NULL };
+    PULONG pMap;
 
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_INIT, "--> %s\n", __FUNCTION__);
 
@@ -262,6 +259,14 @@ HIDJoystickProbe(
         status = STATUS_INSUFFICIENT_RESOURCES;
         goto Exit;
     }
+    RtlFillMemory(pJoystickDesc->AbsAxisMap, sizeof(pJoystickDesc->AbsAxisMap), 0xFF);
+    for (pMap = pJoystickDesc->pAxisMap; pMap[0] != (ULONG)-1; pMap += 2)
+    {
+        if ((pMap[0] & 0xFFFF) < ABS_CNT)
+        {
+            pJoystickDesc->AbsAxisMap[pMap[0] & 0xFFFF] = pMap[1];
+        }
+    }
 
     // one bit per button
     cbButtonBytes = (uNumOfButtons + 7) / 8;
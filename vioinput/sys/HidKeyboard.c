@@ -217,40 +217,6 @@ HIDKeyboardEventToReport(
     return STATUS_SUCCESS;
 }
 
-static NTSTATUS
-HIDKeyboardSendStatus(
-    PINPUT_DEVICE pContext,
-    USHORT uType,
-    USHORT uCode,
-    ULONG uValue,
-    WDFREQUEST Request)
-{
-    PVIRTIO_INPUT_EVENT_WITH_REQUEST pEvent;
-    NTSTATUS status;
-
-    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_WRITE, "--> %s\n", __FUNCTION__);
-
-    pEvent = VIOInputAlloc(sizeof(VIRTIO_INPUT_EVENT_WITH_REQUEST));
-    if (pEvent == NULL)
-    {
-        status = STATUS_INSUFFICIENT_RESOURCES;
-    }
-    else
-    {
-        pEvent->Event.type = uType;
-        pEvent->Event.code = uCode;
-        pEvent->Event.value = uValue;
-        pEvent->Request = Request;
-
-        WdfSpinLockAcquire(pContext->StatusQLock);
-        status = VIOInputAddOutBuf(pContext->StatusQ, &pEvent->Event);
-        WdfSpinLockRelease(pContext->StatusQLock);
-    }
-
-    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_WRITE, "<-- %s\n", __FUNCTION__);
-    return status;
-}
-
 static NTSTATUS
 HIDKeyboardReportToEvent(
     PINPUT_CLASS_COMMON pClass,
@@ -260,8 +226,8 @@ HIDKeyboardReportToEvent(
     ULONG cbReport)
 {
     PINPUT_CLASS_KEYBOARD pKeyboardDesc = (PINPUT_CLASS_KEYBOARD)pClass;
-    USHORT uPendingLedCode = 0xFF;
-    USHORT uShortPendingLedValue = 0;
+    VIRTIO_INPUT_EVENT Events[LED_CNT];
+    ULONG nEvents = 0;
     NTSTATUS status = STATUS_SUCCESS;
     SIZE_T i;
 
@@ -289,29 +255,21 @@ HIDKeyboardReportToEvent(
 
             // LED codes are 1-based
             USHORT uLedCode = HIDLEDUsageCodeToEventCode(uCode + 1);
-            if (uLedCode != 0xFF)
+            if (uLedCode != 0xFF && nEvents < LED_CNT)
             {
-                if (uShortPendingLedValue != 0xFF)
-                {
-                    // send the pending LED change to the host
-                    status = HIDKeyboardSendStatus(pContext, EV_LED, uPendingLedCode,
-                                                   uShortPendingLedValue, NULL);
-                    if (!NT_SUCCESS(status))
-                    {
-                        return status;
-                    }
-                }
-                uPendingLedCode = uLedCode;
-                uShortPendingLedValue = !!(pReport[i] & (1 << uValue));
+                Events[nEvents].type = EV_LED;
+                Events[nEvents].code = uLedCode;
+                Events[nEvents].value = !!(pReport[i] & (1 << uValue));
+                nEvents++;
             }
         }
     }
 
-    // send the last pending LED change; this one will complete the request
-    if (uShortPendingLedValue != 0xFF)
+    // send all LED changes to the host at once; the last one will complete
+    // the request
+    if (nEvents > 0)
     {
-        status = HIDKeyboardSendStatus(pContext, EV_LED, uPendingLedCode,
-                                       uShortPendingLedValue, Request);
+        status = VIOInputSendStatus(pContext, Events, nEvents, Request);
     }
 
     if (NT_SUCCESS(status))
@@ -320,7 +278,7 @@ HIDKeyboardReportToEvent(
         RtlCopyMemory(pKeyboardDesc->pLastOutputReport, pReport,
                       pKeyboardDesc->cbOutputReport);
     }
-    if (uShortPendingLedValue == 0xFF)
+    if (nEvents == 0)
     {
         // nothing was sent up, complete the request now
         WdfRequestComplete(Request, status);
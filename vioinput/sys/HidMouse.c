@@ -47,6 +47,9 @@ typedef struct _tagInputClassMouse
     SIZE_T cbAxisLen;
     // mapping from EVDEV axis codes to HID axis offsets
     PULONG pAxisMap;
+    // the same mapping indexed by EVDEV codes, (ULONG)-1 if not mapped
+    ULONG  RelAxisMap[REL_CNT];
+    ULONG  AbsAxisMap[ABS_CNT];
     // flags
 #define CLASS_MOUSE_HAS_V_WHEEL         0x01
 #define CLASS_MOUSE_HAS_H_WHEEL         0x02
@@ -64,6 +67,7 @@ HIDMouseEventToReport(
     PUCHAR pReport = pClass->pHidReport;
     PINPUT_CLASS_MOUSE pMouseDesc = (PINPUT_CLASS_MOUSE)pClass;
     PULONG pMap;
+    ULONG uOffset;
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_INIT, "--> %s\n", __FUNCTION__);
 
@@ -72,31 +76,24 @@ HIDMouseEventToReport(
     {
 #ifdef EXPOSE_ABS_AXES_WITH_BUTTONS_AS_MOUSE
     case EV_ABS:
+        uOffset = (pEvent->code < ABS_CNT ? pMouseDesc->AbsAxisMap[pEvent->code] : (ULONG)-1);
+        if (uOffset != (ULONG)-1)
+        {
+            // 2 bytes per absolute axis
+            PUSHORT pAxisPtr = (PUSHORT)&pReport[pMouseDesc->cbAxisOffset + uOffset];
+            *pAxisPtr = (USHORT)pEvent->value;
+            pClass->bDirty = TRUE;
+        }
+        break;
 #endif // EXPOSE_ABS_AXES_WITH_BUTTONS_AS_MOUSE
+
     case EV_REL:
-        if (pMouseDesc->pAxisMap)
+        // axis map handles regular relative axes as well as wheels
+        uOffset = (pEvent->code < REL_CNT ? pMouseDesc->RelAxisMap[pEvent->code] : (ULONG)-1);
+        if (uOffset != (ULONG)-1)
         {
-            for (pMap = pMouseDesc->pAxisMap; pMap[0] != (ULONG)-1; pMap += 2)
-            {
-                // axis map handles regular relative axes as well as wheels
-                if (pMap[0] == ((pEvent->type << 16) | pEvent->code))
-                {
-#ifdef EXPOSE_ABS_AXES_WITH_BUTTONS_AS_MOUSE
-                    if (pEvent->type == EV_ABS)
-                    {
-                        // 2 bytes per absolute axis
-                        PUSHORT pAxisPtr = (PUSHORT)&pReport[pMouseDesc->cbAxisOffset + pMap[1]];
-                        *pAxisPtr = (USHORT)pEvent->value;
-                    }
-                    else
-#endif // EXPOSE_ABS_AXES_WITH_BUTTONS_AS_MOUSE
-                    {
-                        pReport[pMouseDesc->cbAxisOffset + pMap[1]] = (UCHAR)pEvent->value;
-                    }
-                    pClass->bDirty = TRUE;
-                    break;
-                }
-            }
+            pReport[pMouseDesc->cbAxisOffset + uOffset] = (UCHAR)pEvent->value;
+            pClass->bDirty = TRUE;
         }
         break;
 
@@ -153,6 +150,62 @@ HIDMouseEventToReport(
     return STATUS_SUCCESS;
 }
 
+static UCHAR
+HIDMouseAddRelative(
+    UCHAR uOlder,
+    UCHAR uNewer)
+{
+    LONG lSum = (LONG)(CHAR)uOlder + (LONG)(CHAR)uNewer;
+    return (UCHAR)(CHAR)max(-127, min(127, lSum));
+}
+
+static BOOLEAN
+HIDMouseCoalesceReport(
+    PINPUT_CLASS_COMMON pClass,
+    PUCHAR pOlder,
+    PUCHAR pNewer)
+{
+    PINPUT_CLASS_MOUSE pMouseDesc = (PINPUT_CLASS_MOUSE)pClass;
+    SIZE_T cbWheelOffset = pMouseDesc->cbAxisOffset + pMouseDesc->cbAxisLen;
+    SIZE_T cbOffset;
+    PULONG pMap;
+
+    // merging would lose a button press or release
+    if (RtlCompareMemory(pOlder + HID_REPORT_DATA_OFFSET,
+                         pNewer + HID_REPORT_DATA_OFFSET,
+                         pMouseDesc->cbAxisOffset - HID_REPORT_DATA_OFFSET) !=
+        pMouseDesc->cbAxisOffset - HID_REPORT_DATA_OFFSET)
+    {
+        return FALSE;
+    }
+
+    // relative axes add up, absolute axes take the newer value
+    for (pMap = pMouseDesc->pAxisMap; pMap[0] != (ULONG)-1; pMap += 2)
+    {
+        cbOffset = pMouseDesc->cbAxisOffset + pMap[1];
+        if (cbOffset >= cbWheelOffset)
+        {
+            // wheels are handled below
+            continue;
+        }
+        if ((pMap[0] >> 16) == EV_REL)
+        {
+            pOlder[cbOffset] = HIDMouseAddRelative(pOlder[cbOffset], pNewer[cbOffset]);
+        }
+        else
+        {
+            RtlCopyMemory(&pOlder[cbOffset], &pNewer[cbOffset], sizeof(USHORT));
+        }
+    }
+
+    // wheels are relative
+    for (cbOffset = cbWheelOffset; cbOffset < pClass->cbHidReportSize; cbOffset++)
+    {
+        pOlder[cbOffset] = HIDMouseAddRelative(pOlder[cbOffset], pNewer[cbOffset]);
+    }
+    return TRUE;
+}
+
 static VOID
 HIDMouseCleanup(
     PINPUT_CLASS_COMMON pClass)
@@ -175,6 +228,31 @@ HIDMouseAxisMapAppend(
     DynamicArrayAppend(pAxisMap, &uAxisIndex, sizeof(ULONG));
 }
 
+static VOID
+HIDMouseIndexAxisMap(
+    PINPUT_CLASS_MOUSE pMouseDesc)
+{
+    PULONG pMap;
+    ULONG uType, uCode;
+
+    RtlFillMemory(pMouseDesc->RelAxisMap, sizeof(pMouseDesc->RelAxisMap), 0xFF);
+    RtlFillMemory(pMouseDesc->AbsAxisMap, sizeof(pMouseDesc->AbsAxisMap), 0xFF);
+
+    for (pMap = pMouseDesc->pAxisMap; pMap[0] != (ULONG)-1; pMap += 2)
+    {
+        uType = pMap[0] >> 16;
+        uCode = pMap[0] & 0xFFFF;
+        if (uType == EV_REL && uCode < REL_CNT)
+        {
+            pMouseDesc->RelAxisMap[uCode] = pMap[1];
+        }
+        else if (uType == EV_ABS && uCode < ABS_CNT)
+        {
+            pMouseDesc->AbsAxisMap[uCode] = pMap[1];
+        }
+    }
+}
+
 static VOID
 HIDMouseDescribeWheel(
     PDYNAMIC_ARRAY pHidDesc,
@@ -241,6 +319,7 @@ HIDMouseProbe(
     }
     pMouseDesc->Common.EventToReportFunc = HIDMouseEventToReport;
     pMouseDesc->Common.CleanupFunc = HIDMouseCleanup;
+    pMouseDesc->Common.CoalesceReportFunc = HIDMouseCoalesceReport;
     pMouseDesc->Common.uReportID = (UCHAR)(pContext->uNumOfClasses + 1);
 
     HIDAppend2(pHidDesc, HID_TAG_USAGE_PAGE, HID_USAGE_PAGE_GENERIC);
@@ -418,9 +497,10 @@ HIDMouseProbe(
     }
 #endif // EXPOSE_ABS_AXES_WITH_BUTTONS_AS_MOUSE
 
-    if (uNumOfRelAxes == 0 && uNumOfAbsAxes == 0)
+    if (uNumOfRelAxes == 0 && uNumOfAbsAxes == 0 &&
+        !(pMouseDesc->uFlags & (CLASS_MOUSE_HAS_V_WHEEL | CLASS_MOUSE_HAS_H_WHEEL)))
     {
-        // this is not a mouse
+        // this is not a mouse, a wheel alone makes one though
         TraceEvents(TRACE_LEVEL_INFORMATION, DBG_INIT, "No mouse axis found\n");
         VIOInputFree(&pMouseDesc);
         pHidDesc->Size = cbInitialHidSize;
@@ -459,6 +539,7 @@ HIDMouseProbe(
         status = STATUS_INSUFFICIENT_RESOURCES;
         goto Exit;
     }
+    HIDMouseIndexAxisMap(pMouseDesc);
 
     if (pMouseDesc->uFlags & CLASS_MOUSE_HAS_V_WHEEL)
     {
@@ -153,7 +153,7 @@ HIDTabletProbe(
     for (i = 0; i < pButtons->size; i++)
     {
         UCHAR uNonButtons = 0;
-        while (DecodeNextBit(&pAxes->u.bitmap[i], &uValue))
+        while (DecodeNextBit(&pButtons->u.bitmap[i], &uValue))
         {
             USHORT uAxisCode = uValue + 8 * i;
             // a few hard-coded buttons we understand
@@ -168,7 +168,7 @@ HIDTabletProbe(
                 uNonButtons |= (1 << uValue);
             }
         }
-        pAxes->u.bitmap[i] = uNonButtons;
+        pButtons->u.bitmap[i] = uNonButtons;
     }
 
     // allocate and initialize pTabletDesc
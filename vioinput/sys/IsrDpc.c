@@ -119,6 +119,33 @@ VIOInputInterruptIsr(
     return serviced;
 }
 
+static
+VOID
+VIOInputUpdateEventStats(PINPUT_DEVICE pContext)
+{
+    ULONG64 now = KeQueryInterruptTime();
+    ULONG64 elapsed = now - pContext->uEventStatsTime;
+
+    // interrupt time is in 100ns units
+    if (elapsed < 10000000)
+    {
+        return;
+    }
+
+    pContext->uEventsPerSec = (ULONG)((pContext->uEventsReceived -
+        pContext->uEventStatsEvents) * 10000000 / elapsed);
+    pContext->uKicksPerSec = (ULONG)((pContext->uEventQKicks -
+        pContext->uEventStatsKicks) * 10000000 / elapsed);
+
+    pContext->uEventStatsTime = now;
+    pContext->uEventStatsEvents = pContext->uEventsReceived;
+    pContext->uEventStatsKicks = pContext->uEventQKicks;
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_DPC,
+        "Event queue: %u events/s, %u kicks/s\n",
+        pContext->uEventsPerSec, pContext->uKicksPerSec);
+}
+
 VOID
 VIOInputQueuesInterruptDpc(
     IN WDFINTERRUPT Interrupt,
@@ -129,6 +156,7 @@ VIOInputQueuesInterruptDpc(
     PVIRTIO_INPUT_EVENT pEvent;
     PVIRTIO_INPUT_EVENT_WITH_REQUEST pEventReq;
     UINT len;
+    bool notify;
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_DPC, "--> %s\n", __FUNCTION__);
 
@@ -139,10 +167,24 @@ VIOInputQueuesInterruptDpc(
         ProcessInputEvent(pContext, pEvent);
 
         // add the buffer back to the queue
-        VIOInputAddInBuf(pContext->EventQ, pEvent);
+        VIOInputAddEventBuf(pContext, pEvent);
+        pContext->uEventsReceived++;
     }
+
+    // one kick for all the buffers added back
+    notify = virtqueue_kick_prepare(pContext->EventQ);
+    if (notify)
+    {
+        pContext->uEventQKicks++;
+    }
+    VIOInputUpdateEventStats(pContext);
     WdfSpinLockRelease(pContext->EventQLock);
 
+    if (notify)
+    {
+        virtqueue_notify(pContext->EventQ);
+    }
+
     WdfSpinLockAcquire(pContext->StatusQLock);
     while ((pEventReq = virtqueue_get_buf(pContext->StatusQ, &len)) != NULL)
     {
@@ -152,8 +194,8 @@ VIOInputQueuesInterruptDpc(
             WdfRequestComplete(pEventReq->Request, STATUS_SUCCESS);
         }
 
-        // free the buffer
-        ExFreePoolWithTag(pEventReq, VIOINPUT_DRIVER_MEMORY_TAG);
+        // return the buffer to the pool
+        PushEntryList(&pContext->StatusFreeList, &pEventReq->ListEntry);
     }
     WdfSpinLockRelease(pContext->StatusQLock);
 
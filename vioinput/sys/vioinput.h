@@ -67,7 +67,21 @@ typedef struct _tagInputClassCommon
     // the HID report is dirty and should be sent up
     BOOLEAN bDirty;
 
+// number of completed reports kept while no read request is pending
+#define HID_REPORT_FIFO_LENGTH 16
+
+    // completed HID reports waiting for read requests, protected by EventQLock
+    PUCHAR pReportFifo;
+    ULONG uFifoHead;
+    ULONG uFifoCount;
+    // reports discarded or merged into a queued one because the FIFO was full
+    ULONG64 uReportsDropped;
+    ULONG64 uReportsCoalesced;
+
     NTSTATUS(*EventToReportFunc)(struct _tagInputClassCommon *pClass, PVIRTIO_INPUT_EVENT pEvent);
+    // optional, merges the newer report into the older one; FALSE if they
+    // can't be merged without losing state changes
+    BOOLEAN(*CoalesceReportFunc)(struct _tagInputClassCommon *pClass, PUCHAR pOlder, PUCHAR pNewer);
     NTSTATUS(*ReportToEventFunc)(struct _tagInputClassCommon *pClass, struct _tagInputDevice *pContext,
                                  WDFREQUEST Request, PUCHAR pReport, ULONG cbReport);
     VOID(*CleanupFunc)(struct _tagInputClassCommon *pClass);
@@ -76,6 +90,21 @@ typedef struct _tagInputClassCommon
 
 #define MAX_INPUT_CLASS_COUNT 5
 
+// event code ranges covered by the dispatch table
+#define KEY_CNT       0x300
+#define REL_CNT       0x10
+#define ABS_CNT       0x40
+
+// no class handles the event code
+#define INPUT_CLASS_NONE 0xFF
+
+// The event queue buffers are slots of a single page, so their physical
+// addresses are computed from the page address.
+#define VIOINPUT_EVENT_RING_SIZE (PAGE_SIZE / sizeof(VIRTIO_INPUT_EVENT))
+
+// The status queue buffers are preallocated the same way.
+#define VIOINPUT_STATUS_POOL_SIZE (PAGE_SIZE / sizeof(struct virtio_input_event_with_request))
+
 typedef struct _tagInputDevice
 {
     VIRTIO_WDF_DRIVER      VDevice;
@@ -88,6 +117,24 @@ typedef struct _tagInputDevice
     WDFSPINLOCK            EventQLock;
     WDFSPINLOCK            StatusQLock;
 
+    // event queue buffers
+    PVIRTIO_INPUT_EVENT    EventRing;
+    PHYSICAL_ADDRESS       EventRingPA;
+
+    // status queue buffers, the free list is protected by StatusQLock
+    struct virtio_input_event_with_request *StatusPool;
+    PHYSICAL_ADDRESS       StatusPoolPA;
+    SINGLE_LIST_ENTRY      StatusFreeList;
+
+    // event queue statistics, the rates are updated once a second
+    ULONG64                uEventsReceived;
+    ULONG64                uEventQKicks;
+    ULONG64                uEventStatsTime;
+    ULONG64                uEventStatsEvents;
+    ULONG64                uEventStatsKicks;
+    ULONG                  uEventsPerSec;
+    ULONG                  uKicksPerSec;
+
     WDFQUEUE               IoctlQueue;
     WDFQUEUE               HidQueue;
 
@@ -99,6 +146,12 @@ typedef struct _tagInputDevice
     // for one device class (e.g. mouse)
     PINPUT_CLASS_COMMON    InputClasses[MAX_INPUT_CLASS_COUNT];
     ULONG                  uNumOfClasses;
+
+    // index of the class handling each event code, built along with the
+    // HID report descriptor
+    UCHAR                  KeyClassMap[KEY_CNT];
+    UCHAR                  RelClassMap[REL_CNT];
+    UCHAR                  AbsClassMap[ABS_CNT];
 } INPUT_DEVICE, *PINPUT_DEVICE;
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(INPUT_DEVICE, GetDeviceContext)
@@ -162,6 +215,7 @@ typedef struct virtio_input_event_with_request
 {
     VIRTIO_INPUT_EVENT Event;
     WDFREQUEST Request;
+    SINGLE_LIST_ENTRY ListEntry;
 } VIRTIO_INPUT_EVENT_WITH_REQUEST, *PVIRTIO_INPUT_EVENT_WITH_REQUEST;
 
 // Event types
@@ -234,23 +288,25 @@ typedef struct virtio_input_event_with_request
 #define LED_MISC      0x08
 #define LED_MAIL      0x09
 #define LED_CHARGING  0x0a
+#define LED_CNT       0x10
 
 NTSTATUS
 VIOInputFillQueue(
-    IN struct virtqueue *vq,
-    IN WDFSPINLOCK Lock
+    IN PINPUT_DEVICE pContext
 );
 
 NTSTATUS
-VIOInputAddInBuf(
-    IN struct virtqueue *vq,
+VIOInputAddEventBuf(
+    IN PINPUT_DEVICE pContext,
     IN PVIRTIO_INPUT_EVENT buf
 );
 
 NTSTATUS
-VIOInputAddOutBuf(
-    IN struct virtqueue *vq,
-    IN PVIRTIO_INPUT_EVENT buf
+VIOInputSendStatus(
+    IN PINPUT_DEVICE pContext,
+    IN PVIRTIO_INPUT_EVENT pEvents,
+    IN ULONG nEvents,
+    IN WDFREQUEST Request
 );
 
 NTSTATUS
@@ -273,6 +329,13 @@ ProcessInputEvent(
     PVIRTIO_INPUT_EVENT pEvent
 );
 
+BOOLEAN
+ReportFifoRead(
+    PINPUT_DEVICE pContext,
+    WDFREQUEST Request,
+    NTSTATUS *pStatus
+);
+
 NTSTATUS
 ProcessOutputReport(
     PINPUT_DEVICE pContext,
@@ -0,0 +1,371 @@
+/**********************************************************************
+ * Copyright (c) 2016 Red Hat, Inc.
+ *
+ * File: replay.c
+ *
+ * Replays evdev event streams through the vioinput HID translation layer
+ * and checks the HID reports it produces. Each case describes the event
+ * codes the emulated host device advertises in its config space, so the
+ * report descriptor and the event routing are built exactly as on a real
+ * device.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#include <stdlib.h>
+
+#include "vioinput.h"
+#include "replay.h"
+
+// evdev codes not needed by the driver itself
+#define SYN_REPORT    0x00
+#define KEY_A         30
+#define KEY_B         48
+#define KEY_LEFTSHIFT 42
+#define KEY_MUTE      113
+#define BTN_TRIGGER   0x120
+#define BTN_THUMB     0x121
+
+// terminates code lists
+#define CODE_END      0xFFFF
+
+#define MAX_REPORT_SIZE  16
+#define MAX_REPORT_COUNT 16
+
+typedef struct _tagReplayEvent
+{
+    USHORT type;
+    USHORT code;
+    LONG   value;
+} REPLAY_EVENT, *PREPLAY_EVENT;
+
+typedef struct _tagReplayReport
+{
+    SIZE_T cbSize;
+    UCHAR  Data[MAX_REPORT_SIZE];
+} REPLAY_REPORT, *PREPLAY_REPORT;
+
+typedef struct _tagReplayCase
+{
+    const char *Name;
+
+    // event codes advertised by the host device
+    USHORT Keys[8];
+    USHORT Rels[8];
+    USHORT Abs[8];
+
+    // evdev stream and the HID reports it must produce
+    REPLAY_EVENT Events[16];
+    REPLAY_REPORT Reports[MAX_REPORT_COUNT];
+} REPLAY_CASE, *PREPLAY_CASE;
+
+#define SYN { EV_SYN, SYN_REPORT, 0 }
+#define EVENTS_END { 0xFFFF, 0, 0 }
+
+static const REPLAY_CASE Cases[] =
+{
+    {
+        "relative mouse",
+        { BTN_LEFT, BTN_RIGHT, BTN_MIDDLE, CODE_END },
+        { REL_X, REL_Y, REL_WHEEL, CODE_END },
+        { CODE_END },
+        {
+            { EV_REL, REL_X, 5 }, { EV_REL, REL_Y, -3 }, SYN,
+            { EV_KEY, BTN_LEFT, 1 }, SYN,
+            { EV_REL, REL_WHEEL, -1 }, SYN,
+            { EV_KEY, BTN_LEFT, 0 }, SYN,
+            EVENTS_END
+        },
+        {
+            // id, buttons, x, y, wheel
+            { 5, { 0x01, 0x00, 0x05, 0xFD, 0x00 } },
+            { 5, { 0x01, 0x01, 0x00, 0x00, 0x00 } },
+            { 5, { 0x01, 0x01, 0x00, 0x00, 0xFF } },
+            { 5, { 0x01, 0x00, 0x00, 0x00, 0x00 } },
+        }
+    },
+    {
+        "absolute tablet",
+        { BTN_LEFT, BTN_RIGHT, BTN_MIDDLE, CODE_END },
+        { REL_WHEEL, CODE_END },
+        { ABS_X, ABS_Y, CODE_END },
+        {
+            { EV_ABS, ABS_X, 0x1234 }, { EV_ABS, ABS_Y, 0x0567 }, SYN,
+            { EV_KEY, BTN_RIGHT, 1 }, { EV_REL, REL_WHEEL, 1 }, SYN,
+            { EV_KEY, BTN_RIGHT, 0 }, SYN,
+            EVENTS_END
+        },
+        {
+            // id, buttons, x, y, wheel
+            { 7, { 0x01, 0x00, 0x34, 0x12, 0x67, 0x05, 0x00 } },
+            { 7, { 0x01, 0x02, 0x34, 0x12, 0x67, 0x05, 0x01 } },
+            { 7, { 0x01, 0x00, 0x34, 0x12, 0x67, 0x05, 0x00 } },
+        }
+    },
+    {
+        // the wheel alone makes a mouse, the buttons must not be dropped
+        "buttons with only a wheel",
+        { BTN_LEFT, BTN_RIGHT, CODE_END },
+        { REL_WHEEL, CODE_END },
+        { CODE_END },
+        {
+            { EV_KEY, BTN_LEFT, 1 }, SYN,
+            { EV_REL, REL_WHEEL, -1 }, SYN,
+            { EV_KEY, BTN_LEFT, 0 }, SYN,
+            EVENTS_END
+        },
+        {
+            // id, buttons, wheel
+            { 3, { 0x01, 0x01, 0x00 } },
+            { 3, { 0x01, 0x01, 0xFF } },
+            { 3, { 0x01, 0x00, 0x00 } },
+        }
+    },
+    {
+        // the mouse probe looks at the axes first and registers nothing
+        "joystick",
+        { BTN_TRIGGER, BTN_THUMB, CODE_END },
+        { CODE_END },
+        { ABS_X, ABS_Y, CODE_END },
+        {
+            { EV_ABS, ABS_X, 100 }, { EV_ABS, ABS_Y, 0x7FFF }, SYN,
+            { EV_KEY, BTN_THUMB, 1 }, SYN,
+            EVENTS_END
+        },
+        {
+            // id, x, y, buttons
+            { 10, { 0x01, 0x64, 0x00, 0x00, 0x00, 0xFF, 0x7F, 0x00, 0x00, 0x00 } },
+            { 10, { 0x01, 0x64, 0x00, 0x00, 0x00, 0xFF, 0x7F, 0x00, 0x00, 0x02 } },
+        }
+    },
+    {
+        "keyboard and consumer controls",
+        { KEY_A, KEY_LEFTSHIFT, KEY_MUTE, CODE_END },
+        { CODE_END },
+        { CODE_END },
+        {
+            { EV_KEY, KEY_LEFTSHIFT, 1 }, { EV_KEY, KEY_A, 1 }, SYN,
+            { EV_KEY, KEY_MUTE, 1 }, SYN,
+            { EV_KEY, KEY_A, 0 }, { EV_KEY, KEY_LEFTSHIFT, 0 }, { EV_KEY, KEY_MUTE, 0 }, SYN,
+            EVENTS_END
+        },
+        {
+            // id, modifiers, padding, key array
+            { 9, { 0x01, 0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+            // id, controls
+            { 2, { 0x02, 0x01 } },
+            { 9, { 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+            { 2, { 0x02, 0x00 } },
+        }
+    },
+    {
+        // events go to the class owning the code only, codes the device
+        // did not advertise are dropped
+        "mouse and keyboard on one device",
+        { KEY_A, BTN_LEFT, CODE_END },
+        { REL_X, REL_Y, CODE_END },
+        { CODE_END },
+        {
+            { EV_KEY, KEY_A, 1 }, { EV_KEY, BTN_LEFT, 1 }, { EV_REL, REL_X, 1 }, SYN,
+            { EV_KEY, KEY_B, 1 }, { EV_REL, REL_HWHEEL, 1 }, { EV_ABS, ABS_X, 5 }, SYN,
+            { EV_KEY, KEY_A, 0 }, SYN,
+            EVENTS_END
+        },
+        {
+            // id, buttons, x, y
+            { 4, { 0x01, 0x01, 0x01, 0x00 } },
+            { 9, { 0x02, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+            { 9, { 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+        }
+    },
+};
+
+// the emulated config space of the host device
+static struct virtio_input_config HostConfig;
+
+// HID reports completed while replaying the current case
+static REPLAY_REPORT Completed[MAX_REPORT_COUNT];
+static ULONG uNumOfCompleted;
+
+VOID ReplayReportCompleted(PUCHAR pReport, SIZE_T cbReport)
+{
+    if (uNumOfCompleted < MAX_REPORT_COUNT)
+    {
+        PREPLAY_REPORT pCompleted = &Completed[uNumOfCompleted];
+        pCompleted->cbSize = cbReport;
+        RtlCopyMemory(pCompleted->Data, pReport, min(cbReport, MAX_REPORT_SIZE));
+    }
+    uNumOfCompleted++;
+}
+
+static VOID HostSetBits(const USHORT *pCodes)
+{
+    for (; *pCodes != CODE_END; pCodes++)
+    {
+        HostConfig.u.bitmap[*pCodes / 8] |= 1 << (*pCodes % 8);
+        HostConfig.size = max(HostConfig.size, (UCHAR)(*pCodes / 8 + 1));
+    }
+}
+
+static BOOLEAN HostHasCode(const USHORT *pCodes, USHORT uCode)
+{
+    for (; *pCodes != CODE_END; pCodes++)
+    {
+        if (*pCodes == uCode)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// fills the config space for the current select/subsel pair
+static VOID HostSelect(const REPLAY_CASE *pCase)
+{
+    HostConfig.size = 0;
+    RtlZeroMemory(&HostConfig.u, sizeof(HostConfig.u));
+
+    switch (HostConfig.select)
+    {
+    case VIRTIO_INPUT_CFG_EV_BITS:
+        switch (HostConfig.subsel)
+        {
+        case EV_KEY: HostSetBits(pCase->Keys); break;
+        case EV_REL: HostSetBits(pCase->Rels); break;
+        case EV_ABS: HostSetBits(pCase->Abs); break;
+        }
+        break;
+    case VIRTIO_INPUT_CFG_ABS_INFO:
+        if (HostHasCode(pCase->Abs, HostConfig.subsel))
+        {
+            HostConfig.u.abs.min = 0;
+            HostConfig.u.abs.max = 0x7FFF;
+            HostConfig.size = sizeof(HostConfig.u.abs);
+        }
+        break;
+    }
+}
+
+void VirtIOWdfDeviceGet(PVIRTIO_WDF_DRIVER pWdfDriver, ULONG offset, PVOID buf, ULONG len)
+{
+    UNREFERENCED_PARAMETER(pWdfDriver);
+    RtlCopyMemory(buf, (PUCHAR)&HostConfig + offset, len);
+}
+
+void VirtIOWdfDeviceSet(PVIRTIO_WDF_DRIVER pWdfDriver, ULONG offset, CONST PVOID buf, ULONG len)
+{
+    RtlCopyMemory((PUCHAR)&HostConfig + offset, buf, len);
+    HostSelect(pWdfDriver->pHostDevice);
+}
+
+static VOID DumpReport(const char *szPrefix, PUCHAR pData, SIZE_T cbSize)
+{
+    SIZE_T i;
+
+    printf("    %s:", szPrefix);
+    for (i = 0; i < cbSize && i < MAX_REPORT_SIZE; i++)
+    {
+        printf(" %02x", pData[i]);
+    }
+    printf("\n");
+}
+
+static BOOLEAN RunCase(const REPLAY_CASE *pCase)
+{
+    PINPUT_DEVICE pContext;
+    VIRTIO_INPUT_EVENT Event;
+    NTSTATUS status;
+    BOOLEAN bPassed = TRUE;
+    ULONG i, uNumOfExpected;
+
+    pContext = VIOInputAlloc(sizeof(INPUT_DEVICE));
+    if (pContext == NULL)
+    {
+        printf("FAIL %s: out of memory\n", pCase->Name);
+        return FALSE;
+    }
+    pContext->VDevice.pHostDevice = (PVOID)pCase;
+    uNumOfCompleted = 0;
+
+    status = VIOInputBuildReportDescriptor(pContext);
+    if (!NT_SUCCESS(status))
+    {
+        printf("FAIL %s: VIOInputBuildReportDescriptor failed with 0x%x\n", pCase->Name, status);
+        bPassed = FALSE;
+        goto Exit;
+    }
+
+    for (i = 0; pCase->Events[i].type != 0xFFFF; i++)
+    {
+        Event.type = pCase->Events[i].type;
+        Event.code = pCase->Events[i].code;
+        Event.value = (unsigned long)pCase->Events[i].value;
+        ProcessInputEvent(pContext, &Event);
+    }
+
+    for (uNumOfExpected = 0; uNumOfExpected < MAX_REPORT_COUNT; uNumOfExpected++)
+    {
+        if (pCase->Reports[uNumOfExpected].cbSize == 0)
+        {
+            break;
+        }
+    }
+    if (uNumOfCompleted != uNumOfExpected)
+    {
+        printf("FAIL %s: got %u reports, expected %u\n", pCase->Name, uNumOfCompleted, uNumOfExpected);
+        bPassed = FALSE;
+    }
+    for (i = 0; i < min(uNumOfCompleted, uNumOfExpected); i++)
+    {
+        const REPLAY_REPORT *pExpected = &pCase->Reports[i];
+        if (Completed[i].cbSize != pExpected->cbSize ||
+            memcmp(Completed[i].Data, pExpected->Data, pExpected->cbSize) != 0)
+        {
+            printf("FAIL %s: report %u differs\n", pCase->Name, i);
+            DumpReport("got     ", Completed[i].Data, Completed[i].cbSize);
+            DumpReport("expected", (PUCHAR)pExpected->Data, pExpected->cbSize);
+            bPassed = FALSE;
+        }
+    }
+
+Exit:
+    for (i = 0; i < pContext->uNumOfClasses; i++)
+    {
+        PINPUT_CLASS_COMMON pClass = pContext->InputClasses[i];
+        if (pClass->CleanupFunc)
+        {
+            pClass->CleanupFunc(pClass);
+        }
+        VIOInputFree(&pClass->pHidReport);
+        VIOInputFree(&pClass->pReportFifo);
+        VIOInputFree(&pClass);
+    }
+    VIOInputFree(&pContext->HidReportDescriptor);
+    VIOInputFree(&pContext);
+
+    if (bPassed)
+    {
+        printf("PASS %s\n", pCase->Name);
+    }
+    return bPassed;
+}
+
+int main(int argc, char **argv)
+{
+    ULONG i, uFailed = 0;
+
+    UNREFERENCED_PARAMETER(argc);
+    UNREFERENCED_PARAMETER(argv);
+
+    for (i = 0; i < sizeof(Cases) / sizeof(Cases[0]); i++)
+    {
+        if (!RunCase(&Cases[i]))
+        {
+            uFailed++;
+        }
+    }
+
+    printf("%u of %u cases failed\n", uFailed, (ULONG)(sizeof(Cases) / sizeof(Cases[0])));
+    return uFailed ? 1 : 0;
+}
@@ -0,0 +1,15 @@
+/**********************************************************************
+ * Copyright (c) 2016 Red Hat, Inc.
+ *
+ * File: replay.h
+ *
+ * Interface between the WDF stubs and the evdev replay test.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#pragma once
+
+// called for every HID report completed to the pending read request
+VOID ReplayReportCompleted(PUCHAR pReport, SIZE_T cbReport);
@@ -0,0 +1,140 @@
+/**********************************************************************
+ * Copyright (c) 2016 Red Hat, Inc.
+ *
+ * File: wdkstub.c
+ *
+ * User mode implementation of the kernel and WDF routines called by the
+ * vioinput HID translation layer. Read requests are always pending, so
+ * every report the driver completes is handed to ReplayReportCompleted.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#include <stdlib.h>
+
+#include "vioinput.h"
+#include "replay.h"
+
+// the only read request, it's always pending
+static struct _WDFREQUEST
+{
+    UCHAR Buffer[64];
+} ReadRequest;
+
+PVOID ExAllocatePoolWithTag(POOL_TYPE PoolType, SIZE_T NumberOfBytes, ULONG Tag)
+{
+    UNREFERENCED_PARAMETER(PoolType);
+    UNREFERENCED_PARAMETER(Tag);
+    return malloc(NumberOfBytes);
+}
+
+VOID ExFreePoolWithTag(PVOID P, ULONG Tag)
+{
+    UNREFERENCED_PARAMETER(Tag);
+    free(P);
+}
+
+SIZE_T RtlCompareMemory(const VOID *Source1, const VOID *Source2, SIZE_T Length)
+{
+    SIZE_T i;
+    for (i = 0; i < Length; i++)
+    {
+        if (((const UCHAR *)Source1)[i] != ((const UCHAR *)Source2)[i])
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+WDFDEVICE WdfIoQueueGetDevice(WDFQUEUE Queue)
+{
+    UNREFERENCED_PARAMETER(Queue);
+    return NULL;
+}
+
+NTSTATUS WdfIoQueueRetrieveNextRequest(WDFQUEUE Queue, WDFREQUEST *OutRequest)
+{
+    UNREFERENCED_PARAMETER(Queue);
+    *OutRequest = &ReadRequest;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRequestForwardToIoQueue(WDFREQUEST Request, WDFQUEUE DestinationQueue)
+{
+    UNREFERENCED_PARAMETER(Request);
+    UNREFERENCED_PARAMETER(DestinationQueue);
+    return STATUS_SUCCESS;
+}
+
+VOID WdfRequestGetParameters(WDFREQUEST Request, PWDF_REQUEST_PARAMETERS Parameters)
+{
+    UNREFERENCED_PARAMETER(Request);
+    RtlZeroMemory(Parameters, sizeof(*Parameters));
+}
+
+PIRP WdfRequestWdmGetIrp(WDFREQUEST Request)
+{
+    UNREFERENCED_PARAMETER(Request);
+    return NULL;
+}
+
+VOID WdfRequestSetInformation(WDFREQUEST Request, SIZE_T Information)
+{
+    if (Request == &ReadRequest)
+    {
+        ReplayReportCompleted(ReadRequest.Buffer, Information);
+    }
+}
+
+VOID WdfRequestComplete(WDFREQUEST Request, NTSTATUS Status)
+{
+    UNREFERENCED_PARAMETER(Request);
+    UNREFERENCED_PARAMETER(Status);
+}
+
+NTSTATUS WdfRequestRetrieveOutputMemory(WDFREQUEST Request, WDFMEMORY *Memory)
+{
+    *Memory = (WDFMEMORY)Request;
+    return STATUS_SUCCESS;
+}
+
+PVOID WdfMemoryGetBuffer(WDFMEMORY Memory, SIZE_T *BufferSize)
+{
+    struct _WDFREQUEST *pRequest = (struct _WDFREQUEST *)Memory;
+    *BufferSize = sizeof(pRequest->Buffer);
+    return pRequest->Buffer;
+}
+
+NTSTATUS WdfMemoryCopyFromBuffer(WDFMEMORY DestinationMemory, SIZE_T DestinationOffset,
+                                 PVOID Buffer, SIZE_T NumBytesToCopyFrom)
+{
+    struct _WDFREQUEST *pRequest = (struct _WDFREQUEST *)DestinationMemory;
+    RtlCopyMemory(pRequest->Buffer + DestinationOffset, Buffer, NumBytesToCopyFrom);
+    return STATUS_SUCCESS;
+}
+
+VOID WdfSpinLockAcquire(WDFSPINLOCK SpinLock)
+{
+    UNREFERENCED_PARAMETER(SpinLock);
+}
+
+VOID WdfSpinLockRelease(WDFSPINLOCK SpinLock)
+{
+    UNREFERENCED_PARAMETER(SpinLock);
+}
+
+NTSTATUS
+VIOInputSendStatus(
+    IN PINPUT_DEVICE pContext,
+    IN PVIRTIO_INPUT_EVENT pEvents,
+    IN ULONG nEvents,
+    IN WDFREQUEST Request)
+{
+    UNREFERENCED_PARAMETER(pContext);
+    UNREFERENCED_PARAMETER(pEvents);
+    UNREFERENCED_PARAMETER(nEvents);
+    UNREFERENCED_PARAMETER(Request);
+    return STATUS_SUCCESS;
+}
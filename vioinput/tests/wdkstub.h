@@ -0,0 +1,271 @@
+/**********************************************************************
+ * Copyright (c) 2016 Red Hat, Inc.
+ *
+ * File: wdkstub.h
+ *
+ * Minimal subset of the WDK and WDF headers needed to build the vioinput
+ * HID translation layer (Hid*.c, Array.c, KeyMap.c) as a Linux program.
+ * It is force-included ahead of the driver sources; the WDK headers and
+ * WPP .tmh files they include resolve to empty files generated by the
+ * Makefile.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// basic types
+#define VOID void
+#define CONST const
+#define IN
+#define OUT
+typedef char CHAR;
+typedef unsigned char UCHAR, *PUCHAR;
+typedef int16_t SHORT;
+typedef uint16_t USHORT, *PUSHORT;
+typedef int32_t LONG;
+typedef uint32_t ULONG, *PULONG;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONG64;
+typedef size_t SIZE_T;
+typedef void *PVOID;
+typedef UCHAR BOOLEAN;
+typedef LONG NTSTATUS;
+typedef uint8_t u8;
+
+typedef union _LARGE_INTEGER
+{
+    LONGLONG QuadPart;
+} PHYSICAL_ADDRESS;
+
+typedef struct _SINGLE_LIST_ENTRY
+{
+    struct _SINGLE_LIST_ENTRY *Next;
+} SINGLE_LIST_ENTRY;
+
+#define TRUE  1
+#define FALSE 0
+
+#define MINCHAR  0x80
+#define MAXUCHAR 0xff
+#define MAXCHAR  0x7f
+#define MINSHORT 0x8000
+#define MAXSHORT 0x7fff
+
+#define PAGE_SIZE 0x1000
+
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+#define UNREFERENCED_PARAMETER(P) (void)(P)
+#define ASSERT(exp) ((void)0)
+#define sprintf_s snprintf
+
+// status codes
+#define NT_SUCCESS(Status) (((NTSTATUS)(Status)) >= 0)
+#define STATUS_SUCCESS                ((NTSTATUS)0x00000000L)
+#define STATUS_NOT_IMPLEMENTED        ((NTSTATUS)0xC0000002L)
+#define STATUS_INVALID_PARAMETER      ((NTSTATUS)0xC000000DL)
+#define STATUS_BUFFER_TOO_SMALL       ((NTSTATUS)0xC0000023L)
+#define STATUS_INSUFFICIENT_RESOURCES ((NTSTATUS)0xC000009AL)
+#define STATUS_INVALID_BUFFER_SIZE    ((NTSTATUS)0xC0000206L)
+#define STATUS_NONE_MAPPED            ((NTSTATUS)0xC0000073L)
+
+// memory
+typedef enum _POOL_TYPE
+{
+    NonPagedPool,
+} POOL_TYPE;
+
+PVOID ExAllocatePoolWithTag(POOL_TYPE PoolType, SIZE_T NumberOfBytes, ULONG Tag);
+VOID ExFreePoolWithTag(PVOID P, ULONG Tag);
+
+#define RtlCopyMemory(Destination, Source, Length) memcpy((Destination), (Source), (Length))
+#define RtlCopyBytes RtlCopyMemory
+#define RtlFillMemory(Destination, Length, Fill) memset((Destination), (Fill), (Length))
+#define RtlZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+SIZE_T RtlCompareMemory(const VOID *Source1, const VOID *Source2, SIZE_T Length);
+
+static inline BOOLEAN BitScanForward(ULONG *Index, ULONG Mask)
+{
+    if (Mask == 0)
+    {
+        return FALSE;
+    }
+    *Index = (ULONG)__builtin_ctz(Mask);
+    return TRUE;
+}
+
+typedef struct _GUID
+{
+    ULONG  Data1;
+    USHORT Data2;
+    USHORT Data3;
+    UCHAR  Data4[8];
+} GUID;
+
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    extern const GUID name
+
+// the sources are built as with WPP tracing, the generated .tmh files are
+// empty and trace messages are dropped
+#define TraceEvents(level, flags, message, ...) ((void)0)
+
+// WDF objects are opaque handles
+typedef struct _WDFDEVICE *WDFDEVICE;
+typedef struct _WDFQUEUE *WDFQUEUE;
+typedef struct _WDFREQUEST *WDFREQUEST;
+typedef struct _WDFMEMORY *WDFMEMORY;
+typedef struct _WDFSPINLOCK *WDFSPINLOCK;
+typedef struct _WDFINTERRUPT *WDFINTERRUPT;
+
+typedef VOID EVT_WDF_DRIVER_DEVICE_ADD(VOID);
+typedef VOID EVT_WDF_INTERRUPT_ISR(VOID);
+typedef VOID EVT_WDF_INTERRUPT_DPC(VOID);
+typedef VOID EVT_WDF_INTERRUPT_ENABLE(VOID);
+typedef VOID EVT_WDF_INTERRUPT_DISABLE(VOID);
+
+// the device context is the device handle itself
+#define WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(_contexttype, _castingfunction) \
+static inline _contexttype *_castingfunction(WDFDEVICE Device)             \
+{                                                                          \
+    return (_contexttype *)Device;                                         \
+}
+
+typedef struct _WDF_REQUEST_PARAMETERS
+{
+    struct
+    {
+        struct
+        {
+            SIZE_T InputBufferLength;
+        } DeviceIoControl;
+    } Parameters;
+} WDF_REQUEST_PARAMETERS, *PWDF_REQUEST_PARAMETERS;
+
+#define WDF_REQUEST_PARAMETERS_INIT(Parameters) \
+    RtlZeroMemory((Parameters), sizeof(WDF_REQUEST_PARAMETERS))
+
+typedef struct _IRP
+{
+    PVOID UserBuffer;
+} IRP, *PIRP;
+
+WDFDEVICE WdfIoQueueGetDevice(WDFQUEUE Queue);
+NTSTATUS WdfIoQueueRetrieveNextRequest(WDFQUEUE Queue, WDFREQUEST *OutRequest);
+NTSTATUS WdfRequestForwardToIoQueue(WDFREQUEST Request, WDFQUEUE DestinationQueue);
+VOID WdfRequestGetParameters(WDFREQUEST Request, PWDF_REQUEST_PARAMETERS Parameters);
+PIRP WdfRequestWdmGetIrp(WDFREQUEST Request);
+VOID WdfRequestSetInformation(WDFREQUEST Request, SIZE_T Information);
+VOID WdfRequestComplete(WDFREQUEST Request, NTSTATUS Status);
+NTSTATUS WdfRequestRetrieveOutputMemory(WDFREQUEST Request, WDFMEMORY *Memory);
+PVOID WdfMemoryGetBuffer(WDFMEMORY Memory, SIZE_T *BufferSize);
+NTSTATUS WdfMemoryCopyFromBuffer(WDFMEMORY DestinationMemory, SIZE_T DestinationOffset,
+                                 PVOID Buffer, SIZE_T NumBytesToCopyFrom);
+VOID WdfSpinLockAcquire(WDFSPINLOCK SpinLock);
+VOID WdfSpinLockRelease(WDFSPINLOCK SpinLock);
+
+// virtio
+struct virtqueue;
+
+typedef struct virtio_wdf_driver
+{
+    // the emulated host device
+    PVOID pHostDevice;
+} VIRTIO_WDF_DRIVER, *PVIRTIO_WDF_DRIVER;
+
+void VirtIOWdfDeviceGet(PVIRTIO_WDF_DRIVER pWdfDriver, ULONG offset, PVOID buf, ULONG len);
+void VirtIOWdfDeviceSet(PVIRTIO_WDF_DRIVER pWdfDriver, ULONG offset, CONST PVOID buf, ULONG len);
+
+// HID class driver interface
+#pragma pack(push, 1)
+typedef struct _HID_DESCRIPTOR
+{
+    UCHAR  bLength;
+    UCHAR  bDescriptorType;
+    USHORT bcdHID;
+    UCHAR  bCountry;
+    UCHAR  bNumDescriptors;
+    struct _HID_DESCRIPTOR_DESC_LIST
+    {
+        UCHAR  bReportType;
+        USHORT wReportLength;
+    } DescriptorList[1];
+} HID_DESCRIPTOR, *PHID_DESCRIPTOR;
+#pragma pack(pop)
+
+typedef struct _HID_DEVICE_ATTRIBUTES
+{
+    ULONG  Size;
+    USHORT VendorID;
+    USHORT ProductID;
+    USHORT VersionNumber;
+    USHORT Reserved[11];
+} HID_DEVICE_ATTRIBUTES, *PHID_DEVICE_ATTRIBUTES;
+
+typedef struct _HID_XFER_PACKET
+{
+    PUCHAR reportBuffer;
+    ULONG  reportBufferLen;
+    UCHAR  reportId;
+} HID_XFER_PACKET, *PHID_XFER_PACKET;
+
+#define IOCTL_HID_GET_DEVICE_DESCRIPTOR 0x000B0003
+#define IOCTL_HID_GET_REPORT_DESCRIPTOR 0x000B0007
+#define IOCTL_HID_READ_REPORT           0x000B000B
+#define IOCTL_HID_WRITE_REPORT          0x000B000F
+#define IOCTL_HID_GET_DEVICE_ATTRIBUTES 0x000B0027
+
+// HID usages
+#define HID_USAGE_PAGE_GENERIC                  0x01
+#define HID_USAGE_PAGE_SIMULATION               0x02
+#define HID_USAGE_PAGE_KEYBOARD                 0x07
+#define HID_USAGE_PAGE_LED                      0x08
+#define HID_USAGE_PAGE_BUTTON                   0x09
+#define HID_USAGE_PAGE_CONSUMER                 0x0C
+#define HID_USAGE_PAGE_DIGITIZER                0x0D
+
+#define HID_USAGE_GENERIC_POINTER               0x01
+#define HID_USAGE_GENERIC_MOUSE                 0x02
+#define HID_USAGE_GENERIC_JOYSTICK              0x04
+#define HID_USAGE_GENERIC_KEYBOARD              0x06
+#define HID_USAGE_GENERIC_X                     0x30
+#define HID_USAGE_GENERIC_Y                     0x31
+#define HID_USAGE_GENERIC_Z                     0x32
+#define HID_USAGE_GENERIC_RX                    0x33
+#define HID_USAGE_GENERIC_RY                    0x34
+#define HID_USAGE_GENERIC_RZ                    0x35
+#define HID_USAGE_GENERIC_SLIDER                0x36
+#define HID_USAGE_GENERIC_WHEEL                 0x38
+#define HID_USAGE_GENERIC_VX                    0x40
+#define HID_USAGE_GENERIC_VY                    0x41
+#define HID_USAGE_GENERIC_RESOLUTION_MULTIPLIER 0x48
+
+#define HID_USAGE_SIMULATION_RUDDER             0xBA
+#define HID_USAGE_SIMULATION_THROTTLE           0xBB
+
+#define HID_USAGE_KEYBOARD_ROLLOVER             0x01
+
+#define HID_USAGE_LED_NUM_LOCK                  0x01
+#define HID_USAGE_LED_CAPS_LOCK                 0x02
+#define HID_USAGE_LED_SCROLL_LOCK               0x03
+#define HID_USAGE_LED_COMPOSE                   0x04
+#define HID_USAGE_LED_KANA                      0x05
+#define HID_USAGE_LED_MUTE                      0x09
+#define HID_USAGE_LED_MESSAGE_WAITING           0x19
+#define HID_USAGE_LED_STAND_BY                  0x27
+#define HID_USAGE_LED_GENERIC_INDICATOR         0x4B
+
+#define HID_USAGE_CONSUMERCTRL                  0x01
+#define HID_USAGE_CONSUMER_AC_PAN               0x238
+
+#define HID_USAGE_DIGITIZER_IN_RANGE            0x32
+#define HID_USAGE_DIGITIZER_TIP_SWITCH          0x42
+#define HID_USAGE_DIGITIZER_BARREL_SWITCH       0x44
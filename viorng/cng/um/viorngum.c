@@ -31,6 +31,7 @@
 #include <tchar.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "viorngum.h"
 #include <bcrypt_provider.h>
@@ -288,3 +289,106 @@ NTSTATUS WINAPI VirtRngGenRandom(IN OUT BCRYPT_ALG_HANDLE Algorithm,
 
     return status;
 }
+
+static VOID BenchmarkPrint(IN HANDLE Console, IN LPCSTR Format, ...)
+{
+    CHAR line[128];
+    DWORD written;
+    va_list args;
+    int length;
+
+    va_start(args, Format);
+    length = _vsnprintf_s(line, sizeof(line), _TRUNCATE, Format, args);
+    va_end(args);
+
+    if (length > 0)
+    {
+        WriteConsoleA(Console, line, (DWORD)length, &written, NULL);
+    }
+}
+
+// Measures the read throughput of the device for a range of request sizes.
+// Run as: rundll32 viorngum.dll,VirtRngBenchmark [seconds per size]
+VOID CALLBACK VirtRngBenchmark(IN HWND Window,
+                               IN HINSTANCE Instance,
+                               IN LPSTR CmdLine,
+                               IN int CmdShow)
+{
+    HANDLE devIface;
+    HANDLE console;
+    OVERLAPPED ovrlpd;
+    LARGE_INTEGER frequency, start, now;
+    ULONGLONG totalBytes;
+    DWORD bytesRead;
+    PUCHAR buffer;
+    ULONG seconds = 1;
+    ULONG size;
+    double elapsed;
+
+    UNREFERENCED_PARAMETER(Window);
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(CmdShow);
+
+    if ((CmdLine != NULL) && (atoi(CmdLine) > 0))
+    {
+        seconds = (ULONG)atoi(CmdLine);
+    }
+
+    AllocConsole();
+    console = GetStdHandle(STD_OUTPUT_HANDLE);
+
+    devIface = OpenVirtRngDeviceInterface();
+    if ((devIface == INVALID_HANDLE_VALUE) || (devIface == NULL))
+    {
+        BenchmarkPrint(console, "Cannot open the VirtIO RNG device.\n");
+        Sleep(3000);
+        return;
+    }
+
+    buffer = (PUCHAR)VirtualAlloc(NULL, VIRT_RNG_BENCHMARK_MAX_SIZE,
+        MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (buffer == NULL)
+    {
+        CloseHandle(devIface);
+        return;
+    }
+
+    QueryPerformanceFrequency(&frequency);
+    ZeroMemory(&ovrlpd, sizeof(ovrlpd));
+
+    BenchmarkPrint(console, "%10s %12s %10s\n", "Size", "Bytes", "MB/s");
+
+    for (size = VIRT_RNG_BENCHMARK_MIN_SIZE;
+         size <= VIRT_RNG_BENCHMARK_MAX_SIZE;
+         size *= 2)
+    {
+        totalBytes = 0;
+        QueryPerformanceCounter(&start);
+
+        do
+        {
+            if (!NT_SUCCESS(ReadRngFromDevice(devIface, &ovrlpd, buffer,
+                size, &bytesRead)))
+            {
+                BenchmarkPrint(console, "Read of %u bytes failed.\n", size);
+                break;
+            }
+            totalBytes += bytesRead;
+            QueryPerformanceCounter(&now);
+        } while ((now.QuadPart - start.QuadPart) <
+                 (LONGLONG)seconds * frequency.QuadPart);
+
+        QueryPerformanceCounter(&now);
+        elapsed = (double)(now.QuadPart - start.QuadPart) /
+            (double)frequency.QuadPart;
+
+        BenchmarkPrint(console, "%10u %12I64u %10.2f\n", size, totalBytes,
+            (double)totalBytes / (1024.0 * 1024.0) / elapsed);
+    }
+
+    VirtualFree(buffer, 0, MEM_RELEASE);
+    CloseHandle(devIface);
+
+    BenchmarkPrint(console, "Done.\n");
+    Sleep(3000);
+}
@@ -38,6 +38,9 @@
 #define STATUS_INVALID_PARAMETER    ((NTSTATUS)0xC000000DL)
 #endif
 
+#define VIRT_RNG_BENCHMARK_MIN_SIZE (4 * 1024)
+#define VIRT_RNG_BENCHMARK_MAX_SIZE (1024 * 1024)
+
 // CNG RNG Provider Interface.
 
 NTSTATUS WINAPI VirtRngOpenAlgorithmProvider(OUT BCRYPT_ALG_HANDLE *Algorithm,
@@ -55,3 +58,8 @@ NTSTATUS WINAPI VirtRngCloseAlgorithmProvider(
 
 NTSTATUS WINAPI VirtRngGenRandom(IN OUT BCRYPT_ALG_HANDLE Algorithm,
     IN OUT PUCHAR Buffer, IN ULONG Length, IN ULONG Flags);
+
+// Throughput benchmark, run through rundll32.
+
+VOID CALLBACK VirtRngBenchmark(IN HWND Window, IN HINSTANCE Instance,
+    IN LPSTR CmdLine, IN int CmdShow);
@@ -94,93 +94,18 @@ VOID VirtRngEvtInterruptDpc(IN WDFINTERRUPT Interrupt,
 {
     PDEVICE_CONTEXT context = GetDeviceContext(
         WdfInterruptGetDevice(Interrupt));
-    struct virtqueue *vq = context->VirtQueue;
-    PREAD_BUFFER_ENTRY entry;
-    PSINGLE_LIST_ENTRY iter;
-    NTSTATUS status;
-    PVOID buffer;
-    size_t bufferLen;
-    unsigned int length;
 
     UNREFERENCED_PARAMETER(AssociatedObject);
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_DPC,
         "--> %!FUNC! Interrupt: %p", Interrupt);
 
-    for (;;)
-    {
-        WdfSpinLockAcquire(context->VirtQueueLock);
-
-        entry = (PREAD_BUFFER_ENTRY)virtqueue_get_buf(vq, &length);
-        if (entry == NULL)
-        {
-            WdfSpinLockRelease(context->VirtQueueLock);
-            break;
-        }
-
-        TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ,
-            "Got %p Request: %p Buffer: %p",
-            entry, entry->Request, entry->Buffer);
-
-        iter = &context->ReadBuffersList;
-        while (iter->Next != NULL)
-        {
-            PREAD_BUFFER_ENTRY current = CONTAINING_RECORD(iter->Next,
-                READ_BUFFER_ENTRY, ListEntry);
-
-            if (entry == current)
-            {
-                TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ,
-                    "Delete %p Request: %p Buffer: %p",
-                    entry, entry->Request, entry->Buffer);
-
-                iter->Next = current->ListEntry.Next;
-                break;
-            }
-            else
-            {
-                iter = iter->Next;
-            }
-        };
-
-        if ((entry->Request == NULL) ||
-            (WdfRequestUnmarkCancelable(entry->Request) == STATUS_CANCELLED))
-        {
-            TraceEvents(TRACE_LEVEL_INFORMATION, DBG_DPC,
-                "Ignoring a canceled read request: %p", entry->Request);
-
-            entry->Request = NULL;
-        }
-
-        WdfSpinLockRelease(context->VirtQueueLock);
-
-        if (entry->Request != NULL)
-        {
-            status = WdfRequestRetrieveOutputBuffer(entry->Request, length,
-                &buffer, &bufferLen);
-
-            if (NT_SUCCESS(status))
-            {
-                length = min(length, (unsigned)bufferLen);
-                RtlCopyMemory(buffer, entry->Buffer, length);
-
-                TraceEvents(TRACE_LEVEL_VERBOSE, DBG_DPC,
-                    "Complete Request: %p Length: %d", entry->Request, length);
-
-                WdfRequestCompleteWithInformation(entry->Request,
-                    STATUS_SUCCESS, (ULONG_PTR)length);
-            }
-            else
-            {
-                TraceEvents(TRACE_LEVEL_ERROR, DBG_READ,
-                    "WdfRequestRetrieveOutputBuffer failed: %!STATUS!", status);
-                WdfRequestComplete(entry->Request, status);
-            }
-        }
-
-        ExFreePoolWithTag(entry->Buffer, VIRT_RNG_MEMORY_TAG);
-        ExFreePoolWithTag(entry, VIRT_RNG_MEMORY_TAG);
-    }
+    WdfSpinLockAcquire(context->VirtQueueLock);
+    VirtRngPoolCollectLocked(context);
+    WdfSpinLockRelease(context->VirtQueueLock);
+
+    VirtRngCompleteLargeReads(context);
+    VirtRngCompletePendingReads(context);
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_DPC, "<-- %!FUNC!");
 }
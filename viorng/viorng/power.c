@@ -107,6 +107,13 @@ NTSTATUS VirtRngEvtDeviceD0Entry(IN WDFDEVICE Device,
     {
         virtio_feature_enable(u64GuestFeatures, VIRTIO_F_ANY_LAYOUT);
     }
+    // Needed to read into the caller's buffer, see VirtRngLargeRead.
+    context->IndirectDescriptors = FALSE;
+    if (virtio_is_feature_enabled(u64HostFeatures, VIRTIO_RING_F_INDIRECT_DESC))
+    {
+        virtio_feature_enable(u64GuestFeatures, VIRTIO_RING_F_INDIRECT_DESC);
+        context->IndirectDescriptors = TRUE;
+    }
 
     status = VirtIOWdfSetDriverFeatures(&context->VDevice, u64GuestFeatures);
     if (NT_SUCCESS(status))
@@ -119,6 +126,12 @@ NTSTATUS VirtRngEvtDeviceD0Entry(IN WDFDEVICE Device,
 
     if (NT_SUCCESS(status))
     {
+        // Start filling the pool, the device is notified when the
+        // interrupt gets enabled.
+        WdfSpinLockAcquire(context->VirtQueueLock);
+        VirtRngPoolRefillLocked(context, TRUE);
+        WdfSpinLockRelease(context->VirtQueueLock);
+
         VirtIOWdfSetDriverOK(&context->VDevice);
     }
     else
@@ -145,6 +158,7 @@ NTSTATUS VirtRngEvtDeviceD0Exit(IN WDFDEVICE Device,
 
     PAGED_CODE();
 
+    VirtRngPoolReset(context);
     VirtIOWdfDestroyQueues(&context->VDevice);
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_POWER, "<-- %!FUNC!");
@@ -25,188 +25,537 @@
 #include "viorng.h"
 #include "read.tmh"
 
-EVT_WDF_REQUEST_CANCEL VirtRngEvtRequestCancel;
+NTSTATUS VirtRngPoolInitialize(IN PDEVICE_CONTEXT Context)
+{
+    PENTROPY_BUFFER entry;
+    ULONG i;
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_INIT, "--> %!FUNC!");
+
+    InitializeListHead(&Context->ReadyList);
+    InitializeListHead(&Context->EmptyList);
+    Context->EmptyCount = 0;
+
+    for (i = 0; i < VIRT_RNG_POOL_BUFFERS; i++)
+    {
+        entry = &Context->Pool[i];
+
+        entry->Buffer = ExAllocatePoolWithTag(NonPagedPool,
+            VIRT_RNG_BUFFER_SIZE, VIRT_RNG_MEMORY_TAG);
 
-static NTSTATUS VirtQueueAddBuffer(IN PDEVICE_CONTEXT Context,
-                                   IN WDFREQUEST Request,
-                                   IN size_t Length)
+        if (entry->Buffer == NULL)
+        {
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_INIT,
+                "Failed to allocate a read buffer.");
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        entry->Length = 0;
+        entry->Offset = 0;
+        InsertTailList(&Context->EmptyList, &entry->ListEntry);
+        Context->EmptyCount++;
+    }
+
+    for (i = 0; i < VIRT_RNG_LARGE_READ_SLOTS; i++)
+    {
+        PLARGE_READ slot = &Context->LargeReads[i];
+
+        // A page sized allocation is page aligned, so the table is
+        // physically contiguous.
+        slot->IndirectVa = ExAllocatePoolWithTag(NonPagedPool, PAGE_SIZE,
+            VIRT_RNG_MEMORY_TAG);
+
+        if (slot->IndirectVa == NULL)
+        {
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_INIT,
+                "Failed to allocate an indirect table.");
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        slot->IndirectPa = MmGetPhysicalAddress(slot->IndirectVa);
+        slot->Request = NULL;
+        slot->Done = FALSE;
+    }
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_INIT, "<-- %!FUNC!");
+
+    return STATUS_SUCCESS;
+}
+
+VOID VirtRngPoolFree(IN PDEVICE_CONTEXT Context)
 {
-    PREAD_BUFFER_ENTRY entry;
-    size_t length;
-    struct virtqueue *vq = Context->VirtQueue;
-    struct VirtIOBufferDescriptor sg;
-    int ret;
+    ULONG i;
 
-    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ, "--> %!FUNC!");
+    for (i = 0; i < VIRT_RNG_POOL_BUFFERS; i++)
+    {
+        if (Context->Pool[i].Buffer != NULL)
+        {
+            RtlSecureZeroMemory(Context->Pool[i].Buffer, VIRT_RNG_BUFFER_SIZE);
+            ExFreePoolWithTag(Context->Pool[i].Buffer, VIRT_RNG_MEMORY_TAG);
+            Context->Pool[i].Buffer = NULL;
+        }
+    }
 
-    entry = (PREAD_BUFFER_ENTRY)ExAllocatePoolWithTag(NonPagedPool,
-        sizeof(READ_BUFFER_ENTRY), VIRT_RNG_MEMORY_TAG);
+    for (i = 0; i < VIRT_RNG_LARGE_READ_SLOTS; i++)
+    {
+        if (Context->LargeReads[i].IndirectVa != NULL)
+        {
+            ExFreePoolWithTag(Context->LargeReads[i].IndirectVa,
+                VIRT_RNG_MEMORY_TAG);
+            Context->LargeReads[i].IndirectVa = NULL;
+        }
+    }
+}
 
-    if (entry == NULL)
+static PLARGE_READ VirtRngGetLargeRead(IN PDEVICE_CONTEXT Context,
+                                       IN PVOID Token)
+{
+    if (((PUCHAR)Token >= (PUCHAR)&Context->LargeReads[0]) &&
+        ((PUCHAR)Token < (PUCHAR)&Context->LargeReads[VIRT_RNG_LARGE_READ_SLOTS]))
     {
-        TraceEvents(TRACE_LEVEL_ERROR, DBG_READ,
-            "Failed to allocate a read entry.");
-        return STATUS_INSUFFICIENT_RESOURCES;
+        return (PLARGE_READ)Token;
     }
+    return NULL;
+}
 
-    length = min(Length, PAGE_SIZE);
-    entry->Buffer = ExAllocatePoolWithTag(NonPagedPool, length,
-        VIRT_RNG_MEMORY_TAG);
+// Puts the empty buffers into the virt queue once there are enough of them
+// or, with Force set, whenever there are any. Returns TRUE if the device has
+// to be notified, which the caller does after releasing the lock.
+BOOLEAN VirtRngPoolRefillLocked(IN PDEVICE_CONTEXT Context,
+                                IN BOOLEAN Force)
+{
+    struct virtqueue *vq = Context->VirtQueue;
+    struct VirtIOBufferDescriptor sg;
+    PENTROPY_BUFFER entry;
+    BOOLEAN added = FALSE;
+    int ret;
 
-    if (entry->Buffer == NULL)
+    if ((Context->EmptyCount == 0) ||
+        (!Force && (Context->EmptyCount < VIRT_RNG_REFILL_BATCH)))
     {
-        TraceEvents(TRACE_LEVEL_ERROR, DBG_READ,
-            "Failed to allocate a read buffer.");
-        ExFreePoolWithTag(entry, VIRT_RNG_MEMORY_TAG);
-        return STATUS_INSUFFICIENT_RESOURCES;
+        return FALSE;
     }
 
-    entry->Request = Request;
+    while (!IsListEmpty(&Context->EmptyList))
+    {
+        if (Context->IndirectDescriptors &&
+            (vq->num_free <= VIRT_RNG_LARGE_READ_SLOTS))
+        {
+            break;
+        }
 
-    sg.physAddr = MmGetPhysicalAddress(entry->Buffer);
-    sg.length = (unsigned)length;
+        entry = CONTAINING_RECORD(Context->EmptyList.Flink,
+            ENTROPY_BUFFER, ListEntry);
 
-    WdfSpinLockAcquire(Context->VirtQueueLock);
+        sg.physAddr = MmGetPhysicalAddress(entry->Buffer);
+        sg.length = VIRT_RNG_BUFFER_SIZE;
 
-    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ,
-        "Push %p Request: %p Buffer: %p",
-        entry, entry->Request, entry->Buffer);
+        // The virt queue may be smaller than the pool.
+        ret = virtqueue_add_buf(vq, &sg, 0, 1, entry, NULL, 0);
+        if (ret < 0)
+        {
+            TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ,
+                "Virt queue is full.");
+            break;
+        }
 
-    PushEntryList(&Context->ReadBuffersList, &entry->ListEntry);
+        RemoveEntryList(&entry->ListEntry);
+        Context->EmptyCount--;
+        added = TRUE;
+    }
 
-    ret = virtqueue_add_buf(vq, &sg, 0, 1, entry, NULL, 0);
-    if (ret < 0)
+    return added && virtqueue_kick_prepare(vq);
+}
+
+// Moves the buffers the device has filled to the ready list.
+VOID VirtRngPoolCollectLocked(IN PDEVICE_CONTEXT Context)
+{
+    PENTROPY_BUFFER entry;
+    PLARGE_READ slot;
+    unsigned int length;
+
+    while ((entry = (PENTROPY_BUFFER)virtqueue_get_buf(Context->VirtQueue,
+        &length)) != NULL)
     {
-        PSINGLE_LIST_ENTRY removed;
+        slot = VirtRngGetLargeRead(Context, entry);
+        if (slot != NULL)
+        {
+            TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ,
+                "Got large read Request: %p Length: %u", slot->Request, length);
 
-        TraceEvents(TRACE_LEVEL_ERROR, DBG_READ,
-            "Failed to add buffer to virt queue.");
+            slot->Status = STATUS_SUCCESS;
+            slot->Length = length;
+            slot->Done = TRUE;
+            continue;
+        }
 
         TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ,
-            "Pop %p Request: %p Buffer: %p",
-            entry, entry->Request, entry->Buffer);
+            "Got %p Buffer: %p Length: %u", entry, entry->Buffer, length);
+
+        entry->Length = min(length, VIRT_RNG_BUFFER_SIZE);
+        entry->Offset = 0;
+
+        if (entry->Length != 0)
+        {
+            InsertTailList(&Context->ReadyList, &entry->ListEntry);
+        }
+        else
+        {
+            InsertTailList(&Context->EmptyList, &entry->ListEntry);
+            Context->EmptyCount++;
+        }
+    }
+}
 
-        removed = PopEntryList(&Context->ReadBuffersList);
-        NT_ASSERT(entry == CONTAINING_RECORD(
-            removed, READ_BUFFER_ENTRY, ListEntry));
+// Takes every buffer back from the virt queue before it is destroyed.
+VOID VirtRngPoolReset(IN PDEVICE_CONTEXT Context)
+{
+    PENTROPY_BUFFER entry;
 
-        ExFreePoolWithTag(entry->Buffer, VIRT_RNG_MEMORY_TAG);
-        ExFreePoolWithTag(entry, VIRT_RNG_MEMORY_TAG);
+    WdfSpinLockAcquire(Context->VirtQueueLock);
 
-        WdfSpinLockRelease(Context->VirtQueueLock);
+    VirtRngPoolCollectLocked(Context);
+
+    while ((entry = (PENTROPY_BUFFER)virtqueue_detach_unused_buf(
+        Context->VirtQueue)) != NULL)
+    {
+        PLARGE_READ slot = VirtRngGetLargeRead(Context, entry);
 
-        return STATUS_UNSUCCESSFUL;
+        if (slot != NULL)
+        {
+            slot->Status = STATUS_CANCELLED;
+            slot->Length = 0;
+            slot->Done = TRUE;
+            continue;
+        }
+
+        InsertTailList(&Context->EmptyList, &entry->ListEntry);
+        Context->EmptyCount++;
     }
 
     WdfSpinLockRelease(Context->VirtQueueLock);
 
-    virtqueue_kick(vq);
+    VirtRngCompleteLargeReads(Context);
+}
 
-    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ, "<-- %!FUNC!");
+// Builds the list of physical ranges of the buffer, merging contiguous
+// pages. Returns the number of entries used, the rest of the buffer is
+// left out if it doesn't fit.
+static ULONG VirtRngBuildSg(IN PMDL Mdl,
+                            OUT struct VirtIOBufferDescriptor *Sg,
+                            IN ULONG MaxSg)
+{
+    PPFN_NUMBER pfns;
+    ULONG offset;
+    ULONG remaining;
+    ULONG chunk;
+    ULONGLONG pa;
+    ULONG nsg = 0;
+    ULONG i;
+
+    for (; Mdl != NULL; Mdl = Mdl->Next)
+    {
+        pfns = MmGetMdlPfnArray(Mdl);
+        offset = MmGetMdlByteOffset(Mdl);
+        remaining = MmGetMdlByteCount(Mdl);
 
-    return STATUS_SUCCESS;
+        for (i = 0; remaining > 0; i++)
+        {
+            chunk = min(remaining, PAGE_SIZE - offset);
+            pa = ((ULONGLONG)pfns[i] << PAGE_SHIFT) + offset;
+
+            if ((nsg > 0) &&
+                ((ULONGLONG)Sg[nsg - 1].physAddr.QuadPart + Sg[nsg - 1].length == pa))
+            {
+                Sg[nsg - 1].length += chunk;
+            }
+            else if (nsg == MaxSg)
+            {
+                return nsg;
+            }
+            else
+            {
+                Sg[nsg].physAddr.QuadPart = pa;
+                Sg[nsg].length = chunk;
+                nsg++;
+            }
+
+            remaining -= chunk;
+            offset = 0;
+        }
+    }
+
+    return nsg;
 }
 
-VOID VirtRngEvtIoRead(IN WDFQUEUE Queue,
-                      IN WDFREQUEST Request,
-                      IN size_t Length)
+// Hands the caller's buffer to the device. Returns STATUS_PENDING if it
+// did, otherwise the request is to be served from the pool.
+static NTSTATUS VirtRngLargeRead(IN PDEVICE_CONTEXT Context,
+                                 IN WDFREQUEST Request)
 {
-    PDEVICE_CONTEXT context = GetDeviceContext(WdfIoQueueGetDevice(Queue));
+    struct virtqueue *vq = Context->VirtQueue;
+    PLARGE_READ slot = NULL;
     NTSTATUS status;
-    PVOID buffer;
-
-    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ,
-        "--> %!FUNC! Queue: %p Request: %p Length: %d",
-        Queue, Request, (ULONG)Length);
+    PMDL mdl;
+    ULONG nsg;
+    BOOLEAN notify;
+    ULONG i;
+    int ret;
 
-    status = WdfRequestRetrieveOutputBuffer(Request, Length, &buffer, NULL);
+    status = WdfRequestRetrieveOutputWdmMdl(Request, &mdl);
     if (!NT_SUCCESS(status))
     {
-        TraceEvents(TRACE_LEVEL_ERROR, DBG_READ,
-            "WdfRequestRetrieveOutputBuffer failed: %!STATUS!", status);
-        WdfRequestComplete(Request, status);
-        return;
+        return status;
     }
 
-    status = WdfRequestMarkCancelableEx(Request, VirtRngEvtRequestCancel);
-    if (!NT_SUCCESS(status))
-    {
-        TraceEvents(TRACE_LEVEL_ERROR, DBG_READ,
-            "WdfRequestMarkCancelableEx failed: %!STATUS!", status);
-        WdfRequestComplete(Request, status);
-        return;
-    }
+    WdfSpinLockAcquire(Context->VirtQueueLock);
 
-    status = VirtQueueAddBuffer(context, Request, Length);
-    if (!NT_SUCCESS(status))
+    for (i = 0; i < VIRT_RNG_LARGE_READ_SLOTS; i++)
     {
-        if (WdfRequestUnmarkCancelable(Request) != STATUS_CANCELLED)
+        if (Context->LargeReads[i].Request == NULL)
         {
-            WdfRequestComplete(Request, status);
+            slot = &Context->LargeReads[i];
+            break;
         }
     }
 
-    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ, "<-- %!FUNC!");
-}
+    if (slot == NULL)
+    {
+        WdfSpinLockRelease(Context->VirtQueueLock);
+        return STATUS_DEVICE_BUSY;
+    }
 
-VOID VirtRngEvtIoStop(IN WDFQUEUE Queue,
-                      IN WDFREQUEST Request,
-                      IN ULONG ActionFlags)
-{
-    UNREFERENCED_PARAMETER(Queue);
+    nsg = VirtRngBuildSg(mdl, slot->Sg, VIRT_RNG_LARGE_READ_MAX_SG);
 
-    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ,
-        "--> %!FUNC! Request: %p", Request);
+    ret = virtqueue_add_buf(vq, slot->Sg, 0, nsg, slot, slot->IndirectVa,
+        slot->IndirectPa.QuadPart);
+    if (ret < 0)
+    {
+        WdfSpinLockRelease(Context->VirtQueueLock);
+        return STATUS_DEVICE_BUSY;
+    }
 
-    if (ActionFlags & WdfRequestStopActionSuspend)
+    // The device owns the pages until it returns the buffer, so the
+    // request is not cancelable.
+    slot->Request = Request;
+    slot->Done = FALSE;
+    notify = virtqueue_kick_prepare(vq);
+
+    WdfSpinLockRelease(Context->VirtQueueLock);
+
+    if (notify)
     {
-        WdfRequestStopAcknowledge(Request, FALSE);
+        virtqueue_notify(vq);
     }
-    else if (ActionFlags & WdfRequestStopActionPurge)
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ,
+        "Large read Request: %p Descriptors: %u", Request, nsg);
+
+    return STATUS_PENDING;
+}
+
+VOID VirtRngCompleteLargeReads(IN PDEVICE_CONTEXT Context)
+{
+    PLARGE_READ slot;
+    WDFREQUEST request;
+    NTSTATUS status = STATUS_SUCCESS;
+    ULONG length = 0;
+    ULONG i;
+
+    for (i = 0; i < VIRT_RNG_LARGE_READ_SLOTS; i++)
     {
-        if (WdfRequestUnmarkCancelable(Request) != STATUS_CANCELLED)
+        slot = &Context->LargeReads[i];
+        request = NULL;
+
+        WdfSpinLockAcquire(Context->VirtQueueLock);
+        if ((slot->Request != NULL) && slot->Done)
         {
-            WdfRequestComplete(Request , STATUS_CANCELLED);
+            request = slot->Request;
+            status = slot->Status;
+            length = slot->Length;
+            slot->Request = NULL;
+            slot->Done = FALSE;
         }
-    }
+        WdfSpinLockRelease(Context->VirtQueueLock);
 
-    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ, "<-- %!FUNC!");
+        if (request != NULL)
+        {
+            TraceEvents(TRACE_LEVEL_VERBOSE, DBG_DPC,
+                "Complete Request: %p Length: %d", request, length);
+
+            WdfRequestCompleteWithInformation(request, status,
+                (ULONG_PTR)length);
+        }
+    }
 }
 
-VOID VirtRngEvtRequestCancel(IN WDFREQUEST Request)
+// Copies up to Length bytes of entropy out of the ready buffers. Every byte
+// is handed out only once.
+static size_t VirtRngPoolReadLocked(IN PDEVICE_CONTEXT Context,
+                                    OUT PUCHAR Buffer,
+                                    IN size_t Length)
 {
-    PDEVICE_CONTEXT context = GetDeviceContext(WdfIoQueueGetDevice(
-        WdfRequestGetIoQueue(Request)));
-    PSINGLE_LIST_ENTRY iter;
+    PENTROPY_BUFFER entry;
+    size_t total = 0;
+    ULONG length;
 
-    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ,
-        "--> %!FUNC! Cancelled Request: %p", Request);
+    while ((total < Length) && !IsListEmpty(&Context->ReadyList))
+    {
+        entry = CONTAINING_RECORD(Context->ReadyList.Flink,
+            ENTROPY_BUFFER, ListEntry);
 
-    WdfSpinLockAcquire(context->VirtQueueLock);
+        length = (ULONG)min(Length - total,
+            (size_t)(entry->Length - entry->Offset));
 
-    WdfRequestComplete(Request, STATUS_CANCELLED);
+        RtlCopyMemory(Buffer + total,
+            (PUCHAR)entry->Buffer + entry->Offset, length);
+        RtlSecureZeroMemory((PUCHAR)entry->Buffer + entry->Offset, length);
 
-    iter = &context->ReadBuffersList;
-    while (iter->Next != NULL)
-    {
-        PREAD_BUFFER_ENTRY entry = CONTAINING_RECORD(iter->Next,
-            READ_BUFFER_ENTRY, ListEntry);
+        entry->Offset += length;
+        total += length;
 
-        if (Request == entry->Request)
+        if (entry->Offset == entry->Length)
         {
-            TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ,
-                "Clear entry %p request.", entry);
+            RemoveEntryList(&entry->ListEntry);
+            InsertTailList(&Context->EmptyList, &entry->ListEntry);
+            Context->EmptyCount++;
+        }
+    }
+
+    return total;
+}
+
+// Serves the pending read requests from the pool, called after the device
+// returned some buffers.
+VOID VirtRngCompletePendingReads(IN PDEVICE_CONTEXT Context)
+{
+    WDFREQUEST request;
+    NTSTATUS status;
+    PVOID buffer;
+    size_t bufferLen;
+    size_t length;
+    BOOLEAN notify;
 
-            entry->Request = NULL;
+    for (;;)
+    {
+        WdfSpinLockAcquire(Context->VirtQueueLock);
+
+        if (IsListEmpty(&Context->ReadyList) ||
+            !NT_SUCCESS(WdfIoQueueRetrieveNextRequest(Context->PendingQueue,
+                &request)))
+        {
             break;
         }
+
+        length = 0;
+        status = WdfRequestRetrieveOutputBuffer(request, 1, &buffer,
+            &bufferLen);
+
+        if (NT_SUCCESS(status))
+        {
+            length = VirtRngPoolReadLocked(Context, (PUCHAR)buffer,
+                bufferLen);
+        }
+
+        WdfSpinLockRelease(Context->VirtQueueLock);
+
+        if (NT_SUCCESS(status))
+        {
+            TraceEvents(TRACE_LEVEL_VERBOSE, DBG_DPC,
+                "Complete Request: %p Length: %d", request, (ULONG)length);
+        }
         else
         {
-            iter = iter->Next;
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_READ,
+                "WdfRequestRetrieveOutputBuffer failed: %!STATUS!", status);
+        }
+
+        WdfRequestCompleteWithInformation(request, status,
+            (ULONG_PTR)length);
+    }
+
+    // The lock is still held here.
+    notify = VirtRngPoolRefillLocked(Context, IsListEmpty(&Context->ReadyList));
+
+    WdfSpinLockRelease(Context->VirtQueueLock);
+
+    if (notify)
+    {
+        virtqueue_notify(Context->VirtQueue);
+    }
+}
+
+VOID VirtRngEvtIoRead(IN WDFQUEUE Queue,
+                      IN WDFREQUEST Request,
+                      IN size_t Length)
+{
+    PDEVICE_CONTEXT context = GetDeviceContext(WdfIoQueueGetDevice(Queue));
+    NTSTATUS status;
+    PVOID buffer;
+    size_t length = 0;
+    BOOLEAN notify;
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ,
+        "--> %!FUNC! Queue: %p Request: %p Length: %d",
+        Queue, Request, (ULONG)Length);
+
+    status = WdfRequestRetrieveOutputBuffer(Request, Length, &buffer, NULL);
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_READ,
+            "WdfRequestRetrieveOutputBuffer failed: %!STATUS!", status);
+        WdfRequestComplete(Request, status);
+        return;
+    }
+
+    if (context->IndirectDescriptors && (Length >= VIRT_RNG_LARGE_READ))
+    {
+        if (VirtRngLargeRead(context, Request) == STATUS_PENDING)
+        {
+            TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ, "<-- %!FUNC!");
+            return;
+        }
+    }
+
+    WdfSpinLockAcquire(context->VirtQueueLock);
+
+    if (IsListEmpty(&context->ReadyList))
+    {
+        // Nothing buffered, wait for the device. The request is queued
+        // under the lock so the DPC can't miss it.
+        status = WdfRequestForwardToIoQueue(Request, context->PendingQueue);
+        notify = VirtRngPoolRefillLocked(context, TRUE);
+        if (!NT_SUCCESS(status))
+        {
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_READ,
+                "WdfRequestForwardToIoQueue failed: %!STATUS!", status);
         }
-    };
+    }
+    else
+    {
+        length = VirtRngPoolReadLocked(context, (PUCHAR)buffer, Length);
+        notify = VirtRngPoolRefillLocked(context,
+            IsListEmpty(&context->ReadyList));
+    }
 
     WdfSpinLockRelease(context->VirtQueueLock);
 
+    if (notify)
+    {
+        virtqueue_notify(context->VirtQueue);
+    }
+
+    if (length != 0)
+    {
+        TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ,
+            "Complete Request: %p Length: %d", Request, (ULONG)length);
+        WdfRequestCompleteWithInformation(Request, STATUS_SUCCESS,
+            (ULONG_PTR)length);
+    }
+    else if (!NT_SUCCESS(status))
+    {
+        WdfRequestComplete(Request, status);
+    }
+
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_READ, "<-- %!FUNC!");
 }
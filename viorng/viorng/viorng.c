@@ -134,6 +134,12 @@ NTSTATUS VirtRngEvtDeviceAdd(IN WDFDRIVER Driver,
         return status;
     }
 
+    status = VirtRngPoolInitialize(context);
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
     status = WdfDeviceCreateDeviceInterface(device,
         &GUID_DEVINTERFACE_VIRT_RNG, NULL);
 
@@ -146,7 +152,6 @@ NTSTATUS VirtRngEvtDeviceAdd(IN WDFDRIVER Driver,
 
     WDF_IO_QUEUE_CONFIG_INIT(&queueConfig, WdfIoQueueDispatchSequential);
     queueConfig.EvtIoRead = VirtRngEvtIoRead;
-    queueConfig.EvtIoStop = VirtRngEvtIoStop;
     queueConfig.AllowZeroLengthRequests = FALSE;
 
     status = WdfIoQueueCreate(device, &queueConfig,
@@ -169,6 +174,18 @@ NTSTATUS VirtRngEvtDeviceAdd(IN WDFDRIVER Driver,
         return status;
     }
 
+    WDF_IO_QUEUE_CONFIG_INIT(&queueConfig, WdfIoQueueDispatchManual);
+
+    status = WdfIoQueueCreate(device, &queueConfig,
+        WDF_NO_OBJECT_ATTRIBUTES, &context->PendingQueue);
+
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_INIT,
+            "WdfIoQueueCreate failed: %!STATUS!", status);
+        return status;
+    }
+
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_INIT, "<-- %!FUNC!");
 
     return status;
@@ -177,21 +194,10 @@ NTSTATUS VirtRngEvtDeviceAdd(IN WDFDRIVER Driver,
 VOID VirtRngEvtDeviceContextCleanup(IN WDFOBJECT DeviceObject)
 {
     PDEVICE_CONTEXT context = GetDeviceContext(DeviceObject);
-    PSINGLE_LIST_ENTRY iter;
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_INIT, "--> %!FUNC!");
 
-    iter = PopEntryList(&context->ReadBuffersList);
-    while (iter != NULL)
-    {
-        PREAD_BUFFER_ENTRY entry = CONTAINING_RECORD(iter,
-            READ_BUFFER_ENTRY, ListEntry);
-
-        ExFreePoolWithTag(entry->Buffer, VIRT_RNG_MEMORY_TAG);
-        ExFreePoolWithTag(entry, VIRT_RNG_MEMORY_TAG);
-
-        iter = PopEntryList(&context->ReadBuffersList);
-    };
+    VirtRngPoolFree(context);
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_INIT, "<-- %!FUNC!");
 }
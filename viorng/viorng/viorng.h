@@ -35,6 +35,7 @@
 
 #include "virtio_pci.h"
 #include "virtio.h"
+#include "virtio_ring.h"
 #include "VirtIOWdf.h"
 
 #define VIRT_RNG_MEMORY_TAG ((ULONG)'gnrV')
@@ -43,13 +44,48 @@
 DEFINE_GUID(GUID_DEVINTERFACE_VIRT_RNG,
     0x2489fc19, 0xd0fd, 0x4950, 0x83, 0x86, 0xf3, 0xda, 0x3f, 0xa8, 0x5, 0x8);
 
-typedef struct _ReadBufferEntry
+// Entropy is read from the device into a pool of preallocated buffers
+// and the read requests are served from it. The buffers are handed back
+// to the device in batches once they have been used up.
+#define VIRT_RNG_POOL_BUFFERS   16
+#define VIRT_RNG_BUFFER_SIZE    PAGE_SIZE
+#define VIRT_RNG_REFILL_BATCH   (VIRT_RNG_POOL_BUFFERS / 2)
+
+typedef struct _EntropyBuffer
 {
-    SINGLE_LIST_ENTRY ListEntry;
-    WDFREQUEST Request;
+    LIST_ENTRY ListEntry;
     PVOID Buffer;
 
-} READ_BUFFER_ENTRY, *PREAD_BUFFER_ENTRY;
+    // Number of bytes the device put into the buffer and how many of them
+    // were already consumed.
+    ULONG Length;
+    ULONG Offset;
+
+} ENTROPY_BUFFER, *PENTROPY_BUFFER;
+
+// Reads of at least VIRT_RNG_LARGE_READ bytes go straight to the device,
+// the pages of the caller's buffer are described by an indirect table.
+// A few descriptors are kept free for them when the pool is refilled.
+#define VIRT_RNG_LARGE_READ         (4 * PAGE_SIZE)
+#define VIRT_RNG_LARGE_READ_SLOTS   2
+// one page of 16 byte descriptors, see virtio_get_indirect_page_capacity
+#define VIRT_RNG_LARGE_READ_MAX_SG  (PAGE_SIZE / 16)
+
+typedef struct _LargeRead
+{
+    // NULL while the slot is free.
+    WDFREQUEST Request;
+
+    // Set once the device is done with the request.
+    BOOLEAN Done;
+    NTSTATUS Status;
+    ULONG Length;
+
+    PVOID IndirectVa;
+    PHYSICAL_ADDRESS IndirectPa;
+    struct VirtIOBufferDescriptor Sg[VIRT_RNG_LARGE_READ_MAX_SG];
+
+} LARGE_READ, *PLARGE_READ;
 
 typedef struct _DEVICE_CONTEXT {
 
@@ -59,9 +95,18 @@ typedef struct _DEVICE_CONTEXT {
     WDFINTERRUPT        WdfInterrupt;
     WDFSPINLOCK         VirtQueueLock;
 
-    // Hold a list of allocated buffers which were put into the virt queue
-    // and was not returned yet.
-    SINGLE_LIST_ENTRY   ReadBuffersList;
+    // Read requests waiting for the device to fill a buffer.
+    WDFQUEUE            PendingQueue;
+
+    // Each buffer is either on one of the lists or in the virt queue.
+    // All protected by VirtQueueLock.
+    ENTROPY_BUFFER      Pool[VIRT_RNG_POOL_BUFFERS];
+    LIST_ENTRY          ReadyList;
+    LIST_ENTRY          EmptyList;
+    ULONG               EmptyCount;
+
+    BOOLEAN             IndirectDescriptors;
+    LARGE_READ          LargeReads[VIRT_RNG_LARGE_READ_SLOTS];
 
 } DEVICE_CONTEXT, *PDEVICE_CONTEXT;
 
@@ -87,4 +132,15 @@ EVT_WDF_INTERRUPT_ENABLE VirtRngEvtInterruptEnable;
 EVT_WDF_INTERRUPT_DISABLE VirtRngEvtInterruptDisable;
 
 EVT_WDF_IO_QUEUE_IO_READ VirtRngEvtIoRead;
-EVT_WDF_IO_QUEUE_IO_STOP VirtRngEvtIoStop;
+
+//
+// Entropy pool
+//
+
+NTSTATUS VirtRngPoolInitialize(IN PDEVICE_CONTEXT Context);
+VOID VirtRngPoolFree(IN PDEVICE_CONTEXT Context);
+BOOLEAN VirtRngPoolRefillLocked(IN PDEVICE_CONTEXT Context, IN BOOLEAN Force);
+VOID VirtRngPoolCollectLocked(IN PDEVICE_CONTEXT Context);
+VOID VirtRngPoolReset(IN PDEVICE_CONTEXT Context);
+VOID VirtRngCompletePendingReads(IN PDEVICE_CONTEXT Context);
+VOID VirtRngCompleteLargeReads(IN PDEVICE_CONTEXT Context);
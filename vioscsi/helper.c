@@ -494,3 +494,97 @@ ENTER_FN();
 
 EXIT_FN();
 }
+
+#if (NTDDI_VERSION > NTDDI_WIN7)
+VOID
+SetupQueueMap(
+    IN PVOID DeviceExtension
+    )
+{
+    PADAPTER_EXTENSION adaptExt = (PADAPTER_EXTENSION)DeviceExtension;
+    ULONG              num_cpus;
+    ULONG              cpu;
+    ULONG              vq;
+    ULONG              i;
+    USHORT             node;
+    USHORT             highest_node;
+    ULONG              owned[MAX_CPU / 32] = { 0 };
+    PROCESSOR_NUMBER   procNum = { 0 };
+    GROUP_AFFINITY     ga;
+ENTER_FN();
+    num_cpus = min(KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS), MAX_CPU);
+    highest_node = KeQueryHighestNodeNumber();
+
+    /* cpu_node and cpu_to_vq_map are indexed by the system-wide processor
+     * index, so that processors in groups other than 0 get their own slot
+     */
+    RtlZeroMemory(adaptExt->cpu_node, sizeof(adaptExt->cpu_node));
+    RtlZeroMemory(adaptExt->node_cpu, sizeof(adaptExt->node_cpu));
+    for (node = 0; node <= highest_node; node++) {
+        BOOLEAN first = TRUE;
+        RtlZeroMemory(&ga, sizeof(ga));
+        KeQueryNodeActiveAffinity(node, &ga, NULL);
+        procNum.Group = ga.Group;
+        for (i = 0; i < sizeof(KAFFINITY) * 8; i++) {
+            if (ga.Mask & ((KAFFINITY)1 << i)) {
+                procNum.Number = (UCHAR)i;
+                cpu = KeGetProcessorIndexFromNumber(&procNum);
+                if (cpu < MAX_CPU) {
+                    adaptExt->cpu_node[cpu] = (UCHAR)node;
+                    if ((node < MAX_NODE) && (first || (cpu < adaptExt->node_cpu[node]))) {
+                        adaptExt->node_cpu[node] = (UCHAR)cpu;
+                        first = FALSE;
+                    }
+                }
+            }
+        }
+    }
+
+    /* every request queue is owned by the processor its MSI-X message
+     * is targeted at, or by the processor with the same index when
+     * StorPort didn't tell us the message affinity
+     */
+    for (vq = 0; vq < adaptExt->num_queues; vq++) {
+        cpu = vq;
+        if ((adaptExt->pmsg_affinity != NULL) &&
+            CHECKFLAG(adaptExt->perfFlags, STOR_PERF_ADV_CONFIG_LOCALITY)) {
+            PGROUP_AFFINITY msg_ga = &adaptExt->pmsg_affinity[vq + VIRTIO_SCSI_REQUEST_QUEUE_0 + 1];
+            if (msg_ga->Mask > 0) {
+                procNum.Group = msg_ga->Group;
+                procNum.Number = (UCHAR)RtlFindLeastSignificantBit((ULONGLONG)msg_ga->Mask);
+                cpu = KeGetProcessorIndexFromNumber(&procNum);
+            }
+        }
+        if (cpu < MAX_CPU) {
+            adaptExt->cpu_to_vq_map[cpu] = (UCHAR)vq;
+            adaptExt->vq_node[vq] = adaptExt->cpu_node[cpu];
+            owned[cpu / 32] |= 1UL << (cpu % 32);
+        }
+    }
+
+    /* processors without a queue of their own use a queue whose
+     * interrupt lands on the same NUMA node, spread by processor index
+     */
+    for (cpu = 0; cpu < num_cpus; cpu++) {
+        if (owned[cpu / 32] & (1UL << (cpu % 32))) {
+            continue;
+        }
+        adaptExt->cpu_to_vq_map[cpu] = (UCHAR)(cpu % adaptExt->num_queues);
+        for (i = 0; i < adaptExt->num_queues; i++) {
+            vq = (cpu + i) % adaptExt->num_queues;
+            if (adaptExt->vq_node[vq] == adaptExt->cpu_node[cpu]) {
+                adaptExt->cpu_to_vq_map[cpu] = (UCHAR)vq;
+                break;
+            }
+        }
+    }
+
+    for (cpu = 0; cpu < num_cpus; cpu++) {
+        RhelDbgPrint(TRACE_LEVEL_INFORMATION, ("cpu %d node %d -> vq %d node %d\n",
+                     cpu, adaptExt->cpu_node[cpu],
+                     adaptExt->cpu_to_vq_map[cpu],
+                     adaptExt->vq_node[adaptExt->cpu_to_vq_map[cpu]]));
+    }
+EXIT_FN();
+}
+#endif
@@ -190,6 +190,13 @@ HandleResponse(
     IN PVirtIOSCSICmd cmd
     );
 
+#if (NTDDI_VERSION > NTDDI_WIN7)
+VOID
+SetupQueueMap(
+    IN PVOID DeviceExtension
+    );
+#endif
+
 PVOID
 VioScsiPoolAlloc(
     IN PVOID DeviceExtension,
@@ -0,0 +1,213 @@
+/**********************************************************************
+ * Copyright (c) 2012-2016 Red Hat, Inc.
+ *
+ * File: buildio.c
+ *
+ * Host-side microbenchmark of VioScsiBuildIo. The adapter is set up by
+ * VioScsiFindAdapter, then each request shape is checked against the
+ * virtio-scsi command layout and timed over a few million SRBs spread
+ * across all targets and LUNs.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vioscsi.h"
+#include "helper.h"
+
+ULONG
+VioScsiFindAdapter(
+    IN PVOID DeviceExtension,
+    IN PVOID HwContext,
+    IN PVOID BusInformation,
+    IN PCHAR ArgumentString,
+    IN OUT PPORT_CONFIGURATION_INFORMATION ConfigInfo,
+    IN PBOOLEAN Again
+    );
+
+BOOLEAN
+VioScsiBuildIo(
+    IN PVOID DeviceExtension,
+    IN PSCSI_REQUEST_BLOCK Srb
+    );
+
+#define ITERATIONS  (4 * 1024 * 1024)
+#define NUM_SRBS    256
+
+typedef struct _BUILDIO_CASE
+{
+    const char *Name;
+    UCHAR       CdbLength;
+    ULONG       SrbFlags;
+    ULONG       Elements;
+    ULONG       ElementLength;
+} BUILDIO_CASE;
+
+static const BUILDIO_CASE Cases[] =
+{
+    { "read-4k",   10, SRB_FLAGS_DATA_IN,  1,  4096 },
+    { "write-4k",  10, SRB_FLAGS_DATA_OUT, 1,  4096 },
+    { "read-64k",  16, SRB_FLAGS_DATA_IN,  16, 4096 },
+    { "write-64k", 16, SRB_FLAGS_DATA_OUT, 16, 4096 },
+    { "tur",       6,  0,                  0,  0 },
+};
+
+typedef struct _BUILDIO_SRB
+{
+    SCSI_REQUEST_BLOCK Srb;
+    PSTOR_SCATTER_GATHER_LIST SgList;
+    PSRB_EXTENSION SrbExt;
+} BUILDIO_SRB;
+
+static ADAPTER_EXTENSION *adaptExt;
+static BUILDIO_SRB Srbs[NUM_SRBS];
+
+static void PrepareSrb(BUILDIO_SRB *pSrb, const BUILDIO_CASE *pCase, ULONG index)
+{
+    PSCSI_REQUEST_BLOCK Srb = &pSrb->Srb;
+    ULONG i;
+
+    memset(Srb, 0, sizeof(*Srb));
+    Srb->Length = sizeof(*Srb);
+    Srb->Function = SRB_FUNCTION_EXECUTE_SCSI;
+    Srb->TargetId = (UCHAR)(index % 64);
+    Srb->Lun = (UCHAR)(index / 64);
+    Srb->CdbLength = pCase->CdbLength;
+    Srb->SrbFlags = pCase->SrbFlags;
+    Srb->DataTransferLength = pCase->Elements * pCase->ElementLength;
+    Srb->SrbExtension = pSrb->SrbExt;
+    memset(Srb->Cdb, 0xA5, sizeof(Srb->Cdb));
+    Srb->Cdb[0] = (UCHAR)index;
+
+    pSrb->SgList->NumberOfElements = pCase->Elements;
+    for (i = 0; i < pCase->Elements; i++) {
+        pSrb->SgList->List[i].PhysicalAddress.QuadPart = 0x100000000LL + (index << 20) + i * pCase->ElementLength;
+        pSrb->SgList->List[i].Length = pCase->ElementLength;
+    }
+    Srb->OriginalRequest = pCase->Elements ? pSrb->SgList : NULL;
+}
+
+static int CheckSrb(BUILDIO_SRB *pSrb, const BUILDIO_CASE *pCase)
+{
+    PSCSI_REQUEST_BLOCK Srb = &pSrb->Srb;
+    PSRB_EXTENSION srbExt = pSrb->SrbExt;
+    VirtIOSCSICmd *cmd = &srbExt->cmd;
+    BOOLEAN dataOut = (pCase->SrbFlags & SRB_FLAGS_DATA_OUT) != 0;
+    ULONG data = dataOut ? 1 : srbExt->out + 1;
+    UCHAR lun[8] = { 1, Srb->TargetId, 0, Srb->Lun, 0, 0, 0, 0 };
+    ULONG i;
+
+    if (memcmp(cmd->req.cmd.lun, lun, sizeof(lun)) != 0) {
+        return printf("FAIL %s: LUN address of %u:%u\n", pCase->Name, Srb->TargetId, Srb->Lun), 1;
+    }
+    if (cmd->req.cmd.tag != (ULONG_PTR)Srb || cmd->req.cmd.task_attr != VIRTIO_SCSI_S_SIMPLE ||
+        cmd->req.cmd.prio != 0 || cmd->req.cmd.crn != 0 || cmd->srb != Srb || srbExt->Srb != Srb) {
+        return printf("FAIL %s: request header\n", pCase->Name), 1;
+    }
+    if (memcmp(cmd->req.cmd.cdb, Srb->Cdb, pCase->CdbLength) != 0) {
+        return printf("FAIL %s: CDB\n", pCase->Name), 1;
+    }
+    for (i = pCase->CdbLength; i < VIRTIO_SCSI_CDB_SIZE; i++) {
+        if (cmd->req.cmd.cdb[i] != 0) {
+            return printf("FAIL %s: CDB byte %u not cleared\n", pCase->Name, i), 1;
+        }
+    }
+    if (cmd->resp.cmd.response != 0 || cmd->resp.cmd.status != 0 || cmd->resp.cmd.sense_len != 0 ||
+        cmd->resp.cmd.resid != 0) {
+        return printf("FAIL %s: response header not cleared\n", pCase->Name), 1;
+    }
+    if (srbExt->out != 1 + (dataOut ? pCase->Elements : 0) ||
+        srbExt->in != 1 + (dataOut ? 0 : pCase->Elements)) {
+        return printf("FAIL %s: %u out, %u in\n", pCase->Name, srbExt->out, srbExt->in), 1;
+    }
+    if (srbExt->sg[0].physAddr.QuadPart != (LONGLONG)(ULONG_PTR)&cmd->req.cmd ||
+        srbExt->sg[0].length != sizeof(cmd->req.cmd) ||
+        srbExt->sg[srbExt->out].physAddr.QuadPart != (LONGLONG)(ULONG_PTR)&cmd->resp.cmd ||
+        srbExt->sg[srbExt->out].length != sizeof(cmd->resp.cmd)) {
+        return printf("FAIL %s: request or response element\n", pCase->Name), 1;
+    }
+    for (i = 0; i < pCase->Elements; i++) {
+        if (srbExt->sg[data + i].physAddr.QuadPart != pSrb->SgList->List[i].PhysicalAddress.QuadPart ||
+            srbExt->sg[data + i].length != pSrb->SgList->List[i].Length) {
+            return printf("FAIL %s: data element %u\n", pCase->Name, i), 1;
+        }
+    }
+    if (srbExt->Xfer != Srb->DataTransferLength) {
+        return printf("FAIL %s: %u bytes transferred\n", pCase->Name, srbExt->Xfer), 1;
+    }
+    return 0;
+}
+
+static double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int RunCase(const BUILDIO_CASE *pCase)
+{
+    ULONG i;
+    double start, elapsed;
+
+    for (i = 0; i < NUM_SRBS; i++) {
+        PrepareSrb(&Srbs[i], pCase, i);
+        // dirty the extension, BuildIo must not depend on it being clear
+        memset(Srbs[i].SrbExt, 0xCC, sizeof(SRB_EXTENSION));
+        if (!VioScsiBuildIo(adaptExt, &Srbs[i].Srb)) {
+            return printf("FAIL %s: VioScsiBuildIo rejected %u:%u\n",
+                          pCase->Name, Srbs[i].Srb.TargetId, Srbs[i].Srb.Lun), 1;
+        }
+        if (CheckSrb(&Srbs[i], pCase)) {
+            return 1;
+        }
+    }
+
+    start = Now();
+    for (i = 0; i < ITERATIONS; i++) {
+        VioScsiBuildIo(adaptExt, &Srbs[i % NUM_SRBS].Srb);
+    }
+    elapsed = Now() - start;
+
+    printf("PASS %-10s %6.1f ns per request\n", pCase->Name, elapsed / ITERATIONS);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    PORT_CONFIGURATION_INFORMATION ConfigInfo;
+    BOOLEAN Again = FALSE;
+    int failed = 0;
+    ULONG i;
+
+    UNREFERENCED_PARAMETER(argc);
+    UNREFERENCED_PARAMETER(argv);
+
+    adaptExt = aligned_alloc(PAGE_SIZE, ROUND_TO_PAGES(sizeof(ADAPTER_EXTENSION)));
+    memset(&ConfigInfo, 0, sizeof(ConfigInfo));
+    if (adaptExt == NULL ||
+        VioScsiFindAdapter(adaptExt, NULL, NULL, NULL, &ConfigInfo, &Again) != SP_RETURN_FOUND) {
+        printf("FAIL VioScsiFindAdapter\n");
+        return 1;
+    }
+
+    for (i = 0; i < NUM_SRBS; i++) {
+        Srbs[i].SrbExt = aligned_alloc(PAGE_SIZE, ROUND_TO_PAGES(sizeof(SRB_EXTENSION)));
+        Srbs[i].SgList = malloc(sizeof(STOR_SCATTER_GATHER_LIST) + 16 * sizeof(STOR_SCATTER_GATHER_ELEMENT));
+        if (Srbs[i].SrbExt == NULL || Srbs[i].SgList == NULL) {
+            printf("FAIL out of memory\n");
+            return 1;
+        }
+    }
+
+    for (i = 0; i < sizeof(Cases) / sizeof(Cases[0]); i++) {
+        failed += RunCase(&Cases[i]);
+    }
+    return failed ? 1 : 0;
+}
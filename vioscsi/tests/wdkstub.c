@@ -0,0 +1,416 @@
+/**********************************************************************
+ * Copyright (c) 2012-2016 Red Hat, Inc.
+ *
+ * File: wdkstub.c
+ *
+ * User mode implementation of the StorPort and kernel routines called
+ * by vioscsi.c. The adapter is a single queue virtio-scsi HBA, physical
+ * addresses are the virtual ones and the scatter gather list of an SRB
+ * is passed in its OriginalRequest field.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+
+#include "vioscsi.h"
+#include "helper.h"
+
+int virtioDebugLevel;
+int bDebugPrint;
+int nViostorDebugLevel;
+tDebugPrintFunc VirtioDebugPrintProc;
+
+// kernel
+ULONG KeGetCurrentProcessorNumberEx(PPROCESSOR_NUMBER ProcNumber)
+{
+    if (ProcNumber) {
+        memset(ProcNumber, 0, sizeof(*ProcNumber));
+    }
+    return 0;
+}
+
+UCHAR KeGetCurrentNodeNumber(VOID)
+{
+    return 0;
+}
+
+ULONG KeQueryActiveProcessorCountEx(USHORT GroupNumber)
+{
+    UNREFERENCED_PARAMETER(GroupNumber);
+    return 1;
+}
+
+ULONG KeQueryMaximumProcessorCountEx(USHORT GroupNumber)
+{
+    UNREFERENCED_PARAMETER(GroupNumber);
+    return 1;
+}
+
+ULONGLONG KeQueryInterruptTime(VOID)
+{
+    return 0;
+}
+
+VOID KeSetSystemGroupAffinityThread(PGROUP_AFFINITY Affinity, PGROUP_AFFINITY PreviousAffinity)
+{
+    UNREFERENCED_PARAMETER(Affinity);
+    UNREFERENCED_PARAMETER(PreviousAffinity);
+}
+
+VOID KeRevertToUserGroupAffinityThread(PGROUP_AFFINITY PreviousAffinity)
+{
+    UNREFERENCED_PARAMETER(PreviousAffinity);
+}
+
+// StorPort
+ULONG StorPortInitialize(PVOID Argument1, PVOID Argument2, PHW_INITIALIZATION_DATA HwInitializationData, PVOID HwContext)
+{
+    UNREFERENCED_PARAMETER(Argument1);
+    UNREFERENCED_PARAMETER(Argument2);
+    UNREFERENCED_PARAMETER(HwInitializationData);
+    UNREFERENCED_PARAMETER(HwContext);
+    return STOR_STATUS_SUCCESS;
+}
+
+VOID StorPortNotification(SCSI_NOTIFICATION_TYPE NotificationType, PVOID HwDeviceExtension, ...)
+{
+    UNREFERENCED_PARAMETER(NotificationType);
+    UNREFERENCED_PARAMETER(HwDeviceExtension);
+}
+
+STOR_PHYSICAL_ADDRESS StorPortGetPhysicalAddress(PVOID HwDeviceExtension, PSCSI_REQUEST_BLOCK Srb,
+                                                 PVOID VirtualAddress, ULONG *Length)
+{
+    STOR_PHYSICAL_ADDRESS pa;
+
+    UNREFERENCED_PARAMETER(HwDeviceExtension);
+    UNREFERENCED_PARAMETER(Srb);
+    pa.QuadPart = (LONGLONG)(ULONG_PTR)VirtualAddress;
+    *Length = PAGE_SIZE - (ULONG)((ULONG_PTR)VirtualAddress & (PAGE_SIZE - 1));
+    return pa;
+}
+
+PSTOR_SCATTER_GATHER_LIST StorPortGetScatterGatherList(PVOID DeviceExtension, PSCSI_REQUEST_BLOCK Srb)
+{
+    UNREFERENCED_PARAMETER(DeviceExtension);
+    return (PSTOR_SCATTER_GATHER_LIST)Srb->OriginalRequest;
+}
+
+PVOID StorPortGetUncachedExtension(PVOID HwDeviceExtension, PPORT_CONFIGURATION_INFORMATION ConfigInfo, ULONG NumberOfBytes)
+{
+    UNREFERENCED_PARAMETER(HwDeviceExtension);
+    UNREFERENCED_PARAMETER(ConfigInfo);
+    return aligned_alloc(PAGE_SIZE, ROUND_TO_PAGES(NumberOfBytes));
+}
+
+ULONG StorPortAllocatePool(PVOID HwDeviceExtension, ULONG NumberOfBytes, ULONG Tag, PVOID *BufferPointer)
+{
+    UNREFERENCED_PARAMETER(HwDeviceExtension);
+    UNREFERENCED_PARAMETER(Tag);
+    *BufferPointer = calloc(1, NumberOfBytes);
+    return *BufferPointer ? STOR_STATUS_SUCCESS : STOR_STATUS_INSUFFICIENT_RESOURCES;
+}
+
+ULONG StorPortInitializePerfOpts(PVOID HwDeviceExtension, BOOLEAN Query, PPERF_CONFIGURATION_DATA PerfConfigData)
+{
+    UNREFERENCED_PARAMETER(HwDeviceExtension);
+    UNREFERENCED_PARAMETER(Query);
+    UNREFERENCED_PARAMETER(PerfConfigData);
+    return STOR_STATUS_NOT_IMPLEMENTED;
+}
+
+ULONG StorPortGetMSIInfo(PVOID HwDeviceExtension, ULONG MessageId, PMESSAGE_INTERRUPT_INFORMATION InterruptInfo)
+{
+    UNREFERENCED_PARAMETER(HwDeviceExtension);
+    UNREFERENCED_PARAMETER(MessageId);
+    UNREFERENCED_PARAMETER(InterruptInfo);
+    return STOR_STATUS_INVALID_PARAMETER;
+}
+
+BOOLEAN StorPortEnablePassiveInitialization(PVOID DeviceExtension, HW_PASSIVE_INITIALIZE_ROUTINE *HwPassiveInitializeRoutine)
+{
+    UNREFERENCED_PARAMETER(DeviceExtension);
+    UNREFERENCED_PARAMETER(HwPassiveInitializeRoutine);
+    return FALSE;
+}
+
+VOID StorPortInitializeDpc(PVOID DeviceExtension, PSTOR_DPC Dpc, PHW_DPC_ROUTINE HwDpcRoutine)
+{
+    UNREFERENCED_PARAMETER(DeviceExtension);
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(HwDpcRoutine);
+}
+
+BOOLEAN StorPortIssueDpc(PVOID DeviceExtension, PSTOR_DPC Dpc, PVOID SystemArgument1, PVOID SystemArgument2)
+{
+    UNREFERENCED_PARAMETER(DeviceExtension);
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+    return FALSE;
+}
+
+BOOLEAN StorPortSetDeviceQueueDepth(PVOID HwDeviceExtension, UCHAR PathId, UCHAR TargetId, UCHAR Lun, ULONG Depth)
+{
+    UNREFERENCED_PARAMETER(HwDeviceExtension);
+    UNREFERENCED_PARAMETER(PathId);
+    UNREFERENCED_PARAMETER(TargetId);
+    UNREFERENCED_PARAMETER(Lun);
+    UNREFERENCED_PARAMETER(Depth);
+    return TRUE;
+}
+
+BOOLEAN StorPortResume(PVOID HwDeviceExtension)
+{
+    UNREFERENCED_PARAMETER(HwDeviceExtension);
+    return TRUE;
+}
+
+VOID StorPortStallExecution(ULONG Delay)
+{
+    UNREFERENCED_PARAMETER(Delay);
+}
+
+VOID StorPortMoveMemory(PVOID WriteBuffer, PVOID ReadBuffer, ULONG Length)
+{
+    memmove(WriteBuffer, ReadBuffer, Length);
+}
+
+ULONG StorPortLogSystemEvent(PVOID HwDeviceExtension, PSTOR_LOG_EVENT_DETAILS LogDetails, PULONG MaximumSize)
+{
+    UNREFERENCED_PARAMETER(HwDeviceExtension);
+    UNREFERENCED_PARAMETER(LogDetails);
+    UNREFERENCED_PARAMETER(MaximumSize);
+    return STOR_STATUS_SUCCESS;
+}
+
+ULONG StorPortInitializeWorker(PVOID HwDeviceExtension, PVOID *Worker)
+{
+    UNREFERENCED_PARAMETER(HwDeviceExtension);
+    *Worker = NULL;
+    return STOR_STATUS_NOT_IMPLEMENTED;
+}
+
+ULONG StorPortQueueWorkItem(PVOID HwDeviceExtension, HW_WORKITEM *WorkItemCallback, PVOID Worker, PVOID Context)
+{
+    UNREFERENCED_PARAMETER(HwDeviceExtension);
+    UNREFERENCED_PARAMETER(WorkItemCallback);
+    UNREFERENCED_PARAMETER(Worker);
+    UNREFERENCED_PARAMETER(Context);
+    return STOR_STATUS_NOT_IMPLEMENTED;
+}
+
+ULONG StorPortFreeWorker(PVOID HwDeviceExtension, PVOID Worker)
+{
+    UNREFERENCED_PARAMETER(HwDeviceExtension);
+    UNREFERENCED_PARAMETER(Worker);
+    return STOR_STATUS_SUCCESS;
+}
+
+ULONG StorPortInitializeSListHead(PVOID HwDeviceExtension, PSTOR_SLIST_HEADER SListHead)
+{
+    UNREFERENCED_PARAMETER(HwDeviceExtension);
+    SListHead->First = NULL;
+    return STOR_STATUS_SUCCESS;
+}
+
+ULONG StorPortInterlockedPushEntrySList(PVOID HwDeviceExtension, PSTOR_SLIST_HEADER SListHead,
+                                        PSTOR_SLIST_ENTRY SListEntry, PSTOR_SLIST_ENTRY *Result)
+{
+    UNREFERENCED_PARAMETER(HwDeviceExtension);
+    do {
+        *Result = SListHead->First;
+        SListEntry->Next = *Result;
+    } while (!__sync_bool_compare_and_swap(&SListHead->First, *Result, SListEntry));
+    return STOR_STATUS_SUCCESS;
+}
+
+ULONG StorPortInterlockedFlushSList(PVOID HwDeviceExtension, PSTOR_SLIST_HEADER SListHead, PSTOR_SLIST_ENTRY *Result)
+{
+    UNREFERENCED_PARAMETER(HwDeviceExtension);
+    *Result = __sync_lock_test_and_set(&SListHead->First, NULL);
+    return STOR_STATUS_SUCCESS;
+}
+
+// SCSI WMI
+BOOLEAN ScsiPortWmiDispatchFunction(PSCSI_WMILIB_CONTEXT WmiLibInfo, UCHAR MinorFunction, PVOID DeviceContext,
+                                    PSCSIWMI_REQUEST_CONTEXT RequestContext, PVOID DataPath, ULONG BufferSize, PVOID Buffer)
+{
+    UNREFERENCED_PARAMETER(WmiLibInfo);
+    UNREFERENCED_PARAMETER(MinorFunction);
+    UNREFERENCED_PARAMETER(DeviceContext);
+    UNREFERENCED_PARAMETER(RequestContext);
+    UNREFERENCED_PARAMETER(DataPath);
+    UNREFERENCED_PARAMETER(BufferSize);
+    UNREFERENCED_PARAMETER(Buffer);
+    return FALSE;
+}
+
+VOID ScsiPortWmiPostProcess(PSCSIWMI_REQUEST_CONTEXT RequestContext, UCHAR SrbStatus, ULONG BufferUsed)
+{
+    UNREFERENCED_PARAMETER(RequestContext);
+    UNREFERENCED_PARAMETER(SrbStatus);
+    UNREFERENCED_PARAMETER(BufferUsed);
+}
+
+// helper.c and utils.c
+VOID InitializeDebugPrints(PDRIVER_OBJECT DriverObject, PUNICODE_STRING RegistryPath)
+{
+    UNREFERENCED_PARAMETER(DriverObject);
+    UNREFERENCED_PARAMETER(RegistryPath);
+}
+
+BOOLEAN InitHW(PVOID DeviceExtension, PPORT_CONFIGURATION_INFORMATION ConfigInfo)
+{
+    PADAPTER_EXTENSION adaptExt = (PADAPTER_EXTENSION)DeviceExtension;
+
+    UNREFERENCED_PARAMETER(ConfigInfo);
+    adaptExt->features = 1ULL << VIRTIO_RING_F_INDIRECT_DESC;
+    return TRUE;
+}
+
+VOID GetScsiConfig(PVOID DeviceExtension)
+{
+    PADAPTER_EXTENSION adaptExt = (PADAPTER_EXTENSION)DeviceExtension;
+
+    adaptExt->scsi_config.num_queues = 1;
+    adaptExt->scsi_config.seg_max = 254;
+    adaptExt->scsi_config.max_sectors = 0xFFFF;
+    adaptExt->scsi_config.cmd_per_lun = 128;
+    adaptExt->scsi_config.event_info_size = sizeof(VirtIOSCSIEvent);
+    adaptExt->scsi_config.sense_size = VIRTIO_SCSI_SENSE_SIZE;
+    adaptExt->scsi_config.cdb_size = VIRTIO_SCSI_CDB_SIZE;
+    adaptExt->scsi_config.max_channel = 0;
+    adaptExt->scsi_config.max_target = 255;
+    adaptExt->scsi_config.max_lun = 255;
+}
+
+BOOLEAN InitVirtIODevice(PVOID DeviceExtension)
+{
+    UNREFERENCED_PARAMETER(DeviceExtension);
+    return TRUE;
+}
+
+BOOLEAN SendSRB(PVOID DeviceExtension, PSRB_TYPE Srb)
+{
+    UNREFERENCED_PARAMETER(DeviceExtension);
+    UNREFERENCED_PARAMETER(Srb);
+    return TRUE;
+}
+
+VOID ShutDown(PVOID DeviceExtension)
+{
+    UNREFERENCED_PARAMETER(DeviceExtension);
+}
+
+BOOLEAN DeviceReset(PVOID DeviceExtension)
+{
+    UNREFERENCED_PARAMETER(DeviceExtension);
+    return TRUE;
+}
+
+BOOLEAN KickEvent(PVOID DeviceExtension, PVirtIOSCSIEventNode event)
+{
+    UNREFERENCED_PARAMETER(DeviceExtension);
+    UNREFERENCED_PARAMETER(event);
+    return TRUE;
+}
+
+BOOLEAN SynchronizedKickEventRoutine(PVOID DeviceExtension, PVOID Context)
+{
+    UNREFERENCED_PARAMETER(DeviceExtension);
+    UNREFERENCED_PARAMETER(Context);
+    return TRUE;
+}
+
+VOID VioScsiVQLock(PVOID DeviceExtension, ULONG MessageID, PSTOR_LOCK_HANDLE LockHandle, BOOLEAN isr)
+{
+    UNREFERENCED_PARAMETER(DeviceExtension);
+    UNREFERENCED_PARAMETER(MessageID);
+    UNREFERENCED_PARAMETER(LockHandle);
+    UNREFERENCED_PARAMETER(isr);
+}
+
+VOID VioScsiVQUnlock(PVOID DeviceExtension, ULONG MessageID, PSTOR_LOCK_HANDLE LockHandle, BOOLEAN isr)
+{
+    UNREFERENCED_PARAMETER(DeviceExtension);
+    UNREFERENCED_PARAMETER(MessageID);
+    UNREFERENCED_PARAMETER(LockHandle);
+    UNREFERENCED_PARAMETER(isr);
+}
+
+VOID SetupQueueMap(PVOID DeviceExtension)
+{
+    UNREFERENCED_PARAMETER(DeviceExtension);
+}
+
+// VirtIO library, the benchmark never touches the rings
+NTSTATUS virtio_query_queue_allocation(VirtIODevice *vdev, unsigned index, unsigned short *pNumEntries,
+                                       unsigned long *pRingSize, unsigned long *pHeapSize)
+{
+    UNREFERENCED_PARAMETER(vdev);
+    UNREFERENCED_PARAMETER(index);
+    *pNumEntries = 128;
+    *pRingSize = 2 * PAGE_SIZE;
+    *pHeapSize = 128 * sizeof(PVOID);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS virtio_find_queues(VirtIODevice *vdev, unsigned nvqs, struct virtqueue *vqs[])
+{
+    UNREFERENCED_PARAMETER(vdev);
+    UNREFERENCED_PARAMETER(nvqs);
+    UNREFERENCED_PARAMETER(vqs);
+    return STATUS_NOT_SUPPORTED;
+}
+
+NTSTATUS virtio_set_features(VirtIODevice *vdev, u64 features)
+{
+    UNREFERENCED_PARAMETER(vdev);
+    UNREFERENCED_PARAMETER(features);
+    return STATUS_SUCCESS;
+}
+
+void virtio_device_ready(VirtIODevice *vdev)
+{
+    UNREFERENCED_PARAMETER(vdev);
+}
+
+u8 virtio_read_isr_status(VirtIODevice *vdev)
+{
+    UNREFERENCED_PARAMETER(vdev);
+    return 0;
+}
+
+void virtio_set_queue_event_suppression(struct virtqueue *vq, bool enable)
+{
+    UNREFERENCED_PARAMETER(vq);
+    UNREFERENCED_PARAMETER(enable);
+}
+
+void virtqueue_disable_cb(struct virtqueue *vq)
+{
+    UNREFERENCED_PARAMETER(vq);
+}
+
+bool virtqueue_enable_cb(struct virtqueue *vq)
+{
+    UNREFERENCED_PARAMETER(vq);
+    return true;
+}
+
+void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
+{
+    UNREFERENCED_PARAMETER(vq);
+    UNREFERENCED_PARAMETER(len);
+    return NULL;
+}
+
+BOOLEAN virtqueue_has_buf(struct virtqueue *vq)
+{
+    UNREFERENCED_PARAMETER(vq);
+    return FALSE;
+}
@@ -0,0 +1,829 @@
+/**********************************************************************
+ * Copyright (c) 2012-2016 Red Hat, Inc.
+ *
+ * File: wdkstub.h
+ *
+ * Minimal subset of the WDK and StorPort headers needed to build the
+ * vioscsi miniport (vioscsi.c) as a Linux program. It is force-included
+ * ahead of the driver sources; the WDK headers they include resolve to
+ * empty files generated by the Makefile, and the VirtIO library headers
+ * take their OS dependencies from external_os_dep.h.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+
+#define NTDDI_WIN7    0x06010000
+#define NTDDI_WIN8    0x06020000
+#define NTDDI_VERSION NTDDI_WIN8
+
+// basic types
+#define VOID void
+#define CONST const
+#define IN
+#define OUT
+#define _In_
+#define _In_opt_
+#define _cdecl
+#define FORCEINLINE static inline
+#define UNALIGNED
+typedef char CHAR, *PCHAR;
+typedef unsigned char UCHAR, *PUCHAR;
+typedef int16_t SHORT;
+typedef uint16_t USHORT, *PUSHORT;
+typedef uint16_t WCHAR, *PWCHAR;
+typedef int32_t LONG, *PLONG;
+typedef uint32_t ULONG, *PULONG;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG, *PULONGLONG;
+typedef uintptr_t ULONG_PTR, KAFFINITY;
+typedef size_t SIZE_T;
+typedef void *PVOID;
+typedef UCHAR BOOLEAN, *PBOOLEAN;
+typedef LONG NTSTATUS;
+typedef UCHAR KIRQL;
+
+// the VirtIO library types, sized as on Windows
+#define _LINUX_TYPES_H
+typedef uint8_t u8, __u8;
+typedef uint16_t u16, __u16, __le16;
+typedef uint32_t u32, __u32, __le32;
+typedef uint64_t u64, __u64;
+#define __bitwise__
+
+typedef union _LARGE_INTEGER
+{
+    struct
+    {
+        ULONG LowPart;
+        LONG HighPart;
+    };
+    LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER, PHYSICAL_ADDRESS, STOR_PHYSICAL_ADDRESS, *PPHYSICAL_ADDRESS;
+
+typedef struct _UNICODE_STRING
+{
+    USHORT Length;
+    USHORT MaximumLength;
+    PWCHAR Buffer;
+} UNICODE_STRING, *PUNICODE_STRING;
+
+typedef struct _DRIVER_OBJECT *PDRIVER_OBJECT;
+
+typedef struct _GUID
+{
+    ULONG  Data1;
+    USHORT Data2;
+    USHORT Data3;
+    UCHAR  Data4[8];
+} GUID, *LPGUID;
+
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    extern const GUID name
+
+#define TRUE  1
+#define FALSE 0
+
+#define PAGE_SIZE 0x1000
+#define ROUND_TO_PAGES(Size) (((ULONG_PTR)(Size) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+#define FIELD_OFFSET(type, field) ((LONG)offsetof(type, field))
+#define CONTAINING_RECORD(address, type, field) \
+    ((type *)((PUCHAR)(address) - offsetof(type, field)))
+#define UNREFERENCED_PARAMETER(P) (void)(P)
+#define ASSERT(exp) ((void)0)
+#define NT_ASSERT(exp) ((void)0)
+#define PtrToUlong(p) ((ULONG)(ULONG_PTR)(p))
+#define ULongToPtr(ul) ((PVOID)(ULONG_PTR)(ul))
+#define NT_SUCCESS(Status) (((NTSTATUS)(Status)) >= 0)
+#define STATUS_SUCCESS ((NTSTATUS)0x00000000L)
+#define STATUS_NOT_SUPPORTED ((NTSTATUS)0xC00000BBL)
+
+#define RtlCopyMemory(Destination, Source, Length) memcpy((Destination), (Source), (Length))
+#define RtlMoveMemory(Destination, Source, Length) memmove((Destination), (Source), (Length))
+#define RtlZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+
+#define REVERSE_BYTES_QUAD(Destination, Source) \
+    (*(ULONGLONG *)(Destination) = __builtin_bswap64(*(ULONGLONG *)(Source)))
+
+#define InterlockedIncrement(p) __sync_add_and_fetch((p), 1)
+#define InterlockedExchangeAdd(p, v) __sync_fetch_and_add((p), (v))
+#define InterlockedExchange(p, v) __sync_lock_test_and_set((p), (v))
+#define KeMemoryBarrier() __sync_synchronize()
+
+// processors
+#define ALL_PROCESSOR_GROUPS 0xffff
+
+typedef struct _PROCESSOR_NUMBER
+{
+    USHORT Group;
+    UCHAR  Number;
+    UCHAR  Reserved;
+} PROCESSOR_NUMBER, *PPROCESSOR_NUMBER;
+
+typedef struct _GROUP_AFFINITY
+{
+    KAFFINITY Mask;
+    USHORT    Group;
+    USHORT    Reserved[3];
+} GROUP_AFFINITY, *PGROUP_AFFINITY;
+
+ULONG KeGetCurrentProcessorNumberEx(PPROCESSOR_NUMBER ProcNumber);
+ULONG KeGetCurrentProcessorNumber(VOID);
+UCHAR KeGetCurrentNodeNumber(VOID);
+ULONG KeQueryActiveProcessorCountEx(USHORT GroupNumber);
+ULONG KeQueryActiveProcessorCount(KAFFINITY *ActiveProcessors);
+ULONG KeQueryMaximumProcessorCountEx(USHORT GroupNumber);
+ULONG KeQueryMaximumProcessorCount(VOID);
+ULONG KeGetProcessorIndexFromNumber(PPROCESSOR_NUMBER ProcNumber);
+USHORT KeQueryHighestNodeNumber(VOID);
+VOID KeQueryNodeActiveAffinity(USHORT NodeNumber, PGROUP_AFFINITY Affinity, PUSHORT Count);
+VOID KeSetSystemGroupAffinityThread(PGROUP_AFFINITY Affinity, PGROUP_AFFINITY PreviousAffinity);
+VOID KeRevertToUserGroupAffinityThread(PGROUP_AFFINITY PreviousAffinity);
+ULONGLONG KeQueryInterruptTime(VOID);
+KIRQL KeGetCurrentIrql(VOID);
+VOID KeStallExecutionProcessor(ULONG MicroSeconds);
+LARGE_INTEGER KeQueryPerformanceCounter(PLARGE_INTEGER PerformanceFrequency);
+ULONG RtlFindLeastSignificantBit(ULONGLONG Set);
+
+// PCI
+#define PCI_TYPE0_ADDRESSES 6
+
+typedef struct _PCI_CAPABILITIES_HEADER
+{
+    UCHAR CapabilityID;
+    UCHAR Next;
+} PCI_CAPABILITIES_HEADER, *PPCI_CAPABILITIES_HEADER;
+
+typedef struct _PCI_COMMON_HEADER
+{
+    USHORT VendorID;
+    USHORT DeviceID;
+    USHORT Command;
+    USHORT Status;
+    UCHAR  RevisionID;
+    UCHAR  ProgIf;
+    UCHAR  SubClass;
+    UCHAR  BaseClass;
+    UCHAR  CacheLineSize;
+    UCHAR  LatencyTimer;
+    UCHAR  HeaderType;
+    UCHAR  BIST;
+    union
+    {
+        struct
+        {
+            ULONG BaseAddresses[PCI_TYPE0_ADDRESSES];
+            ULONG CIS;
+            USHORT SubVendorID;
+            USHORT SubSystemID;
+            ULONG ROMBaseAddress;
+            UCHAR CapabilitiesPtr;
+            UCHAR Reserved1[3];
+            ULONG Reserved2;
+            UCHAR InterruptLine;
+            UCHAR InterruptPin;
+            UCHAR MinimumGrant;
+            UCHAR MaximumLatency;
+        } type0;
+    } u;
+} PCI_COMMON_HEADER, *PPCI_COMMON_HEADER;
+
+typedef struct _PCI_COMMON_CONFIG
+{
+    PCI_COMMON_HEADER Header;
+    UCHAR DeviceSpecific[192];
+} PCI_COMMON_CONFIG, *PPCI_COMMON_CONFIG;
+
+// SCSI
+#define SCSI_MAXIMUM_TARGETS_PER_BUS 128
+#define SCSI_MAXIMUM_LUNS_PER_TARGET 255
+
+#define SCSIOP_INQUIRY          0x12
+#define SCSIOP_READ_CAPACITY    0x25
+#define SCSIOP_READ             0x28
+#define SCSIOP_READ_CAPACITY16  0x9E
+
+#define SCSISTAT_GOOD           0x00
+
+#define VPD_SERIAL_NUMBER       0x80
+#define VPD_DEVICE_IDENTIFIERS  0x83
+#define VpdCodeSetBinary        1
+
+#define SCSI_ADSENSE_PARAMETERS_CHANGED               0x2A
+#define SPC3_SCSI_SENSEQ_PARAMETERS_CHANGED           0x00
+#define SPC3_SCSI_SENSEQ_MODE_PARAMETERS_CHANGED      0x01
+#define SPC3_SCSI_SENSEQ_CAPACITY_DATA_HAS_CHANGED    0x09
+
+typedef union _CDB
+{
+    struct _CDB6GENERIC
+    {
+        UCHAR OperationCode;
+        UCHAR Reserved[4];
+        UCHAR Control;
+    } CDB6GENERIC;
+    struct _CDB6INQUIRY3
+    {
+        UCHAR OperationCode;
+        UCHAR EnableVitalProductData;
+        UCHAR PageCode;
+        UCHAR Reserved;
+        UCHAR AllocationLength;
+        UCHAR Control;
+    } CDB6INQUIRY3;
+    struct _CDB10
+    {
+        UCHAR OperationCode;
+        UCHAR Flags;
+        UCHAR LogicalBlock[4];
+        UCHAR Reserved;
+        UCHAR TransferBlocks[2];
+        UCHAR Control;
+    } CDB10;
+    UCHAR AsByte[16];
+} CDB, *PCDB;
+
+typedef struct _INQUIRYDATA
+{
+    UCHAR DeviceType;
+    UCHAR Reserved[35];
+} INQUIRYDATA, *PINQUIRYDATA;
+
+typedef struct _SENSE_DATA
+{
+    UCHAR ErrorCode;
+    UCHAR SegmentNumber;
+    UCHAR SenseKey;
+    UCHAR Information[4];
+    UCHAR AdditionalSenseLength;
+    UCHAR CommandSpecificInformation[4];
+    UCHAR AdditionalSenseCode;
+    UCHAR AdditionalSenseCodeQualifier;
+    UCHAR FieldReplaceableUnitCode;
+    UCHAR SenseKeySpecific[3];
+} SENSE_DATA, *PSENSE_DATA;
+
+typedef struct _VPD_SERIAL_NUMBER_PAGE
+{
+    UCHAR DeviceType;
+    UCHAR PageCode;
+    UCHAR Reserved;
+    UCHAR PageLength;
+    UCHAR SerialNumber[0];
+} VPD_SERIAL_NUMBER_PAGE, *PVPD_SERIAL_NUMBER_PAGE;
+
+typedef struct _VPD_IDENTIFICATION_DESCRIPTOR
+{
+    UCHAR CodeSet;
+    UCHAR IdentifierType;
+    UCHAR Reserved;
+    UCHAR IdentifierLength;
+    UCHAR Identifier[0];
+} VPD_IDENTIFICATION_DESCRIPTOR, *PVPD_IDENTIFICATION_DESCRIPTOR;
+
+typedef struct _VPD_IDENTIFICATION_PAGE
+{
+    UCHAR DeviceType;
+    UCHAR PageCode;
+    UCHAR Reserved;
+    UCHAR PageLength;
+    UCHAR Descriptors[0];
+} VPD_IDENTIFICATION_PAGE, *PVPD_IDENTIFICATION_PAGE;
+
+// SRBs; the STORAGE_REQUEST_BLOCK accessors of srbhelper.h work on the
+// classic SCSI_REQUEST_BLOCK layout
+#define SRB_FUNCTION_EXECUTE_SCSI         0x00
+#define SRB_FUNCTION_IO_CONTROL           0x02
+#define SRB_FUNCTION_RESET_BUS            0x12
+#define SRB_FUNCTION_WMI                  0x17
+#define SRB_FUNCTION_RESET_DEVICE         0x13
+#define SRB_FUNCTION_RESET_LOGICAL_UNIT   0x20
+#define SRB_FUNCTION_POWER                0x24
+#define SRB_FUNCTION_PNP                  0x25
+
+#define SRB_STATUS_PENDING                0x00
+#define SRB_STATUS_SUCCESS                0x01
+#define SRB_STATUS_ABORTED                0x02
+#define SRB_STATUS_ERROR                  0x04
+#define SRB_STATUS_BUSY                   0x05
+#define SRB_STATUS_INVALID_REQUEST        0x06
+#define SRB_STATUS_NO_DEVICE              0x08
+#define SRB_STATUS_BUS_RESET              0x0E
+#define SRB_STATUS_DATA_OVERRUN           0x12
+#define SRB_STATUS_BAD_FUNCTION           0x22
+#define SRB_STATUS_INVALID_TARGET_ID      0x21
+#define SRB_STATUS_AUTOSENSE_VALID        0x80
+
+#define SRB_FLAGS_DATA_IN                 0x00000040
+#define SRB_FLAGS_DATA_OUT                0x00000080
+
+#define SRB_WMI_FLAGS_ADAPTER_REQUEST     0x01
+#define SRB_TYPE_FLAG_STORAGE_REQUEST_BLOCK 0x1
+
+typedef struct _SCSI_REQUEST_BLOCK
+{
+    USHORT Length;
+    UCHAR  Function;
+    UCHAR  SrbStatus;
+    UCHAR  ScsiStatus;
+    UCHAR  PathId;
+    UCHAR  TargetId;
+    UCHAR  Lun;
+    UCHAR  QueueTag;
+    UCHAR  QueueAction;
+    UCHAR  CdbLength;
+    UCHAR  SenseInfoBufferLength;
+    ULONG  SrbFlags;
+    ULONG  DataTransferLength;
+    ULONG  TimeOutValue;
+    PVOID  DataBuffer;
+    PVOID  SenseInfoBuffer;
+    struct _SCSI_REQUEST_BLOCK *NextSrb;
+    PVOID  OriginalRequest;
+    PVOID  SrbExtension;
+    ULONG  QueueSortKey;
+    UCHAR  Cdb[16];
+} SCSI_REQUEST_BLOCK, *PSCSI_REQUEST_BLOCK,
+  STORAGE_REQUEST_BLOCK, *PSTORAGE_REQUEST_BLOCK;
+
+typedef struct _SCSI_WMI_REQUEST_BLOCK
+{
+    USHORT Length;
+    UCHAR  Function;
+    UCHAR  SrbStatus;
+    UCHAR  WMISubFunction;
+    UCHAR  PathId;
+    UCHAR  TargetId;
+    UCHAR  Lun;
+    UCHAR  Reserved1;
+    UCHAR  WMIFlags;
+    UCHAR  Reserved2[2];
+    ULONG  SrbFlags;
+    ULONG  DataTransferLength;
+    ULONG  TimeOutValue;
+    PVOID  DataBuffer;
+    PVOID  DataPath;
+} SCSI_WMI_REQUEST_BLOCK, *PSCSI_WMI_REQUEST_BLOCK,
+  SRBEX_DATA_WMI, *PSRBEX_DATA_WMI;
+
+typedef struct _SCSI_PNP_REQUEST_BLOCK
+{
+    USHORT Length;
+    UCHAR  Function;
+    UCHAR  SrbStatus;
+    ULONG  PnPAction;
+    ULONG  SrbPnPFlags;
+} SCSI_PNP_REQUEST_BLOCK, *PSCSI_PNP_REQUEST_BLOCK,
+  SRBEX_DATA_PNP, *PSRBEX_DATA_PNP;
+
+typedef struct _SRB_IO_CONTROL
+{
+    ULONG  HeaderLength;
+    UCHAR  Signature[8];
+    ULONG  Timeout;
+    ULONG  ControlCode;
+    ULONG  ReturnCode;
+    ULONG  Length;
+} SRB_IO_CONTROL, *PSRB_IO_CONTROL;
+
+#define IOCTL_SCSI_MINIPORT_NOT_QUORUM_CAPABLE 0x1B0620
+
+typedef enum
+{
+    SrbExDataTypeWmi,
+    SrbExDataTypePnP,
+} SRBEXDATATYPE;
+
+static inline PVOID SrbGetMiniportContext(PVOID Srb) { return ((PSCSI_REQUEST_BLOCK)Srb)->SrbExtension; }
+static inline UCHAR SrbGetSrbFunction(PVOID Srb) { return ((PSCSI_REQUEST_BLOCK)Srb)->Function; }
+static inline PCDB SrbGetCdb(PVOID Srb) { return (PCDB)((PSCSI_REQUEST_BLOCK)Srb)->Cdb; }
+static inline ULONG SrbGetSrbFlags(PVOID Srb) { return ((PSCSI_REQUEST_BLOCK)Srb)->SrbFlags; }
+static inline UCHAR SrbGetPathId(PVOID Srb) { return ((PSCSI_REQUEST_BLOCK)Srb)->PathId; }
+static inline UCHAR SrbGetTargetId(PVOID Srb) { return ((PSCSI_REQUEST_BLOCK)Srb)->TargetId; }
+static inline UCHAR SrbGetLun(PVOID Srb) { return ((PSCSI_REQUEST_BLOCK)Srb)->Lun; }
+static inline PVOID SrbGetDataBuffer(PVOID Srb) { return ((PSCSI_REQUEST_BLOCK)Srb)->DataBuffer; }
+static inline ULONG SrbGetDataTransferLength(PVOID Srb) { return ((PSCSI_REQUEST_BLOCK)Srb)->DataTransferLength; }
+static inline ULONG SrbGetSrbLength(PVOID Srb) { return ((PSCSI_REQUEST_BLOCK)Srb)->Length; }
+static inline VOID SrbSetSrbStatus(PVOID Srb, UCHAR status) { ((PSCSI_REQUEST_BLOCK)Srb)->SrbStatus = status; }
+static inline VOID SrbSetDataTransferLength(PVOID Srb, ULONG Length) { ((PSCSI_REQUEST_BLOCK)Srb)->DataTransferLength = Length; }
+static inline PVOID SrbGetSrbExDataByType(PSTORAGE_REQUEST_BLOCK Srb, SRBEXDATATYPE Type) { UNREFERENCED_PARAMETER(Type); return Srb; }
+
+static inline VOID SrbGetScsiData(PVOID Srb, PUCHAR CdbLength8, PULONG CdbLength32, PUCHAR ScsiStatus,
+                                  PVOID *SenseInfoBuffer, PUCHAR SenseInfoBufferLength)
+{
+    PSCSI_REQUEST_BLOCK srb = (PSCSI_REQUEST_BLOCK)Srb;
+    if (CdbLength8) *CdbLength8 = srb->CdbLength;
+    if (CdbLength32) *CdbLength32 = 0;
+    if (ScsiStatus) *ScsiStatus = srb->ScsiStatus;
+    if (SenseInfoBuffer) *SenseInfoBuffer = srb->SenseInfoBuffer;
+    if (SenseInfoBufferLength) *SenseInfoBufferLength = srb->SenseInfoBufferLength;
+}
+
+static inline VOID SrbSetScsiData(PVOID Srb, PUCHAR CdbLength8, PULONG CdbLength32, PUCHAR ScsiStatus,
+                                  PVOID *SenseInfoBuffer, PUCHAR SenseInfoBufferLength)
+{
+    UNREFERENCED_PARAMETER(CdbLength8);
+    UNREFERENCED_PARAMETER(CdbLength32);
+    UNREFERENCED_PARAMETER(SenseInfoBuffer);
+    UNREFERENCED_PARAMETER(SenseInfoBufferLength);
+    if (ScsiStatus) ((PSCSI_REQUEST_BLOCK)Srb)->ScsiStatus = *ScsiStatus;
+}
+
+// StorPort
+#define STOR_STATUS_SUCCESS               0x00000000
+#define STOR_STATUS_BUSY                  0xC0000001
+#define STOR_STATUS_INVALID_PARAMETER     0xC0000006
+#define STOR_STATUS_NOT_IMPLEMENTED       0xC0000008
+#define STOR_STATUS_INSUFFICIENT_RESOURCES 0xC0000009
+
+#define SP_RETURN_NOT_FOUND               0
+#define SP_RETURN_FOUND                   1
+#define SP_RETURN_ERROR                   2
+#define SP_INTERNAL_ADAPTER_ERROR         0x00000006
+
+#define STOR_MAP_NON_READ_WRITE_BUFFERS   2
+#define SCSI_DMA64_MINIPORT_FULL64BIT_SUPPORTED 2
+
+#define STOR_PERF_DPC_REDIRECTION                         0x00000001
+#define STOR_PERF_CONCURRENT_CHANNELS                     0x00000002
+#define STOR_PERF_INTERRUPT_MESSAGE_RANGES                0x00000004
+#define STOR_PERF_ADV_CONFIG_LOCALITY                     0x00000008
+#define STOR_PERF_OPTIMIZE_FOR_COMPLETION_DURING_STARTIO  0x00000010
+#define STOR_PERF_DPC_REDIRECTION_CURRENT_CPU             0x00000020
+#define STOR_PERF_VERSION                                 5
+
+#define STOR_CURRENT_LOG_INTERFACE_REVISION 0x100
+
+typedef enum
+{
+    RequestComplete,
+    NextRequest,
+    NextLuRequest,
+    ResetDetected,
+    BusChangeDetected = 0x0B,
+    StorEventAdapterAssociation = 0x1000,
+} SCSI_NOTIFICATION_TYPE;
+
+typedef enum _SCSI_ADAPTER_CONTROL_TYPE
+{
+    ScsiQuerySupportedControlTypes = 0,
+    ScsiStopAdapter,
+    ScsiRestartAdapter,
+    ScsiSetBootConfig,
+    ScsiSetRunningConfig,
+    ScsiAdapterControlMax,
+} SCSI_ADAPTER_CONTROL_TYPE;
+
+typedef enum _SCSI_ADAPTER_CONTROL_STATUS
+{
+    ScsiAdapterControlSuccess = 0,
+    ScsiAdapterControlUnsuccessful,
+} SCSI_ADAPTER_CONTROL_STATUS;
+
+typedef struct _SCSI_SUPPORTED_CONTROL_TYPE_LIST
+{
+    ULONG MaxControlType;
+    BOOLEAN SupportedTypeList[0];
+} SCSI_SUPPORTED_CONTROL_TYPE_LIST, *PSCSI_SUPPORTED_CONTROL_TYPE_LIST;
+
+typedef enum { Isa, Eisa, PCIBus = 5 } INTERFACE_TYPE;
+typedef enum { LevelSensitive, Latched } KINTERRUPT_MODE;
+typedef enum { Width8Bits, Width16Bits, Width32Bits } DMA_WIDTH;
+typedef enum { StorSynchronizeHalfDuplex, StorSynchronizeFullDuplex } STOR_SYNCHRONIZATION_MODEL;
+typedef enum { InterruptSupportNone, InterruptSynchronizeAll, InterruptSynchronizePerMessage } INTERRUPT_SYNCHRONIZATION_MODE;
+
+typedef BOOLEAN HW_INITIALIZE(PVOID DeviceExtension);
+typedef BOOLEAN HW_STARTIO(PVOID DeviceExtension, PSCSI_REQUEST_BLOCK Srb);
+typedef BOOLEAN HW_BUILDIO(PVOID DeviceExtension, PSCSI_REQUEST_BLOCK Srb);
+typedef BOOLEAN HW_INTERRUPT(PVOID DeviceExtension);
+typedef BOOLEAN HW_RESET_BUS(PVOID DeviceExtension, ULONG PathId);
+typedef SCSI_ADAPTER_CONTROL_STATUS HW_ADAPTER_CONTROL(PVOID DeviceExtension, SCSI_ADAPTER_CONTROL_TYPE ControlType, PVOID Parameters);
+typedef BOOLEAN HW_MESSAGE_SIGNALED_INTERRUPT_ROUTINE(PVOID DeviceExtension, ULONG MessageID);
+typedef BOOLEAN HW_PASSIVE_INITIALIZE_ROUTINE(PVOID DeviceExtension);
+typedef VOID HW_WORKITEM(PVOID DeviceExtension, PVOID Context, PVOID Worker);
+typedef ULONG sp_DRIVER_INITIALIZE(PVOID DriverObject, PVOID RegistryPath);
+
+typedef struct _STOR_DPC
+{
+    PVOID Routine;
+    PVOID Context;
+} STOR_DPC, *PSTOR_DPC;
+
+typedef VOID HW_DPC_ROUTINE(PSTOR_DPC Dpc, PVOID Context, PVOID SystemArgument1, PVOID SystemArgument2);
+typedef HW_DPC_ROUTINE *PHW_DPC_ROUTINE;
+
+typedef struct _PORT_CONFIGURATION_INFORMATION PORT_CONFIGURATION_INFORMATION, *PPORT_CONFIGURATION_INFORMATION;
+typedef ULONG HW_FIND_ADAPTER(PVOID DeviceExtension, PVOID HwContext, PVOID BusInformation,
+                              PCHAR ArgumentString, PPORT_CONFIGURATION_INFORMATION ConfigInfo, PBOOLEAN Again);
+
+typedef struct _HW_INITIALIZATION_DATA
+{
+    ULONG HwInitializationDataSize;
+    INTERFACE_TYPE AdapterInterfaceType;
+    HW_INITIALIZE *HwInitialize;
+    HW_STARTIO *HwStartIo;
+    HW_INTERRUPT *HwInterrupt;
+    HW_FIND_ADAPTER *HwFindAdapter;
+    HW_RESET_BUS *HwResetBus;
+    HW_ADAPTER_CONTROL *HwAdapterControl;
+    HW_BUILDIO *HwBuildIo;
+    ULONG DeviceExtensionSize;
+    ULONG SpecificLuExtensionSize;
+    ULONG SrbExtensionSize;
+    ULONG NumberOfAccessRanges;
+    BOOLEAN NeedPhysicalAddresses;
+    BOOLEAN TaggedQueuing;
+    BOOLEAN AutoRequestSense;
+    BOOLEAN MultipleRequestPerLu;
+    BOOLEAN ReceiveEvent;
+    UCHAR MapBuffers;
+    ULONG SrbTypeFlags;
+    PVOID VendorId;
+    PVOID DeviceId;
+    USHORT VendorIdLength;
+    USHORT DeviceIdLength;
+} HW_INITIALIZATION_DATA, *PHW_INITIALIZATION_DATA;
+
+struct _PORT_CONFIGURATION_INFORMATION
+{
+    ULONG Length;
+    ULONG SystemIoBusNumber;
+    INTERFACE_TYPE AdapterInterfaceType;
+    ULONG BusInterruptLevel;
+    ULONG BusInterruptVector;
+    KINTERRUPT_MODE InterruptMode;
+    ULONG MaximumTransferLength;
+    ULONG NumberOfPhysicalBreaks;
+    ULONG DmaChannel;
+    ULONG DmaPort;
+    DMA_WIDTH DmaWidth;
+    ULONG AlignmentMask;
+    ULONG NumberOfAccessRanges;
+    PVOID AccessRanges;
+    PVOID MiniportDumpData;
+    UCHAR NumberOfBuses;
+    UCHAR InitiatorBusId[8];
+    BOOLEAN ScatterGather;
+    BOOLEAN Master;
+    BOOLEAN CachesData;
+    BOOLEAN AdapterScansDown;
+    BOOLEAN Dma32BitAddresses;
+    BOOLEAN Dma64BitAddresses;
+    BOOLEAN WmiDataProvider;
+    UCHAR MapBuffers;
+    UCHAR MaximumNumberOfTargets;
+    UCHAR MaximumNumberOfLogicalUnits;
+    ULONG SrbExtensionSize;
+    ULONG MaxNumberOfIO;
+    ULONG MaxIOsPerLun;
+    ULONG InitialLunQueueDepth;
+    PVOID DumpData;
+    ULONG DumpDataSize;
+    ULONG DumpRegion;
+    UCHAR SynchronizationModel;
+    HW_MESSAGE_SIGNALED_INTERRUPT_ROUTINE *HwMSInterruptRoutine;
+    INTERRUPT_SYNCHRONIZATION_MODE InterruptSynchronizationMode;
+};
+
+typedef struct _ACCESS_RANGE
+{
+    PHYSICAL_ADDRESS RangeStart;
+    ULONG RangeLength;
+    BOOLEAN RangeInMemory;
+} ACCESS_RANGE, *PACCESS_RANGE;
+
+typedef struct _STOR_SCATTER_GATHER_ELEMENT
+{
+    STOR_PHYSICAL_ADDRESS PhysicalAddress;
+    ULONG Length;
+    ULONG_PTR Reserved;
+} STOR_SCATTER_GATHER_ELEMENT, *PSTOR_SCATTER_GATHER_ELEMENT;
+
+typedef struct _STOR_SCATTER_GATHER_LIST
+{
+    ULONG NumberOfElements;
+    ULONG_PTR Reserved;
+    STOR_SCATTER_GATHER_ELEMENT List[0];
+} STOR_SCATTER_GATHER_LIST, *PSTOR_SCATTER_GATHER_LIST;
+
+typedef struct _STOR_LOCK_HANDLE
+{
+    ULONG Lock;
+    KIRQL OldIrql;
+} STOR_LOCK_HANDLE, *PSTOR_LOCK_HANDLE;
+
+typedef enum { DpcLock, StartIoLock, InterruptLock } STOR_SPINLOCK;
+
+typedef struct _STOR_SLIST_ENTRY
+{
+    struct _STOR_SLIST_ENTRY *Next;
+} STOR_SLIST_ENTRY, *PSTOR_SLIST_ENTRY;
+
+typedef struct _STOR_SLIST_HEADER
+{
+    PSTOR_SLIST_ENTRY First;
+} STOR_SLIST_HEADER, *PSTOR_SLIST_HEADER;
+
+typedef struct _PERF_CONFIGURATION_DATA
+{
+    ULONG Version;
+    ULONG Size;
+    ULONG Flags;
+    ULONG ConcurrentChannels;
+    ULONG FirstRedirectionMessageNumber;
+    ULONG LastRedirectionMessageNumber;
+    ULONG DeviceNode;
+    ULONG Reserved;
+    PGROUP_AFFINITY MessageTargets;
+} PERF_CONFIGURATION_DATA, *PPERF_CONFIGURATION_DATA;
+
+typedef struct _MESSAGE_INTERRUPT_INFORMATION
+{
+    ULONG MessageId;
+    ULONG MessageData;
+    PHYSICAL_ADDRESS MessageAddress;
+    ULONG InterruptVector;
+    ULONG InterruptLevel;
+    KINTERRUPT_MODE InterruptMode;
+} MESSAGE_INTERRUPT_INFORMATION, *PMESSAGE_INTERRUPT_INFORMATION;
+
+typedef struct _STOR_DEVICE_CAPABILITIES
+{
+    USHORT Version;
+    ULONG DeviceD1:1;
+    ULONG DeviceD2:1;
+    ULONG LockSupported:1;
+    ULONG EjectSupported:1;
+    ULONG Removable:1;
+    ULONG DockDevice:1;
+    ULONG UniqueID:1;
+    ULONG SilentInstall:1;
+    ULONG SurpriseRemovalOK:1;
+    ULONG NoDisplayInUI:1;
+} STOR_DEVICE_CAPABILITIES, *PSTOR_DEVICE_CAPABILITIES,
+  STOR_DEVICE_CAPABILITIES_EX, *PSTOR_DEVICE_CAPABILITIES_EX;
+
+typedef struct _STOR_LOG_EVENT_DETAILS
+{
+    ULONG InterfaceRevision;
+    ULONG Size;
+    ULONG Flags;
+    ULONG EventAssociation;
+    ULONG PathId;
+    ULONG TargetId;
+    ULONG Lun;
+    BOOLEAN StorportSpecificErrorCode;
+    ULONG ErrorCode;
+    ULONG UniqueId;
+    ULONG DumpDataSize;
+    PVOID DumpData;
+    ULONG StringCount;
+    PWCHAR *StringList;
+} STOR_LOG_EVENT_DETAILS, *PSTOR_LOG_EVENT_DETAILS;
+
+ULONG StorPortInitialize(PVOID Argument1, PVOID Argument2, PHW_INITIALIZATION_DATA HwInitializationData, PVOID HwContext);
+VOID StorPortNotification(SCSI_NOTIFICATION_TYPE NotificationType, PVOID HwDeviceExtension, ...);
+STOR_PHYSICAL_ADDRESS StorPortGetPhysicalAddress(PVOID HwDeviceExtension, PSCSI_REQUEST_BLOCK Srb,
+                                                 PVOID VirtualAddress, ULONG *Length);
+PSTOR_SCATTER_GATHER_LIST StorPortGetScatterGatherList(PVOID DeviceExtension, PSCSI_REQUEST_BLOCK Srb);
+PVOID StorPortGetUncachedExtension(PVOID HwDeviceExtension, PPORT_CONFIGURATION_INFORMATION ConfigInfo, ULONG NumberOfBytes);
+ULONG StorPortGetBusData(PVOID DeviceExtension, ULONG BusDataType, ULONG SystemIoBusNumber, ULONG SlotNumber,
+                         PVOID Buffer, ULONG Length);
+ULONG StorPortAllocatePool(PVOID HwDeviceExtension, ULONG NumberOfBytes, ULONG Tag, PVOID *BufferPointer);
+ULONG StorPortInitializePerfOpts(PVOID HwDeviceExtension, BOOLEAN Query, PPERF_CONFIGURATION_DATA PerfConfigData);
+ULONG StorPortGetMSIInfo(PVOID HwDeviceExtension, ULONG MessageId, PMESSAGE_INTERRUPT_INFORMATION InterruptInfo);
+BOOLEAN StorPortEnablePassiveInitialization(PVOID DeviceExtension, HW_PASSIVE_INITIALIZE_ROUTINE *HwPassiveInitializeRoutine);
+VOID StorPortInitializeDpc(PVOID DeviceExtension, PSTOR_DPC Dpc, PHW_DPC_ROUTINE HwDpcRoutine);
+BOOLEAN StorPortIssueDpc(PVOID DeviceExtension, PSTOR_DPC Dpc, PVOID SystemArgument1, PVOID SystemArgument2);
+VOID StorPortAcquireSpinLock(PVOID DeviceExtension, STOR_SPINLOCK SpinLock, PVOID LockContext, PSTOR_LOCK_HANDLE LockHandle);
+VOID StorPortReleaseSpinLock(PVOID DeviceExtension, PSTOR_LOCK_HANDLE LockHandle);
+ULONG StorPortAcquireMSISpinLock(PVOID HwDeviceExtension, ULONG MessageId, PULONG OldIrql);
+ULONG StorPortReleaseMSISpinLock(PVOID HwDeviceExtension, ULONG MessageId, ULONG OldIrql);
+BOOLEAN StorPortSynchronizeAccess(PVOID HwDeviceExtension, BOOLEAN (*SynchronizedAccessRoutine)(PVOID, PVOID), PVOID Context);
+BOOLEAN StorPortSetDeviceQueueDepth(PVOID HwDeviceExtension, UCHAR PathId, UCHAR TargetId, UCHAR Lun, ULONG Depth);
+BOOLEAN StorPortPause(PVOID HwDeviceExtension, ULONG TimeOut);
+BOOLEAN StorPortResume(PVOID HwDeviceExtension);
+BOOLEAN StorPortBusy(PVOID HwDeviceExtension, ULONG RequestsToComplete);
+VOID StorPortStallExecution(ULONG Delay);
+VOID StorPortMoveMemory(PVOID WriteBuffer, PVOID ReadBuffer, ULONG Length);
+VOID StorPortLogError(PVOID HwDeviceExtension, PSCSI_REQUEST_BLOCK Srb, UCHAR PathId, UCHAR TargetId,
+                      UCHAR Lun, ULONG ErrorCode, ULONG UniqueId);
+ULONG StorPortLogSystemEvent(PVOID HwDeviceExtension, PSTOR_LOG_EVENT_DETAILS LogDetails, PULONG MaximumSize);
+ULONG StorPortInitializeWorker(PVOID HwDeviceExtension, PVOID *Worker);
+ULONG StorPortQueueWorkItem(PVOID HwDeviceExtension, HW_WORKITEM *WorkItemCallback, PVOID Worker, PVOID Context);
+ULONG StorPortFreeWorker(PVOID HwDeviceExtension, PVOID Worker);
+ULONG StorPortInitializeSListHead(PVOID HwDeviceExtension, PSTOR_SLIST_HEADER SListHead);
+ULONG StorPortInterlockedPushEntrySList(PVOID HwDeviceExtension, PSTOR_SLIST_HEADER SListHead,
+                                        PSTOR_SLIST_ENTRY SListEntry, PSTOR_SLIST_ENTRY *Result);
+ULONG StorPortInterlockedFlushSList(PVOID HwDeviceExtension, PSTOR_SLIST_HEADER SListHead, PSTOR_SLIST_ENTRY *Result);
+
+// SCSI WMI
+typedef struct _SCSIWMIGUIDREGINFO
+{
+    LPGUID Guid;
+    ULONG InstanceCount;
+    ULONG Flags;
+} SCSIWMIGUIDREGINFO, *PSCSIWMIGUIDREGINFO;
+
+typedef struct _SCSIWMI_REQUEST_CONTEXT
+{
+    PVOID UserContext;
+    ULONG BufferSize;
+    PUCHAR Buffer;
+    UCHAR MinorFunction;
+    UCHAR ReturnStatus;
+    ULONG ReturnSize;
+} SCSIWMI_REQUEST_CONTEXT, *PSCSIWMI_REQUEST_CONTEXT;
+
+typedef UCHAR (*PSCSIWMI_QUERY_REGINFO)(PVOID, PSCSIWMI_REQUEST_CONTEXT, PWCHAR *);
+typedef BOOLEAN (*PSCSIWMI_QUERY_DATABLOCK)(PVOID, PSCSIWMI_REQUEST_CONTEXT, ULONG, ULONG, ULONG, PULONG, ULONG, PUCHAR);
+typedef BOOLEAN (*PSCSIWMI_SET_DATABLOCK)(PVOID, PSCSIWMI_REQUEST_CONTEXT, ULONG, ULONG, ULONG, PUCHAR);
+typedef BOOLEAN (*PSCSIWMI_SET_DATAITEM)(PVOID, PSCSIWMI_REQUEST_CONTEXT, ULONG, ULONG, ULONG, ULONG, PUCHAR);
+typedef BOOLEAN (*PSCSIWMI_EXECUTE_METHOD)(PVOID, PSCSIWMI_REQUEST_CONTEXT, ULONG, ULONG, ULONG, ULONG, ULONG, PUCHAR);
+typedef BOOLEAN (*PSCSIWMI_FUNCTION_CONTROL)(PVOID, PSCSIWMI_REQUEST_CONTEXT, ULONG, ULONG, BOOLEAN);
+
+typedef struct _SCSIWMILIB_CONTEXT
+{
+    ULONG GuidCount;
+    PSCSIWMIGUIDREGINFO GuidList;
+    PSCSIWMI_QUERY_REGINFO QueryWmiRegInfo;
+    PSCSIWMI_QUERY_DATABLOCK QueryWmiDataBlock;
+    PSCSIWMI_SET_DATABLOCK SetWmiDataBlock;
+    PSCSIWMI_SET_DATAITEM SetWmiDataItem;
+    PSCSIWMI_EXECUTE_METHOD ExecuteWmiMethod;
+    PSCSIWMI_FUNCTION_CONTROL WmiFunctionControl;
+} SCSI_WMILIB_CONTEXT, *PSCSI_WMILIB_CONTEXT;
+
+BOOLEAN ScsiPortWmiDispatchFunction(PSCSI_WMILIB_CONTEXT WmiLibInfo, UCHAR MinorFunction, PVOID DeviceContext,
+                                    PSCSIWMI_REQUEST_CONTEXT RequestContext, PVOID DataPath, ULONG BufferSize, PVOID Buffer);
+VOID ScsiPortWmiPostProcess(PSCSIWMI_REQUEST_CONTEXT RequestContext, UCHAR SrbStatus, ULONG BufferUsed);
+#define ScsiPortWmiGetReturnStatus(RequestContext) ((RequestContext)->ReturnStatus)
+#define ScsiPortWmiGetReturnSize(RequestContext) ((RequestContext)->ReturnSize)
+
+// SM-HBA WMI classes; only the adapter query is filled in, the methods
+// merely check their buffer sizes
+#define HBA_STATUS_OK 0
+
+#define MS_SM_AdapterInformationQueryGuid \
+    { 0xbdc67efa, 0xe5e7, 0x4777, { 0xb1, 0x3c, 0x62, 0x14, 0x59, 0x65, 0x70, 0x99 } }
+#define MS_SM_PortInformationMethodsGuid \
+    { 0x5b6a8b86, 0x708d, 0x4ec6, { 0x82, 0xa6, 0x39, 0xad, 0xcf, 0x6f, 0x64, 0x33 } }
+
+typedef struct _MS_SM_AdapterInformationQuery
+{
+    ULONGLONG UniqueAdapterId;
+    ULONG HBAStatus;
+    ULONG NumberOfPorts;
+    ULONG VendorSpecificID;
+    WCHAR Manufacturer[65];
+    WCHAR SerialNumber[65];
+    WCHAR Model[257];
+    WCHAR ModelDescription[257];
+    WCHAR HardwareVersion[257];
+    WCHAR DriverVersion[257];
+    WCHAR OptionROMVersion[257];
+    WCHAR FirmwareVersion[257];
+    WCHAR DriverName[257];
+    WCHAR HBASymbolicName[257];
+    WCHAR RedundantOptionROMVersion[257];
+    WCHAR RedundantFirmwareVersion[257];
+    WCHAR MfgDomain[257];
+} MS_SM_AdapterInformationQuery, *PMS_SM_AdapterInformationQuery;
+
+#define SM_METHOD(Name, Id)                                                   \
+    typedef struct _##Name##_IN { ULONG In; } Name##_IN, *P##Name##_IN;        \
+    typedef struct _##Name##_OUT { ULONG HBAStatus; LONGLONG PhyCounter[1]; } \
+        Name##_OUT, *P##Name##_OUT;                                           \
+    enum { Name = Id,                                                         \
+           Name##_IN_SIZE = sizeof(Name##_IN),                                \
+           Name##_OUT_SIZE = sizeof(Name##_OUT) };
+
+SM_METHOD(SM_GetPortType, 1)
+SM_METHOD(SM_GetAdapterPortAttributes, 2)
+SM_METHOD(SM_GetDiscoveredPortAttributes, 3)
+SM_METHOD(SM_GetPortAttributesByWWN, 4)
+SM_METHOD(SM_GetProtocolStatistics, 5)
+SM_METHOD(SM_GetPhyStatistics, 6)
+SM_METHOD(SM_GetSASPhyAttributes, 7)
+SM_METHOD(SM_GetFCPhyAttributes, 8)
+SM_METHOD(SM_RefreshInformation, 10)
+
+// debug prints
+extern int virtioDebugLevel;
+extern int bDebugPrint;
+typedef void (*tDebugPrintFunc)(const char *format, ...);
+extern tDebugPrintFunc VirtioDebugPrintProc;
@@ -31,6 +31,7 @@
 #define VIOSCSI_SETUP_GUID_INDEX 0
 #define VIOSCSI_MS_ADAPTER_INFORM_GUID_INDEX 1
 #define VIOSCSI_MS_PORT_INFORM_GUID_INDEX 2
+#define VIOSCSI_QUEUE_MAP_GUID_INDEX 3
 
 BOOLEAN IsCrashDumpMode;
 
@@ -203,21 +204,36 @@ VioScsiReadExtendedData(
     OUT PUCHAR Buffer
    );
 
+VOID
+VioScsiReadQueueMap(
+    IN PVOID Context,
+    OUT PUCHAR Buffer
+    );
+
 VOID
 VioScsiSaveInquiryData(
     IN PVOID  DeviceExtension,
     IN OUT PSRB_TYPE Srb
     );
 
+#if (NTDDI_VERSION > NTDDI_WIN7)
+VOID
+VioScsiFreeWorkers(
+    IN PVOID  DeviceExtension
+    );
+#endif
+
 GUID VioScsiWmiExtendedInfoGuid = VioScsiWmi_ExtendedInfo_Guid;
 GUID VioScsiWmiAdaperInformationQueryGuid = MS_SM_AdapterInformationQueryGuid;
 GUID VioScsiWmiPortInformationMethodsGuid = MS_SM_PortInformationMethodsGuid;
+GUID VioScsiWmiQueueMapGuid = VioScsiWmi_QueueMap_Guid;
 
 SCSIWMIGUIDREGINFO VioScsiGuidList[] =
 {
    { &VioScsiWmiExtendedInfoGuid, 1, 0 },
    { &VioScsiWmiAdaperInformationQueryGuid, 1, 0 },
    { &VioScsiWmiPortInformationMethodsGuid, 1, 0 },
+   { &VioScsiWmiQueueMapGuid, 1, 0 },
 };
 
 #define VioScsiGuidCount (sizeof(VioScsiGuidList) / sizeof(SCSIWMIGUIDREGINFO))
@@ -349,6 +365,12 @@ ENTER_FN();
 
     GetScsiConfig(DeviceExtension);
 
+    for (index = 0; index < MAX_TARGET; ++index) {
+        RtlZeroMemory(adaptExt->target_lun[index], sizeof(adaptExt->target_lun[index]));
+        adaptExt->target_lun[index][0] = 1;
+        adaptExt->target_lun[index][1] = (UCHAR)index;
+    }
+
     ConfigInfo->NumberOfBuses               = 1;//(UCHAR)adaptExt->num_queues;
     ConfigInfo->MaximumNumberOfTargets      = min((UCHAR)adaptExt->scsi_config.max_target, 255/*SCSI_MAXIMUM_TARGETS_PER_BUS*/);
     ConfigInfo->MaximumNumberOfLogicalUnits = min((UCHAR)adaptExt->scsi_config.max_lun, SCSI_MAXIMUM_LUNS_PER_TARGET);
@@ -650,9 +672,6 @@ ENTER_FN();
         for (index = VIRTIO_SCSI_CONTROL_QUEUE; index < adaptExt->num_queues + VIRTIO_SCSI_REQUEST_QUEUE_0; ++index) {
               if ((adaptExt->num_queues > 1) &&
                   (index >= VIRTIO_SCSI_REQUEST_QUEUE_0)) {
-                  if (!CHECKFLAG(adaptExt->perfFlags, STOR_PERF_ADV_CONFIG_LOCALITY)) {
-                      adaptExt->cpu_to_vq_map[index - VIRTIO_SCSI_REQUEST_QUEUE_0] = (UCHAR)(index - VIRTIO_SCSI_REQUEST_QUEUE_0);
-                  }
 #if (NTDDI_VERSION > NTDDI_WIN7)
                   status = StorPortInitializeSListHead(DeviceExtension, &adaptExt->srb_list[index - VIRTIO_SCSI_REQUEST_QUEUE_0]); 
                   if (status != STOR_STATUS_SUCCESS) {
@@ -743,16 +762,11 @@ ENTER_FN();
                 else if ((adaptExt->pmsg_affinity != NULL) && CHECKFLAG(perfData.Flags, STOR_PERF_ADV_CONFIG_LOCALITY)){
                     UCHAR msg = 0;
                     PGROUP_AFFINITY ga;
-                    UCHAR cpu = 0;
                     RhelDbgPrint(TRACE_LEVEL_FATAL, ("Perf Version = 0x%x, Flags = 0x%x, ConcurrentChannels = %d, FirstRedirectionMessageNumber = %d,LastRedirectionMessageNumber = %d\n",
                         perfData.Version, perfData.Flags, perfData.ConcurrentChannels, perfData.FirstRedirectionMessageNumber, perfData.LastRedirectionMessageNumber));
-                    for (msg = 0; msg < adaptExt->num_queues + 3; msg++) {
+                    for (msg = 3; msg < adaptExt->num_queues + 3; msg++) {
                         ga = &adaptExt->pmsg_affinity[msg];
-                        if ( ga->Mask > 0 && msg > 2) {
-                            cpu = RtlFindLeastSignificantBit((ULONGLONG)ga->Mask);
-                            adaptExt->cpu_to_vq_map[cpu] = msg - 3;
-                            RhelDbgPrint(TRACE_LEVEL_FATAL, ("msg = %d, mask = 0x%lx group = %hu cpu = %hu vq = %hu\n", msg, ga->Mask, ga->Group, cpu, adaptExt->cpu_to_vq_map[cpu]));
-                        }
+                        RhelDbgPrint(TRACE_LEVEL_FATAL, ("msg = %d, mask = 0x%lx group = %hu\n", msg, ga->Mask, ga->Group));
                     }
                 }
             }
@@ -761,6 +775,11 @@ ENTER_FN();
             }
 #endif
         }
+#if (NTDDI_VERSION > NTDDI_WIN7)
+        if (adaptExt->num_queues > 1) {
+            SetupQueueMap(DeviceExtension);
+        }
+#endif
         if ((adaptExt->num_queues > 1) && !adaptExt->dpc_ok && !StorPortEnablePassiveInitialization(DeviceExtension, VioScsiPassiveInitializeRoutine)) {
             RhelDbgPrint(TRACE_LEVEL_FATAL, ("%s StorPortEnablePassiveInitialization FAILED\n", __FUNCTION__));
             return FALSE;
@@ -1111,6 +1130,9 @@ ENTER_FN();
     case ScsiStopAdapter: {
         RhelDbgPrint(TRACE_LEVEL_VERBOSE, ("ScsiStopAdapter\n"));
         ShutDown(DeviceExtension);
+#if (NTDDI_VERSION > NTDDI_WIN7)
+        VioScsiFreeWorkers(DeviceExtension);
+#endif
         status = ScsiAdapterControlSuccess;
         break;
     }
@@ -1139,6 +1161,7 @@ VioScsiBuildIo(
     )
 {
     PCDB                  cdb;
+    ULONG                 cdbLength;
     ULONG                 i;
     ULONG                 fragLen;
     ULONG                 sgElement;
@@ -1149,10 +1172,11 @@ VioScsiBuildIo(
     VirtIOSCSICmd         *cmd;
     UCHAR                 TargetId;
     UCHAR                 Lun;
+    STOR_PHYSICAL_ADDRESS reqPA;
+    STOR_PHYSICAL_ADDRESS respPA;
 #if (NTDDI_VERSION >= NTDDI_WIN7)
     PROCESSOR_NUMBER ProcNumber;
-    ULONG processor = KeGetCurrentProcessorNumberEx(&ProcNumber);
-    ULONG cpu = ProcNumber.Number;
+    ULONG cpu = KeGetCurrentProcessorNumberEx(&ProcNumber);
 #else
     ULONG cpu = KeGetCurrentProcessorNumber();
 #endif
@@ -1164,6 +1188,19 @@ ENTER_FN();
     TargetId = SRB_TARGET_ID(Srb);
     Lun      = SRB_LUN(Srb);
 
+#if (NTDDI_VERSION > NTDDI_WIN7)
+    /* the queue map has MAX_CPU slots, a processor beyond that takes the
+     * slot of the first processor on its NUMA node
+     */
+    if (cpu >= MAX_CPU) {
+        UCHAR node = KeGetCurrentNodeNumber();
+        cpu = (node < MAX_NODE) ? adaptExt->node_cpu[node] : 0;
+    }
+#elif (NTDDI_VERSION >= NTDDI_WIN7)
+    /* a single request queue, the index only tags the request */
+    cpu = min(cpu, MAX_CPU - 1);
+#endif
+
     if( (SRB_PATH_ID(Srb) > (UCHAR)adaptExt->num_queues) ||
         (TargetId >= adaptExt->scsi_config.max_target) ||
         (Lun >= adaptExt->scsi_config.max_lun) ) {
@@ -1177,25 +1214,45 @@ ENTER_FN();
 //    RhelDbgPrint(TRACE_LEVEL_FATAL, ("<-->%s (%d::%d::%d)\n", DbgGetScsiOpStr(Srb), SRB_PATH_ID(Srb), SRB_TARGET_ID(Srb), SRB_LUN(Srb)));
 //RhelDbgPrint(TRACE_LEVEL_FATAL, ("<-->%s (%d::%d::%d on %d)\n", DbgGetScsiOpStr(Srb), SRB_PATH_ID(Srb), SRB_TARGET_ID(Srb), SRB_LUN(Srb), cpu));
 
-    RtlZeroMemory(srbExt, sizeof(*srbExt));
+    /* Only the header of the extension needs to be cleared, the sg array
+     * is written up to the number of elements actually used and the
+     * response is filled in by the device.
+     */
     srbExt->Srb = Srb;
+    srbExt->Xfer = 0;
+    srbExt->priv = NULL;
     srbExt->cpu = (UCHAR)cpu;
+#if (NTDDI_VERSION > NTDDI_WIN7)
+    srbExt->procNum = ProcNumber;
+#endif
     cmd = &srbExt->cmd;
     cmd->srb = (PVOID)Srb;
-    cmd->req.cmd.lun[0] = 1;
-    cmd->req.cmd.lun[1] = TargetId;
-    cmd->req.cmd.lun[2] = 0;
+    cmd->comp = NULL;
+    RtlZeroMemory(&cmd->resp.cmd, FIELD_OFFSET(VirtIOSCSICmdResp, sense));
+    RtlCopyMemory(cmd->req.cmd.lun, adaptExt->target_lun[TargetId], sizeof(cmd->req.cmd.lun));
     cmd->req.cmd.lun[3] = Lun;
     cmd->req.cmd.tag = (ULONG_PTR)(Srb);
     cmd->req.cmd.task_attr = VIRTIO_SCSI_S_SIMPLE;
     cmd->req.cmd.prio = 0;
     cmd->req.cmd.crn = 0;
+    cdbLength = 0;
     if (cdb != NULL) {
-        RtlCopyMemory(cmd->req.cmd.cdb, cdb, min(VIRTIO_SCSI_CDB_SIZE, SRB_CDB_LENGTH(Srb)));
+        cdbLength = min(VIRTIO_SCSI_CDB_SIZE, SRB_CDB_LENGTH(Srb));
+        RtlCopyMemory(cmd->req.cmd.cdb, cdb, cdbLength);
     }
+    RtlZeroMemory(cmd->req.cmd.cdb + cdbLength, VIRTIO_SCSI_CDB_SIZE - cdbLength);
 
+    /* req and resp are adjacent in the packed command, so one physical
+     * address lookup is enough unless they straddle a page boundary
+     */
     sgElement = 0;
-    srbExt->sg[sgElement].physAddr = StorPortGetPhysicalAddress(DeviceExtension, NULL, &cmd->req.cmd, &fragLen);
+    reqPA = StorPortGetPhysicalAddress(DeviceExtension, NULL, &cmd->req.cmd, &fragLen);
+    if (fragLen >= FIELD_OFFSET(VirtIOSCSICmd, resp) - FIELD_OFFSET(VirtIOSCSICmd, req) + sizeof(cmd->resp.cmd)) {
+        respPA.QuadPart = reqPA.QuadPart + FIELD_OFFSET(VirtIOSCSICmd, resp) - FIELD_OFFSET(VirtIOSCSICmd, req);
+    } else {
+        respPA = StorPortGetPhysicalAddress(DeviceExtension, NULL, &cmd->resp.cmd, &fragLen);
+    }
+    srbExt->sg[sgElement].physAddr = reqPA;
     srbExt->sg[sgElement].length   = sizeof(cmd->req.cmd);
     sgElement++;
 
@@ -1213,7 +1270,7 @@ ENTER_FN();
         }
     }
     srbExt->out = sgElement;
-    srbExt->sg[sgElement].physAddr = StorPortGetPhysicalAddress(DeviceExtension, NULL, &cmd->resp.cmd, &fragLen);
+    srbExt->sg[sgElement].physAddr = respPA;
     srbExt->sg[sgElement].length = sizeof(cmd->resp.cmd);
     sgElement++;
     if (sgList)
@@ -1313,18 +1370,29 @@ ENTER_FN();
 
 #if (NTDDI_VERSION > NTDDI_WIN7)
     if (cnt) {
+       PCOMPLETION_QUEUE compQueue = &adaptExt->completion_queue[msg];
        ULONG status = STOR_STATUS_SUCCESS;
-       PVOID Worker = NULL;
-       status = StorPortInitializeWorker(DeviceExtension, &Worker);
-       if (status != STOR_STATUS_SUCCESS) {
-          RhelDbgPrint(TRACE_LEVEL_FATAL, ("StorPortInitializeWorker failed with status 0x%x\n\n", status));
-//FIXME   VioScsiWorkItemCallback
-          return;
+       /* the worker is allocated once per queue and is only requeued
+        * if it is not already pending or running, it picks up everything
+        * pushed to srb_list in the meantime
+        */
+       if (compQueue->worker == NULL) {
+          status = StorPortInitializeWorker(DeviceExtension, &compQueue->worker);
+          if (status != STOR_STATUS_SUCCESS) {
+             RhelDbgPrint(TRACE_LEVEL_FATAL, ("StorPortInitializeWorker failed with status 0x%x\n\n", status));
+             compQueue->worker = NULL;
+//FIXME      VioScsiWorkItemCallback
+             return;
+          }
        }
-       status = StorPortQueueWorkItem(DeviceExtension, &VioScsiWorkItemCallback, Worker, ULongToPtr(MessageID));
-       if (status != STOR_STATUS_SUCCESS) {
-          RhelDbgPrint(TRACE_LEVEL_FATAL, ("StorPortQueueWorkItem failed with status 0x%x\n\n", status));
-//FIXME   VioScsiWorkItemCallback
+       if (InterlockedIncrement(&compQueue->worker_pending) == 1) {
+          compQueue->queued_time = KeQueryInterruptTime();
+          status = StorPortQueueWorkItem(DeviceExtension, &VioScsiWorkItemCallback, compQueue->worker, ULongToPtr(MessageID));
+          if (status != STOR_STATUS_SUCCESS) {
+             RhelDbgPrint(TRACE_LEVEL_FATAL, ("StorPortQueueWorkItem failed with status 0x%x\n\n", status));
+             InterlockedExchange(&compQueue->worker_pending, 0);
+//FIXME      VioScsiWorkItemCallback
+          }
        }
     }
 #endif
@@ -1711,7 +1779,7 @@ ENTER_FN();
     {
         case VIOSCSI_SETUP_GUID_INDEX:
         {
-            size = sizeof(VioScsiExtendedInfo) - 1;
+            size = VioScsiExtendedInfo_SIZE;
             if (OutBufferSize < size)
             {
                 status = SRB_STATUS_DATA_OVERRUN;
@@ -1761,6 +1829,21 @@ ENTER_FN();
             RhelDbgPrint(TRACE_LEVEL_FATAL, ("-->VIOSCSI_MS_PORT_INFORM_GUID_INDEX ERROR\n"));
             break;
         }
+        case VIOSCSI_QUEUE_MAP_GUID_INDEX:
+        {
+            size = VioScsiQueueMap_SIZE;
+            if (OutBufferSize < size)
+            {
+                status = SRB_STATUS_DATA_OVERRUN;
+                break;
+            }
+
+            VioScsiReadQueueMap(Context,
+                                 Buffer);
+            *InstanceLengthArray = size;
+            status = SRB_STATUS_SUCCESS;
+            break;
+        }
         default:
         {
             status = SRB_STATUS_ERROR;
@@ -2043,9 +2126,14 @@ IN PVOID Context,
 OUT PUCHAR Buffer
 )
 {
-    UCHAR numberOfBytes = sizeof(VioScsiExtendedInfo) - 1;
+    UCHAR numberOfBytes = VioScsiExtendedInfo_SIZE;
     PADAPTER_EXTENSION    adaptExt;
     PVioScsiExtendedInfo  extInfo;
+#if (NTDDI_VERSION > NTDDI_WIN7)
+    ULONGLONG             latency_total = 0;
+    ULONGLONG             latency_max = 0;
+    ULONG                 index;
+#endif
 
 ENTER_FN();
 
@@ -2062,11 +2150,125 @@ ENTER_FN();
     extInfo->ConcurrentChannels = CHECKFLAG(adaptExt->perfFlags, STOR_PERF_CONCURRENT_CHANNELS);
     extInfo->InterruptMsgRanges = CHECKFLAG(adaptExt->perfFlags, STOR_PERF_INTERRUPT_MESSAGE_RANGES);
     extInfo->CompletionDuringStartIo = CHECKFLAG(adaptExt->perfFlags, STOR_PERF_OPTIMIZE_FOR_COMPLETION_DURING_STARTIO);
+#if (NTDDI_VERSION > NTDDI_WIN7)
+    for (index = 0; index < adaptExt->num_queues; ++index) {
+        PCOMPLETION_QUEUE compQueue = &adaptExt->completion_queue[index];
+        extInfo->CompletionWakeups += compQueue->wakeups;
+        extInfo->Completions += compQueue->completions;
+        latency_total += compQueue->latency_total;
+        latency_max = max(latency_max, compQueue->latency_max);
+    }
+    /* interrupt time is kept in 100ns units */
+    if (extInfo->CompletionWakeups) {
+        extInfo->CompletionLatencyAvgUs = (ULONG)(latency_total / extInfo->CompletionWakeups / 10);
+    }
+    extInfo->CompletionLatencyMaxUs = (ULONG)(latency_max / 10);
+#endif
+
+EXIT_FN();
+}
+
+VOID
+VioScsiReadQueueMap(
+IN PVOID Context,
+OUT PUCHAR Buffer
+)
+{
+    PADAPTER_EXTENSION    adaptExt;
+    PVioScsiQueueMap      queueMap;
+    ULONG                 num_cpus;
+
+ENTER_FN();
+
+    adaptExt = (PADAPTER_EXTENSION)Context;
+    queueMap = (PVioScsiQueueMap)Buffer;
+
+    RtlZeroMemory(Buffer, VioScsiQueueMap_SIZE);
+
+#if (NTDDI_VERSION >= NTDDI_WIN7)
+    num_cpus = KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS);
+#else
+    num_cpus = KeQueryActiveProcessorCount(NULL);
+#endif
+    queueMap->CpuCount = min(num_cpus, MAX_CPU);
+    queueMap->QueuesCount = adaptExt->num_queues;
+    if (adaptExt->num_queues > 1) {
+        RtlCopyMemory(queueMap->CpuToQueue, adaptExt->cpu_to_vq_map, sizeof(queueMap->CpuToQueue));
+        RtlCopyMemory(queueMap->CpuNode, adaptExt->cpu_node, sizeof(queueMap->CpuNode));
+        RtlCopyMemory(queueMap->QueueNode, adaptExt->vq_node, sizeof(queueMap->QueueNode));
+    }
 
 EXIT_FN();
 }
 
 #if (NTDDI_VERSION > NTDDI_WIN7)
+static ULONG
+VioScsiCompleteQueued(
+    IN PVOID DeviceExtension,
+    IN ULONG msg
+    )
+{
+    PADAPTER_EXTENSION  adaptExt = (PADAPTER_EXTENSION)DeviceExtension;
+    PSTOR_SLIST_ENTRY   listEntry;
+    ULONG               status;
+    ULONG               cnt = 0;
+
+    status = StorPortInterlockedFlushSList(DeviceExtension, &adaptExt->srb_list[msg], &listEntry);
+    if ((status == STOR_STATUS_SUCCESS) && (listEntry != NULL)) {
+        GROUP_AFFINITY old_affinity;
+        BOOLEAN affinity_set = FALSE;
+        /* complete the requests grouped by the processor they were issued on,
+         * switching the thread affinity once per group
+         */
+        while (listEntry)
+        {
+            PSTOR_SLIST_ENTRY rest = NULL;
+            PSTOR_SLIST_ENTRY *tail = &rest;
+            PSRB_EXTENSION first = CONTAINING_RECORD(listEntry, SRB_EXTENSION, list_entry);
+            GROUP_AFFINITY new_affinity;
+            GROUP_AFFINITY prev_affinity;
+
+            RtlZeroMemory(&new_affinity, sizeof(new_affinity));
+            new_affinity.Group = first->procNum.Group;
+            new_affinity.Mask = ((KAFFINITY)1) << first->procNum.Number;
+            KeSetSystemGroupAffinityThread(&new_affinity, &prev_affinity);
+            if (!affinity_set) {
+                old_affinity = prev_affinity;
+                affinity_set = TRUE;
+            }
+            while (listEntry)
+            {
+                PSTOR_SLIST_ENTRY next = listEntry->Next;
+                PSRB_EXTENSION srbExt = CONTAINING_RECORD(listEntry,
+                            SRB_EXTENSION, list_entry);
+
+                ASSERT(srbExt);
+                if ((srbExt->procNum.Group == first->procNum.Group) &&
+                    (srbExt->procNum.Number == first->procNum.Number)) {
+                    PVirtIOSCSICmd cmd = (PVirtIOSCSICmd)srbExt->priv;
+                    ASSERT(cmd);
+                    HandleResponse(DeviceExtension, cmd);
+                    cnt++;
+                } else {
+                    *tail = listEntry;
+                    tail = &listEntry->Next;
+                }
+                listEntry = next;
+            }
+            *tail = NULL;
+            listEntry = rest;
+        }
+        if (affinity_set) {
+            KeRevertToUserGroupAffinityThread(&old_affinity);
+        }
+    }
+    else if (status != STOR_STATUS_SUCCESS) {
+       RhelDbgPrint(TRACE_LEVEL_FATAL, ("StorPortInterlockedFlushSList failed with status 0x%x\n\n", status));
+    }
+
+    return cnt;
+}
+
 VOID
 VioScsiWorkItemCallback(
     _In_ PVOID DeviceExtension,
@@ -2075,57 +2277,80 @@ VioScsiWorkItemCallback(
     )
 {
     ULONG MessageId = PtrToUlong(Context);
-    ULONG status = STOR_STATUS_SUCCESS;
     ULONG msg = MessageId - 3;
     PADAPTER_EXTENSION adaptExt = (PADAPTER_EXTENSION)DeviceExtension;
-    PSTOR_SLIST_ENTRY   listEntryRev, listEntry;
+    PCOMPLETION_QUEUE compQueue = &adaptExt->completion_queue[msg];
+    ULONGLONG           latency;
+    LONG                pending;
+    BOOLEAN             woken = FALSE;
+
+    UNREFERENCED_PARAMETER(Worker);
 ENTER_FN();
-    status = StorPortInterlockedFlushSList(DeviceExtension, &adaptExt->srb_list[msg], &listEntryRev);
-    if ((status == STOR_STATUS_SUCCESS) && (listEntryRev != NULL)) {
-        KAFFINITY old_affinity, new_affinity;
-        old_affinity = new_affinity = 0;
-#if 1
-        listEntry = listEntryRev;
-#else
-        listEntry = NULL;
-        while (listEntryRev != NULL) {
-            next = listEntryRev->Next;
-            listEntryRev->Next = listEntry;
-            listEntry = listEntryRev;
-            listEntryRev = next;
-        }
-#endif
-        while(listEntry)
-        {
-            PVirtIOSCSICmd  cmd = NULL;
-            PSRB_TYPE Srb = NULL;
-            PSRB_EXTENSION srbExt = NULL;
-            PSTOR_SLIST_ENTRY next = listEntry->Next;
-            srbExt = CONTAINING_RECORD(listEntry,
-                        SRB_EXTENSION, list_entry);
-
-            ASSERT(srExt);
-            Srb = (PSRB_TYPE)(srbExt->Srb);
-            cmd = (PVirtIOSCSICmd)srbExt->priv;
-            ASSERT(cmd);
-            if (new_affinity == 0) {
-                new_affinity = ((KAFFINITY)1) << srbExt->cpu;
-                old_affinity = KeSetSystemAffinityThreadEx(new_affinity);
+    latency = KeQueryInterruptTime() - compQueue->queued_time;
+    /* everything counted in pending was pushed to srb_list before it was
+     * counted, so one flush covers it; pushes counted meanwhile are
+     * picked up by another pass instead of another worker instance
+     */
+    do {
+        ULONG cnt;
+
+        pending = *(volatile LONG *)&compQueue->worker_pending;
+        cnt = VioScsiCompleteQueued(DeviceExtension, msg);
+        if (cnt) {
+            if (!woken) {
+                compQueue->wakeups++;
+                compQueue->latency_total += latency;
+                if (latency > compQueue->latency_max) {
+                    compQueue->latency_max = latency;
+                }
+                woken = TRUE;
             }
-            HandleResponse(DeviceExtension, cmd);
-            listEntry = next;
-        }
-        if (old_affinity != 0) {
-            KeRevertToUserAffinityThreadEx(old_affinity);
+            compQueue->completions += cnt;
         }
-    }
-    else if (status != STOR_STATUS_SUCCESS) {
-       RhelDbgPrint(TRACE_LEVEL_FATAL, ("StorPortInterlockedPushEntrySList failed with status 0x%x\n\n", status));
-    }
+    } while (InterlockedExchangeAdd(&compQueue->worker_pending, -pending) != pending);
+EXIT_FN();
+}
 
-    status = StorPortFreeWorker(DeviceExtension, Worker);
-    if (status != STOR_STATUS_SUCCESS) {
-       RhelDbgPrint(TRACE_LEVEL_FATAL, ("StorPortFreeWorker failed with status 0x%x\n\n", status));
+VOID
+VioScsiFreeWorkers(
+    IN PVOID DeviceExtension
+    )
+{
+    PADAPTER_EXTENSION adaptExt = (PADAPTER_EXTENSION)DeviceExtension;
+    ULONG index;
+    ULONG status;
+
+ENTER_FN();
+    for (index = 0; index < MAX_CPU; ++index) {
+        PCOMPLETION_QUEUE compQueue = &adaptExt->completion_queue[index];
+        if (compQueue->worker != NULL) {
+            ULONG waited = 0;
+            /* let a queued or running callback drain srb_list and return,
+             * StorPortFreeWorker fails with STOR_STATUS_BUSY until then
+             */
+            while (*(volatile LONG *)&compQueue->worker_pending != 0 &&
+                   waited < VIRTIO_SCSI_WORKER_DRAIN_US) {
+                StorPortStallExecution(10);
+                waited += 10;
+            }
+            for (;;) {
+                status = StorPortFreeWorker(DeviceExtension, compQueue->worker);
+                if (status != STOR_STATUS_BUSY || waited >= VIRTIO_SCSI_WORKER_DRAIN_US) {
+                    break;
+                }
+                StorPortStallExecution(10);
+                waited += 10;
+            }
+            if (status != STOR_STATUS_SUCCESS) {
+               /* keep the worker, its callback may still run and the
+                * restarted adapter reuses it
+                */
+               RhelDbgPrint(TRACE_LEVEL_FATAL, ("StorPortFreeWorker failed with status 0x%x\n\n", status));
+               continue;
+            }
+            compQueue->worker = NULL;
+            compQueue->worker_pending = 0;
+        }
     }
 EXIT_FN();
 }
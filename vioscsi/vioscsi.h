@@ -40,6 +40,13 @@ typedef struct VirtIOBufferDescriptor VIO_SG, *PVIO_SG;
 #define SECTOR_SIZE             512
 #define IO_PORT_LENGTH          0x40
 #define MAX_CPU                 256
+#define MAX_NODE                64
+#define MAX_TARGET              256
+
+/* How long ScsiStopAdapter waits for a queued or running completion worker
+ * before giving up on freeing it
+ */
+#define VIRTIO_SCSI_WORKER_DRAIN_US         1000000
 
 /* Feature Bits */
 #define VIRTIO_SCSI_F_INOUT                    0
@@ -232,6 +239,9 @@ typedef struct _SRB_EXTENSION {
     VRING_DESC_ALIAS      desc[VIRTIO_MAX_SG];
 #endif
     UCHAR                 cpu;
+#if (NTDDI_VERSION > NTDDI_WIN7)
+    PROCESSOR_NUMBER      procNum;
+#endif
     PVOID                 priv;
 }SRB_EXTENSION, * PSRB_EXTENSION;
 #pragma pack()
@@ -243,6 +253,23 @@ typedef struct {
 }TMF_COMMAND, * PTMF_COMMAND;
 #pragma pack()
 
+#if (NTDDI_VERSION > NTDDI_WIN7)
+/* worker_pending counts the ProcessQueue calls that pushed completions since
+ * the worker last drained srb_list; the worker is queued when it goes from 0
+ * to 1 and runs until it is back to 0, so at most one instance runs per queue
+ * and the statistics below are only updated by that instance
+ */
+typedef struct _COMPLETION_QUEUE {
+    PVOID                 worker;
+    LONG                  worker_pending;
+    ULONGLONG             queued_time;
+    ULONGLONG             wakeups;
+    ULONGLONG             completions;
+    ULONGLONG             latency_total;
+    ULONGLONG             latency_max;
+} COMPLETION_QUEUE, *PCOMPLETION_QUEUE;
+#endif
+
 typedef struct virtio_bar {
     PHYSICAL_ADDRESS  BasePA;
     ULONG             uLength;
@@ -286,10 +313,22 @@ typedef struct _ADAPTER_EXTENSION {
 
     PVirtIOSCSIEventNode  events;
 
+    /* single level LUN addresses of LUN 0 of every target, BuildIo
+     * only fills in the LUN number
+     */
+    UCHAR                 target_lun[MAX_TARGET][8];
+
     ULONG                 num_queues;
     UCHAR                 cpu_to_vq_map[MAX_CPU];
+    UCHAR                 cpu_node[MAX_CPU];
+    UCHAR                 vq_node[MAX_CPU];
+    /* first processor index below MAX_CPU on every NUMA node (0 if it
+     * has none), processors beyond MAX_CPU use its slot in the maps above
+     */
+    UCHAR                 node_cpu[MAX_NODE];
 #if (NTDDI_VERSION > NTDDI_WIN7)
     STOR_SLIST_HEADER     srb_list[MAX_CPU];
+    COMPLETION_QUEUE      completion_queue[MAX_CPU];
 #endif
     ULONG                 perfFlags;
     PGROUP_AFFINITY       pmsg_affinity;
@@ -54,8 +54,70 @@ typedef struct _VioScsiExtendedInfo
     #define VioScsiExtendedInfo_CompletionDuringStartIo_SIZE sizeof(BOOLEAN)
     #define VioScsiExtendedInfo_CompletionDuringStartIo_ID 8
 
+    // 
+    ULONGLONG CompletionWakeups;
+    #define VioScsiExtendedInfo_CompletionWakeups_SIZE sizeof(ULONGLONG)
+    #define VioScsiExtendedInfo_CompletionWakeups_ID 9
+
+    // 
+    ULONGLONG Completions;
+    #define VioScsiExtendedInfo_Completions_SIZE sizeof(ULONGLONG)
+    #define VioScsiExtendedInfo_Completions_ID 10
+
+    // 
+    ULONG CompletionLatencyAvgUs;
+    #define VioScsiExtendedInfo_CompletionLatencyAvgUs_SIZE sizeof(ULONG)
+    #define VioScsiExtendedInfo_CompletionLatencyAvgUs_ID 11
+
+    // 
+    ULONG CompletionLatencyMaxUs;
+    #define VioScsiExtendedInfo_CompletionLatencyMaxUs_SIZE sizeof(ULONG)
+    #define VioScsiExtendedInfo_CompletionLatencyMaxUs_ID 12
+
 } VioScsiExtendedInfo, *PVioScsiExtendedInfo;
 
-#define VioScsiExtendedInfo_SIZE (FIELD_OFFSET(VioScsiExtendedInfo, CompletionDuringStartIo) + VioScsiExtendedInfo_CompletionDuringStartIo_SIZE)
+#define VioScsiExtendedInfo_SIZE (FIELD_OFFSET(VioScsiExtendedInfo, CompletionLatencyMaxUs) + VioScsiExtendedInfo_CompletionLatencyMaxUs_SIZE)
+
+// VioScsiQueueMapGuid - VioScsiQueueMap
+// VirtIO SCSI Request Queue Mapping
+#define VioScsiWmi_QueueMap_Guid \
+    { 0x7a4c1e52,0x96b3,0x4f0d, { 0xa8,0xe4,0x3c,0x2d,0x1b,0x9f,0x6e,0x10 } }
+
+#if ! (defined(MIDL_PASS))
+DEFINE_GUID(VioScsiQueueMapGuid_GUID, \
+            0x7a4c1e52,0x96b3,0x4f0d,0xa8,0xe4,0x3c,0x2d,0x1b,0x9f,0x6e,0x10);
+#endif
+
+
+typedef struct _VioScsiQueueMap
+{
+    // 
+    ULONG CpuCount;
+    #define VioScsiQueueMap_CpuCount_SIZE sizeof(ULONG)
+    #define VioScsiQueueMap_CpuCount_ID 1
+
+    // 
+    ULONG QueuesCount;
+    #define VioScsiQueueMap_QueuesCount_SIZE sizeof(ULONG)
+    #define VioScsiQueueMap_QueuesCount_ID 2
+
+    // 
+    UCHAR CpuToQueue[256];
+    #define VioScsiQueueMap_CpuToQueue_SIZE sizeof(UCHAR[256])
+    #define VioScsiQueueMap_CpuToQueue_ID 3
+
+    // 
+    UCHAR CpuNode[256];
+    #define VioScsiQueueMap_CpuNode_SIZE sizeof(UCHAR[256])
+    #define VioScsiQueueMap_CpuNode_ID 4
+
+    // 
+    UCHAR QueueNode[256];
+    #define VioScsiQueueMap_QueueNode_SIZE sizeof(UCHAR[256])
+    #define VioScsiQueueMap_QueueNode_ID 5
+
+} VioScsiQueueMap, *PVioScsiQueueMap;
+
+#define VioScsiQueueMap_SIZE (FIELD_OFFSET(VioScsiQueueMap, QueueNode) + VioScsiQueueMap_QueueNode_SIZE)
 
 #endif
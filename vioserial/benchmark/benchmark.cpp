@@ -1,137 +1,188 @@
 #include "stdafx.h"
 
-template<class IOPROVIDER>
-BOOL RunBenchmarkWorker(HANDLE hPort, SIZE_T cbRequestSize, DWORD dwConcurency, DWORD dwIterations)
+static BOOL GetPortStatistics(HANDLE hPort, PVIRTIO_PORT_STATISTICS lpStats)
 {
-    std::unique_ptr<OVERLAPPED[]> lpOverlapped(new OVERLAPPED[dwConcurency]);
-    std::unique_ptr<HANDLE[]> lpHandles(new HANDLE[dwConcurency + 1]);
-    HANDLE* hTimer = &lpHandles[0];
-    HANDLE* lpEvents = &lpHandles[1];
-    std::unique_ptr<BYTE[]> lpBuffer(new BYTE[cbRequestSize]);
-    memset(lpBuffer.get(), 0, cbRequestSize);
+    OVERLAPPED overlapped;
+    DWORD cbReturned = 0;
+    BOOL bResult;
 
-    // set up the timer
-    *hTimer = CreateWaitableTimer(NULL, FALSE, NULL);
-    if (*hTimer == NULL)
+    // the port is opened for overlapped I/O
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (overlapped.hEvent == NULL)
     {
-        wprintf(L"CreateWaitableTimer failed with error %d\n", GetLastError());
         return FALSE;
     }
+    // keep the completion away from the benchmark's completion port
+    overlapped.hEvent = (HANDLE)((ULONG_PTR)overlapped.hEvent | 1);
 
-    SIZE_T cbTotalTransferred = 0;
-    LARGE_INTEGER iDueTime = { 0, 0 };
-    if (!SetWaitableTimer(*hTimer, &iDueTime, 1000, NULL, NULL, FALSE))
+    bResult = DeviceIoControl(hPort, IOCTL_GET_PORT_STATISTICS, NULL, 0,
+        lpStats, sizeof(*lpStats), NULL, &overlapped);
+    if (bResult || GetLastError() == ERROR_IO_PENDING)
     {
-        wprintf(L"SetWaitableTimer failed with error %d\n", GetLastError());
-        CloseHandle(*hTimer);
-        return FALSE;
+        bResult = GetOverlappedResult(hPort, &overlapped, &cbReturned, TRUE) &&
+            cbReturned == sizeof(*lpStats);
     }
+    CloseHandle((HANDLE)((ULONG_PTR)overlapped.hEvent & ~(ULONG_PTR)1));
+    return bResult;
+}
+
+template<class IOPROVIDER>
+BOOL RunBenchmarkWorker(
+    HANDLE hPort,
+    HANDLE hCompletionPort,
+    SIZE_T cbRequestSize,
+    DWORD dwConcurency,
+    DWORD dwIterations,
+    PBENCHMARK_RESULT lpResult)
+{
+    std::unique_ptr<OVERLAPPED[]> lpOverlapped(new OVERLAPPED[dwConcurency]);
+    std::unique_ptr<LARGE_INTEGER[]> lpStartTime(new LARGE_INTEGER[dwConcurency]);
+    std::vector<ULONGLONG> latencies;
+    LARGE_INTEGER liFrequency;
+    QueryPerformanceFrequency(&liFrequency);
+    std::unique_ptr<BYTE[]> lpBuffer(new BYTE[cbRequestSize]);
+    memset(lpBuffer.get(), 0, cbRequestSize);
 
-    // prepare requests
+    // drivers without the statistics IOCTL just leave the metric out
+    VIRTIO_PORT_STATISTICS statsBefore, statsAfter;
+    BOOL bHaveStats = GetPortStatistics(hPort, &statsBefore);
+
+    // Completions are collected through an I/O completion port rather than
+    // one event per request so that the number of requests in flight is not
+    // limited by MAXIMUM_WAIT_OBJECTS.
+    DWORD dwOutstanding = 0;
     for (DWORD i = 0; i < dwConcurency; i++)
     {
         memset(&lpOverlapped[i], 0, sizeof(OVERLAPPED));
-        lpEvents[i] = CreateEvent(NULL, TRUE, FALSE, NULL);
-        if (lpEvents[i] == NULL)
+        QueryPerformanceCounter(&lpStartTime[i]);
+        if (IOPROVIDER::StartIO(hPort, lpBuffer.get(), (DWORD)cbRequestSize, &lpOverlapped[i]) ||
+            GetLastError() == ERROR_IO_PENDING)
         {
-            wprintf(L"CreateEvent failed with error %d\n", GetLastError());
-            while (i-- > 0)
-            {
-                CloseHandle(lpEvents[i]);
-            }
-            CloseHandle(*hTimer);
-            return FALSE;
+            dwOutstanding++;
+        }
+        else
+        {
+            wprintf(L"StartIO failed with error %d\n", GetLastError());
         }
     }
 
+    ULONGLONG cbTotalTransferred = 0;
+    ULONGLONG cbIntervalTransferred = 0;
+    DWORD dwIntervals = 0;
+    ULONGLONG ullNextTick = GetTickCount64() + 1000;
+
     // main loop
-    while (!_kbhit() && dwIterations > 0)
+    while (!_kbhit() && dwIterations > 0 && dwOutstanding > 0)
     {
-        // (re)initialize all overlapped structures and start the I/O
-        for (DWORD i = 0; i < dwConcurency; i++)
+        ULONGLONG ullNow = GetTickCount64();
+        if (ullNow >= ullNextTick)
         {
-            if (lpOverlapped[i].hEvent == NULL)
+            // one second has elapsed
+            if (cbIntervalTransferred != 0)
             {
-                lpOverlapped[i].hEvent = lpEvents[i];
-                if (!IOPROVIDER::StartIO(hPort, lpBuffer.get(), (DWORD)cbRequestSize, &lpOverlapped[i]))
-                {
-                    DWORD err = GetLastError();
-                    if (err != ERROR_IO_PENDING)
-                    {
-                        wprintf(L"StartIO failed with error %d\n", err);
-                        memset(&lpOverlapped[i], 0, sizeof(OVERLAPPED));
-                    }
-                }
+                wprintf(L"Parallelism %d, throughput %I64u\n", dwConcurency, cbIntervalTransferred);
+                cbTotalTransferred += cbIntervalTransferred;
+                cbIntervalTransferred = 0;
+                dwIntervals++;
+                dwIterations--;
             }
+            ullNextTick += 1000;
+            continue;
         }
 
-        // wait for any of the overlapped events to get signaled or for a timer tick
-        DWORD dwWaitRes = WaitForMultipleObjects(dwConcurency + 1, lpHandles.get(), FALSE, INFINITE);
-        if (dwWaitRes == WAIT_OBJECT_0)
+        DWORD cbTransferred = 0;
+        ULONG_PTR ulKey;
+        LPOVERLAPPED lpCompleted = NULL;
+        if (GetQueuedCompletionStatus(hCompletionPort, &cbTransferred, &ulKey,
+                                      &lpCompleted, (DWORD)(ullNextTick - ullNow)))
         {
-            // the timer object was signaled
-            if (cbTotalTransferred != 0)
-            {
-                wprintf(L"Parallelism %d, throughput %Iu\n", dwConcurency, cbTotalTransferred);
-                cbTotalTransferred = 0;
-                dwIterations--;
-            }
+            LARGE_INTEGER liNow;
+            QueryPerformanceCounter(&liNow);
+            latencies.push_back(liNow.QuadPart - lpStartTime[lpCompleted - lpOverlapped.get()].QuadPart);
+
+            IOPROVIDER::CompleteIO((DWORD)cbRequestSize, cbTransferred);
+            cbIntervalTransferred += cbTransferred;
         }
-        else if (dwWaitRes > WAIT_OBJECT_0 && dwWaitRes <= WAIT_OBJECT_0 + dwConcurency)
+        else if (lpCompleted != NULL)
         {
-            // one of the overlapped events was signaled
-            for (DWORD idx = dwWaitRes - WAIT_OBJECT_0 - 1; idx < dwWaitRes; idx++)
-            {
-                if (WaitForSingleObject(lpEvents[idx], 0) == WAIT_OBJECT_0)
-                {
-                    ResetEvent(lpEvents[idx]);
-                    DWORD cbTransferred;
-                    if (IOPROVIDER::CompleteIO(hPort, (DWORD)cbRequestSize, &lpOverlapped[idx], &cbTransferred))
-                    {
-                        cbTotalTransferred += cbTransferred;
-                    }
-                    else
-                    {
-                        DWORD err = GetLastError();
-                        wprintf(L"CompleteIO failed with error %d\n", err);
-                    }
-                    memset(&lpOverlapped[idx], 0, sizeof(OVERLAPPED));
-                }
-            }
+            wprintf(L"CompleteIO failed with error %d\n", GetLastError());
+        }
+        else
+        {
+            // timed out waiting for a completion
+            continue;
         }
-        else if (dwWaitRes == WAIT_FAILED)
+
+        // restart the request that has just completed
+        dwOutstanding--;
+        memset(lpCompleted, 0, sizeof(OVERLAPPED));
+        QueryPerformanceCounter(&lpStartTime[lpCompleted - lpOverlapped.get()]);
+        if (IOPROVIDER::StartIO(hPort, lpBuffer.get(), (DWORD)cbRequestSize, lpCompleted) ||
+            GetLastError() == ERROR_IO_PENDING)
         {
-            wprintf(L"WaitForMultipleObjects failed with error %d\n", GetLastError());
+            dwOutstanding++;
         }
         else
         {
-            wprintf(L"Unexpected WaitForMultipleObjects return value %d\n", dwWaitRes);
+            wprintf(L"StartIO failed with error %d\n", GetLastError());
         }
     }
 
-    // cancel all requests
-    for (DWORD i = 0; i < dwConcurency; i++)
+    // cancel all requests and wait for them to come back
+    CancelIoEx(hPort, NULL);
+    while (dwOutstanding > 0)
     {
-        if (lpOverlapped[i].hEvent != NULL)
+        DWORD cbTransferred;
+        ULONG_PTR ulKey;
+        LPOVERLAPPED lpCompleted = NULL;
+        GetQueuedCompletionStatus(hCompletionPort, &cbTransferred, &ulKey, &lpCompleted, INFINITE);
+        if (lpCompleted != NULL)
         {
-            if (CancelIoEx(hPort, &lpOverlapped[i]) || GetLastError() != ERROR_NOT_FOUND)
-            {
-                DWORD cbTransferred;
-                GetOverlappedResult(hPort, &lpOverlapped[i], &cbTransferred, TRUE);
-            }
+            dwOutstanding--;
         }
     }
 
-    // close all handles
-    for (DWORD i = 0; i < dwConcurency; i++)
+    lpResult->dNotificationsPerMB = 0;
+    if (bHaveStats && GetPortStatistics(hPort, &statsAfter))
+    {
+        ULONGLONG ullNotifications =
+            (statsAfter.TxNotifications - statsBefore.TxNotifications) +
+            (statsAfter.RxNotifications - statsBefore.RxNotifications) +
+            (statsAfter.Interrupts - statsBefore.Interrupts);
+        ULONGLONG cbMoved = IOPROVIDER::BytesMoved(statsBefore, statsAfter);
+        if (cbMoved != 0)
+        {
+            lpResult->dNotificationsPerMB = ullNotifications * (1024.0 * 1024.0) / cbMoved;
+            wprintf(L"Notifications per MB: %.1f\n", lpResult->dNotificationsPerMB);
+        }
+    }
+
+    lpResult->cbRequestSize = cbRequestSize;
+    lpResult->dwConcurrency = dwConcurency;
+    lpResult->cbThroughput = (dwIntervals != 0) ? (cbTotalTransferred / dwIntervals) : 0;
+    lpResult->ullRequests = latencies.size();
+
+    // latency percentiles in microseconds
+    ZeroMemory(lpResult->ullLatencyUs, sizeof(lpResult->ullLatencyUs));
+    if (!latencies.empty())
     {
-        CloseHandle(lpEvents[i]);
+        static const double percentiles[LATENCY_PERCENTILES] = { 0.5, 0.9, 0.99, 1.0 };
+        std::sort(latencies.begin(), latencies.end());
+        for (int i = 0; i < LATENCY_PERCENTILES; i++)
+        {
+            size_t idx = std::min(latencies.size() - 1, (size_t)(percentiles[i] * latencies.size()));
+            lpResult->ullLatencyUs[i] = latencies[idx] * 1000000 / liFrequency.QuadPart;
+        }
+        wprintf(L"Latency (us): p50 %I64u, p90 %I64u, p99 %I64u, max %I64u\n",
+            lpResult->ullLatencyUs[0], lpResult->ullLatencyUs[1],
+            lpResult->ullLatencyUs[2], lpResult->ullLatencyUs[3]);
     }
-    CloseHandle(*hTimer);
     return TRUE;
 }
 
-BOOL RunWriteBenchmark(HANDLE hPort, SIZE_T cbRequestSize, DWORD dwConcurrency, DWORD dwIterations)
+BOOL RunWriteBenchmark(HANDLE hPort, HANDLE hCompletionPort, SIZE_T cbRequestSize,
+                       DWORD dwConcurrency, DWORD dwIterations, PBENCHMARK_RESULT lpResult)
 {
     class WriteIOProvider
     {
@@ -141,21 +192,22 @@ BOOL RunWriteBenchmark(HANDLE hPort, SIZE_T cbRequestSize, DWORD dwConcurrency,
             return WriteFile(handle, lpBuffer, cbBuffer, NULL, lpOverlapped);
         }
 
-        static BOOL CompleteIO(HANDLE handle, DWORD cbBuffer, LPOVERLAPPED lpOverlapped, LPDWORD lpcbTransferred)
+        static VOID CompleteIO(DWORD cbBuffer, DWORD cbTransferred)
         {
             // we expect to have written the entire buffer
-            if (GetOverlappedResult(handle, lpOverlapped, lpcbTransferred, FALSE))
+            if (cbTransferred != cbBuffer)
             {
-                if (*lpcbTransferred != cbBuffer)
-                {
-                    wprintf(L"Written %d bytes which is not equal to request size %d",
-                        *lpcbTransferred,
-                        cbBuffer
-                        );
-                }
-                return TRUE;
+                wprintf(L"Written %d bytes which is not equal to request size %d",
+                    cbTransferred,
+                    cbBuffer
+                    );
             }
-            return FALSE;
+        }
+
+        static ULONGLONG BytesMoved(const VIRTIO_PORT_STATISTICS &before,
+                                    const VIRTIO_PORT_STATISTICS &after)
+        {
+            return after.BytesWritten - before.BytesWritten;
         }
     };
 
@@ -165,10 +217,12 @@ BOOL RunWriteBenchmark(HANDLE hPort, SIZE_T cbRequestSize, DWORD dwConcurrency,
         dwConcurrency,
         dwIterations
         );
-    return RunBenchmarkWorker<WriteIOProvider>(hPort, cbRequestSize, dwConcurrency, dwIterations);
+    return RunBenchmarkWorker<WriteIOProvider>(hPort, hCompletionPort, cbRequestSize,
+                                               dwConcurrency, dwIterations, lpResult);
 }
 
-BOOL RunReadBenchmark(HANDLE hPort, SIZE_T cbRequestSize, DWORD dwConcurrency, DWORD dwIterations)
+BOOL RunReadBenchmark(HANDLE hPort, HANDLE hCompletionPort, SIZE_T cbRequestSize,
+                      DWORD dwConcurrency, DWORD dwIterations, PBENCHMARK_RESULT lpResult)
 {
     class ReadIOProvider
     {
@@ -178,10 +232,17 @@ BOOL RunReadBenchmark(HANDLE hPort, SIZE_T cbRequestSize, DWORD dwConcurrency, D
             return ReadFile(hPort, lpBuffer, cbBuffer, NULL, lpOverlapped);
         }
 
-        static BOOL CompleteIO(HANDLE hPort, DWORD cbBuffer, LPOVERLAPPED lpOverlapped, LPDWORD lpcbTransferred)
+        static VOID CompleteIO(DWORD cbBuffer, DWORD cbTransferred)
         {
-            // *lpcbTransferred may be less than cbBuffer which is fine for reads
-            return GetOverlappedResult(hPort, lpOverlapped, lpcbTransferred, FALSE);
+            // cbTransferred may be less than cbBuffer which is fine for reads
+            UNREFERENCED_PARAMETER(cbBuffer);
+            UNREFERENCED_PARAMETER(cbTransferred);
+        }
+
+        static ULONGLONG BytesMoved(const VIRTIO_PORT_STATISTICS &before,
+                                    const VIRTIO_PORT_STATISTICS &after)
+        {
+            return after.BytesRead - before.BytesRead;
         }
     };
 
@@ -191,7 +252,8 @@ BOOL RunReadBenchmark(HANDLE hPort, SIZE_T cbRequestSize, DWORD dwConcurrency, D
         dwConcurrency,
         dwIterations
         );
-    return RunBenchmarkWorker<ReadIOProvider>(hPort, cbRequestSize, dwConcurrency, dwIterations);
+    return RunBenchmarkWorker<ReadIOProvider>(hPort, hCompletionPort, cbRequestSize,
+                                              dwConcurrency, dwIterations, lpResult);
 }
 
 BOOL RunBenchmark(
@@ -219,31 +281,74 @@ BOOL RunBenchmark(
         return FALSE;
     }
 
-    BOOL bResult = FALSE;
+    HANDLE hCompletionPort = CreateIoCompletionPort(hPort, NULL, 0, 1);
+    if (hCompletionPort == NULL)
+    {
+        wprintf(L"CreateIoCompletionPort failed with error %d\n", GetLastError());
+        CloseHandle(hPort);
+        return FALSE;
+    }
+
+    // without an explicit concurrency level, sweep 1, 2, 4, ... up to
+    // MAX_SWEEP_CONCURRENCY requests in flight, and without an explicit
+    // request size sweep MIN_SWEEP_REQUEST_SIZE * 4^n up to
+    // MAX_SWEEP_REQUEST_SIZE, then summarize at the end
+    std::vector<BENCHMARK_RESULT> results;
+    BOOL bResult = TRUE;
+    BOOL bSingleSize = (cbRequestSize != 0);
     BOOL bSingleRun = (dwConcurrency != 0);
-    dwConcurrency = std::max((DWORD)1, dwConcurrency);
+    SIZE_T cbSize = bSingleSize ? cbRequestSize : MIN_SWEEP_REQUEST_SIZE;
     do
     {
-        switch (type)
+        DWORD dwLevel = std::max((DWORD)1, dwConcurrency);
+        do
         {
-        case ReadBenchmark:
-            bResult = RunReadBenchmark(hPort, cbRequestSize, dwConcurrency, dwIterations);
-            break;
-        case WriteBenchmark:
-            bResult = RunWriteBenchmark(hPort, cbRequestSize, dwConcurrency, dwIterations);
-            break;
-        default:
-            wprintf(L"Unknown benchmark type\n");
-            break;
+            BENCHMARK_RESULT result;
+            switch (type)
+            {
+            case ReadBenchmark:
+                bResult = RunReadBenchmark(hPort, hCompletionPort, cbSize,
+                                           dwLevel, dwIterations, &result);
+                break;
+            case WriteBenchmark:
+                bResult = RunWriteBenchmark(hPort, hCompletionPort, cbSize,
+                                            dwLevel, dwIterations, &result);
+                break;
+            default:
+                wprintf(L"Unknown benchmark type\n");
+                bResult = FALSE;
+                break;
+            }
+            if (bResult)
+            {
+                results.push_back(result);
+            }
+            dwLevel *= 2;
+        } while (bResult && !bSingleRun && dwLevel <= MAX_SWEEP_CONCURRENCY && !_kbhit());
+        cbSize *= 4;
+    } while (bResult && !bSingleSize && cbSize <= MAX_SWEEP_REQUEST_SIZE && !_kbhit());
+
+    if (results.size() > 1)
+    {
+        wprintf(L"\n%10s %12s %16s %10s %10s %10s %10s %10s\n",
+            L"Size", L"Parallelism", L"Bytes/s", L"p50 us", L"p90 us", L"p99 us", L"max us",
+            L"Notif/MB");
+        for (const auto &result : results)
+        {
+            wprintf(L"%10Iu %12u %16I64u %10I64u %10I64u %10I64u %10I64u %10.1f\n",
+                result.cbRequestSize, result.dwConcurrency, result.cbThroughput,
+                result.ullLatencyUs[0], result.ullLatencyUs[1],
+                result.ullLatencyUs[2], result.ullLatencyUs[3],
+                result.dNotificationsPerMB);
         }
-        dwConcurrency++;
-    } while (bResult && !bSingleRun && !_kbhit());
+    }
 
     while (_kbhit())
     {
         _getch();
     }
 
+    CloseHandle(hCompletionPort);
     CloseHandle(hPort);
     return bResult;
 }
@@ -1,5 +1,25 @@
 #pragma once
 
+// highest number of requests in flight tried by a concurrency sweep
+#define MAX_SWEEP_CONCURRENCY 256
+
+// request sizes tried by a size sweep, growing 4x per step
+#define MIN_SWEEP_REQUEST_SIZE 512
+#define MAX_SWEEP_REQUEST_SIZE (128 * 1024)
+
+// p50, p90, p99 and max
+#define LATENCY_PERCENTILES 4
+
+typedef struct _BENCHMARK_RESULT
+{
+    SIZE_T cbRequestSize;
+    DWORD dwConcurrency;
+    ULONGLONG cbThroughput;     // average bytes per second
+    ULONGLONG ullRequests;      // number of completed requests
+    ULONGLONG ullLatencyUs[LATENCY_PERCENTILES];
+    double dNotificationsPerMB; // driver kicks and queue interrupts, 0 if unknown
+} BENCHMARK_RESULT, *PBENCHMARK_RESULT;
+
 enum BenchmarkType
 {
     ReadBenchmark,
@@ -9,7 +29,8 @@ enum BenchmarkType
 BOOL RunBenchmark(
     LPCWSTR wszPortName,   // for example "com.redhat.port1"
     BenchmarkType type,    // the type of benchmark to run
-    SIZE_T cbRequestSize,  // size of each request in bytes
+    SIZE_T cbRequestSize,  // size of each request in bytes, 0 for a sweep
     DWORD dwConcurrency,   // number of requests running in parallel, 0 for a sweep
+                           // over 1, 2, 4, ... MAX_SWEEP_CONCURRENCY
     DWORD dwIterations     // number of seconds to run the benchmark for
     );
@@ -10,9 +10,11 @@ VOID ShowUsage()
     wprintf(L"\n");
     wprintf(L"<type>           (r)ead or (w)rite\n");
     wprintf(L"<port_name>      name of the port to use\n");
-    wprintf(L"<request_size>   size of each I/O request in bytes, %u by default\n", DEFAULT_REQUEST_SIZE);
+    wprintf(L"<request_size>   size of each I/O request in bytes, %u by default,\n", DEFAULT_REQUEST_SIZE);
+    wprintf(L"                 0 benchmarks sizes %u, %u, ... %u\n",
+        MIN_SWEEP_REQUEST_SIZE, MIN_SWEEP_REQUEST_SIZE * 4, MAX_SWEEP_REQUEST_SIZE);
     wprintf(L"<concurrency>    number of requests to run in parallel, if ommitted\n");
-    wprintf(L"                 benchmarks all concurrency levels 1 and up\n");
+    wprintf(L"                 benchmarks concurrency levels 1, 2, 4, ... %u\n", MAX_SWEEP_CONCURRENCY);
     wprintf(L"<time>           time in seconds to run for at each concurrency level,\n");
     wprintf(L"                 %u by default\n", DEFAULT_NUM_OF_ITERATIONS);
     wprintf(L"\n");
@@ -1,13 +1,16 @@
 #pragma once
 
 #include <windows.h>
+#include <winioctl.h>
 #include <stdio.h>
 #include <conio.h>
 #include <algorithm>
 #include <limits>
 #include <memory>
+#include <vector>
 
 // interferes with numeric_limits<T>::max
 #undef max
 
+#include "..\sys\public.h"
 #include "benchmark.h"
@@ -78,6 +78,7 @@ public:
     PVOID OpenPortById(UINT id);
     BOOL ReadPort(PVOID port, PVOID buf, PULONG size);
     BOOL WritePort(PVOID port, PVOID buf, ULONG size);
+    BOOL MapPortRing(PVOID port, ULONG size);
     VOID ClosePort(PVOID port);
     size_t NumPorts() {return Ports.size();};
     wchar_t* PortSymbolicName(int index);
@@ -144,6 +145,16 @@ private:
     HDEVNOTIFY Notify;
     PnPControl* Control;
     UINT Reference;
+    PVIRTIO_SHARED_RINGS Rings;
+    ULONG RingSize;
+    HANDLE RxEvent;
+    HANDLE TxEvent;
+    OVERLAPPED RingOverlapped;
+    void FreeRing();
+    BOOL KickRing();
+    BOOL WaitRing(HANDLE hEvent);
+    BOOL ReadRing(PVOID buf, size_t *len);
+    BOOL WriteRing(PVOID buf, size_t *len);
 public:
     SerialPort(wstring LinkName, PnPControl* ptr);
     virtual ~SerialPort();
@@ -153,6 +164,7 @@ public:
     void ClosePort();
     BOOL ReadPort(PVOID buf, size_t *len);
     BOOL WritePort(PVOID buf, size_t *len);
+    BOOL MapRing(ULONG size);
     virtual void handleEvent(const PnPControl& ref);
     pair <VIOSERIALNOTIFYCALLBACK*, PVOID> NotificationPair;
 };
@@ -422,6 +422,20 @@ BOOL PnPControl::WritePort(PVOID port, PVOID buf, ULONG size)
     LeaveCriticalSection(&PortsCS);
     return (*it != port) ? FALSE : ((SerialPort*)(*it))->WritePort(buf, (size_t*)(&size));
 }
+BOOL PnPControl::MapPortRing(PVOID port, ULONG size)
+{
+    Iterator it;
+    EnterCriticalSection(&PortsCS);
+    for(it = Ports.begin(); it != Ports.end(); it++)
+    {
+        if (*it == port)
+        {
+            break;
+        }
+    }
+    LeaveCriticalSection(&PortsCS);
+    return (*it != port) ? FALSE : ((SerialPort*)(*it))->MapRing(size);
+}
 VOID PnPControl::ClosePort(PVOID port)
 {
     EnterCriticalSection(&PortsCS);
@@ -64,6 +64,14 @@ DLL_API BOOL WritePort ( PVOID port, PVOID buf, ULONG size )
     return ret;
 }
 
+DLL_API BOOL MapPortRing ( PVOID port, ULONG size )
+{
+    PnPControl* control = PnPControl::GetInstance();
+    BOOL ret = control->MapPortRing(port, size);
+    PnPControl::CloseInstance();
+    return ret;
+}
+
 DLL_API VOID ClosePort ( PVOID port )
 {
     PnPControl* control = PnPControl::GetInstance();
@@ -7,6 +7,11 @@ SerialPort::SerialPort(wstring LinkName, PnPControl* ptr)
     NotificationPair.first = NULL;
     NotificationPair.second = NULL;
     Reference = 0;
+    Rings = NULL;
+    RingSize = 0;
+    RxEvent = NULL;
+    TxEvent = NULL;
+    ZeroMemory(&RingOverlapped, sizeof(RingOverlapped));
     Handle = CreateFile(Name.c_str(),
         GENERIC_WRITE | GENERIC_READ,
         0,
@@ -103,6 +108,8 @@ void SerialPort::ClosePort()
         CloseHandle(Handle);
         Handle = INVALID_HANDLE_VALUE;
     }
+    // closing the handle has cancelled the map request, if any
+    FreeRing();
 }
 
 BOOL SerialPort::ReadPort(PVOID buf, size_t *len)
@@ -118,6 +125,11 @@ BOOL SerialPort::ReadPort(PVOID buf, size_t *len)
         return TRUE;
     }
 
+    if (Rings != NULL)
+    {
+        return ReadRing(buf, len);
+    }
+
     ol.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
     if( ol.hEvent == NULL)
     {
@@ -174,6 +186,11 @@ BOOL SerialPort::WritePort(PVOID buf, size_t *len)
         return TRUE;
     }
 
+    if (Rings != NULL)
+    {
+        return WriteRing(buf, len);
+    }
+
     ol.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
 
     if( ol.hEvent == NULL)
@@ -218,6 +235,203 @@ BOOL SerialPort::WritePort(PVOID buf, size_t *len)
     return res;
 }
 
+BOOL SerialPort::MapRing(ULONG size)
+{
+    VIRTIO_SHARED_RING_MAP map = {0};
+    DWORD bytes = (DWORD)VIRTIO_SHARED_RING_BUFFER_SIZE(size);
+    DWORD ret;
+    PVOID mem;
+
+    if (Handle == INVALID_HANDLE_VALUE || Rings != NULL)
+    {
+        return FALSE;
+    }
+
+    // VirtualAlloc hands out page aligned memory, which the driver locks
+    // for as long as the map request is pending
+    mem = VirtualAlloc(NULL, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    RxEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    TxEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    RingOverlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (mem == NULL || RxEvent == NULL || TxEvent == NULL ||
+        RingOverlapped.hEvent == NULL)
+    {
+        printf ("Error. Can't allocate the shared ring %d.\n", GetLastError());
+        if (mem != NULL)
+        {
+            VirtualFree(mem, 0, MEM_RELEASE);
+        }
+        FreeRing();
+        return FALSE;
+    }
+
+    map.RingSize = size;
+    map.RxEvent = (ULONGLONG)(ULONG_PTR)RxEvent;
+    map.TxEvent = (ULONGLONG)(ULONG_PTR)TxEvent;
+
+    // the request completes only when the driver lets go of the rings
+    if (DeviceIoControl(Handle, IOCTL_MAP_SHARED_RING, &map, sizeof(map),
+        mem, bytes, &ret, &RingOverlapped) ||
+        GetLastError() != ERROR_IO_PENDING)
+    {
+        printf ("Error. Can't map the shared ring %d.\n", GetLastError());
+        VirtualFree(mem, 0, MEM_RELEASE);
+        FreeRing();
+        return FALSE;
+    }
+
+    Rings = (PVIRTIO_SHARED_RINGS)mem;
+    RingSize = size;
+    return TRUE;
+}
+
+void SerialPort::FreeRing()
+{
+    if (Rings != NULL)
+    {
+        WaitForSingleObject(RingOverlapped.hEvent, INFINITE);
+        VirtualFree(Rings, 0, MEM_RELEASE);
+        Rings = NULL;
+        RingSize = 0;
+    }
+    if (RingOverlapped.hEvent != NULL)
+    {
+        CloseHandle(RingOverlapped.hEvent);
+        RingOverlapped.hEvent = NULL;
+    }
+    if (RxEvent != NULL)
+    {
+        CloseHandle(RxEvent);
+        RxEvent = NULL;
+    }
+    if (TxEvent != NULL)
+    {
+        CloseHandle(TxEvent);
+        TxEvent = NULL;
+    }
+}
+
+BOOL SerialPort::KickRing()
+{
+    BOOL res;
+    DWORD ret;
+    OVERLAPPED  ol = {0};
+
+    ol.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if( ol.hEvent == NULL)
+    {
+        return FALSE;
+    }
+
+    res = DeviceIoControl(Handle, IOCTL_KICK_SHARED_RING, NULL, 0,
+        NULL, 0, &ret, &ol);
+    if (!res && GetLastError() == ERROR_IO_PENDING)
+    {
+        res = GetOverlappedResult(Handle, &ol, &ret, TRUE);
+    }
+
+    CloseHandle( ol.hEvent );
+    return res;
+}
+
+BOOL SerialPort::WaitRing(HANDLE hEvent)
+{
+    HANDLE handles[2] = { hEvent, RingOverlapped.hEvent };
+
+    // the map request completing means the driver has dropped the rings
+    return WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0;
+}
+
+BOOL SerialPort::ReadRing(PVOID buf, size_t *len)
+{
+    PVIRTIO_SHARED_RING_HEADER rx = &Rings->Rx;
+    PUCHAR data = Rings->Data + RingSize;
+    ULONG head, tail, used, offset, count, first;
+
+    for (;;)
+    {
+        tail = rx->Tail;
+        head = rx->Head;
+        MemoryBarrier();
+        if (head != tail)
+        {
+            break;
+        }
+        if (!WaitRing(RxEvent))
+        {
+            *len = 0;
+            return FALSE;
+        }
+    }
+
+    used = head - tail;
+    count = (ULONG)min(*len, (size_t)used);
+    offset = tail & (RingSize - 1);
+    first = min(count, RingSize - offset);
+    memcpy(buf, data + offset, first);
+    memcpy((PUCHAR)buf + first, data, count - first);
+
+    MemoryBarrier();
+    rx->Tail = tail + count;
+    MemoryBarrier();
+    *len = count;
+
+    // The driver stops filling a full ring until it is told about the room.
+    // It may have filled it up after we took our snapshot, so look at the
+    // head again now that the new tail is visible.
+    if (rx->Head - tail == RingSize)
+    {
+        return KickRing();
+    }
+    return TRUE;
+}
+
+BOOL SerialPort::WriteRing(PVOID buf, size_t *len)
+{
+    PVIRTIO_SHARED_RING_HEADER tx = &Rings->Tx;
+    PUCHAR data = Rings->Data;
+    size_t total = *len;
+    size_t written = 0;
+    ULONG head, space, offset, count, first;
+    BOOL res = TRUE;
+
+    while (written < total)
+    {
+        head = tx->Head;
+        space = RingSize - (head - tx->Tail);
+        if (space == 0)
+        {
+            // signalled once the driver has taken everything out
+            if (!WaitRing(TxEvent))
+            {
+                res = FALSE;
+                break;
+            }
+            continue;
+        }
+
+        count = (ULONG)min(total - written, (size_t)space);
+        offset = head & (RingSize - 1);
+        first = min(count, RingSize - offset);
+        memcpy(data + offset, (PUCHAR)buf + written, first);
+        memcpy(data, (PUCHAR)buf + written + first, count - first);
+
+        MemoryBarrier();
+        tx->Head = head + count;
+        MemoryBarrier();
+        written += count;
+
+        // the driver goes idle once the ring is empty, wake it up if it was
+        if (tx->Tail == head && !KickRing())
+        {
+            res = FALSE;
+            break;
+        }
+    }
+
+    *len = written;
+    return res;
+}
 
 void SerialPort::handleEvent(const PnPControl& ref)
 {
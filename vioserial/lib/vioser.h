@@ -17,6 +17,10 @@ DLL_API PVOID OpenPortByName(const wchar_t* name);
 DLL_API PVOID OpenPortById(UINT id);
 DLL_API BOOL ReadPort(PVOID port, PVOID buf, PULONG size);
 DLL_API BOOL WritePort(PVOID port, PVOID buf, ULONG size);
+// Switches an open port to the shared ring mode with rings of size bytes
+// (a power of two) per direction. ReadPort and WritePort keep working on top
+// of the rings until the port is closed.
+DLL_API BOOL MapPortRing(PVOID port, ULONG size);
 DLL_API VOID ClosePort(PVOID port);
 DLL_API UINT NumPorts();
 DLL_API wchar_t* PortSymbolicName(int index);
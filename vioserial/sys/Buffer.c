@@ -42,6 +42,7 @@ VIOSerialAllocateBuffer(
     buf->len = 0;
     buf->offset = 0;
     buf->size = buf_size;
+    buf->pooled = FALSE;
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_QUEUEING, "<-- %s\n", __FUNCTION__);
     return buf;
@@ -52,45 +53,42 @@ size_t VIOSerialSendBuffers(IN PVIOSERIAL_PORT Port,
                             IN size_t Length)
 {
     struct virtqueue *vq = GetOutQueue(Port);
-    struct VirtIOBufferDescriptor sg[QUEUE_DESCRIPTORS];
-    PVOID buffer = Entry->Buffer;
-    size_t length = Length;
-    int out = 0, prepared = 0;
-    int ret;
+    WDFREQUEST cancelled = NULL;
+    int prepared = 0;
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_WRITE,
         "--> %s Buffer: %p Length: %d\n", __FUNCTION__, Entry->Buffer, Length);
 
-    if (BYTES_TO_PAGES(Length) > QUEUE_DESCRIPTORS)
+    if (ADDRESS_AND_SIZE_TO_SPAN_PAGES(Entry->Buffer, Length) > QUEUE_DESCRIPTORS)
     {
         return 0;
     }
 
-    while (length > 0)
-    {
-        sg[out].physAddr = MmGetPhysicalAddress(buffer);
-        sg[out].length = min(length, PAGE_SIZE);
-
-        buffer = (PVOID)((LONG_PTR)buffer + sg[out].length);
-        length -= sg[out].length;
-        out += 1;
-    }
-
     WdfSpinLockAcquire(Port->OutVqLock);
 
-    ret = virtqueue_add_buf(vq, sg, out, 0, Entry->Buffer, NULL, 0);
-
-    if (ret >= 0)
+    if (VIOSerialAddOutBufLocked(Port, Entry, Length))
     {
+        Port->Statistics.BytesWritten += Length;
+        // Only a write the host got a copy of can be cancelled, a direct
+        // write is completed when the host gives the request's pages back.
+        // Marking it once it is posted, under the lock, guarantees the
+        // cancel routine finds the entry in WriteBuffersList.
+        if (Entry->OwnBuffer && Entry->Request != NULL &&
+            WdfRequestMarkCancelableEx(Entry->Request,
+                VIOSerialPortWriteRequestCancel) == STATUS_CANCELLED)
+        {
+            cancelled = Entry->Request;
+            Entry->Request = NULL;
+        }
         prepared = virtqueue_kick_prepare(vq);
-        PushEntryList(&Port->WriteBuffersList, &Entry->ListEntry);
+        if (prepared)
+        {
+            Port->Statistics.TxNotifications++;
+        }
     }
     else
     {
-        Port->OutVqFull = TRUE;
         Length = 0;
-        TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE,
-            "Error adding buffer to queue (ret = %d)\n", ret);
     }
 
     WdfSpinLockRelease(Port->OutVqLock);
@@ -101,11 +99,70 @@ size_t VIOSerialSendBuffers(IN PVIOSERIAL_PORT Port,
         virtqueue_notify(vq);
     }
 
+    if (cancelled != NULL)
+    {
+        WdfRequestCompleteWithInformation(cancelled, STATUS_CANCELLED, 0L);
+    }
+
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_WRITE, "<-- %s\n", __FUNCTION__);
 
     return Length;
 }
 
+BOOLEAN
+VIOSerialAddOutBufLocked(
+    IN PVIOSERIAL_PORT Port,
+    IN PWRITE_BUFFER_ENTRY Entry,
+    IN size_t Length
+)
+{
+    struct virtqueue *vq = GetOutQueue(Port);
+    struct VirtIOBufferDescriptor sg[QUEUE_DESCRIPTORS];
+    PVOID buffer = Entry->Buffer;
+    size_t length = Length;
+    int out = 0;
+    int ret;
+
+    ASSERT(ADDRESS_AND_SIZE_TO_SPAN_PAGES(buffer, Length) <= QUEUE_DESCRIPTORS);
+
+    // The buffer is not necessarily page aligned when it comes straight
+    // from the request, so split it on page boundaries.
+    while (length > 0)
+    {
+        sg[out].physAddr = MmGetPhysicalAddress(buffer);
+        sg[out].length = (ULONG)min(length, PAGE_SIZE - BYTE_OFFSET(buffer));
+
+        buffer = (PVOID)((LONG_PTR)buffer + sg[out].length);
+        length -= sg[out].length;
+        out += 1;
+    }
+
+    ret = virtqueue_add_buf(vq, sg, out, 0, Entry, NULL, 0);
+    if (ret < 0)
+    {
+        Port->OutVqFull = TRUE;
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE,
+            "Error adding buffer to queue (ret = %d)\n", ret);
+        return FALSE;
+    }
+
+    InsertTailList(&Port->WriteBuffersList, &Entry->ListEntry);
+    return TRUE;
+}
+
+VOID
+VIOSerialFreeWriteBufferEntry(
+    IN PWRITE_BUFFER_ENTRY Entry
+)
+{
+    if (Entry->OwnBuffer)
+    {
+        ExFreePoolWithTag(Entry->Buffer, VIOSERIAL_DRIVER_MEMORY_TAG);
+    }
+    Entry->Buffer = NULL;
+    WdfObjectDelete(Entry->EntryHandle);
+}
+
 VOID
 VIOSerialFreeBuffer(
     IN PPORT_BUFFER buf
@@ -113,6 +170,11 @@ VIOSerialFreeBuffer(
 {
     ASSERT(buf);
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_QUEUEING, "--> %s  buf = %p, buf->va_buf = %p\n", __FUNCTION__, buf, buf->va_buf);
+    if (buf->pooled)
+    {
+        // released with the rest of the pool by VIOSerialFreeInBufPool
+        return;
+    }
     if (buf->va_buf)
     {
         ExFreePoolWithTag(buf->va_buf, VIOSERIAL_DRIVER_MEMORY_TAG);
@@ -122,11 +184,97 @@ VIOSerialFreeBuffer(
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_QUEUEING, "<-- %s\n", __FUNCTION__);
 }
 
+NTSTATUS
+VIOSerialAllocateInBufPool(
+    IN PVIOSERIAL_PORT Port
+)
+{
+    struct virtqueue *vq = GetInQueue(Port);
+    PPORT_BUFFER buf;
+    size_t size;
+    ULONG count, max_count, i;
+    NTSTATUS status = STATUS_SUCCESS;
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_INIT, "--> %s\n", __FUNCTION__);
+
+    ASSERT(Port->InBufPool == NULL);
+
+    size = ROUND_TO_PAGES(Port->InBufSize);
+    size = min(max(size, PAGE_SIZE), VIOSERIAL_MAX_IN_BUF_PAGES * PAGE_SIZE);
+
+    // every page of a buffer takes one descriptor
+    max_count = virtqueue_get_vring_size(vq) / (ULONG)BYTES_TO_PAGES(size);
+    count = Port->InBufCount ? min(Port->InBufCount, max_count) : max_count;
+    if (count == 0)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    Port->InBufPool = (PPORT_BUFFER)ExAllocatePoolWithTag(NonPagedPool,
+        count * sizeof(PORT_BUFFER), VIOSERIAL_DRIVER_MEMORY_TAG);
+    Port->InBufPoolData = ExAllocatePoolWithTag(NonPagedPool,
+        count * size, VIOSERIAL_DRIVER_MEMORY_TAG);
+    if (Port->InBufPool == NULL || Port->InBufPoolData == NULL)
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_INIT,
+            "Failed to allocate %u receive buffers of %Iu bytes\n", count, size);
+        VIOSerialFreeInBufPool(Port);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    WdfSpinLockAcquire(Port->InBufLock);
+    for (i = 0; i < count; i++)
+    {
+        buf = &Port->InBufPool[i];
+        buf->va_buf = (PVOID)((LONG_PTR)Port->InBufPoolData + i * size);
+        buf->pa_buf = MmGetPhysicalAddress(buf->va_buf);
+        buf->size = size;
+        buf->len = 0;
+        buf->offset = 0;
+        buf->pooled = TRUE;
+
+        status = VIOSerialAddInBuf(vq, buf);
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+    }
+    virtqueue_kick(vq);
+    WdfSpinLockRelease(Port->InBufLock);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_INIT,
+        "Port %d: %u of %u receive buffers of %Iu bytes posted\n",
+        Port->PortId, i, count, size);
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_INIT, "<-- %s\n", __FUNCTION__);
+    return (i > 0) ? STATUS_SUCCESS : status;
+}
+
+// the buffers must have been detached from the virtqueue already
+VOID
+VIOSerialFreeInBufPool(
+    IN PVIOSERIAL_PORT Port
+)
+{
+    if (Port->InBufPoolData != NULL)
+    {
+        ExFreePoolWithTag(Port->InBufPoolData, VIOSERIAL_DRIVER_MEMORY_TAG);
+        Port->InBufPoolData = NULL;
+    }
+    if (Port->InBufPool != NULL)
+    {
+        ExFreePoolWithTag(Port->InBufPool, VIOSERIAL_DRIVER_MEMORY_TAG);
+        Port->InBufPool = NULL;
+    }
+}
+
 VOID VIOSerialProcessInputBuffers(IN PVIOSERIAL_PORT Port)
 {
     NTSTATUS status;
     ULONG Read;
-    WDFREQUEST Request = NULL;
+    WDFREQUEST Request;
+    PVOID Buffer;
+    size_t Length;
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_QUEUEING, "--> %s\n", __FUNCTION__);
 
@@ -141,41 +289,40 @@ VOID VIOSerialProcessInputBuffers(IN PVIOSERIAL_PORT Port)
         VIOSerialDiscardPortDataLocked(Port);
     }
 
-    if (Port->InBuf && Port->PendingReadRequest)
+    if (Port->SharedRing.Rings != NULL)
     {
-        status = WdfRequestUnmarkCancelable(Port->PendingReadRequest);
-        if (status != STATUS_CANCELLED)
-        {
-            PVOID Buffer;
-            size_t Length;
+        // a mapped port has no reads, everything goes to its rx ring
+        VIOSerialSharedRingFillLocked(Port);
+        WdfSpinLockRelease(Port->InBufLock);
+        TraceEvents(TRACE_LEVEL_VERBOSE, DBG_QUEUEING, "<-- %s\n", __FUNCTION__);
+        return;
+    }
 
-            status = WdfRequestRetrieveOutputBuffer(Port->PendingReadRequest, 0, &Buffer, &Length);
-            if (NT_SUCCESS(status))
-            {
-                Request = Port->PendingReadRequest;
-                Port->PendingReadRequest = NULL;
-                Read = (ULONG)VIOSerialFillReadBufLocked(Port, Buffer, Length);
-            }
-            else
-            {
-                TraceEvents(TRACE_LEVEL_ERROR, DBG_QUEUEING,
-                    "Failed to retrieve output buffer (Status: %x Request: %p).\n",
-                    status, Request);
-            }
+    // satisfy as many waiting reads as there is data for, each of them
+    // taking whatever is available up to its own length
+    while (VIOSerialPortHasDataLocked(Port) &&
+           NT_SUCCESS(WdfIoQueueRetrieveNextRequest(Port->PendingReadQueue, &Request)))
+    {
+        Read = 0;
+        status = WdfRequestRetrieveOutputBuffer(Request, 0, &Buffer, &Length);
+        if (NT_SUCCESS(status))
+        {
+            Read = (ULONG)VIOSerialFillReadBufLocked(Port, Buffer, Length);
         }
         else
         {
-            TraceEvents(TRACE_LEVEL_INFORMATION, DBG_QUEUEING,
-                "Request %p was cancelled.\n", Request);
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_QUEUEING,
+                "Failed to retrieve output buffer (Status: %x Request: %p).\n",
+                status, Request);
         }
-    }
-    WdfSpinLockRelease(Port->InBufLock);
 
-    if (Request != NULL)
-    {
-        // no need to have the lock when completing the request
-        WdfRequestCompleteWithInformation(Request, STATUS_SUCCESS, Read);
+        // no need to have the lock when completing the request, the data
+        // is already taken and new reads queue up behind the pending ones
+        WdfSpinLockRelease(Port->InBufLock);
+        WdfRequestCompleteWithInformation(Request, status, Read);
+        WdfSpinLockAcquire(Port->InBufLock);
     }
+    WdfSpinLockRelease(Port->InBufLock);
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_QUEUEING, "<-- %s\n", __FUNCTION__);
 }
@@ -183,53 +330,37 @@ VOID VIOSerialProcessInputBuffers(IN PVIOSERIAL_PORT Port)
 BOOLEAN VIOSerialReclaimConsumedBuffers(IN PVIOSERIAL_PORT Port)
 {
     WDFREQUEST request;
-    SINGLE_LIST_ENTRY ReclaimedList = { NULL };
-    PSINGLE_LIST_ENTRY iter, last = &ReclaimedList;
-    PVOID buffer;
+    LIST_ENTRY ReclaimedList;
+    PLIST_ENTRY iter;
+    PWRITE_BUFFER_ENTRY entry;
     UINT len;
     struct virtqueue *vq = GetOutQueue(Port);
     BOOLEAN ret;
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_QUEUEING, "--> %s\n", __FUNCTION__);
 
+    InitializeListHead(&ReclaimedList);
+
     WdfSpinLockAcquire(Port->OutVqLock);
 
     if (vq)
     {
-        while ((buffer = virtqueue_get_buf(vq, &len)) != NULL)
+        while ((entry = (PWRITE_BUFFER_ENTRY)virtqueue_get_buf(vq, &len)) != NULL)
         {
-            iter = &Port->WriteBuffersList;
-            while (iter->Next != NULL)
+            if (entry->Request != NULL && entry->OwnBuffer)
             {
-                PWRITE_BUFFER_ENTRY entry = CONTAINING_RECORD(iter->Next,
-                    WRITE_BUFFER_ENTRY, ListEntry);
-
-                if (buffer == entry->Buffer)
-                {
-                    if (entry->Request != NULL)
-                    {
-                        request = entry->Request;
-                        if (WdfRequestUnmarkCancelable(request) == STATUS_CANCELLED)
-                        {
-                            TraceEvents(TRACE_LEVEL_INFORMATION, DBG_QUEUEING,
-                                "Request %p was cancelled.\n", request);
-                            entry->Request = NULL;
-                        }
-                    }
-
-                    // remove from WriteBuffersList
-                    iter->Next = entry->ListEntry.Next;
-
-                    // append to ReclaimedList
-                    last->Next = &entry->ListEntry;
-                    last = last->Next;
-                    last->Next = NULL;
-                }
-                else
+                request = entry->Request;
+                if (WdfRequestUnmarkCancelable(request) == STATUS_CANCELLED)
                 {
-                    iter = iter->Next;
+                    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_QUEUEING,
+                        "Request %p was cancelled.\n", request);
+                    entry->Request = NULL;
                 }
-            };
+            }
+
+            // move from WriteBuffersList to ReclaimedList
+            RemoveEntryList(&entry->ListEntry);
+            InsertTailList(&ReclaimedList, &entry->ListEntry);
 
             Port->OutVqFull = FALSE;
         }
@@ -239,10 +370,10 @@ BOOLEAN VIOSerialReclaimConsumedBuffers(IN PVIOSERIAL_PORT Port)
     WdfSpinLockRelease(Port->OutVqLock);
 
     // no need to hold the lock to complete requests and free buffers
-    while ((iter = PopEntryList(&ReclaimedList)) != NULL)
+    while (!IsListEmpty(&ReclaimedList))
     {
-        PWRITE_BUFFER_ENTRY entry = CONTAINING_RECORD(iter,
-            WRITE_BUFFER_ENTRY, ListEntry);
+        iter = RemoveHeadList(&ReclaimedList);
+        entry = CONTAINING_RECORD(iter, WRITE_BUFFER_ENTRY, ListEntry);
 
         request = entry->Request;
         if (request != NULL)
@@ -251,8 +382,7 @@ BOOLEAN VIOSerialReclaimConsumedBuffers(IN PVIOSERIAL_PORT Port)
                 WdfRequestGetInformation(request));
         }
 
-        ExFreePoolWithTag(entry->Buffer, VIOSERIAL_DRIVER_MEMORY_TAG);
-        WdfObjectDelete(entry->EntryHandle);
+        VIOSerialFreeWriteBufferEntry(entry);
     };
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_QUEUEING, "<-- %s Full: %d\n",
@@ -271,31 +401,51 @@ VIOSerialFillReadBufLocked(
 {
     PPORT_BUFFER buf;
     NTSTATUS  status = STATUS_SUCCESS;
+    SIZE_T    copied = 0;
+    SIZE_T    chunk;
+    ULONG     refilled = 0;
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_QUEUEING, "--> %s\n", __FUNCTION__);
 
-    if (!count || !VIOSerialPortHasDataLocked(port))
-        return 0;
-
-    buf = port->InBuf;
-    count = min(count, buf->len - buf->offset);
-
-    RtlCopyMemory(outbuf, (PVOID)((LONG_PTR)buf->va_buf + buf->offset), count);
+    // keep going through the received buffers until the caller's buffer
+    // is full or there is nothing more the host has sent
+    while (copied < count && VIOSerialPortHasDataLocked(port))
+    {
+        buf = port->InBuf;
+        chunk = min(count - copied, buf->len - buf->offset);
 
-    buf->offset += count;
+        RtlCopyMemory((PVOID)((LONG_PTR)outbuf + copied),
+                      (PVOID)((LONG_PTR)buf->va_buf + buf->offset), chunk);
 
-    if (buf->offset == buf->len)
-    {
-        port->InBuf = NULL;
+        buf->offset += chunk;
+        copied += chunk;
 
-        status = VIOSerialAddInBuf(GetInQueue(port), buf);
-        if (!NT_SUCCESS(status))
+        if (buf->offset == buf->len)
         {
-           TraceEvents(TRACE_LEVEL_ERROR, DBG_QUEUEING, "%s::%d  VIOSerialAddInBuf failed\n", __FUNCTION__, __LINE__);
+            port->InBuf = NULL;
+
+            status = VIOSerialAddInBuf(GetInQueue(port), buf);
+            if (!NT_SUCCESS(status))
+            {
+               TraceEvents(TRACE_LEVEL_ERROR, DBG_QUEUEING, "%s::%d  VIOSerialAddInBuf failed\n", __FUNCTION__, __LINE__);
+            }
+            else
+            {
+               refilled++;
+            }
         }
     }
+
+    port->Statistics.BytesRead += copied;
+
+    // one notification for all the buffers given back to the host
+    if (refilled && virtqueue_kick_prepare(GetInQueue(port)))
+    {
+        virtqueue_notify(GetInQueue(port));
+        port->Statistics.RxNotifications++;
+    }
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_QUEUEING, "<-- %s\n", __FUNCTION__);
-    return count;
+    return copied;
 }
 
 
@@ -305,7 +455,9 @@ VIOSerialAddInBuf(
     IN PPORT_BUFFER buf)
 {
     NTSTATUS  status = STATUS_SUCCESS;
-    struct VirtIOBufferDescriptor sg;
+    struct VirtIOBufferDescriptor sg[VIOSERIAL_MAX_IN_BUF_PAGES];
+    size_t offset;
+    int in = 0;
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_QUEUEING, "--> %s  buf = %p\n", __FUNCTION__, buf);
     if (buf == NULL)
@@ -319,16 +471,24 @@ VIOSerialAddInBuf(
         return STATUS_INSUFFICIENT_RESOURCES;
     }
 
-    sg.physAddr = buf->pa_buf;
-    sg.length = buf->size;
+    // buffers larger than a page are page aligned but not necessarily
+    // physically contiguous
+    sg[0].physAddr = buf->pa_buf;
+    sg[0].length = (ULONG)min(buf->size, PAGE_SIZE);
+    for (offset = PAGE_SIZE, in = 1;
+         offset < buf->size && in < VIOSERIAL_MAX_IN_BUF_PAGES;
+         offset += PAGE_SIZE, in++)
+    {
+        sg[in].physAddr = MmGetPhysicalAddress((PVOID)((LONG_PTR)buf->va_buf + offset));
+        sg[in].length = (ULONG)min(buf->size - offset, PAGE_SIZE);
+    }
 
-    if(0 > virtqueue_add_buf(vq, &sg, 0, 1, buf, NULL, 0))
+    if(0 > virtqueue_add_buf(vq, sg, 0, in, buf, NULL, 0))
     {
         TraceEvents(TRACE_LEVEL_ERROR, DBG_QUEUEING, "<-- %s cannot add_buf\n", __FUNCTION__);
         status = STATUS_INSUFFICIENT_RESOURCES;
     }
 
-    virtqueue_kick(vq);
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_QUEUEING, "<-- %s\n", __FUNCTION__);
     return status;
 }
@@ -23,9 +23,9 @@ VIOSerialSendCtrlMsg(
 {
     struct VirtIOBufferDescriptor sg;
     struct virtqueue *vq;
-    UINT len;
     PPORTS_DEVICE pContext = GetPortsDevice(Device);
-    VIRTIO_CONSOLE_CONTROL cpkt;
+    PVIRTIO_CONSOLE_CONTROL cpkt;
+    BOOLEAN notify = FALSE;
     int cnt = 0;
     if (!pContext->isHostMultiport)
     {
@@ -36,32 +36,71 @@ VIOSerialSendCtrlMsg(
 
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP, "--> %s vq = %p\n", __FUNCTION__, vq);
 
-    cpkt.id = id;
-    cpkt.event = event;
-    cpkt.value = value;
+    // The message stays in the ring until the host consumes it, so it can't
+    // live on the stack. Consumed messages are freed by the next sender.
+    cpkt = (PVIRTIO_CONSOLE_CONTROL)ExAllocatePoolWithTag(
+                                 NonPagedPool,
+                                 sizeof(VIRTIO_CONSOLE_CONTROL),
+                                 VIOSERIAL_DRIVER_MEMORY_TAG
+                                 );
+    if (cpkt == NULL)
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "ExAllocatePoolWithTag failed, %s::%d\n", __FUNCTION__, __LINE__);
+        return;
+    }
+
+    cpkt->id = id;
+    cpkt->event = event;
+    cpkt->value = value;
 
-    sg.physAddr = MmGetPhysicalAddress(&cpkt);
-    sg.length = sizeof(cpkt);
+    sg.physAddr = MmGetPhysicalAddress(cpkt);
+    sg.length = sizeof(VIRTIO_CONSOLE_CONTROL);
 
     WdfSpinLockAcquire(pContext->CVqLock);
-    if(0 <= virtqueue_add_buf(vq, &sg, 1, 0, &cpkt, NULL, 0))
+    VIOSerialReclaimCtrlMsgsLocked(vq);
+    while (0 > virtqueue_add_buf(vq, &sg, 1, 0, cpkt, NULL, 0))
     {
+        // The ring is full of messages the host hasn't consumed yet,
+        // make sure it knows about them and wait for some room.
         virtqueue_kick(vq);
-        while(!virtqueue_get_buf(vq, &len))
+        KeStallExecutionProcessor(50);
+        VIOSerialReclaimCtrlMsgsLocked(vq);
+        if (++cnt > RETRY_THRESHOLD)
         {
-           KeStallExecutionProcessor(50);
-           if(++cnt > RETRY_THRESHOLD)
-           {
-              TraceEvents(TRACE_LEVEL_FATAL, DBG_PNP, "<-> %s retries = %d\n", __FUNCTION__, cnt);
-              break;
-           }
+            TraceEvents(TRACE_LEVEL_FATAL, DBG_PNP, "<-> %s retries = %d\n", __FUNCTION__, cnt);
+            ExFreePoolWithTag(cpkt, VIOSERIAL_DRIVER_MEMORY_TAG);
+            cpkt = NULL;
+            break;
         }
     }
+    if (cpkt)
+    {
+        notify = virtqueue_kick_prepare(vq);
+    }
     WdfSpinLockRelease(pContext->CVqLock);
 
+    if (notify)
+    {
+        virtqueue_notify(vq);
+    }
+
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP, "<-- %s cnt = %d\n", __FUNCTION__, cnt);
 }
 
+VOID
+VIOSerialReclaimCtrlMsgsLocked(
+    IN struct virtqueue *vq
+)
+{
+    PVIRTIO_CONSOLE_CONTROL cpkt;
+    UINT len;
+
+    while ((cpkt = (PVIRTIO_CONSOLE_CONTROL)virtqueue_get_buf(vq, &len)))
+    {
+        ExFreePoolWithTag(cpkt, VIOSERIAL_DRIVER_MEMORY_TAG);
+    }
+}
+
 VOID
 VIOSerialCtrlWorkHandler(
     IN WDFDEVICE Device
@@ -72,30 +111,57 @@ VIOSerialCtrlWorkHandler(
     UINT len;
     NTSTATUS  status = STATUS_SUCCESS;
     PPORTS_DEVICE pContext = GetPortsDevice(Device);
+    LIST_ENTRY ReceivedList;
+    PLIST_ENTRY entry;
+    ULONG count = 0;
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_PNP, "--> %s\n", __FUNCTION__);
 
     vq = pContext->c_ivq;
     ASSERT(vq);
 
-    WdfSpinLockAcquire(pContext->CVqLock);
-    while ((buf = virtqueue_get_buf(vq, &len)))
+    for (;;)
     {
+        // Take everything the host has sent so far in one pass, handle it
+        // without the lock and give all the buffers back with a single kick.
+        InitializeListHead(&ReceivedList);
+        WdfSpinLockAcquire(pContext->CVqLock);
+        while ((buf = virtqueue_get_buf(vq, &len)))
+        {
+            buf->len = len;
+            buf->offset = 0;
+            InsertTailList(&ReceivedList, &buf->list_entry);
+        }
         WdfSpinLockRelease(pContext->CVqLock);
-        buf->len = len;
-        buf->offset = 0;
-        VIOSerialHandleCtrlMsg(Device, buf);
+
+        if (IsListEmpty(&ReceivedList))
+        {
+            break;
+        }
+
+        for (entry = ReceivedList.Flink; entry != &ReceivedList; entry = entry->Flink)
+        {
+            buf = CONTAINING_RECORD(entry, PORT_BUFFER, list_entry);
+            VIOSerialHandleCtrlMsg(Device, buf);
+            count++;
+        }
 
         WdfSpinLockAcquire(pContext->CVqLock);
-        status = VIOSerialAddInBuf(vq, buf);
-        if (!NT_SUCCESS(status))
+        while (!IsListEmpty(&ReceivedList))
         {
-           TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "%s::%d Error adding buffer to queue\n", __FUNCTION__, __LINE__);
-           VIOSerialFreeBuffer(buf);
+            entry = RemoveHeadList(&ReceivedList);
+            buf = CONTAINING_RECORD(entry, PORT_BUFFER, list_entry);
+            status = VIOSerialAddInBuf(vq, buf);
+            if (!NT_SUCCESS(status))
+            {
+               TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "%s::%d Error adding buffer to queue\n", __FUNCTION__, __LINE__);
+               VIOSerialFreeBuffer(buf);
+            }
         }
+        virtqueue_kick(vq);
+        WdfSpinLockRelease(pContext->CVqLock);
     }
-    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_PNP, "<-- %s\n", __FUNCTION__);
-    WdfSpinLockRelease(pContext->CVqLock);
+    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_PNP, "<-- %s messages = %u\n", __FUNCTION__, count);
 }
 
 VOID
@@ -163,6 +229,13 @@ VIOSerialHandleCtrlMsg(
            {
               BOOLEAN  Connected = (BOOLEAN)cpkt->value;
               TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP, "VIRTIO_CONSOLE_PORT_OPEN id = %d, HostConnected = %d\n", cpkt->id, Connected);
+              if (Connected && port->OpenTime == 0)
+              {
+                 port->OpenTime = KeQueryInterruptTime();
+                 TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP,
+                    "Port id = %d opened by host %I64u us after discovery\n",
+                    cpkt->id, (port->OpenTime - port->AddTime) / 10);
+              }
               if (port->HostConnected != Connected)
               {
                  VIOSerialPortPnpNotify(Device, port, Connected);
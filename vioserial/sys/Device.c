@@ -439,7 +439,8 @@ VIOSerialFillQueue(
         if(buf == NULL)
         {
            TraceEvents(TRACE_LEVEL_ERROR, DBG_INIT, "VIOSerialAllocateBuffer failed\n");
-           return STATUS_INSUFFICIENT_RESOURCES;
+           status = STATUS_INSUFFICIENT_RESOURCES;
+           break;
         }
 
         WdfSpinLockAcquire(Lock);
@@ -448,12 +449,19 @@ VIOSerialFillQueue(
         {
            VIOSerialFreeBuffer(buf);
            WdfSpinLockRelease(Lock);
+           status = STATUS_SUCCESS;
            break;
         }
         WdfSpinLockRelease(Lock);
     }
+
+    // notify the host once the whole queue has been filled
+    WdfSpinLockAcquire(Lock);
+    virtqueue_kick(vq);
+    WdfSpinLockRelease(Lock);
+
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_INIT, "<-- %s\n", __FUNCTION__);
-    return STATUS_SUCCESS;
+    return status;
 }
 
 NTSTATUS
@@ -507,6 +515,17 @@ VIOSerialEvtDeviceD0Exit(
         VIOSerialFreeBuffer(buf);
     }
 
+    if (pContext->c_ovq)
+    {
+        PVOID cpkt;
+
+        VIOSerialReclaimCtrlMsgsLocked(pContext->c_ovq);
+        while (cpkt = virtqueue_detach_unused_buf(pContext->c_ovq))
+        {
+            ExFreePoolWithTag(cpkt, VIOSERIAL_DRIVER_MEMORY_TAG);
+        }
+    }
+
     VIOSerialShutDownAllQueues(Device);
 
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP, "<-- %s\n", __FUNCTION__);
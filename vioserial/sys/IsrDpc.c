@@ -72,6 +72,8 @@ VOID VIOSerialQueuesInterruptDpc(IN WDFINTERRUPT Interrupt,
     WDF_CHILD_RETRIEVE_INFO PortInfo;
     VIOSERIAL_PORT VirtPort;
     VIOSERIAL_PORT *Port;
+    struct virtqueue *InQueue;
+    struct virtqueue *OutQueue;
 
     UNREFERENCED_PARAMETER(AssociatedObject);
 
@@ -97,11 +99,27 @@ VOID VIOSerialQueuesInterruptDpc(IN WDFINTERRUPT Interrupt,
 
         Port = RawPdoSerialPortGetData(Device)->port;
 
+        // the interrupt is shared by all the ports, count it only for the
+        // ones the host sent or gave back buffers on
+        InQueue = GetInQueue(Port);
+        OutQueue = GetOutQueue(Port);
+        if ((InQueue != NULL && virtqueue_has_buf(InQueue)) ||
+            (OutQueue != NULL && virtqueue_has_buf(OutQueue)))
+        {
+            Port->Statistics.Interrupts++;
+        }
+
         // handle the read queue
         VIOSerialProcessInputBuffers(Port);
 
         // handle the write queue
         VIOSerialReclaimConsumedBuffers(Port);
+
+        // refill the out queue from the shared ring of a mapped port
+        if (Port->SharedRing.Rings != NULL)
+        {
+            VIOSerialSharedRingDrain(Port);
+        }
     }
     WdfChildListEndIteration(PortList, &iterator);
 
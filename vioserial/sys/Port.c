@@ -9,8 +9,6 @@
 
 EVT_WDF_WORKITEM VIOSerialPortSymbolicNameWork;
 EVT_WDF_WORKITEM VIOSerialPortPnpNotifyWork;
-EVT_WDF_REQUEST_CANCEL VIOSerialPortReadRequestCancel;
-EVT_WDF_REQUEST_CANCEL VIOSerialPortWriteRequestCancel;
 EVT_WDF_DEVICE_D0_ENTRY VIOSerialPortEvtDeviceD0Entry;
 EVT_WDF_DEVICE_D0_EXIT VIOSerialPortEvtDeviceD0Exit;
 
@@ -101,9 +99,18 @@ VIOSerialAddPort(
     port.NameString.MaximumLength = 0;
 
     port.InBuf = NULL;
+    port.InBufPool = NULL;
+    port.InBufPoolData = NULL;
+    port.InBufCount = VIOSERIAL_DEFAULT_IN_BUF_COUNT;
+    port.InBufSize = VIOSERIAL_DEFAULT_IN_BUF_SIZE;
     port.HostConnected = port.GuestConnected = FALSE;
     port.OutVqFull = FALSE;
     port.Removed = FALSE;
+    RtlZeroMemory(&port.SharedRing, sizeof(port.SharedRing));
+    port.AddTime = KeQueryInterruptTime();
+    port.ReadyTime = 0;
+    port.OpenTime = 0;
+    RtlZeroMemory(&port.Statistics, sizeof(port.Statistics));
 
     port.BusDevice = Device;
 
@@ -201,6 +208,10 @@ VIOSerialDiscardPortDataLocked(
         }
         buf = (PPORT_BUFFER)virtqueue_get_buf(vq, &len);
     }
+    if (vq)
+    {
+        virtqueue_kick(vq);
+    }
     port->InBuf = NULL;
     if (ret > 0)
     {
@@ -367,6 +378,9 @@ VIOSerialDeviceListCreatePdo(
 
         WdfPdoInitSetDefaultLocale(ChildInit, 0x409);
 
+        WdfDeviceInitSetIoInCallerContextCallback(ChildInit,
+                                 VIOSerialPortIoInCallerContext);
+
         WDF_FILEOBJECT_CONFIG_INIT(
                                  &fileConfig,
                                  VIOSerialPortCreate,
@@ -404,6 +418,7 @@ VIOSerialDeviceListCreatePdo(
         rawPdo = RawPdoSerialPortGetData(hChild);
         rawPdo->port = pport;
         pport->Device = hChild;
+        InitializeListHead(&pport->WriteBuffersList);
 
         WDF_IO_QUEUE_CONFIG_INIT(&queueConfig,
                                  WdfIoQueueDispatchSequential
@@ -438,7 +453,6 @@ VIOSerialDeviceListCreatePdo(
                                  WdfIoQueueDispatchSequential);
 
         queueConfig.EvtIoRead   =  VIOSerialPortRead;
-        queueConfig.EvtIoStop   =  VIOSerialPortReadIoStop;
         status = WdfIoQueueCreate(hChild,
                                  &queueConfig,
                                  WDF_NO_OBJECT_ATTRIBUTES,
@@ -464,6 +478,38 @@ VIOSerialDeviceListCreatePdo(
            break;
         }
 
+        // reads which can't be satisfied right away are parked here, so
+        // that the sequential read queue can deliver the next one
+        WDF_IO_QUEUE_CONFIG_INIT(&queueConfig, WdfIoQueueDispatchManual);
+        status = WdfIoQueueCreate(hChild,
+                                 &queueConfig,
+                                 WDF_NO_OBJECT_ATTRIBUTES,
+                                 &pport->PendingReadQueue
+                                 );
+        if (!NT_SUCCESS(status))
+        {
+           TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP,
+                    "WdfIoQueueCreate (Pending Read Queue) failed 0x%x\n", status);
+           break;
+        }
+
+        // the pending IOCTL_MAP_SHARED_RING request of a mapped port, kept
+        // across power transitions until the port is unmapped in D0Exit
+        WDF_IO_QUEUE_CONFIG_INIT(&queueConfig, WdfIoQueueDispatchManual);
+        queueConfig.PowerManaged = WdfFalse;
+        queueConfig.EvtIoCanceledOnQueue = VIOSerialSharedRingCanceledOnQueue;
+        status = WdfIoQueueCreate(hChild,
+                                 &queueConfig,
+                                 WDF_NO_OBJECT_ATTRIBUTES,
+                                 &pport->SharedRingQueue
+                                 );
+        if (!NT_SUCCESS(status))
+        {
+           TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP,
+                    "WdfIoQueueCreate (Shared Ring Queue) failed 0x%x\n", status);
+           break;
+        }
+
         WDF_IO_QUEUE_CONFIG_INIT(&queueConfig, WdfIoQueueDispatchParallel);
         queueConfig.AllowZeroLengthRequests = WdfFalse;
         queueConfig.EvtIoWrite = VIOSerialPortWrite;
@@ -569,6 +615,8 @@ VIOSerialPortRead(
     size_t             length;
     NTSTATUS           status;
     PVOID              systemBuffer;
+    ULONG              pendingReads = 0;
+    BOOLEAN            drain = FALSE;
 
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_READ, "-->%s\n", __FUNCTION__);
 
@@ -581,26 +629,37 @@ VIOSerialPortRead(
 
 	WdfSpinLockAcquire(pport->InBufLock);
 
-	if (!VIOSerialPortHasDataLocked(pport))
+	// reads waiting in the queue get the data first, whoever comes
+	// next lines up behind them to keep the stream in order
+	WdfIoQueueGetState(pport->PendingReadQueue, &pendingReads, NULL);
+
+	if (pport->SharedRing.Rings != NULL)
 	{
-		if (!pport->HostConnected)
+		// the data goes to the shared ring while the port is mapped
+		status = STATUS_INVALID_DEVICE_STATE;
+		length = 0;
+	}
+	else if (pendingReads != 0 || !VIOSerialPortHasDataLocked(pport))
+	{
+		if (pendingReads == 0 && !pport->HostConnected)
 		{
 			status = STATUS_INSUFFICIENT_RESOURCES;
 			length = 0;
 		}
 		else
 		{
-			ASSERT (pport->PendingReadRequest == NULL);
-			status = WdfRequestMarkCancelableEx(Request,
-				VIOSerialPortReadRequestCancel);
+			// the queue takes care of cancellation while the request
+			// waits, VIOSerialProcessInputBuffers picks it up from there
+			status = WdfRequestForwardToIoQueue(Request,
+				pport->PendingReadQueue);
 			if (!NT_SUCCESS(status))
 			{
 				length = 0;
 			}
 			else
 			{
-				pport->PendingReadRequest = Request;
 				Request = NULL;
+				drain = VIOSerialPortHasDataLocked(pport);
 			}
 		}
     }
@@ -621,6 +680,10 @@ VIOSerialPortRead(
         // an error or because data was available in the input buffer
         WdfRequestCompleteWithInformation(Request, status, (ULONG_PTR)length);
     }
+    else if (drain)
+    {
+        VIOSerialProcessInputBuffers(pport);
+    }
 
 	TraceEvents(TRACE_LEVEL_INFORMATION, DBG_READ,"<-- %s\n", __FUNCTION__);
 }
@@ -668,91 +731,76 @@ VOID VIOSerialPortWrite(IN WDFQUEUE Queue,
         return;
     }
 
-    buffer = ExAllocatePoolWithTag(NonPagedPool, Length,
-        VIOSERIAL_DRIVER_MEMORY_TAG);
-
-    if (buffer == NULL)
+    if (Port->SharedRing.Rings != NULL)
     {
-        TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE, "Failed to allocate.\n");
-        WdfRequestComplete(Request, STATUS_INSUFFICIENT_RESOURCES);
+        WdfRequestComplete(Request, STATUS_INVALID_DEVICE_STATE);
         return;
     }
 
-    Context = GetDriverContext(WdfDeviceGetDriver(Device));
-    status = WdfMemoryCreateFromLookaside(Context->WriteBufferLookaside, &EntryHandle);
-    if (!NT_SUCCESS(status))
+    // Large writes go to the host straight from the request's buffer,
+    // which the I/O manager keeps locked until the request is completed.
+    // Such requests are not cancelable, they stay pending until the host
+    // returns the buffer.
+    if (Length >= VIOSERIAL_DIRECT_WRITE_THRESHOLD)
     {
-        TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE,
-            "Failed to allocate write buffer entry: %x.\n", status);
-        ExFreePoolWithTag(buffer, VIOSERIAL_DRIVER_MEMORY_TAG);
-        WdfRequestComplete(Request, STATUS_INSUFFICIENT_RESOURCES);
-        return;
+        buffer = InBuf;
     }
+    else
+    {
+        buffer = ExAllocatePoolWithTag(NonPagedPool, Length,
+            VIOSERIAL_DRIVER_MEMORY_TAG);
 
-    status = WdfRequestMarkCancelableEx(Request,
-        VIOSerialPortWriteRequestCancel);
+        if (buffer == NULL)
+        {
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE, "Failed to allocate.\n");
+            WdfRequestComplete(Request, STATUS_INSUFFICIENT_RESOURCES);
+            return;
+        }
+        RtlCopyMemory(buffer, InBuf, Length);
+    }
 
+    Context = GetDriverContext(WdfDeviceGetDriver(Device));
+    status = WdfMemoryCreateFromLookaside(Context->WriteBufferLookaside, &EntryHandle);
     if (!NT_SUCCESS(status))
     {
         TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE,
-            "Failed to mark request as cancelable: %x\n", status);
-        ExFreePoolWithTag(buffer, VIOSERIAL_DRIVER_MEMORY_TAG);
-        WdfObjectDelete(EntryHandle);
-        WdfRequestComplete(Request, status);
+            "Failed to allocate write buffer entry: %x.\n", status);
+        if (buffer != InBuf)
+        {
+            ExFreePoolWithTag(buffer, VIOSERIAL_DRIVER_MEMORY_TAG);
+        }
+        WdfRequestComplete(Request, STATUS_INSUFFICIENT_RESOURCES);
         return;
     }
 
-    RtlCopyMemory(buffer, InBuf, Length);
-    WdfRequestSetInformation(Request, (ULONG_PTR)Length);
-
     entry = (PWRITE_BUFFER_ENTRY)WdfMemoryGetBuffer(EntryHandle, NULL);
     entry->EntryHandle = EntryHandle;
     entry->Buffer = buffer;
+    entry->OwnBuffer = (buffer != InBuf);
     entry->Request = Request;
 
+    WdfRequestSetInformation(Request, (ULONG_PTR)Length);
+
+    // the request only becomes cancelable once its buffer is posted
     if (VIOSerialSendBuffers(Port, entry, Length) <= 0)
     {
         TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE,
             "Failed to send user's buffer.\n");
 
-        ExFreePoolWithTag(buffer, VIOSERIAL_DRIVER_MEMORY_TAG);
-        WdfObjectDelete(EntryHandle);
+        VIOSerialFreeWriteBufferEntry(entry);
 
-        if (WdfRequestUnmarkCancelable(Request) != STATUS_CANCELLED)
-        {
-            WdfRequestComplete(Request, Port->Removed ?
-                STATUS_INVALID_DEVICE_STATE : STATUS_INSUFFICIENT_RESOURCES);
-        }
+        WdfRequestComplete(Request, Port->Removed ?
+            STATUS_INVALID_DEVICE_STATE : STATUS_INSUFFICIENT_RESOURCES);
     }
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_WRITE,"<-- %s\n", __FUNCTION__);
 }
 
-VOID
-VIOSerialPortReadRequestCancel(
-    IN WDFREQUEST Request
-    )
-{
-    PRAWPDO_VIOSERIAL_PORT  pdoData = RawPdoSerialPortGetData(WdfIoQueueGetDevice(WdfRequestGetIoQueue(Request)));
-
-    TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE, "-->%s called on request 0x%p\n", __FUNCTION__, Request);
-
-    // synchronize with VIOSerialQueuesInterruptDpc because the pending
-    // request is not guaranteed to be alive after we return from this callback
-    WdfSpinLockAcquire(pdoData->port->InBufLock);
-    pdoData->port->PendingReadRequest = NULL;
-    WdfSpinLockRelease(pdoData->port->InBufLock);
-
-    WdfRequestCompleteWithInformation(Request, STATUS_CANCELLED, 0L);
-
-    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_WRITE, "<-- %s\n", __FUNCTION__);
-}
-
 VOID VIOSerialPortWriteRequestCancel(IN WDFREQUEST Request)
 {
     PVIOSERIAL_PORT Port = RawPdoSerialPortGetData(
         WdfIoQueueGetDevice(WdfRequestGetIoQueue(Request)))->port;
-    PSINGLE_LIST_ENTRY iter;
+    PLIST_ENTRY iter;
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_WRITE, "--> %s Request: 0x%p\n",
         __FUNCTION__, Request);
@@ -760,8 +808,9 @@ VOID VIOSerialPortWriteRequestCancel(IN WDFREQUEST Request)
     // synchronize with VIOSerialReclaimConsumedBuffers because the pending
     // request is not guaranteed to be alive after we return from this callback
     WdfSpinLockAcquire(Port->OutVqLock);
-    iter = &Port->WriteBuffersList;
-    while ((iter = iter->Next) != NULL)
+    for (iter = Port->WriteBuffersList.Flink;
+         iter != &Port->WriteBuffersList;
+         iter = iter->Flink)
     {
         PWRITE_BUFFER_ENTRY entry = CONTAINING_RECORD(iter, WRITE_BUFFER_ENTRY, ListEntry);
         if (entry->Request == Request)
@@ -848,12 +897,70 @@ VIOSerialPortDeviceControl(
            break;
         }
 
+        case IOCTL_GET_PORT_TIMINGS:
+        {
+           PVIRTIO_PORT_TIMINGS ptimings = NULL;
+           PVIOSERIAL_PORT port = pdoData->port;
+
+           status = WdfRequestRetrieveOutputBuffer(Request, sizeof(VIRTIO_PORT_TIMINGS), (PVOID*)&ptimings, &length);
+           if (!NT_SUCCESS(status))
+           {
+              TraceEvents(TRACE_LEVEL_ERROR, DBG_IOCTLS,
+                            "WdfRequestRetrieveOutputBuffer failed 0x%x\n", status);
+              break;
+           }
+
+           ptimings->AddToReady = port->ReadyTime ? port->ReadyTime - port->AddTime : 0;
+           ptimings->AddToOpen = port->OpenTime ? port->OpenTime - port->AddTime : 0;
+           length = sizeof(VIRTIO_PORT_TIMINGS);
+           break;
+        }
+
+        case IOCTL_GET_PORT_STATISTICS:
+        {
+           PVIRTIO_PORT_STATISTICS pstats = NULL;
+
+           status = WdfRequestRetrieveOutputBuffer(Request, sizeof(VIRTIO_PORT_STATISTICS), (PVOID*)&pstats, &length);
+           if (!NT_SUCCESS(status))
+           {
+              TraceEvents(TRACE_LEVEL_ERROR, DBG_IOCTLS,
+                            "WdfRequestRetrieveOutputBuffer failed 0x%x\n", status);
+              break;
+           }
+
+           *pstats = pdoData->port->Statistics;
+           length = sizeof(VIRTIO_PORT_STATISTICS);
+           break;
+        }
+
+        case IOCTL_MAP_SHARED_RING:
+        {
+           // stays pending while the port is mapped
+           status = VIOSerialSharedRingMap(pdoData->port, Request);
+           break;
+        }
+
+        case IOCTL_KICK_SHARED_RING:
+        {
+           if (pdoData->port->SharedRing.Rings == NULL)
+           {
+              status = STATUS_INVALID_DEVICE_STATE;
+              break;
+           }
+           VIOSerialSharedRingDrain(pdoData->port);
+           VIOSerialProcessInputBuffers(pdoData->port);
+           break;
+        }
+
         default:
            status = STATUS_INVALID_DEVICE_REQUEST;
            break;
     }
 
-    WdfRequestCompleteWithInformation(Request, status, length);
+    if (status != STATUS_PENDING)
+    {
+        WdfRequestCompleteWithInformation(Request, status, length);
+    }
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_IOCTLS, "<-- %s\n", __FUNCTION__);
 }
 
@@ -1188,6 +1295,10 @@ VIOSerialEvtChildListIdentificationDescriptionDuplicate(
 
     dst->InBuf = src->InBuf;
     dst->InBufLock = src->InBufLock;
+    dst->InBufPool = src->InBufPool;
+    dst->InBufPoolData = src->InBufPoolData;
+    dst->InBufCount = src->InBufCount;
+    dst->InBufSize = src->InBufSize;
     dst->OutVqLock = src->OutVqLock;
 
     dst->NameString.Length = src->NameString.Length;
@@ -1217,10 +1328,17 @@ VIOSerialEvtChildListIdentificationDescriptionDuplicate(
     dst->GuestConnected = src->GuestConnected;
     dst->Removed = src->Removed;
 
+    dst->AddTime = src->AddTime;
+    dst->ReadyTime = src->ReadyTime;
+    dst->OpenTime = src->OpenTime;
+    dst->Statistics = src->Statistics;
+
     dst->ReadQueue = src->ReadQueue;
-    dst->PendingReadRequest = src->PendingReadRequest;
+    dst->PendingReadQueue = src->PendingReadQueue;
     dst->WriteQueue = src->WriteQueue;
     dst->IoctlQueue = src->IoctlQueue;
+    dst->SharedRingQueue = src->SharedRingQueue;
+    dst->SharedRing = src->SharedRing;
 
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CREATE_CLOSE, "<-- %s\n", __FUNCTION__);
     return STATUS_SUCCESS;
@@ -1280,33 +1398,6 @@ VIOSerialEvtChildListIdentificationDescriptionCleanup(
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CREATE_CLOSE, "<-- %s\n", __FUNCTION__);
 }
 
-VOID VIOSerialPortReadIoStop(IN WDFQUEUE Queue,
-                             IN WDFREQUEST Request,
-                             IN ULONG ActionFlags)
-{
-    PRAWPDO_VIOSERIAL_PORT pdoData = RawPdoSerialPortGetData(
-        WdfIoQueueGetDevice(Queue));
-    PVIOSERIAL_PORT pport = pdoData->port;
-
-    TraceEvents(TRACE_LEVEL_ERROR, DBG_READ, "--> %s\n", __FUNCTION__);
-    ASSERT(pport->PendingReadRequest == Request);
-
-    WdfSpinLockAcquire(pport->InBufLock);
-    if (ActionFlags & WdfRequestStopActionSuspend)
-    {
-        WdfRequestStopAcknowledge(Request, FALSE);
-    }
-    else if (ActionFlags & WdfRequestStopActionPurge)
-    {
-        if (WdfRequestUnmarkCancelable(Request) != STATUS_CANCELLED)
-        {
-           pport->PendingReadRequest = NULL;
-           WdfRequestCompleteWithInformation(Request , STATUS_CANCELLED, 0L);
-        }
-    }
-    WdfSpinLockRelease(pport->InBufLock);
-}
-
 VOID VIOSerialPortWriteIoStop(IN WDFQUEUE Queue,
                               IN WDFREQUEST Request,
                               IN ULONG ActionFlags)
@@ -1324,19 +1415,31 @@ VOID VIOSerialPortWriteIoStop(IN WDFQUEUE Queue,
    }
    else if (ActionFlags & WdfRequestStopActionPurge)
    {
-      if (WdfRequestUnmarkCancelable(Request) != STATUS_CANCELLED)
+      PWRITE_BUFFER_ENTRY entry = NULL;
+      PLIST_ENTRY iter;
+      for (iter = pport->WriteBuffersList.Flink;
+           iter != &pport->WriteBuffersList;
+           iter = iter->Flink)
+      {
+         entry = CONTAINING_RECORD(iter, WRITE_BUFFER_ENTRY, ListEntry);
+         if (entry->Request == Request)
+         {
+            break;
+         }
+         entry = NULL;
+      }
+
+      // a direct write is completed once the host returns its pages
+      if (entry == NULL || entry->OwnBuffer)
       {
-         PSINGLE_LIST_ENTRY iter = &pport->WriteBuffersList;
-         while ((iter = iter->Next) != NULL)
+         if (WdfRequestUnmarkCancelable(Request) != STATUS_CANCELLED)
          {
-            PWRITE_BUFFER_ENTRY entry = CONTAINING_RECORD(iter, WRITE_BUFFER_ENTRY, ListEntry);
-            if (entry->Request == Request)
+            if (entry != NULL)
             {
                entry->Request = NULL;
-               break;
             }
+            WdfRequestComplete(Request, STATUS_OBJECT_NO_LONGER_EXISTS);
          }
-         WdfRequestComplete(Request, STATUS_OBJECT_NO_LONGER_EXISTS);
       }
    }
    WdfSpinLockRelease(pport->OutVqLock);
@@ -1344,6 +1447,41 @@ VOID VIOSerialPortWriteIoStop(IN WDFQUEUE Queue,
    TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE, "<-- %s\n", __FUNCTION__);
 }
 
+static
+VOID
+VIOSerialPortQueryInBufConfig(
+    IN WDFDEVICE Device,
+    IN PVIOSERIAL_PORT Port)
+{
+    WDFKEY hKey;
+    ULONG value;
+    DECLARE_CONST_UNICODE_STRING(sizeName, L"InBufferSize");
+    DECLARE_CONST_UNICODE_STRING(countName, L"InBufferCount");
+
+    PAGED_CODE();
+
+    Port->InBufSize = VIOSERIAL_DEFAULT_IN_BUF_SIZE;
+    Port->InBufCount = VIOSERIAL_DEFAULT_IN_BUF_COUNT;
+
+    if (NT_SUCCESS(WdfDeviceOpenRegistryKey(Device, PLUGPLAY_REGKEY_DEVICE,
+        KEY_READ, WDF_NO_OBJECT_ATTRIBUTES, &hKey)))
+    {
+        if (NT_SUCCESS(WdfRegistryQueryULong(hKey, &sizeName, &value)))
+        {
+            Port->InBufSize = value;
+        }
+        if (NT_SUCCESS(WdfRegistryQueryULong(hKey, &countName, &value)))
+        {
+            Port->InBufCount = value;
+        }
+        WdfRegistryClose(hKey);
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP,
+        "Port %d: InBufferSize %Iu InBufferCount %u\n",
+        Port->PortId, Port->InBufSize, Port->InBufCount);
+}
+
 NTSTATUS VIOSerialPortEvtDeviceD0Entry(
     IN WDFDEVICE Device,
     IN WDF_POWER_DEVICE_STATE PreviousState)
@@ -1361,7 +1499,9 @@ NTSTATUS VIOSerialPortEvtDeviceD0Entry(
         return STATUS_NOT_FOUND;
     }
 
-    status = VIOSerialFillQueue(GetInQueue(port), port->InBufLock);
+    VIOSerialPortQueryInBufConfig(Device, port);
+
+    status = VIOSerialAllocateInBufPool(port);
     if (!NT_SUCCESS(status))
     {
         TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP,
@@ -1372,6 +1512,14 @@ NTSTATUS VIOSerialPortEvtDeviceD0Entry(
     VIOSerialSendCtrlMsg(port->BusDevice, port->PortId,
         VIRTIO_CONSOLE_PORT_READY, 1);
 
+    if (port->ReadyTime == 0)
+    {
+        port->ReadyTime = KeQueryInterruptTime();
+        TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP,
+            "Port id = %d ready %I64u us after discovery\n",
+            port->PortId, (port->ReadyTime - port->AddTime) / 10);
+    }
+
     if (port->GuestConnected)
     {
         VIOSerialSendCtrlMsg(port->BusDevice, port->PortId,
@@ -1395,7 +1543,7 @@ VIOSerialPortEvtDeviceD0Exit(
 {
     PVIOSERIAL_PORT Port = RawPdoSerialPortGetData(Device)->port;
     PPORT_BUFFER buf;
-    PSINGLE_LIST_ENTRY iter;
+    PLIST_ENTRY iter;
 
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_INIT, "--> %s TargetState: %d\n",
         __FUNCTION__, TargetState);
@@ -1404,6 +1552,8 @@ VIOSerialPortEvtDeviceD0Exit(
 
     VIOSerialDisableInterruptQueue(GetInQueue(Port));
 
+    VIOSerialSharedRingDetach(Port);
+
     WdfSpinLockAcquire(Port->InBufLock);
     VIOSerialDiscardPortDataLocked(Port);
     Port->InBuf = NULL;
@@ -1415,17 +1565,21 @@ VIOSerialPortEvtDeviceD0Exit(
     {
         VIOSerialFreeBuffer(buf);
     }
+    VIOSerialFreeInBufPool(Port);
 
-    iter = PopEntryList(&Port->WriteBuffersList);
-    while (iter != NULL)
+    while (!IsListEmpty(&Port->WriteBuffersList))
     {
-        PWRITE_BUFFER_ENTRY entry = CONTAINING_RECORD(iter,
-            WRITE_BUFFER_ENTRY, ListEntry);
+        PWRITE_BUFFER_ENTRY entry;
 
-        ExFreePoolWithTag(entry->Buffer, VIOSERIAL_DRIVER_MEMORY_TAG);
-        WdfObjectDelete(entry->EntryHandle);
+        iter = RemoveHeadList(&Port->WriteBuffersList);
+        entry = CONTAINING_RECORD(iter, WRITE_BUFFER_ENTRY, ListEntry);
 
-        iter = PopEntryList(&Port->WriteBuffersList);
+        if (entry->Request != NULL && (!entry->OwnBuffer ||
+            WdfRequestUnmarkCancelable(entry->Request) != STATUS_CANCELLED))
+        {
+            WdfRequestComplete(entry->Request, STATUS_OBJECT_NO_LONGER_EXISTS);
+        }
+        VIOSerialFreeWriteBufferEntry(entry);
     };
 
     TraceEvents(TRACE_LEVEL_INFORMATION, DBG_INIT, "<-- %s\n", __FUNCTION__);
@@ -0,0 +1,416 @@
+#include "precomp.h"
+#include "vioser.h"
+
+#if defined(EVENT_TRACING)
+#include "SharedRing.tmh"
+#endif
+
+static
+NTSTATUS
+VIOSerialSharedRingReferenceEvents(
+    IN WDFREQUEST Request
+)
+{
+    NTSTATUS status;
+    PVIRTIO_SHARED_RING_MAP map;
+    PSHARED_RING_REQUEST_CONTEXT ctx;
+    WDF_OBJECT_ATTRIBUTES attributes;
+    KPROCESSOR_MODE mode = WdfRequestGetRequestorMode(Request);
+
+    status = WdfRequestRetrieveInputBuffer(Request, sizeof(VIRTIO_SHARED_RING_MAP),
+        (PVOID*)&map, NULL);
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_IOCTLS,
+            "WdfRequestRetrieveInputBuffer failed 0x%x\n", status);
+        return status;
+    }
+
+    WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&attributes, SHARED_RING_REQUEST_CONTEXT);
+    attributes.EvtCleanupCallback = VIOSerialSharedRingRequestCleanup;
+    status = WdfObjectAllocateContext(Request, &attributes, (PVOID*)&ctx);
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_IOCTLS,
+            "WdfObjectAllocateContext failed 0x%x\n", status);
+        return status;
+    }
+
+    status = ObReferenceObjectByHandle((HANDLE)(ULONG_PTR)map->RxEvent,
+        EVENT_MODIFY_STATE, *ExEventObjectType, mode, (PVOID*)&ctx->RxEvent, NULL);
+    if (NT_SUCCESS(status))
+    {
+        status = ObReferenceObjectByHandle((HANDLE)(ULONG_PTR)map->TxEvent,
+            EVENT_MODIFY_STATE, *ExEventObjectType, mode, (PVOID*)&ctx->TxEvent, NULL);
+    }
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_IOCTLS,
+            "ObReferenceObjectByHandle failed 0x%x\n", status);
+    }
+    return status;
+}
+
+VOID
+VIOSerialPortIoInCallerContext(
+    IN WDFDEVICE Device,
+    IN WDFREQUEST Request
+)
+{
+    WDF_REQUEST_PARAMETERS params;
+    NTSTATUS status;
+
+    WDF_REQUEST_PARAMETERS_INIT(&params);
+    WdfRequestGetParameters(Request, &params);
+
+    // the event handles are only meaningful in the context of the process
+    // which sent them, everything else goes to the queues as usual
+    if (params.Type == WdfRequestTypeDeviceControl &&
+        params.Parameters.DeviceIoControl.IoControlCode == IOCTL_MAP_SHARED_RING)
+    {
+        status = VIOSerialSharedRingReferenceEvents(Request);
+        if (!NT_SUCCESS(status))
+        {
+            WdfRequestComplete(Request, status);
+            return;
+        }
+    }
+
+    status = WdfDeviceEnqueueRequest(Device, Request);
+    if (!NT_SUCCESS(status))
+    {
+        WdfRequestComplete(Request, status);
+    }
+}
+
+VOID
+VIOSerialSharedRingRequestCleanup(
+    IN WDFOBJECT Object
+)
+{
+    PSHARED_RING_REQUEST_CONTEXT ctx = GetSharedRingRequestContext(Object);
+
+    if (ctx->RxEvent != NULL)
+    {
+        ObDereferenceObject(ctx->RxEvent);
+        ctx->RxEvent = NULL;
+    }
+    if (ctx->TxEvent != NULL)
+    {
+        ObDereferenceObject(ctx->TxEvent);
+        ctx->TxEvent = NULL;
+    }
+}
+
+static
+VOID
+VIOSerialSharedRingUnmap(
+    IN PVIOSERIAL_PORT Port,
+    IN WDFREQUEST Request,
+    IN NTSTATUS Status
+)
+{
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_IOCTLS,
+        "%s Port id = %d Status = 0x%x\n", __FUNCTION__, Port->PortId, Status);
+
+    // once both sides have let go of the rings the request and with it the
+    // locked pages and the events can go away
+    WdfSpinLockAcquire(Port->InBufLock);
+    WdfSpinLockAcquire(Port->OutVqLock);
+    if (Port->SharedRing.Request == Request)
+    {
+        RtlZeroMemory(&Port->SharedRing, sizeof(SHARED_RING));
+    }
+    WdfSpinLockRelease(Port->OutVqLock);
+    WdfSpinLockRelease(Port->InBufLock);
+
+    WdfRequestComplete(Request, Status);
+}
+
+NTSTATUS
+VIOSerialSharedRingMap(
+    IN PVIOSERIAL_PORT Port,
+    IN WDFREQUEST Request
+)
+{
+    NTSTATUS status;
+    PVIRTIO_SHARED_RING_MAP map;
+    PVIRTIO_SHARED_RINGS rings;
+    PSHARED_RING_REQUEST_CONTEXT ctx = GetSharedRingRequestContext(Request);
+    ULONG size;
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_IOCTLS, "--> %s\n", __FUNCTION__);
+
+    if (ctx == NULL || Port->Removed)
+    {
+        return STATUS_INVALID_DEVICE_STATE;
+    }
+
+    status = WdfRequestRetrieveInputBuffer(Request, sizeof(VIRTIO_SHARED_RING_MAP),
+        (PVOID*)&map, NULL);
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    size = map->RingSize;
+    if (size < VIOSERIAL_SHARED_RING_MIN_SIZE ||
+        size > VIOSERIAL_SHARED_RING_MAX_SIZE ||
+        (size & (size - 1)) != 0)
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_IOCTLS, "Invalid ring size %u\n", size);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    status = WdfRequestRetrieveOutputBuffer(Request,
+        VIRTIO_SHARED_RING_BUFFER_SIZE(size), (PVOID*)&rings, NULL);
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_IOCTLS,
+            "WdfRequestRetrieveOutputBuffer failed 0x%x\n", status);
+        return status;
+    }
+
+    rings->Tx.Head = rings->Tx.Tail = 0;
+    rings->Rx.Head = rings->Rx.Tail = 0;
+
+    WdfSpinLockAcquire(Port->InBufLock);
+    WdfSpinLockAcquire(Port->OutVqLock);
+    if (Port->SharedRing.Rings != NULL)
+    {
+        status = STATUS_DEVICE_BUSY;
+    }
+    else
+    {
+        Port->SharedRing.Request = Request;
+        Port->SharedRing.Rings = rings;
+        Port->SharedRing.TxData = rings->Data;
+        Port->SharedRing.RxData = rings->Data + size;
+        Port->SharedRing.Size = size;
+        Port->SharedRing.RxEvent = ctx->RxEvent;
+        Port->SharedRing.TxEvent = ctx->TxEvent;
+    }
+    WdfSpinLockRelease(Port->OutVqLock);
+    WdfSpinLockRelease(Port->InBufLock);
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    // from here on the request is cancelled through the queue
+    status = WdfRequestForwardToIoQueue(Request, Port->SharedRingQueue);
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_IOCTLS,
+            "WdfRequestForwardToIoQueue failed 0x%x\n", status);
+        WdfSpinLockAcquire(Port->InBufLock);
+        WdfSpinLockAcquire(Port->OutVqLock);
+        RtlZeroMemory(&Port->SharedRing, sizeof(SHARED_RING));
+        WdfSpinLockRelease(Port->OutVqLock);
+        WdfSpinLockRelease(Port->InBufLock);
+        return status;
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_IOCTLS,
+        "Port id = %d mapped rings of %u bytes\n", Port->PortId, size);
+
+    // hand over whatever arrived before the port was mapped
+    VIOSerialProcessInputBuffers(Port);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_IOCTLS, "<-- %s\n", __FUNCTION__);
+    return STATUS_PENDING;
+}
+
+VOID
+VIOSerialSharedRingCanceledOnQueue(
+    IN WDFQUEUE Queue,
+    IN WDFREQUEST Request
+)
+{
+    PVIOSERIAL_PORT Port = RawPdoSerialPortGetData(
+        WdfIoQueueGetDevice(Queue))->port;
+
+    VIOSerialSharedRingUnmap(Port, Request, STATUS_CANCELLED);
+}
+
+VOID
+VIOSerialSharedRingDetach(
+    IN PVIOSERIAL_PORT Port
+)
+{
+    WDFREQUEST Request;
+
+    if (NT_SUCCESS(WdfIoQueueRetrieveNextRequest(Port->SharedRingQueue, &Request)))
+    {
+        VIOSerialSharedRingUnmap(Port, Request, STATUS_OBJECT_NO_LONGER_EXISTS);
+    }
+}
+
+// Moves received data into the rx ring, the port's InBufLock must be held.
+VOID
+VIOSerialSharedRingFillLocked(
+    IN PVIOSERIAL_PORT Port
+)
+{
+    PSHARED_RING ring = &Port->SharedRing;
+    ULONG head, used, offset, space, copied;
+
+    if (ring->Rings == NULL)
+    {
+        return;
+    }
+
+    head = ring->Rings->Rx.Head;
+    while (VIOSerialPortHasDataLocked(Port))
+    {
+        used = head - ring->Rings->Rx.Tail;
+        if (used >= ring->Size)
+        {
+            if (used > ring->Size)
+            {
+                TraceEvents(TRACE_LEVEL_ERROR, DBG_QUEUEING,
+                    "Port id = %d rx ring is corrupted\n", Port->PortId);
+            }
+            // the application kicks us once it has made room
+            break;
+        }
+
+        offset = head & (ring->Size - 1);
+        space = min(ring->Size - used, ring->Size - offset);
+        copied = (ULONG)VIOSerialFillReadBufLocked(Port,
+            ring->RxData + offset, space);
+        if (copied == 0)
+        {
+            break;
+        }
+
+        // the data must be visible before the new head, and the new head
+        // before the tail is read again: the reader publishes its tail and
+        // then rereads the head to decide whether we need a kick
+        KeMemoryBarrier();
+        ring->Rings->Rx.Head = head + copied;
+        KeMemoryBarrier();
+
+        // the consumer only waits once it has seen the ring empty
+        if (ring->Rings->Rx.Tail == head)
+        {
+            KeSetEvent(ring->RxEvent, IO_NO_INCREMENT, FALSE);
+        }
+        head += copied;
+    }
+}
+
+// Moves data from the tx ring to the out virtqueue for as long as it has room.
+VOID
+VIOSerialSharedRingDrain(
+    IN PVIOSERIAL_PORT Port
+)
+{
+    PSHARED_RING ring = &Port->SharedRing;
+    PDRIVER_CONTEXT Context;
+    struct virtqueue *vq = GetOutQueue(Port);
+    PWRITE_BUFFER_ENTRY entry;
+    WDFMEMORY EntryHandle;
+    PUCHAR buffer;
+    ULONG head, tail, offset, chunk, first;
+    ULONG sent = 0;
+    BOOLEAN prepared = FALSE;
+    NTSTATUS status;
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_WRITE, "--> %s\n", __FUNCTION__);
+
+    Context = GetDriverContext(WdfGetDriver());
+
+    WdfSpinLockAcquire(Port->OutVqLock);
+    if (ring->Rings == NULL || vq == NULL)
+    {
+        WdfSpinLockRelease(Port->OutVqLock);
+        return;
+    }
+
+    tail = ring->Rings->Tx.Tail;
+    while (!Port->OutVqFull && !Port->Removed)
+    {
+        head = ring->Rings->Tx.Head;
+        // don't read the data ahead of the head which announced it
+        KeMemoryBarrier();
+        if (head == tail)
+        {
+            break;
+        }
+        if (head - tail > ring->Size)
+        {
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE,
+                "Port id = %d tx ring is corrupted\n", Port->PortId);
+            break;
+        }
+
+        chunk = min(head - tail, VIOSERIAL_SHARED_RING_CHUNK);
+        buffer = (PUCHAR)ExAllocatePoolWithTag(NonPagedPool, chunk,
+            VIOSERIAL_DRIVER_MEMORY_TAG);
+        if (buffer == NULL)
+        {
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE, "Failed to allocate.\n");
+            break;
+        }
+
+        status = WdfMemoryCreateFromLookaside(Context->WriteBufferLookaside, &EntryHandle);
+        if (!NT_SUCCESS(status))
+        {
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_WRITE,
+                "Failed to allocate write buffer entry: %x.\n", status);
+            ExFreePoolWithTag(buffer, VIOSERIAL_DRIVER_MEMORY_TAG);
+            break;
+        }
+
+        // the ring can be overwritten as soon as the tail moves on,
+        // so the host gets a copy
+        offset = tail & (ring->Size - 1);
+        first = min(chunk, ring->Size - offset);
+        RtlCopyMemory(buffer, ring->TxData + offset, first);
+        RtlCopyMemory(buffer + first, ring->TxData, chunk - first);
+
+        entry = (PWRITE_BUFFER_ENTRY)WdfMemoryGetBuffer(EntryHandle, NULL);
+        entry->EntryHandle = EntryHandle;
+        entry->Buffer = buffer;
+        entry->OwnBuffer = TRUE;
+        entry->Request = NULL;
+
+        if (!VIOSerialAddOutBufLocked(Port, entry, chunk))
+        {
+            // picked up again when the host returns some buffers
+            VIOSerialFreeWriteBufferEntry(entry);
+            break;
+        }
+
+        tail += chunk;
+        sent += chunk;
+        ring->Rings->Tx.Tail = tail;
+        KeMemoryBarrier();
+    }
+
+    if (sent)
+    {
+        Port->Statistics.BytesWritten += sent;
+        prepared = virtqueue_kick_prepare(vq);
+        if (prepared)
+        {
+            Port->Statistics.TxNotifications++;
+        }
+
+        // the producer only waits when it has found the ring full
+        if (ring->Rings->Tx.Head == tail)
+        {
+            KeSetEvent(ring->TxEvent, IO_NO_INCREMENT, FALSE);
+        }
+    }
+    WdfSpinLockRelease(Port->OutVqLock);
+
+    if (prepared)
+    {
+        virtqueue_notify(vq);
+    }
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, DBG_WRITE, "<-- %s sent %u\n", __FUNCTION__, sent);
+}
@@ -33,6 +33,64 @@ typedef struct _tagVirtioPortInfo {
     CHAR                Name[1];
 }VIRTIO_PORT_INFO, * PVIRTIO_PORT_INFO;
 
+#define IOCTL_GET_PORT_TIMINGS   CTL_CODE(FILE_DEVICE_UNKNOWN, 0x801, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+// Port bring-up timings in 100ns units, measured from the moment the host
+// announced the port. A milestone not reached yet is reported as zero.
+typedef struct _tagVirtioPortTimings {
+    ULONGLONG           AddToReady;
+    ULONGLONG           AddToOpen;
+}VIRTIO_PORT_TIMINGS, * PVIRTIO_PORT_TIMINGS;
+
+#define IOCTL_GET_PORT_STATISTICS CTL_CODE(FILE_DEVICE_UNKNOWN, 0x804, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+// Running totals since the port was added. Notifications are the kicks the
+// driver sent to the host on the port's queues, Interrupts the queue
+// interrupts that found buffers used by the host on the port's queues.
+typedef struct _tagVirtioPortStatistics {
+    ULONGLONG           BytesWritten;
+    ULONGLONG           BytesRead;
+    ULONGLONG           TxNotifications;
+    ULONGLONG           RxNotifications;
+    ULONGLONG           Interrupts;
+}VIRTIO_PORT_STATISTICS, * PVIRTIO_PORT_STATISTICS;
+
+// Shared ring mode. The caller passes VIRTIO_SHARED_RING_MAP as the input
+// buffer and a page aligned buffer of VIRTIO_SHARED_RING_BUFFER_SIZE(RingSize)
+// bytes as the output buffer. The request stays pending for as long as the
+// port runs in this mode, ReadFile/WriteFile are refused meanwhile. Cancelling
+// it returns the port to the normal mode.
+#define IOCTL_MAP_SHARED_RING    CTL_CODE(FILE_DEVICE_UNKNOWN, 0x802, METHOD_OUT_DIRECT, FILE_ANY_ACCESS)
+// Tells the driver to look at the rings again: sent when the tx ring goes
+// from empty to non-empty or the rx ring stops being full.
+#define IOCTL_KICK_SHARED_RING   CTL_CODE(FILE_DEVICE_UNKNOWN, 0x803, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+typedef struct _tagVirtioSharedRingMap {
+    ULONG               RingSize;   // bytes per direction, a power of two
+    ULONG               Reserved;
+    ULONGLONG           RxEvent;    // event handle, set when the rx ring becomes non-empty
+    ULONGLONG           TxEvent;    // event handle, set when the tx ring has been drained
+}VIRTIO_SHARED_RING_MAP, * PVIRTIO_SHARED_RING_MAP;
+
+// Head and Tail are free running byte counters, the position in the data
+// area is the counter modulo RingSize. Head is only written by the producer
+// and Tail only by the consumer.
+typedef struct _tagVirtioSharedRingHeader {
+    volatile ULONG      Head;
+    volatile ULONG      Tail;
+}VIRTIO_SHARED_RING_HEADER, * PVIRTIO_SHARED_RING_HEADER;
+
+// The tx data area (application to host) follows the headers, the rx data
+// area (host to application) follows the tx one.
+typedef struct _tagVirtioSharedRings {
+    VIRTIO_SHARED_RING_HEADER Tx;
+    VIRTIO_SHARED_RING_HEADER Rx;
+    UCHAR               Data[1];
+}VIRTIO_SHARED_RINGS, * PVIRTIO_SHARED_RINGS;
+
+#define VIRTIO_SHARED_RING_BUFFER_SIZE(RingSize) \
+    (FIELD_OFFSET(VIRTIO_SHARED_RINGS, Data) + 2 * (RingSize))
+
 DEFINE_GUID(GUID_VIOSERIAL_PORT_CHANGE_STATUS,
 0x2c0f39ac, 0xb156, 0x4237, 0x9c, 0x64, 0x89, 0x91, 0xa1, 0x8b, 0xf3, 0x5c);
 // {2C0F39AC-B156-4237-9C64-8991A18BF35C}
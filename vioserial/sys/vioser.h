@@ -50,6 +50,23 @@ EVT_WDF_INTERRUPT_DISABLE                       VIOSerialInterruptDisable;
 
 #define RETRY_THRESHOLD                 400
 
+// Writes of at least this many bytes are posted to the out virtqueue
+// straight from the locked request buffer, smaller ones are copied.
+#define VIOSERIAL_DIRECT_WRITE_THRESHOLD PAGE_SIZE
+
+// Receive buffer pool defaults, overridable per port with the InBufferSize
+// and InBufferCount values in the port's device key. A count of 0 fills the
+// whole in virtqueue.
+#define VIOSERIAL_DEFAULT_IN_BUF_SIZE   PAGE_SIZE
+#define VIOSERIAL_DEFAULT_IN_BUF_COUNT  0
+#define VIOSERIAL_MAX_IN_BUF_PAGES      16
+
+// Limits of the per direction size of a shared ring and the most the driver
+// copies out of the tx ring into a single out virtqueue buffer.
+#define VIOSERIAL_SHARED_RING_MIN_SIZE  PAGE_SIZE
+#define VIOSERIAL_SHARED_RING_MAX_SIZE  (1024 * 1024)
+#define VIOSERIAL_SHARED_RING_CHUNK     (4 * PAGE_SIZE)
+
 // This is the value of the IOCTL_GET_INFORMATION macro used by older versions
 // of the driver. We still respond to it for backward compatibility. New clients
 // should use the new value declared in public.h.
@@ -118,16 +135,48 @@ typedef struct _tagPortBuffer
     size_t              size;
     size_t              len;
     size_t              offset;
+    // TRUE if the buffer belongs to a port's receive pool and is only
+    // freed together with it
+    BOOLEAN             pooled;
+    // links control queue buffers while a batch of messages is handled
+    LIST_ENTRY          list_entry;
 } PORT_BUFFER, * PPORT_BUFFER;
 
 typedef struct _WriteBufferEntry
 {
-    SINGLE_LIST_ENTRY ListEntry;
+    LIST_ENTRY ListEntry;
     WDFMEMORY EntryHandle;
     WDFREQUEST Request;
     PVOID Buffer;
+    // TRUE if Buffer is a pool copy of the request data which must be
+    // freed on reclaim, FALSE if it points into the request's own MDL.
+    BOOLEAN OwnBuffer;
 } WRITE_BUFFER_ENTRY, *PWRITE_BUFFER_ENTRY;
 
+// A port's view of the rings mapped with IOCTL_MAP_SHARED_RING. Changed with
+// both InBufLock and OutVqLock held, the rx side is used under InBufLock and
+// the tx side under OutVqLock. Rings is NULL while the port isn't mapped.
+typedef struct _tagSharedRing
+{
+    WDFREQUEST          Request;
+    PVIRTIO_SHARED_RINGS Rings;
+    PUCHAR              TxData;
+    PUCHAR              RxData;
+    ULONG               Size;
+    PKEVENT             RxEvent;
+    PKEVENT             TxEvent;
+} SHARED_RING, *PSHARED_RING;
+
+// Events of an IOCTL_MAP_SHARED_RING request, referenced in the caller's
+// context and released together with the request.
+typedef struct _tagSharedRingRequestContext
+{
+    PKEVENT             RxEvent;
+    PKEVENT             TxEvent;
+} SHARED_RING_REQUEST_CONTEXT, *PSHARED_RING_REQUEST_CONTEXT;
+
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(SHARED_RING_REQUEST_CONTEXT, GetSharedRingRequestContext)
+
 typedef struct _tagVioSerialPort
 {
     WDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER Header;
@@ -137,6 +186,14 @@ typedef struct _tagVioSerialPort
 
     PPORT_BUFFER        InBuf;
     WDFSPINLOCK         InBufLock;
+
+    // Receive buffers posted to the in virtqueue, allocated as one block
+    // while the port is in D0.
+    PPORT_BUFFER        InBufPool;
+    PVOID               InBufPoolData;
+    ULONG               InBufCount;
+    size_t              InBufSize;
+
     WDFSPINLOCK         OutVqLock;
     ANSI_STRING         NameString;
     UINT                PortId;
@@ -146,15 +203,32 @@ typedef struct _tagVioSerialPort
     BOOLEAN             GuestConnected;
 
     BOOLEAN             Removed;
+
+    // Bring-up milestones (interrupt time): PORT_ADD received from the
+    // host, PORT_READY sent back and host side opened. Zero until reached.
+    ULONGLONG           AddTime;
+    ULONGLONG           ReadyTime;
+    ULONGLONG           OpenTime;
+
+    // Tx counters are updated under OutVqLock, rx ones under InBufLock
+    // and Interrupts by the queues' DPC.
+    VIRTIO_PORT_STATISTICS Statistics;
+
     WDFQUEUE            ReadQueue;
-    WDFREQUEST          PendingReadRequest;
+    // Reads waiting for data from the host, completed in arrival order.
+    WDFQUEUE            PendingReadQueue;
 
     // Hold a list of allocated buffers which were written to the virt queue
-    // and was not returned yet.
-    SINGLE_LIST_ENTRY   WriteBuffersList;
+    // and was not returned yet. The entries themselves are the virt queue
+    // tokens, so a returned buffer is unlinked without searching the list.
+    LIST_ENTRY          WriteBuffersList;
 
     WDFQUEUE            WriteQueue;
     WDFQUEUE            IoctlQueue;
+
+    // Holds the pending IOCTL_MAP_SHARED_RING request of a mapped port.
+    WDFQUEUE            SharedRingQueue;
+    SHARED_RING         SharedRing;
 } VIOSERIAL_PORT, *PVIOSERIAL_PORT;
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(VIOSERIAL_PORT, SerialPortGetData)
@@ -183,6 +257,7 @@ VIOSerialFillQueue(
     IN WDFSPINLOCK Lock
 );
 
+// the caller is responsible for kicking the queue once it is done adding
 NTSTATUS
 VIOSerialAddInBuf(
     IN struct virtqueue *vq,
@@ -206,6 +281,22 @@ VIOSerialSendBuffers(
     IN size_t Length
 );
 
+EVT_WDF_REQUEST_CANCEL VIOSerialPortWriteRequestCancel;
+
+// posts Entry to the out virtqueue without notifying the host,
+// OutVqLock must be held
+BOOLEAN
+VIOSerialAddOutBufLocked(
+    IN PVIOSERIAL_PORT Port,
+    IN PWRITE_BUFFER_ENTRY Entry,
+    IN size_t Length
+);
+
+VOID
+VIOSerialFreeWriteBufferEntry(
+    IN PWRITE_BUFFER_ENTRY Entry
+);
+
 SSIZE_T
 VIOSerialFillReadBufLocked(
     IN PVIOSERIAL_PORT port,
@@ -223,6 +314,16 @@ VIOSerialFreeBuffer(
     IN PPORT_BUFFER buf
 );
 
+NTSTATUS
+VIOSerialAllocateInBufPool(
+    IN PVIOSERIAL_PORT Port
+);
+
+VOID
+VIOSerialFreeInBufPool(
+    IN PVIOSERIAL_PORT Port
+);
+
 VOID
 VIOSerialSendCtrlMsg(
     IN WDFDEVICE hDevice,
@@ -231,6 +332,12 @@ VIOSerialSendCtrlMsg(
     IN USHORT value
 );
 
+// frees control messages the host has consumed, CVqLock must be held
+VOID
+VIOSerialReclaimCtrlMsgsLocked(
+    IN struct virtqueue *vq
+);
+
 VOID
 VIOSerialCtrlWorkHandler(
     IN WDFDEVICE Device
@@ -291,11 +398,34 @@ EVT_WDF_CHILD_LIST_IDENTIFICATION_DESCRIPTION_CLEANUP VIOSerialEvtChildListIdent
 EVT_WDF_CHILD_LIST_IDENTIFICATION_DESCRIPTION_DUPLICATE VIOSerialEvtChildListIdentificationDescriptionDuplicate;
 EVT_WDF_IO_QUEUE_IO_READ VIOSerialPortRead;
 EVT_WDF_IO_QUEUE_IO_WRITE VIOSerialPortWrite;
-EVT_WDF_IO_QUEUE_IO_STOP VIOSerialPortReadIoStop;
 EVT_WDF_IO_QUEUE_IO_STOP VIOSerialPortWriteIoStop;
 EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL VIOSerialPortDeviceControl;
 EVT_WDF_DEVICE_FILE_CREATE VIOSerialPortCreate;
 EVT_WDF_FILE_CLOSE VIOSerialPortClose;
+EVT_WDF_IO_IN_CALLER_CONTEXT VIOSerialPortIoInCallerContext;
+EVT_WDF_IO_QUEUE_IO_CANCELED_ON_QUEUE VIOSerialSharedRingCanceledOnQueue;
+EVT_WDF_OBJECT_CONTEXT_CLEANUP VIOSerialSharedRingRequestCleanup;
+
+NTSTATUS
+VIOSerialSharedRingMap(
+    IN PVIOSERIAL_PORT Port,
+    IN WDFREQUEST Request
+);
+
+VOID
+VIOSerialSharedRingDetach(
+    IN PVIOSERIAL_PORT Port
+);
+
+VOID
+VIOSerialSharedRingFillLocked(
+    IN PVIOSERIAL_PORT Port
+);
+
+VOID
+VIOSerialSharedRingDrain(
+    IN PVIOSERIAL_PORT Port
+);
 
 VOID
 VIOSerialPortCreateName (
@@ -0,0 +1,497 @@
+/**********************************************************************
+ * Copyright (c) 2010-2016 Red Hat, Inc.
+ *
+ * File: benchmark.c
+ *
+ * Host-side benchmark of the vioserial port I/O path. Writes and reads
+ * of a range of sizes are kept in flight at a range of depths on port 0
+ * of the simulated console, the data streams are checked on both ends
+ * and the driver's per-port statistics against what the device counted.
+ * The table has the columns of the Windows benchmark; latencies are the
+ * time from dispatching a request to its completion.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "precomp.h"
+#include "vioser.h"
+#include "console.h"
+
+VOID VIOSerialPortRead(IN WDFQUEUE Queue, IN WDFREQUEST Request, IN size_t Length);
+VOID VIOSerialPortWrite(IN WDFQUEUE Queue, IN WDFREQUEST Request, IN size_t Length);
+
+#define BENCH_PORT          0
+#define IDLE_PORT           1
+#define MAX_DEPTH           64
+#define BYTES_PER_RUN       (8 * 1024 * 1024)
+#define MIN_REQUESTS        512
+#define MAX_REQUESTS        8192
+// passes of the device without any progress before the run is declared stuck
+#define MAX_IDLE_PASSES     4
+
+static const size_t Sizes[] = { 512, 2048, 8192, 32768, 131072 };
+static const ULONG Depths[] = { 1, 4, 16, 64 };
+
+typedef struct _BENCH_SLOT
+{
+    WDFREQUEST Request;
+    PUCHAR Buffer;
+    ULONGLONG Issued;
+    ULONGLONG Completed;
+} BENCH_SLOT, *PBENCH_SLOT;
+
+typedef struct _BENCH_RESULT
+{
+    const char *Name;
+    size_t Size;
+    ULONG Depth;
+    ULONGLONG BytesPerSecond;
+    ULONGLONG Latency[4];
+    double NotificationsPerMB;
+    ULONG Retries;
+} BENCH_RESULT, *PBENCH_RESULT;
+
+static BENCH_SLOT Slots[MAX_DEPTH];
+static ULONGLONG Latencies[MAX_REQUESTS];
+static ULONG LatencyCount;
+static ULONG Outstanding;
+static ULONG Errors;
+
+// stream offsets of the next byte to write and to check on read
+static ULONGLONG WriteOffset;
+static ULONGLONG ReadOffset;
+
+static ULONGLONG Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ULONGLONG)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int CompareLatency(const void *a, const void *b)
+{
+    ULONGLONG x = *(const ULONGLONG *)a;
+    ULONGLONG y = *(const ULONGLONG *)b;
+
+    return (x > y) - (x < y);
+}
+
+static ULONGLONG Notifications(PVIOSERIAL_PORT Port)
+{
+    return Port->Statistics.TxNotifications + Port->Statistics.RxNotifications +
+        Port->Statistics.Interrupts;
+}
+
+static VOID BenchFail(const char *Name, const char *Format, ...)
+{
+    va_list args;
+
+    printf("FAIL %s: ", Name);
+    va_start(args, Format);
+    vprintf(Format, args);
+    va_end(args);
+    printf("\n");
+    Errors++;
+}
+
+static VOID WriteCompletion(WDFREQUEST Request, PVOID Context)
+{
+    PBENCH_SLOT Slot = (PBENCH_SLOT)Context;
+
+    UNREFERENCED_PARAMETER(Request);
+    Slot->Completed = Now();
+}
+
+static VOID ReadCompletion(WDFREQUEST Request, PVOID Context)
+{
+    PBENCH_SLOT Slot = (PBENCH_SLOT)Context;
+    ULONG_PTR Length = StubRequestInformation(Request);
+    ULONG_PTR i;
+
+    Slot->Completed = Now();
+    if (!NT_SUCCESS(StubRequestStatus(Request)))
+    {
+        return;
+    }
+
+    // reads complete in stream order, check the data as it arrives
+    for (i = 0; i < Length; i++)
+    {
+        if (Slot->Buffer[i] != CONSOLE_STREAM_BYTE(ReadOffset + i))
+        {
+            BenchFail("read", "data mismatch at stream offset %llu", ReadOffset + i);
+            break;
+        }
+    }
+    ReadOffset += Length;
+}
+
+static PBENCH_SLOT GetFreeSlot(ULONG Depth)
+{
+    ULONG i;
+
+    for (i = 0; i < Depth; i++)
+    {
+        if (Slots[i].Request == NULL)
+        {
+            return &Slots[i];
+        }
+    }
+    return NULL;
+}
+
+static VOID ReleaseSlot(PBENCH_SLOT Slot)
+{
+    StubFreeRequest(Slot->Request);
+    Slot->Request = NULL;
+    Outstanding--;
+}
+
+// Runs the device once, returns FALSE if it has been idle for too long
+// with requests in flight.
+static BOOLEAN RunDevice(const char *Name, BOOLEAN Progress, ULONG *IdlePasses)
+{
+    if (ConsoleRun() || Progress)
+    {
+        *IdlePasses = 0;
+    }
+    else if (++*IdlePasses > MAX_IDLE_PASSES)
+    {
+        BenchFail(Name, "stalled with %u requests in flight", Outstanding);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static VOID Summarize(PBENCH_RESULT Result, ULONGLONG Bytes, ULONGLONG Elapsed,
+                      ULONGLONG NotificationCount)
+{
+    qsort(Latencies, LatencyCount, sizeof(Latencies[0]), CompareLatency);
+    Result->BytesPerSecond = Elapsed ? Bytes * 1000000000ULL / Elapsed : 0;
+    Result->Latency[0] = Latencies[LatencyCount * 50 / 100];
+    Result->Latency[1] = Latencies[LatencyCount * 90 / 100];
+    Result->Latency[2] = Latencies[LatencyCount * 99 / 100];
+    Result->Latency[3] = Latencies[LatencyCount - 1];
+    Result->NotificationsPerMB = Bytes ? NotificationCount * 1048576.0 / Bytes : 0;
+}
+
+static VOID RunWrite(PBENCH_RESULT Result, size_t Size, ULONG Depth, ULONG Count)
+{
+    PVIOSERIAL_PORT Port = ConsoleGetPort(BENCH_PORT);
+    ULONGLONG Start, Notified;
+    ULONG Issued = 0, Done = 0, IdlePasses = 0, i;
+    BOOLEAN Progress;
+    PBENCH_SLOT Slot;
+    size_t k;
+
+    Result->Name = "write";
+    Result->Size = Size;
+    Result->Depth = Depth;
+    Result->Retries = 0;
+    LatencyCount = 0;
+
+    Notified = Notifications(Port);
+    Start = Now();
+    while (Done < Count)
+    {
+        Progress = FALSE;
+        while (Issued < Count && (Slot = GetFreeSlot(Depth)) != NULL)
+        {
+            for (k = 0; k < Size; k++)
+            {
+                Slot->Buffer[k] = CONSOLE_STREAM_BYTE(WriteOffset + k);
+            }
+            Slot->Request = StubCreateRequest(Slot->Buffer, Size, WriteCompletion, Slot);
+            Slot->Issued = Now();
+            Slot->Completed = 0;
+            Outstanding++;
+            StubDispatchRequest(Port->WriteQueue, Slot->Request, WdfRequestTypeWrite);
+
+            // a full queue fails the write right away, it's retried once
+            // the device has returned some buffers
+            if (StubRequestCompleted(Slot->Request) &&
+                (StubRequestStatus(Slot->Request) == STATUS_CANT_WAIT ||
+                 StubRequestStatus(Slot->Request) == STATUS_INSUFFICIENT_RESOURCES))
+            {
+                ReleaseSlot(Slot);
+                Result->Retries++;
+                break;
+            }
+            WriteOffset += Size;
+            Issued++;
+            Progress = TRUE;
+        }
+
+        if (!RunDevice("write", Progress, &IdlePasses))
+        {
+            return;
+        }
+
+        for (i = 0; i < Depth; i++)
+        {
+            Slot = &Slots[i];
+            if (Slot->Request == NULL || !StubRequestCompleted(Slot->Request))
+            {
+                continue;
+            }
+            if (StubRequestStatus(Slot->Request) != STATUS_SUCCESS)
+            {
+                BenchFail("write", "completed with 0x%x", (ULONG)StubRequestStatus(Slot->Request));
+            }
+            else if (StubRequestInformation(Slot->Request) != Size)
+            {
+                BenchFail("write", "wrote %llu bytes", (ULONGLONG)StubRequestInformation(Slot->Request));
+            }
+            Latencies[LatencyCount++] = Slot->Completed - Slot->Issued;
+            ReleaseSlot(Slot);
+            Done++;
+            IdlePasses = 0;
+        }
+    }
+    Summarize(Result, (ULONGLONG)Size * Count, Now() - Start, Notifications(Port) - Notified);
+}
+
+static VOID RunRead(PBENCH_RESULT Result, size_t Size, ULONG Depth, ULONG Count)
+{
+    PVIOSERIAL_PORT Port = ConsoleGetPort(BENCH_PORT);
+    ULONGLONG Start, Notified, Total, Target;
+    ULONG IdlePasses = 0, i;
+    BOOLEAN Progress;
+    PBENCH_SLOT Slot;
+
+    Result->Name = "read";
+    Result->Size = Size;
+    Result->Depth = Depth;
+    Result->Retries = 0;
+    LatencyCount = 0;
+
+    Total = (ULONGLONG)Size * Count;
+    Target = ReadOffset + Total;
+    ConsoleSend(BENCH_PORT, Total);
+
+    Notified = Notifications(Port);
+    Start = Now();
+    while (ReadOffset < Target)
+    {
+        Progress = FALSE;
+        while (LatencyCount + Outstanding < MAX_REQUESTS && (Slot = GetFreeSlot(Depth)) != NULL)
+        {
+            Slot->Request = StubCreateRequest(Slot->Buffer, Size, ReadCompletion, Slot);
+            Slot->Issued = Now();
+            Slot->Completed = 0;
+            Outstanding++;
+            StubDispatchRequest(Port->ReadQueue, Slot->Request, WdfRequestTypeRead);
+            Progress = TRUE;
+        }
+
+        if (!RunDevice("read", Progress, &IdlePasses))
+        {
+            break;
+        }
+
+        for (i = 0; i < Depth; i++)
+        {
+            Slot = &Slots[i];
+            if (Slot->Request == NULL || !StubRequestCompleted(Slot->Request))
+            {
+                continue;
+            }
+            if (StubRequestStatus(Slot->Request) != STATUS_SUCCESS)
+            {
+                BenchFail("read", "completed with 0x%x", (ULONG)StubRequestStatus(Slot->Request));
+            }
+            else if (StubRequestInformation(Slot->Request) == 0)
+            {
+                BenchFail("read", "completed with no data");
+            }
+            if (LatencyCount < MAX_REQUESTS)
+            {
+                Latencies[LatencyCount++] = Slot->Completed - Slot->Issued;
+            }
+            ReleaseSlot(Slot);
+            IdlePasses = 0;
+        }
+    }
+    Summarize(Result, Total, Now() - Start, Notifications(Port) - Notified);
+
+    // the reads left waiting for more data are cancelled
+    for (i = 0; i < Depth; i++)
+    {
+        Slot = &Slots[i];
+        if (Slot->Request == NULL)
+        {
+            continue;
+        }
+        StubCancelRequest(Slot->Request);
+        if (!StubRequestCompleted(Slot->Request) ||
+            StubRequestStatus(Slot->Request) != STATUS_CANCELLED)
+        {
+            BenchFail("read", "pending read not cancelled");
+        }
+        ReleaseSlot(Slot);
+    }
+}
+
+// A copied write is cancelable while the host holds its buffer; the
+// buffer is reclaimed without the request once the host returns it.
+static VOID CancelWrite(VOID)
+{
+    PVIOSERIAL_PORT Port = ConsoleGetPort(BENCH_PORT);
+    PBENCH_SLOT Slot = &Slots[0];
+    ULONG Before = Errors;
+    size_t k;
+
+    for (k = 0; k < 512; k++)
+    {
+        Slot->Buffer[k] = CONSOLE_STREAM_BYTE(WriteOffset + k);
+    }
+    Slot->Request = StubCreateRequest(Slot->Buffer, 512, WriteCompletion, Slot);
+    Outstanding++;
+    StubDispatchRequest(Port->WriteQueue, Slot->Request, WdfRequestTypeWrite);
+    if (StubRequestCompleted(Slot->Request))
+    {
+        BenchFail("cancel-write", "write completed with 0x%x before the host took it",
+            (ULONG)StubRequestStatus(Slot->Request));
+        ReleaseSlot(Slot);
+        return;
+    }
+    WriteOffset += 512;
+
+    StubCancelRequest(Slot->Request);
+    if (!StubRequestCompleted(Slot->Request) ||
+        StubRequestStatus(Slot->Request) != STATUS_CANCELLED)
+    {
+        BenchFail("cancel-write", "write not cancelled");
+    }
+    ReleaseSlot(Slot);
+
+    while (ConsoleRun())
+    {
+    }
+    if (!IsListEmpty(&Port->WriteBuffersList))
+    {
+        BenchFail("cancel-write", "buffer of the cancelled write not reclaimed");
+    }
+    if (Errors == Before)
+    {
+        printf("PASS cancel-write\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static BENCH_RESULT Results[2 * ARRAYSIZE(Sizes) * ARRAYSIZE(Depths)];
+    CONSOLE_STATISTICS Statistics, Idle;
+    PVIOSERIAL_PORT Port;
+    ULONG ResultCount = 0, Count, i, s, d;
+    ULONG Before;
+
+    UNREFERENCED_PARAMETER(argc);
+    UNREFERENCED_PARAMETER(argv);
+
+    for (i = 0; i < MAX_DEPTH; i++)
+    {
+        Slots[i].Buffer = malloc(Sizes[ARRAYSIZE(Sizes) - 1]);
+        if (Slots[i].Buffer == NULL)
+        {
+            printf("FAIL out of memory\n");
+            return 1;
+        }
+    }
+
+    ConsoleCreate(TRUE);
+    Port = ConsoleGetPort(BENCH_PORT);
+
+    for (s = 0; s < ARRAYSIZE(Sizes); s++)
+    {
+        Count = (ULONG)min(max(BYTES_PER_RUN / Sizes[s], MIN_REQUESTS), MAX_REQUESTS);
+        for (d = 0; d < ARRAYSIZE(Depths); d++)
+        {
+            Before = Errors;
+            RunWrite(&Results[ResultCount], Sizes[s], Depths[d], Count);
+            if (Errors == Before)
+            {
+                printf("PASS write %6zu x %-2u (%u retries)\n", Sizes[s], Depths[d],
+                    Results[ResultCount].Retries);
+            }
+            ResultCount++;
+
+            Before = Errors;
+            RunRead(&Results[ResultCount], Sizes[s], Depths[d], Count);
+            if (Errors == Before)
+            {
+                printf("PASS read  %6zu x %-2u\n", Sizes[s], Depths[d]);
+            }
+            ResultCount++;
+        }
+    }
+
+    CancelWrite();
+
+    // the device saw the whole write stream intact, and the driver counted
+    // an interrupt for a port only when the host had used its buffers
+    ConsoleGetStatistics(BENCH_PORT, &Statistics);
+    ConsoleGetStatistics(IDLE_PORT, &Idle);
+    Before = Errors;
+    if (Statistics.DataErrors != 0)
+    {
+        BenchFail("streams", "%llu bytes written differ", Statistics.DataErrors);
+    }
+    if (Statistics.BytesReceived != WriteOffset)
+    {
+        BenchFail("streams", "device received %llu bytes", Statistics.BytesReceived);
+    }
+    if (Port->Statistics.BytesWritten != WriteOffset)
+    {
+        BenchFail("statistics", "driver wrote %llu bytes", Port->Statistics.BytesWritten);
+    }
+    if (Port->Statistics.BytesRead != ReadOffset)
+    {
+        BenchFail("statistics", "driver read %llu bytes", Port->Statistics.BytesRead);
+    }
+    if (Port->Statistics.Interrupts != Statistics.Interrupts)
+    {
+        BenchFail("statistics", "driver counted %llu interrupts", Port->Statistics.Interrupts);
+    }
+    if (ConsoleGetPort(IDLE_PORT)->Statistics.Interrupts != 0 || Idle.Interrupts != 0)
+    {
+        BenchFail("statistics", "idle port counted %llu interrupts",
+            ConsoleGetPort(IDLE_PORT)->Statistics.Interrupts);
+    }
+    if (Errors == Before)
+    {
+        printf("PASS streams and statistics\n");
+    }
+
+    printf("\n%10s %6s %12s %16s %10s %10s %10s %10s %10s\n",
+        "Type", "Size", "Parallelism", "Bytes/s", "p50 ns", "p90 ns", "p99 ns", "max ns",
+        "Notif/MB");
+    for (i = 0; i < ResultCount; i++)
+    {
+        printf("%10s %6zu %12u %16llu %10llu %10llu %10llu %10llu %10.1f\n",
+            Results[i].Name, Results[i].Size, Results[i].Depth, Results[i].BytesPerSecond,
+            Results[i].Latency[0], Results[i].Latency[1], Results[i].Latency[2],
+            Results[i].Latency[3], Results[i].NotificationsPerMB);
+    }
+
+    ConsoleDestroy();
+    for (i = 0; i < MAX_DEPTH; i++)
+    {
+        free(Slots[i].Buffer);
+    }
+
+    if (Errors != 0)
+    {
+        printf("%u checks failed\n", Errors);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,420 @@
+/**********************************************************************
+ * Copyright (c) 2010-2016 Red Hat, Inc.
+ *
+ * File: console.c
+ *
+ * A simulated multiport virtio-console device. The port queues are real
+ * split rings set up by the VirtIO library on guest memory; the device
+ * side walks them the way QEMU does: the out queue is taken when kicked,
+ * the in queue is filled with the data the host has to send whenever
+ * there is some and the guest has posted buffers. Event index is used
+ * both ways, all port queues share one MSI vector which runs the
+ * driver's queues DPC.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#include <stdlib.h>
+
+#include "precomp.h"
+#include "vioser.h"
+#include "virtio_ring.h"
+#include "windows/virtio_ring_allocation.h"
+#include "console.h"
+
+typedef struct _CONSOLE_QUEUE
+{
+    struct virtqueue *vq;
+    // the device's view of the ring
+    struct vring vring;
+    PVOID Pages;
+    PVOID Control;
+    u16 LastAvailIdx;
+    u16 UsedIdx;
+    BOOLEAN Kicked;
+} CONSOLE_QUEUE, *PCONSOLE_QUEUE;
+
+typedef struct _CONSOLE_PORT
+{
+    CONSOLE_QUEUE In;
+    CONSOLE_QUEUE Out;
+    PVIOSERIAL_PORT Port;
+    // stream offsets of the next byte to send and to receive
+    ULONGLONG TxOffset;
+    ULONGLONG RxOffset;
+    ULONGLONG RxPending;
+    BOOLEAN RxWaiting;
+    CONSOLE_STATISTICS Statistics;
+} CONSOLE_PORT, *PCONSOLE_PORT;
+
+static struct
+{
+    WDFDRIVER Driver;
+    WDFDEVICE Device;
+    CONSOLE_PORT Ports[CONSOLE_PORTS];
+    struct virtqueue *InQueues[CONSOLE_PORTS];
+    struct virtqueue *OutQueues[CONSOLE_PORTS];
+    BOOLEAN EventIdx;
+} Console;
+
+// the control queue isn't simulated, port events are handled in place
+VOID VIOSerialSendCtrlMsg(IN WDFDEVICE hDevice, IN ULONG id, IN USHORT event, IN USHORT value)
+{
+    UNREFERENCED_PARAMETER(hDevice);
+    UNREFERENCED_PARAMETER(id);
+    UNREFERENCED_PARAMETER(event);
+    UNREFERENCED_PARAMETER(value);
+}
+
+VOID VIOSerialCtrlWorkHandler(IN WDFDEVICE Device)
+{
+    UNREFERENCED_PARAMETER(Device);
+}
+
+// no port is mapped to a shared ring
+NTSTATUS VIOSerialSharedRingMap(IN PVIOSERIAL_PORT Port, IN WDFREQUEST Request)
+{
+    UNREFERENCED_PARAMETER(Port);
+    UNREFERENCED_PARAMETER(Request);
+    return STATUS_INVALID_DEVICE_REQUEST;
+}
+
+VOID VIOSerialSharedRingDetach(IN PVIOSERIAL_PORT Port)
+{
+    UNREFERENCED_PARAMETER(Port);
+}
+
+VOID VIOSerialSharedRingFillLocked(IN PVIOSERIAL_PORT Port)
+{
+    UNREFERENCED_PARAMETER(Port);
+}
+
+VOID VIOSerialSharedRingDrain(IN PVIOSERIAL_PORT Port)
+{
+    UNREFERENCED_PARAMETER(Port);
+}
+
+VOID VIOSerialSharedRingCanceledOnQueue(IN WDFQUEUE Queue, IN WDFREQUEST Request)
+{
+    UNREFERENCED_PARAMETER(Queue);
+    UNREFERENCED_PARAMETER(Request);
+}
+
+VOID VIOSerialPortIoInCallerContext(IN WDFDEVICE Device, IN WDFREQUEST Request)
+{
+    UNREFERENCED_PARAMETER(Device);
+    UNREFERENCED_PARAMETER(Request);
+}
+
+static PCONSOLE_QUEUE ConsoleFindQueue(struct virtqueue *vq)
+{
+    ULONG i;
+
+    for (i = 0; i < CONSOLE_PORTS; i++)
+    {
+        if (Console.Ports[i].In.vq == vq)
+        {
+            return &Console.Ports[i].In;
+        }
+        if (Console.Ports[i].Out.vq == vq)
+        {
+            return &Console.Ports[i].Out;
+        }
+    }
+    StubFail("notification of an unknown queue %p", vq);
+    return NULL;
+}
+
+static VOID ConsoleNotify(struct virtqueue *vq)
+{
+    PCONSOLE_QUEUE Queue = ConsoleFindQueue(vq);
+    ULONG i;
+
+    Queue->Kicked = TRUE;
+    for (i = 0; i < CONSOLE_PORTS; i++)
+    {
+        if (Queue == &Console.Ports[i].In)
+        {
+            Console.Ports[i].Statistics.RxKicks++;
+        }
+        else if (Queue == &Console.Ports[i].Out)
+        {
+            Console.Ports[i].Statistics.TxKicks++;
+        }
+    }
+}
+
+static VOID ConsoleCreateQueue(PCONSOLE_QUEUE Queue, unsigned int Index)
+{
+    Queue->Pages = aligned_alloc(PAGE_SIZE,
+        ROUND_TO_PAGES(vring_size(CONSOLE_QUEUE_SIZE, PAGE_SIZE)));
+    Queue->Control = malloc(vring_control_block_size() +
+        CONSOLE_QUEUE_SIZE * sizeof(void *));
+    if (Queue->Pages == NULL || Queue->Control == NULL)
+    {
+        StubFail("out of memory");
+    }
+    memset(Queue->Pages, 0, ROUND_TO_PAGES(vring_size(CONSOLE_QUEUE_SIZE, PAGE_SIZE)));
+
+    Queue->vq = vring_new_virtqueue(Index, CONSOLE_QUEUE_SIZE, PAGE_SIZE, NULL,
+        Console.EventIdx, Queue->Pages, ConsoleNotify, Queue->Control);
+    vring_init(&Queue->vring, CONSOLE_QUEUE_SIZE, Queue->Pages, PAGE_SIZE);
+    Queue->LastAvailIdx = 0;
+    Queue->UsedIdx = 0;
+    Queue->Kicked = FALSE;
+}
+
+static VOID ConsoleDeleteQueue(PCONSOLE_QUEUE Queue)
+{
+    free(Queue->Pages);
+    free(Queue->Control);
+}
+
+VOID ConsoleCreate(BOOLEAN EventIdx)
+{
+    PPORTS_DEVICE pContext;
+    PDRIVER_CONTEXT DriverContext;
+    PCONSOLE_PORT Port;
+    ULONG i;
+
+    RtlZeroMemory(&Console, sizeof(Console));
+    Console.EventIdx = EventIdx;
+
+    Console.Driver = StubCreateDriver(sizeof(DRIVER_CONTEXT));
+    DriverContext = GetDriverContext(Console.Driver);
+    DriverContext->WriteBufferLookaside = StubCreateLookaside(sizeof(WRITE_BUFFER_ENTRY));
+
+    Console.Device = StubCreateFdo(Console.Driver, sizeof(PORTS_DEVICE));
+    pContext = GetPortsDevice(Console.Device);
+    pContext->isHostMultiport = TRUE;
+    pContext->consoleConfig.max_nr_ports = CONSOLE_PORTS;
+    pContext->QueuesInterrupt = StubCreateInterrupt(Console.Device);
+    pContext->in_vqs = Console.InQueues;
+    pContext->out_vqs = Console.OutQueues;
+    pContext->DeviceOK = TRUE;
+
+    // port 0 uses queues 0 and 1, the control queues come next and then
+    // a pair per port
+    for (i = 0; i < CONSOLE_PORTS; i++)
+    {
+        Port = &Console.Ports[i];
+        ConsoleCreateQueue(&Port->In, (i == 0) ? 0 : 2 * (i + 1));
+        ConsoleCreateQueue(&Port->Out, (i == 0) ? 1 : 2 * (i + 1) + 1);
+        Console.InQueues[i] = Port->In.vq;
+        Console.OutQueues[i] = Port->Out.vq;
+    }
+
+    // the host adds the ports and opens them once they're ready, the
+    // guest application opens them after that
+    for (i = 0; i < CONSOLE_PORTS; i++)
+    {
+        VIOSerialAddPort(Console.Device, i);
+        Port = &Console.Ports[i];
+        Port->Port = VIOSerialFindPortById(Console.Device, i);
+        if (Port->Port == NULL)
+        {
+            StubFail("port %u not added", i);
+        }
+        if (!NT_SUCCESS(StubDeviceD0Entry(Port->Port->Device)))
+        {
+            StubFail("port %u failed to enter D0", i);
+        }
+        VIOSerialPortPnpNotify(Console.Device, Port->Port, TRUE);
+        if (!NT_SUCCESS(StubDeviceOpen(Port->Port->Device)))
+        {
+            StubFail("port %u failed to open", i);
+        }
+    }
+}
+
+VOID ConsoleDestroy(VOID)
+{
+    PDRIVER_CONTEXT DriverContext = GetDriverContext(Console.Driver);
+    ULONG i;
+
+    for (i = 0; i < CONSOLE_PORTS; i++)
+    {
+        StubDeviceClose(Console.Ports[i].Port->Device);
+        StubDeviceD0Exit(Console.Ports[i].Port->Device);
+    }
+    StubDeleteDevice(Console.Device);
+    for (i = 0; i < CONSOLE_PORTS; i++)
+    {
+        ConsoleDeleteQueue(&Console.Ports[i].In);
+        ConsoleDeleteQueue(&Console.Ports[i].Out);
+    }
+    WdfObjectDelete(DriverContext->WriteBufferLookaside);
+    WdfObjectDelete(Console.Driver);
+}
+
+PVIOSERIAL_PORT ConsoleGetPort(ULONG Index)
+{
+    return Console.Ports[Index].Port;
+}
+
+VOID ConsoleGetStatistics(ULONG Index, PCONSOLE_STATISTICS Statistics)
+{
+    *Statistics = Console.Ports[Index].Statistics;
+}
+
+VOID ConsoleSend(ULONG Index, ULONGLONG Length)
+{
+    Console.Ports[Index].RxPending += Length;
+}
+
+// Gives the buffer at the head of the avail ring back to the driver,
+// Process is called for each of its descriptors. Returns FALSE if the
+// driver has not posted any.
+typedef ULONG CONSOLE_PROCESS_DESCRIPTOR(PCONSOLE_PORT Port, PUCHAR Buffer, ULONG Length);
+
+static BOOLEAN ConsoleTakeBuffer(PCONSOLE_PORT Port, PCONSOLE_QUEUE Queue,
+                                 CONSOLE_PROCESS_DESCRIPTOR *Process)
+{
+    struct vring *vring = &Queue->vring;
+    struct vring_used_elem *used;
+    u16 head, i;
+    ULONG written = 0;
+    unsigned int count = 0;
+
+    if (Queue->LastAvailIdx == vring->avail->idx)
+    {
+        return FALSE;
+    }
+    rmb();
+
+    head = vring->avail->ring[Queue->LastAvailIdx % vring->num];
+    Queue->LastAvailIdx++;
+
+    i = head;
+    for (;;)
+    {
+        if (i >= vring->num || ++count > vring->num)
+        {
+            StubFail("bad descriptor chain at %u", head);
+        }
+        written += Process(Port, (PUCHAR)(ULONG_PTR)vring->desc[i].addr, vring->desc[i].len);
+        if (!(vring->desc[i].flags & VRING_DESC_F_NEXT))
+        {
+            break;
+        }
+        i = vring->desc[i].next;
+    }
+
+    used = &vring->used->ring[Queue->UsedIdx % vring->num];
+    used->id = head;
+    used->len = written;
+    Queue->UsedIdx++;
+    return TRUE;
+}
+
+static ULONG ConsoleReceive(PCONSOLE_PORT Port, PUCHAR Buffer, ULONG Length)
+{
+    ULONG i;
+
+    for (i = 0; i < Length; i++)
+    {
+        if (Buffer[i] != CONSOLE_STREAM_BYTE(Port->RxOffset + i))
+        {
+            Port->Statistics.DataErrors++;
+        }
+    }
+    Port->RxOffset += Length;
+    Port->Statistics.BytesReceived += Length;
+    return 0;
+}
+
+static ULONG ConsoleTransmit(PCONSOLE_PORT Port, PUCHAR Buffer, ULONG Length)
+{
+    ULONG i;
+
+    Length = (ULONG)min(Length, Port->RxPending);
+    for (i = 0; i < Length; i++)
+    {
+        Buffer[i] = CONSOLE_STREAM_BYTE(Port->TxOffset + i);
+    }
+    Port->TxOffset += Length;
+    Port->RxPending -= Length;
+    Port->Statistics.BytesSent += Length;
+    return Length;
+}
+
+// Publishes the used buffers and returns TRUE if the driver wants to be
+// interrupted for them.
+static BOOLEAN ConsoleFlushQueue(PCONSOLE_QUEUE Queue)
+{
+    struct vring *vring = &Queue->vring;
+    u16 old = vring->used->idx;
+    u16 new = Queue->UsedIdx;
+
+    // take the next kick only once the ring has been caught up with
+    if (Console.EventIdx)
+    {
+        vring_avail_event(vring) = Queue->LastAvailIdx;
+    }
+    if (old == new)
+    {
+        return FALSE;
+    }
+
+    wmb();
+    vring->used->idx = new;
+    mb();
+
+    if (Console.EventIdx)
+    {
+        return vring_need_event(vring_used_event(vring), new, old);
+    }
+    return !(vring->avail->flags & VRING_AVAIL_F_NO_INTERRUPT);
+}
+
+BOOLEAN ConsoleRun(VOID)
+{
+    PPORTS_DEVICE pContext = GetPortsDevice(Console.Device);
+    PCONSOLE_PORT Port;
+    BOOLEAN interrupt = FALSE;
+    BOOLEAN progress = FALSE;
+    BOOLEAN notify;
+    ULONG i;
+
+    for (i = 0; i < CONSOLE_PORTS; i++)
+    {
+        Port = &Console.Ports[i];
+        notify = FALSE;
+
+        if (Port->Out.Kicked)
+        {
+            Port->Out.Kicked = FALSE;
+            while (ConsoleTakeBuffer(Port, &Port->Out, ConsoleReceive))
+            {
+                progress = TRUE;
+            }
+            notify |= ConsoleFlushQueue(&Port->Out);
+        }
+
+        // new data goes out right away, once the in queue ran out of
+        // buffers the rest waits for the driver to kick it
+        if (Port->RxPending > 0 && (!Port->RxWaiting || Port->In.Kicked))
+        {
+            while (Port->RxPending > 0 && ConsoleTakeBuffer(Port, &Port->In, ConsoleTransmit))
+            {
+                progress = TRUE;
+            }
+            Port->RxWaiting = (Port->RxPending > 0);
+        }
+        Port->In.Kicked = FALSE;
+        notify |= ConsoleFlushQueue(&Port->In);
+
+        if (notify)
+        {
+            Port->Statistics.Interrupts++;
+            interrupt = TRUE;
+        }
+    }
+
+    if (interrupt)
+    {
+        VIOSerialQueuesInterruptDpc(pContext->QueuesInterrupt, NULL);
+    }
+    return progress;
+}
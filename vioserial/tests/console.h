@@ -0,0 +1,78 @@
+/**********************************************************************
+ * Copyright (c) 2010-2016 Red Hat, Inc.
+ *
+ * File: console.h
+ *
+ * The simulated virtio-console device and the stub WDF objects the
+ * benchmark drives the port I/O path with.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#pragma once
+
+// the device has a few ports, all of them sharing the queues' interrupt
+#define CONSOLE_PORTS       2
+#define CONSOLE_QUEUE_SIZE  128
+
+// byte k of a port's data stream, both directions use the same pattern
+#define CONSOLE_STREAM_BYTE(k) ((UCHAR)((k) % 251))
+
+typedef VOID STUB_REQUEST_COMPLETION(WDFREQUEST Request, PVOID Context);
+typedef STUB_REQUEST_COMPLETION *PFN_STUB_REQUEST_COMPLETION;
+
+// stub WDF objects (wdkstub.c)
+WDFDRIVER StubCreateDriver(size_t ContextSize);
+WDFDEVICE StubCreateFdo(WDFDRIVER Driver, size_t ContextSize);
+WDFINTERRUPT StubCreateInterrupt(WDFDEVICE Device);
+WDFLOOKASIDE StubCreateLookaside(size_t BufferSize);
+VOID StubDeleteDevice(WDFDEVICE Device);
+
+NTSTATUS StubDeviceD0Entry(WDFDEVICE Device);
+NTSTATUS StubDeviceD0Exit(WDFDEVICE Device);
+NTSTATUS StubDeviceOpen(WDFDEVICE Device);
+VOID StubDeviceClose(WDFDEVICE Device);
+
+// A request of a harness owned buffer. The completion routine is called
+// once the driver completes it, the request is freed with StubFreeRequest.
+WDFREQUEST StubCreateRequest(PVOID Buffer, size_t Length,
+                             PFN_STUB_REQUEST_COMPLETION Completion, PVOID Context);
+VOID StubFreeRequest(WDFREQUEST Request);
+VOID StubDispatchRequest(WDFQUEUE Queue, WDFREQUEST Request, WDF_REQUEST_TYPE Type);
+VOID StubCancelRequest(WDFREQUEST Request);
+BOOLEAN StubRequestCompleted(WDFREQUEST Request);
+NTSTATUS StubRequestStatus(WDFREQUEST Request);
+ULONG_PTR StubRequestInformation(WDFREQUEST Request);
+PVOID StubRequestBuffer(WDFREQUEST Request);
+
+// fails the program on a misuse of a stub object by the driver
+VOID StubFail(const char *Format, ...);
+
+// the simulated device (console.c)
+typedef struct _CONSOLE_STATISTICS
+{
+    // bytes the device took from the out queue and put in the in queue
+    ULONGLONG BytesReceived;
+    ULONGLONG BytesSent;
+    // kicks of the out and in queue and interrupts raised for the port
+    ULONGLONG TxKicks;
+    ULONGLONG RxKicks;
+    ULONGLONG Interrupts;
+    // bytes of the out queue which didn't match the data stream
+    ULONGLONG DataErrors;
+} CONSOLE_STATISTICS, *PCONSOLE_STATISTICS;
+
+VOID ConsoleCreate(BOOLEAN EventIdx);
+VOID ConsoleDestroy(VOID);
+PVIOSERIAL_PORT ConsoleGetPort(ULONG Index);
+VOID ConsoleGetStatistics(ULONG Index, PCONSOLE_STATISTICS Statistics);
+
+// The host sends Length more bytes of the port's stream as the in queue
+// buffers allow.
+VOID ConsoleSend(ULONG Index, ULONGLONG Length);
+
+// Runs the device: takes the buffers of the kicked queues and raises the
+// queues' interrupt if the driver asked for one. Returns FALSE if there
+// was nothing to do.
+BOOLEAN ConsoleRun(VOID);
@@ -0,0 +1,40 @@
+/**********************************************************************
+ * Copyright (c) 2012-2016 Red Hat, Inc.
+ *
+ * File: external_os_dep.h
+ *
+ * OS dependencies of the VirtIO library headers for the user mode build,
+ * picked up instead of osdep.h and kdebugprint.h when
+ * IGNORE_VIRTIO_OSDEP_H is defined.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#pragma once
+
+#include <stdbool.h>
+
+#define ktime_t ULONGLONG
+#define ktime_get() KeQueryPerformanceCounter(NULL).QuadPart
+
+#define likely(x) x
+#define unlikely(x) x
+
+#define ENOSPC 1
+#define BUG_ON(a) ASSERT(!(a))
+#define WARN_ON(a)
+#define BUG() ASSERT(0)
+
+// the driver headers' __inline functions are local to each source file,
+// no C library header comes after this one
+#define __inline static inline
+#define __forceinline inline
+
+#define mb()   __sync_synchronize()
+#define rmb()  __sync_synchronize()
+#define wmb()  __sync_synchronize()
+
+#define SMP_CACHE_BYTES 64
+
+#define DPrintf(Level, Fmt) if ((!bDebugPrint) || Level > virtioDebugLevel) {} else VirtioDebugPrintProc Fmt
@@ -0,0 +1,20 @@
+/**********************************************************************
+ * Copyright (c) 2010-2016 Red Hat, Inc.
+ *
+ * File: ring.c
+ *
+ * Builds the VirtIO library's split ring. virtio_pci.h declares
+ * virtio_get_indirect_page_capacity as returning unsigned long, which
+ * only matches its u32 definition where long is 32 bits; the declaration
+ * is moved out of the way here.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#include "osdep.h"
+#define virtio_get_indirect_page_capacity virtio_get_indirect_page_capacity_decl
+#include "virtio_pci.h"
+#undef virtio_get_indirect_page_capacity
+
+#include "VirtIORing.c"
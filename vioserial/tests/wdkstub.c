@@ -0,0 +1,1080 @@
+/**********************************************************************
+ * Copyright (c) 2010-2016 Red Hat, Inc.
+ *
+ * File: wdkstub.c
+ *
+ * User mode implementation of the kernel and WDF routines called by the
+ * vioserial port I/O path. Every WDF handle is a stub object carrying a
+ * single context, the driver runs single threaded: spin locks only check
+ * they are not taken recursively, manual queues are plain lists and work
+ * items run as soon as they are queued. Requests wrap harness owned
+ * buffers and report their completion to the harness.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "precomp.h"
+#include "vioser.h"
+#include "console.h"
+
+int virtioDebugLevel;
+int bDebugPrint;
+tDebugPrintFunc VirtioDebugPrintProc;
+
+const GUID GUID_VIOSERIAL_PORT;
+const GUID GUID_VIOSERIAL_PORT_CHANGE_STATUS;
+const GUID GUID_DEVCLASS_PORT_DEVICE;
+const UNICODE_STRING SDDL_DEVOBJ_SYS_ALL_ADM_ALL;
+
+typedef enum _STUB_OBJECT_TYPE
+{
+    StubDriver,
+    StubDevice,
+    StubQueue,
+    StubRequest,
+    StubMemory,
+    StubLookaside,
+    StubSpinLock,
+    StubInterrupt,
+    StubChildList,
+    StubWorkItem,
+    StubFileObject
+} STUB_OBJECT_TYPE;
+
+typedef struct _STUB_CHILD
+{
+    PWDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER Description;
+    WDFDEVICE Device;
+    BOOLEAN Present;
+} STUB_CHILD;
+
+struct _WDFDEVICE_INIT
+{
+    WDFDEVICE Parent;
+    WDF_PNPPOWER_EVENT_CALLBACKS PnpPowerCallbacks;
+    WDF_FILEOBJECT_CONFIG FileObjectConfig;
+};
+
+struct _WDFOBJECT
+{
+    STUB_OBJECT_TYPE Type;
+    PVOID Context;
+    // the device of a queue, interrupt or child list, the driver of a
+    // device, the queue a request was last dispatched or forwarded to
+    WDFOBJECT Parent;
+
+    // device
+    WDFCHILDLIST ChildList;
+    WDFFILEOBJECT FileObject;
+    WDF_PNPPOWER_EVENT_CALLBACKS PnpPowerCallbacks;
+    WDF_FILEOBJECT_CONFIG FileObjectConfig;
+
+    // queue, only the manual ones hold requests
+    WDF_IO_QUEUE_CONFIG QueueConfig;
+    LIST_ENTRY Requests;
+    ULONG RequestCount;
+
+    // request
+    LIST_ENTRY QueueEntry;
+    BOOLEAN Queued;
+    PVOID Buffer;
+    size_t Length;
+    ULONG_PTR Information;
+    NTSTATUS Status;
+    BOOLEAN Completed;
+    BOOLEAN Cancelled;
+    PFN_WDF_REQUEST_CANCEL EvtRequestCancel;
+    PFN_STUB_REQUEST_COMPLETION Completion;
+    PVOID CompletionContext;
+
+    // memory and lookaside
+    size_t Size;
+
+    // spin lock
+    BOOLEAN Held;
+
+    // child list
+    STUB_CHILD Children[CONSOLE_PORTS];
+    ULONG ChildCount;
+
+    // work item
+    PFN_WDF_WORKITEM EvtWorkItemFunc;
+};
+
+VOID StubFail(const char *Format, ...)
+{
+    va_list args;
+
+    va_start(args, Format);
+    printf("FAIL ");
+    vprintf(Format, args);
+    printf("\n");
+    va_end(args);
+    exit(1);
+}
+
+static WDFOBJECT StubCreateObject(STUB_OBJECT_TYPE Type, WDFOBJECT Parent, size_t ContextSize)
+{
+    WDFOBJECT Object = calloc(1, sizeof(*Object));
+
+    if (Object == NULL)
+    {
+        StubFail("out of memory");
+    }
+    Object->Type = Type;
+    Object->Parent = Parent;
+    if (ContextSize)
+    {
+        Object->Context = calloc(1, ContextSize);
+        if (Object->Context == NULL)
+        {
+            StubFail("out of memory");
+        }
+    }
+    InitializeListHead(&Object->Requests);
+    InitializeListHead(&Object->QueueEntry);
+    return Object;
+}
+
+static VOID StubCheckType(WDFOBJECT Object, STUB_OBJECT_TYPE Type, const char *Caller)
+{
+    if (Object == NULL || Object->Type != Type)
+    {
+        StubFail("%s called with a wrong handle %p", Caller, Object);
+    }
+}
+
+PVOID WdfObjectGetContext(WDFOBJECT Handle)
+{
+    if (Handle == NULL || Handle->Context == NULL)
+    {
+        StubFail("context of %p taken, the object has none", Handle);
+    }
+    return Handle->Context;
+}
+
+VOID WdfObjectDelete(WDFOBJECT Object)
+{
+    if (Object->Type == StubMemory)
+    {
+        free(Object->Buffer);
+    }
+    free(Object->Context);
+    free(Object);
+}
+
+// kernel
+PVOID ExAllocatePoolWithTag(POOL_TYPE PoolType, SIZE_T NumberOfBytes, ULONG Tag)
+{
+    UNREFERENCED_PARAMETER(PoolType);
+    UNREFERENCED_PARAMETER(Tag);
+    // non paged pool allocations of a page or more are page aligned
+    if (NumberOfBytes >= PAGE_SIZE)
+    {
+        return aligned_alloc(PAGE_SIZE, ROUND_TO_PAGES(NumberOfBytes));
+    }
+    return malloc(NumberOfBytes);
+}
+
+VOID ExFreePoolWithTag(PVOID P, ULONG Tag)
+{
+    UNREFERENCED_PARAMETER(Tag);
+    free(P);
+}
+
+// the simulated device accesses the guest memory at its virtual address
+PHYSICAL_ADDRESS MmGetPhysicalAddress(PVOID BaseAddress)
+{
+    PHYSICAL_ADDRESS pa;
+
+    pa.QuadPart = (LONGLONG)(ULONG_PTR)BaseAddress;
+    return pa;
+}
+
+ULONGLONG KeQueryInterruptTime(VOID)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ULONGLONG)ts.tv_sec * 10000000 + ts.tv_nsec / 100;
+}
+
+LARGE_INTEGER KeQueryPerformanceCounter(PLARGE_INTEGER PerformanceFrequency)
+{
+    LARGE_INTEGER counter;
+
+    if (PerformanceFrequency != NULL)
+    {
+        PerformanceFrequency->QuadPart = 10000000;
+    }
+    counter.QuadPart = (LONGLONG)KeQueryInterruptTime();
+    return counter;
+}
+
+NTSTATUS IoReportTargetDeviceChangeAsynchronous(PDEVICE_OBJECT PhysicalDeviceObject,
+                                                PVOID NotificationStructure,
+                                                PVOID Callback, PVOID Context)
+{
+    UNREFERENCED_PARAMETER(PhysicalDeviceObject);
+    UNREFERENCED_PARAMETER(NotificationStructure);
+    UNREFERENCED_PARAMETER(Callback);
+    UNREFERENCED_PARAMETER(Context);
+    return STATUS_SUCCESS;
+}
+
+// the device names are not used, formatting them is left out
+NTSTATUS RtlUnicodeStringPrintf(PUNICODE_STRING DestinationString, const wchar_t *Format, ...)
+{
+    UNREFERENCED_PARAMETER(Format);
+    DestinationString->Length = 0;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS RtlStringCbCopyA(PCHAR Destination, SIZE_T Size, const char *Source)
+{
+    if (Size == 0)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+    strncpy(Destination, Source, Size - 1);
+    Destination[Size - 1] = '\0';
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS RtlAnsiStringToUnicodeString(PUNICODE_STRING DestinationString,
+                                      PANSI_STRING SourceString,
+                                      BOOLEAN AllocateDestinationString)
+{
+    USHORT i;
+
+    if (!AllocateDestinationString)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+    DestinationString->Buffer = calloc(SourceString->Length + 1, sizeof(WCHAR));
+    if (DestinationString->Buffer == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    for (i = 0; i < SourceString->Length; i++)
+    {
+        DestinationString->Buffer[i] = (UCHAR)SourceString->Buffer[i];
+    }
+    DestinationString->Length = SourceString->Length * sizeof(WCHAR);
+    DestinationString->MaximumLength = DestinationString->Length + sizeof(WCHAR);
+    return STATUS_SUCCESS;
+}
+
+VOID RtlFreeUnicodeString(PUNICODE_STRING UnicodeString)
+{
+    free(UnicodeString->Buffer);
+    UnicodeString->Buffer = NULL;
+}
+
+NTSTATUS RtlULongAdd(ULONG Augend, ULONG Addend, PULONG Result)
+{
+    *Result = Augend + Addend;
+    return (*Result < Augend) ? STATUS_INVALID_PARAMETER : STATUS_SUCCESS;
+}
+
+// driver and devices
+WDFDRIVER StubCreateDriver(size_t ContextSize)
+{
+    return StubCreateObject(StubDriver, NULL, ContextSize);
+}
+
+WDFDEVICE StubCreateFdo(WDFDRIVER Driver, size_t ContextSize)
+{
+    WDFDEVICE Device = StubCreateObject(StubDevice, Driver, ContextSize);
+
+    Device->ChildList = StubCreateObject(StubChildList, Device, 0);
+    return Device;
+}
+
+WDFINTERRUPT StubCreateInterrupt(WDFDEVICE Device)
+{
+    return StubCreateObject(StubInterrupt, Device, 0);
+}
+
+WDFLOOKASIDE StubCreateLookaside(size_t BufferSize)
+{
+    WDFLOOKASIDE Lookaside = StubCreateObject(StubLookaside, NULL, 0);
+
+    Lookaside->Size = BufferSize;
+    return Lookaside;
+}
+
+// Deletes a device together with the child devices, queues and locks the
+// driver created for it. The objects are only tracked through the
+// driver's own port descriptions.
+VOID StubDeleteDevice(WDFDEVICE Device)
+{
+    WDFCHILDLIST List = Device->ChildList;
+    PVIOSERIAL_PORT Port;
+    ULONG i;
+
+    for (i = 0; List != NULL && i < List->ChildCount; i++)
+    {
+        Port = CONTAINING_RECORD(List->Children[i].Description, VIOSERIAL_PORT, Header);
+        WdfObjectDelete(Port->ReadQueue);
+        WdfObjectDelete(Port->PendingReadQueue);
+        WdfObjectDelete(Port->WriteQueue);
+        WdfObjectDelete(Port->IoctlQueue);
+        WdfObjectDelete(Port->SharedRingQueue);
+        WdfObjectDelete(Port->InBufLock);
+        WdfObjectDelete(Port->OutVqLock);
+        if (List->Children[i].Device != NULL)
+        {
+            StubDeleteDevice(List->Children[i].Device);
+        }
+        VIOSerialEvtChildListIdentificationDescriptionCleanup(List,
+            List->Children[i].Description);
+        free(List->Children[i].Description);
+    }
+    if (List != NULL)
+    {
+        WdfObjectDelete(List);
+    }
+    if (Device->FileObject != NULL)
+    {
+        WdfObjectDelete(Device->FileObject);
+    }
+    WdfObjectDelete(Device);
+}
+
+VOID WdfDeviceInitSetDeviceType(PWDFDEVICE_INIT DeviceInit, ULONG DeviceType)
+{
+    UNREFERENCED_PARAMETER(DeviceInit);
+    UNREFERENCED_PARAMETER(DeviceType);
+}
+
+VOID WdfDeviceInitSetIoType(PWDFDEVICE_INIT DeviceInit, WDF_DEVICE_IO_TYPE IoType)
+{
+    UNREFERENCED_PARAMETER(DeviceInit);
+    UNREFERENCED_PARAMETER(IoType);
+}
+
+VOID WdfDeviceInitSetExclusive(PWDFDEVICE_INIT DeviceInit, BOOLEAN IsExclusive)
+{
+    UNREFERENCED_PARAMETER(DeviceInit);
+    UNREFERENCED_PARAMETER(IsExclusive);
+}
+
+NTSTATUS WdfDeviceInitAssignSDDLString(PWDFDEVICE_INIT DeviceInit, PCUNICODE_STRING SDDLString)
+{
+    UNREFERENCED_PARAMETER(DeviceInit);
+    UNREFERENCED_PARAMETER(SDDLString);
+    return STATUS_SUCCESS;
+}
+
+VOID WdfDeviceInitSetIoInCallerContextCallback(PWDFDEVICE_INIT DeviceInit,
+                                               PFN_WDF_IO_IN_CALLER_CONTEXT EvtIoInCallerContext)
+{
+    UNREFERENCED_PARAMETER(DeviceInit);
+    UNREFERENCED_PARAMETER(EvtIoInCallerContext);
+}
+
+VOID WdfDeviceInitSetFileObjectConfig(PWDFDEVICE_INIT DeviceInit,
+                                      PWDF_FILEOBJECT_CONFIG FileObjectConfig,
+                                      PWDF_OBJECT_ATTRIBUTES FileObjectAttributes)
+{
+    UNREFERENCED_PARAMETER(FileObjectAttributes);
+    DeviceInit->FileObjectConfig = *FileObjectConfig;
+}
+
+VOID WdfDeviceInitSetPnpPowerEventCallbacks(PWDFDEVICE_INIT DeviceInit,
+                                            PWDF_PNPPOWER_EVENT_CALLBACKS PnpPowerEventCallbacks)
+{
+    DeviceInit->PnpPowerCallbacks = *PnpPowerEventCallbacks;
+}
+
+NTSTATUS WdfPdoInitAssignRawDevice(PWDFDEVICE_INIT DeviceInit, const GUID *DeviceClassGuid)
+{
+    UNREFERENCED_PARAMETER(DeviceInit);
+    UNREFERENCED_PARAMETER(DeviceClassGuid);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfPdoInitAssignDeviceID(PWDFDEVICE_INIT DeviceInit, PCUNICODE_STRING DeviceID)
+{
+    UNREFERENCED_PARAMETER(DeviceInit);
+    UNREFERENCED_PARAMETER(DeviceID);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfPdoInitAddHardwareID(PWDFDEVICE_INIT DeviceInit, PCUNICODE_STRING HardwareID)
+{
+    UNREFERENCED_PARAMETER(DeviceInit);
+    UNREFERENCED_PARAMETER(HardwareID);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfPdoInitAssignInstanceID(PWDFDEVICE_INIT DeviceInit, PCUNICODE_STRING InstanceID)
+{
+    UNREFERENCED_PARAMETER(DeviceInit);
+    UNREFERENCED_PARAMETER(InstanceID);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfPdoInitAddDeviceText(PWDFDEVICE_INIT DeviceInit, PCUNICODE_STRING DeviceDescription,
+                                 PCUNICODE_STRING DeviceLocation, LCID LocaleId)
+{
+    UNREFERENCED_PARAMETER(DeviceInit);
+    UNREFERENCED_PARAMETER(DeviceDescription);
+    UNREFERENCED_PARAMETER(DeviceLocation);
+    UNREFERENCED_PARAMETER(LocaleId);
+    return STATUS_SUCCESS;
+}
+
+VOID WdfPdoInitSetDefaultLocale(PWDFDEVICE_INIT DeviceInit, LCID LocaleId)
+{
+    UNREFERENCED_PARAMETER(DeviceInit);
+    UNREFERENCED_PARAMETER(LocaleId);
+}
+
+NTSTATUS WdfDeviceCreate(PWDFDEVICE_INIT *DeviceInit, PWDF_OBJECT_ATTRIBUTES DeviceAttributes,
+                         WDFDEVICE *Device)
+{
+    PWDFDEVICE_INIT Init = *DeviceInit;
+    WDFDEVICE Parent = Init->Parent;
+    WDFDEVICE Child;
+
+    // a PDO belongs to the driver of its bus device
+    Child = StubCreateObject(StubDevice, Parent->Parent,
+                             DeviceAttributes ? DeviceAttributes->ContextSize : 0);
+    Child->PnpPowerCallbacks = Init->PnpPowerCallbacks;
+    Child->FileObjectConfig = Init->FileObjectConfig;
+    Child->FileObject = StubCreateObject(StubFileObject, Child, 0);
+
+    *DeviceInit = NULL;
+    *Device = Child;
+    return STATUS_SUCCESS;
+}
+
+WDFDRIVER WdfDeviceGetDriver(WDFDEVICE Device)
+{
+    StubCheckType(Device, StubDevice, __FUNCTION__);
+    return Device->Parent;
+}
+
+NTSTATUS WdfDeviceConfigureRequestDispatching(WDFDEVICE Device, WDFQUEUE Queue,
+                                              WDF_REQUEST_TYPE RequestType)
+{
+    UNREFERENCED_PARAMETER(Device);
+    UNREFERENCED_PARAMETER(Queue);
+    UNREFERENCED_PARAMETER(RequestType);
+    return STATUS_SUCCESS;
+}
+
+VOID WdfDeviceSetPnpCapabilities(WDFDEVICE Device, PWDF_DEVICE_PNP_CAPABILITIES PnpCapabilities)
+{
+    UNREFERENCED_PARAMETER(Device);
+    UNREFERENCED_PARAMETER(PnpCapabilities);
+}
+
+VOID WdfDeviceSetDeviceState(WDFDEVICE Device, PWDF_DEVICE_STATE DeviceState)
+{
+    UNREFERENCED_PARAMETER(Device);
+    UNREFERENCED_PARAMETER(DeviceState);
+}
+
+NTSTATUS WdfDeviceCreateDeviceInterface(WDFDEVICE Device, const GUID *InterfaceClassGUID,
+                                        PCUNICODE_STRING ReferenceString)
+{
+    UNREFERENCED_PARAMETER(Device);
+    UNREFERENCED_PARAMETER(InterfaceClassGUID);
+    UNREFERENCED_PARAMETER(ReferenceString);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfDeviceCreateSymbolicLink(WDFDEVICE Device, PCUNICODE_STRING SymbolicLinkName)
+{
+    UNREFERENCED_PARAMETER(Device);
+    UNREFERENCED_PARAMETER(SymbolicLinkName);
+    return STATUS_SUCCESS;
+}
+
+// the port devices never report PnP notifications
+WDF_DEVICE_PNP_STATE WdfDeviceGetDevicePnpState(WDFDEVICE Device)
+{
+    UNREFERENCED_PARAMETER(Device);
+    return WdfDevStatePnpInvalid;
+}
+
+PDEVICE_OBJECT WdfDeviceWdmGetPhysicalDevice(WDFDEVICE Device)
+{
+    UNREFERENCED_PARAMETER(Device);
+    return NULL;
+}
+
+// there are no registry settings, the ports use the defaults
+NTSTATUS WdfDeviceOpenRegistryKey(WDFDEVICE Device, ULONG DeviceInstanceKeyType,
+                                  ULONG DesiredAccess, PWDF_OBJECT_ATTRIBUTES KeyAttributes,
+                                  WDFKEY *Key)
+{
+    UNREFERENCED_PARAMETER(Device);
+    UNREFERENCED_PARAMETER(DeviceInstanceKeyType);
+    UNREFERENCED_PARAMETER(DesiredAccess);
+    UNREFERENCED_PARAMETER(KeyAttributes);
+    *Key = NULL;
+    return STATUS_OBJECT_NAME_NOT_FOUND;
+}
+
+NTSTATUS WdfRegistryQueryULong(WDFKEY Key, PCUNICODE_STRING ValueName, PULONG Value)
+{
+    UNREFERENCED_PARAMETER(Key);
+    UNREFERENCED_PARAMETER(ValueName);
+    UNREFERENCED_PARAMETER(Value);
+    return STATUS_OBJECT_NAME_NOT_FOUND;
+}
+
+VOID WdfRegistryClose(WDFKEY Key)
+{
+    UNREFERENCED_PARAMETER(Key);
+}
+
+WDFDEVICE WdfFileObjectGetDevice(WDFFILEOBJECT FileObject)
+{
+    StubCheckType(FileObject, StubFileObject, __FUNCTION__);
+    return FileObject->Parent;
+}
+
+NTSTATUS StubDeviceD0Entry(WDFDEVICE Device)
+{
+    return Device->PnpPowerCallbacks.EvtDeviceD0Entry(Device, WdfPowerDeviceD3);
+}
+
+NTSTATUS StubDeviceD0Exit(WDFDEVICE Device)
+{
+    return Device->PnpPowerCallbacks.EvtDeviceD0Exit(Device, WdfPowerDeviceD3);
+}
+
+NTSTATUS StubDeviceOpen(WDFDEVICE Device)
+{
+    WDFREQUEST Request = StubCreateRequest(NULL, 0, NULL, NULL);
+    NTSTATUS status;
+
+    Device->FileObjectConfig.EvtDeviceFileCreate(Device, Request, Device->FileObject);
+    if (!Request->Completed)
+    {
+        StubFail("create request left pending");
+    }
+    status = Request->Status;
+    StubFreeRequest(Request);
+    return status;
+}
+
+VOID StubDeviceClose(WDFDEVICE Device)
+{
+    Device->FileObjectConfig.EvtFileClose(Device->FileObject);
+}
+
+// queues
+NTSTATUS WdfIoQueueCreate(WDFDEVICE Device, PWDF_IO_QUEUE_CONFIG Config,
+                          PWDF_OBJECT_ATTRIBUTES QueueAttributes, WDFQUEUE *Queue)
+{
+    WDFQUEUE NewQueue = StubCreateObject(StubQueue, Device,
+                                         QueueAttributes ? QueueAttributes->ContextSize : 0);
+
+    NewQueue->QueueConfig = *Config;
+    *Queue = NewQueue;
+    return STATUS_SUCCESS;
+}
+
+WDFDEVICE WdfIoQueueGetDevice(WDFQUEUE Queue)
+{
+    StubCheckType(Queue, StubQueue, __FUNCTION__);
+    return Queue->Parent;
+}
+
+WDF_IO_QUEUE_STATE WdfIoQueueGetState(WDFQUEUE Queue, PULONG QueueRequests, PULONG DriverRequests)
+{
+    StubCheckType(Queue, StubQueue, __FUNCTION__);
+    if (QueueRequests != NULL)
+    {
+        *QueueRequests = Queue->RequestCount;
+    }
+    if (DriverRequests != NULL)
+    {
+        *DriverRequests = 0;
+    }
+    return WdfIoQueueAcceptRequests | WdfIoQueueDispatchRequests;
+}
+
+static VOID StubDequeueRequest(WDFREQUEST Request)
+{
+    if (Request->Queued)
+    {
+        RemoveEntryList(&Request->QueueEntry);
+        Request->Parent->RequestCount--;
+        Request->Queued = FALSE;
+    }
+}
+
+NTSTATUS WdfIoQueueRetrieveNextRequest(WDFQUEUE Queue, WDFREQUEST *OutRequest)
+{
+    WDFREQUEST Request;
+
+    StubCheckType(Queue, StubQueue, __FUNCTION__);
+    if (Queue->QueueConfig.DispatchType != WdfIoQueueDispatchManual)
+    {
+        StubFail("requests retrieved from a queue which is not manual");
+    }
+    if (IsListEmpty(&Queue->Requests))
+    {
+        *OutRequest = NULL;
+        return STATUS_NO_MORE_ENTRIES;
+    }
+    Request = CONTAINING_RECORD(Queue->Requests.Flink, struct _WDFOBJECT, QueueEntry);
+    StubDequeueRequest(Request);
+    *OutRequest = Request;
+    return STATUS_SUCCESS;
+}
+
+// requests
+WDFREQUEST StubCreateRequest(PVOID Buffer, size_t Length,
+                             PFN_STUB_REQUEST_COMPLETION Completion, PVOID Context)
+{
+    WDFREQUEST Request = StubCreateObject(StubRequest, NULL, 0);
+
+    Request->Buffer = Buffer;
+    Request->Length = Length;
+    Request->Completion = Completion;
+    Request->CompletionContext = Context;
+    return Request;
+}
+
+VOID StubFreeRequest(WDFREQUEST Request)
+{
+    StubCheckType(Request, StubRequest, __FUNCTION__);
+    if (!Request->Completed)
+    {
+        StubFail("request %p freed while the driver owns it", Request);
+    }
+    WdfObjectDelete(Request);
+}
+
+VOID StubDispatchRequest(WDFQUEUE Queue, WDFREQUEST Request, WDF_REQUEST_TYPE Type)
+{
+    StubCheckType(Queue, StubQueue, __FUNCTION__);
+    Request->Parent = Queue;
+    switch (Type)
+    {
+    case WdfRequestTypeRead:
+        Queue->QueueConfig.EvtIoRead(Queue, Request, Request->Length);
+        break;
+    case WdfRequestTypeWrite:
+        Queue->QueueConfig.EvtIoWrite(Queue, Request, Request->Length);
+        break;
+    default:
+        StubFail("request type %d is not dispatched", Type);
+    }
+}
+
+// Cancels a request the way the framework does: a request waiting in a
+// manual queue is completed right away, one marked cancelable has its
+// cancel routine called, any other is cancelled once it's marked.
+VOID StubCancelRequest(WDFREQUEST Request)
+{
+    PFN_WDF_REQUEST_CANCEL EvtRequestCancel;
+
+    StubCheckType(Request, StubRequest, __FUNCTION__);
+    if (Request->Completed)
+    {
+        return;
+    }
+    Request->Cancelled = TRUE;
+    if (Request->Queued)
+    {
+        StubDequeueRequest(Request);
+        WdfRequestComplete(Request, STATUS_CANCELLED);
+    }
+    else if (Request->EvtRequestCancel != NULL)
+    {
+        EvtRequestCancel = Request->EvtRequestCancel;
+        Request->EvtRequestCancel = NULL;
+        EvtRequestCancel(Request);
+    }
+}
+
+BOOLEAN StubRequestCompleted(WDFREQUEST Request)
+{
+    return Request->Completed;
+}
+
+NTSTATUS StubRequestStatus(WDFREQUEST Request)
+{
+    return Request->Status;
+}
+
+ULONG_PTR StubRequestInformation(WDFREQUEST Request)
+{
+    return Request->Information;
+}
+
+PVOID StubRequestBuffer(WDFREQUEST Request)
+{
+    return Request->Buffer;
+}
+
+static NTSTATUS StubRetrieveBuffer(WDFREQUEST Request, size_t MinimumRequiredSize,
+                                   PVOID *Buffer, size_t *Length)
+{
+    StubCheckType(Request, StubRequest, __FUNCTION__);
+    if (Request->Length < MinimumRequiredSize || Request->Buffer == NULL)
+    {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+    *Buffer = Request->Buffer;
+    if (Length != NULL)
+    {
+        *Length = Request->Length;
+    }
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRequestRetrieveInputBuffer(WDFREQUEST Request, size_t MinimumRequiredSize,
+                                       PVOID *Buffer, size_t *Length)
+{
+    return StubRetrieveBuffer(Request, MinimumRequiredSize, Buffer, Length);
+}
+
+NTSTATUS WdfRequestRetrieveOutputBuffer(WDFREQUEST Request, size_t MinimumRequiredSize,
+                                        PVOID *Buffer, size_t *Length)
+{
+    return StubRetrieveBuffer(Request, MinimumRequiredSize, Buffer, Length);
+}
+
+NTSTATUS WdfRequestForwardToIoQueue(WDFREQUEST Request, WDFQUEUE DestinationQueue)
+{
+    StubCheckType(Request, StubRequest, __FUNCTION__);
+    StubCheckType(DestinationQueue, StubQueue, __FUNCTION__);
+    if (DestinationQueue->QueueConfig.DispatchType != WdfIoQueueDispatchManual)
+    {
+        StubFail("request forwarded to a queue which is not manual");
+    }
+    if (Request->Cancelled)
+    {
+        return STATUS_CANCELLED;
+    }
+    Request->Parent = DestinationQueue;
+    InsertTailList(&DestinationQueue->Requests, &Request->QueueEntry);
+    DestinationQueue->RequestCount++;
+    Request->Queued = TRUE;
+    return STATUS_SUCCESS;
+}
+
+WDFQUEUE WdfRequestGetIoQueue(WDFREQUEST Request)
+{
+    StubCheckType(Request, StubRequest, __FUNCTION__);
+    return Request->Parent;
+}
+
+VOID WdfRequestSetInformation(WDFREQUEST Request, ULONG_PTR Information)
+{
+    StubCheckType(Request, StubRequest, __FUNCTION__);
+    Request->Information = Information;
+}
+
+ULONG_PTR WdfRequestGetInformation(WDFREQUEST Request)
+{
+    StubCheckType(Request, StubRequest, __FUNCTION__);
+    return Request->Information;
+}
+
+NTSTATUS WdfRequestMarkCancelableEx(WDFREQUEST Request, PFN_WDF_REQUEST_CANCEL EvtRequestCancel)
+{
+    StubCheckType(Request, StubRequest, __FUNCTION__);
+    if (Request->EvtRequestCancel != NULL)
+    {
+        StubFail("request %p marked cancelable twice", Request);
+    }
+    if (Request->Cancelled)
+    {
+        return STATUS_CANCELLED;
+    }
+    Request->EvtRequestCancel = EvtRequestCancel;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfRequestUnmarkCancelable(WDFREQUEST Request)
+{
+    StubCheckType(Request, StubRequest, __FUNCTION__);
+    if (Request->EvtRequestCancel == NULL)
+    {
+        // the cancel routine runs or has run
+        return Request->Cancelled ? STATUS_CANCELLED : STATUS_SUCCESS;
+    }
+    Request->EvtRequestCancel = NULL;
+    return STATUS_SUCCESS;
+}
+
+VOID WdfRequestStopAcknowledge(WDFREQUEST Request, BOOLEAN Requeue)
+{
+    UNREFERENCED_PARAMETER(Request);
+    UNREFERENCED_PARAMETER(Requeue);
+}
+
+VOID WdfRequestCompleteWithInformation(WDFREQUEST Request, NTSTATUS Status, ULONG_PTR Information)
+{
+    StubCheckType(Request, StubRequest, __FUNCTION__);
+    if (Request->Completed)
+    {
+        StubFail("request %p completed twice", Request);
+    }
+    if (Request->Queued)
+    {
+        StubFail("request %p completed while in a queue", Request);
+    }
+    if (Request->EvtRequestCancel != NULL)
+    {
+        StubFail("request %p completed while cancelable", Request);
+    }
+    Request->Status = Status;
+    Request->Information = Information;
+    Request->Completed = TRUE;
+    if (Request->Completion != NULL)
+    {
+        Request->Completion(Request, Request->CompletionContext);
+    }
+}
+
+VOID WdfRequestComplete(WDFREQUEST Request, NTSTATUS Status)
+{
+    WdfRequestCompleteWithInformation(Request, Status, NT_SUCCESS(Status) ? Request->Information : 0);
+}
+
+// memory
+NTSTATUS WdfMemoryCreateFromLookaside(WDFLOOKASIDE Lookaside, WDFMEMORY *Memory)
+{
+    WDFMEMORY NewMemory;
+
+    StubCheckType(Lookaside, StubLookaside, __FUNCTION__);
+    NewMemory = StubCreateObject(StubMemory, NULL, 0);
+    NewMemory->Buffer = calloc(1, Lookaside->Size);
+    if (NewMemory->Buffer == NULL)
+    {
+        WdfObjectDelete(NewMemory);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    NewMemory->Size = Lookaside->Size;
+    *Memory = NewMemory;
+    return STATUS_SUCCESS;
+}
+
+PVOID WdfMemoryGetBuffer(WDFMEMORY Memory, size_t *BufferSize)
+{
+    StubCheckType(Memory, StubMemory, __FUNCTION__);
+    if (BufferSize != NULL)
+    {
+        *BufferSize = Memory->Size;
+    }
+    return Memory->Buffer;
+}
+
+// synchronization
+NTSTATUS WdfSpinLockCreate(PWDF_OBJECT_ATTRIBUTES SpinLockAttributes, WDFSPINLOCK *SpinLock)
+{
+    UNREFERENCED_PARAMETER(SpinLockAttributes);
+    *SpinLock = StubCreateObject(StubSpinLock, NULL, 0);
+    return STATUS_SUCCESS;
+}
+
+VOID WdfSpinLockAcquire(WDFSPINLOCK SpinLock)
+{
+    StubCheckType(SpinLock, StubSpinLock, __FUNCTION__);
+    if (SpinLock->Held)
+    {
+        StubFail("spin lock %p acquired recursively", SpinLock);
+    }
+    SpinLock->Held = TRUE;
+}
+
+VOID WdfSpinLockRelease(WDFSPINLOCK SpinLock)
+{
+    StubCheckType(SpinLock, StubSpinLock, __FUNCTION__);
+    if (!SpinLock->Held)
+    {
+        StubFail("spin lock %p released while not held", SpinLock);
+    }
+    SpinLock->Held = FALSE;
+}
+
+// work items
+NTSTATUS WdfWorkItemCreate(PWDF_WORKITEM_CONFIG Config, PWDF_OBJECT_ATTRIBUTES Attributes,
+                           WDFWORKITEM *WorkItem)
+{
+    WDFWORKITEM NewWorkItem = StubCreateObject(StubWorkItem, NULL,
+                                               Attributes ? Attributes->ContextSize : 0);
+
+    NewWorkItem->EvtWorkItemFunc = Config->EvtWorkItemFunc;
+    *WorkItem = NewWorkItem;
+    return STATUS_SUCCESS;
+}
+
+VOID WdfWorkItemEnqueue(WDFWORKITEM WorkItem)
+{
+    StubCheckType(WorkItem, StubWorkItem, __FUNCTION__);
+    WorkItem->EvtWorkItemFunc(WorkItem);
+}
+
+// interrupts, a message signaled vector per interrupt object
+WDFDEVICE WdfInterruptGetDevice(WDFINTERRUPT Interrupt)
+{
+    StubCheckType(Interrupt, StubInterrupt, __FUNCTION__);
+    return Interrupt->Parent;
+}
+
+VOID WdfInterruptGetInfo(WDFINTERRUPT Interrupt, PWDF_INTERRUPT_INFO Info)
+{
+    StubCheckType(Interrupt, StubInterrupt, __FUNCTION__);
+    Info->Vector = 1;
+    Info->MessageSignaled = TRUE;
+}
+
+BOOLEAN WdfInterruptQueueDpcForIsr(WDFINTERRUPT Interrupt)
+{
+    UNREFERENCED_PARAMETER(Interrupt);
+    return TRUE;
+}
+
+UCHAR VirtIOWdfGetISRStatus(PVIRTIO_WDF_DRIVER pWdfDriver)
+{
+    UNREFERENCED_PARAMETER(pWdfDriver);
+    return 0;
+}
+
+// child lists, the PDO of a port is created as soon as it is reported
+WDFCHILDLIST WdfFdoGetDefaultChildList(WDFDEVICE Fdo)
+{
+    StubCheckType(Fdo, StubDevice, __FUNCTION__);
+    return Fdo->ChildList;
+}
+
+static STUB_CHILD *StubFindChild(WDFCHILDLIST ChildList,
+                                 PWDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER IdentificationDescription)
+{
+    ULONG i;
+
+    for (i = 0; i < ChildList->ChildCount; i++)
+    {
+        if (VIOSerialEvtChildListIdentificationDescriptionCompare(ChildList,
+            ChildList->Children[i].Description, IdentificationDescription))
+        {
+            return &ChildList->Children[i];
+        }
+    }
+    return NULL;
+}
+
+NTSTATUS WdfChildListAddOrUpdateChildDescriptionAsPresent(
+    WDFCHILDLIST ChildList,
+    PWDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER IdentificationDescription,
+    PWDF_CHILD_ADDRESS_DESCRIPTION_HEADER AddressDescription)
+{
+    struct _WDFDEVICE_INIT ChildInit;
+    STUB_CHILD *Child;
+    NTSTATUS status;
+
+    UNREFERENCED_PARAMETER(AddressDescription);
+    StubCheckType(ChildList, StubChildList, __FUNCTION__);
+
+    if (StubFindChild(ChildList, IdentificationDescription) != NULL)
+    {
+        return STATUS_OBJECT_NAME_EXISTS;
+    }
+    if (ChildList->ChildCount == CONSOLE_PORTS)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Child = &ChildList->Children[ChildList->ChildCount];
+    Child->Description = calloc(1, IdentificationDescription->IdentificationDescriptionSize);
+    if (Child->Description == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    Child->Description->IdentificationDescriptionSize =
+        IdentificationDescription->IdentificationDescriptionSize;
+    status = VIOSerialEvtChildListIdentificationDescriptionDuplicate(ChildList,
+        IdentificationDescription, Child->Description);
+    if (!NT_SUCCESS(status))
+    {
+        free(Child->Description);
+        return status;
+    }
+    ChildList->ChildCount++;
+
+    RtlZeroMemory(&ChildInit, sizeof(ChildInit));
+    ChildInit.Parent = ChildList->Parent;
+    status = VIOSerialDeviceListCreatePdo(ChildList, Child->Description, &ChildInit);
+    if (!NT_SUCCESS(status))
+    {
+        StubFail("port device creation failed with %x", status);
+    }
+    Child->Device = CONTAINING_RECORD(Child->Description, VIOSERIAL_PORT, Header)->Device;
+    Child->Present = TRUE;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS WdfChildListUpdateChildDescriptionAsMissing(
+    WDFCHILDLIST ChildList,
+    PWDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER IdentificationDescription)
+{
+    STUB_CHILD *Child;
+
+    StubCheckType(ChildList, StubChildList, __FUNCTION__);
+    Child = StubFindChild(ChildList, IdentificationDescription);
+    if (Child == NULL)
+    {
+        return STATUS_NO_SUCH_DEVICE;
+    }
+    Child->Present = FALSE;
+    return STATUS_SUCCESS;
+}
+
+VOID WdfChildListBeginIteration(WDFCHILDLIST ChildList, PWDF_CHILD_LIST_ITERATOR Iterator)
+{
+    StubCheckType(ChildList, StubChildList, __FUNCTION__);
+    Iterator->Reserved[0] = 0;
+}
+
+NTSTATUS WdfChildListRetrieveNextDevice(WDFCHILDLIST ChildList, PWDF_CHILD_LIST_ITERATOR Iterator,
+                                        WDFDEVICE *Device, PWDF_CHILD_RETRIEVE_INFO Info)
+{
+    ULONG_PTR i;
+    STUB_CHILD *Child;
+
+    StubCheckType(ChildList, StubChildList, __FUNCTION__);
+    for (i = (ULONG_PTR)Iterator->Reserved[0]; i < ChildList->ChildCount; i++)
+    {
+        Child = &ChildList->Children[i];
+        if (Child->Present && Child->Device != NULL)
+        {
+            Iterator->Reserved[0] = (PVOID)(i + 1);
+            if (Info != NULL && Info->IdentificationDescription != NULL)
+            {
+                memcpy(Info->IdentificationDescription, Child->Description,
+                       min(Info->IdentificationDescription->IdentificationDescriptionSize,
+                           Child->Description->IdentificationDescriptionSize));
+                Info->Status = WdfChildListRetrieveDeviceSuccess;
+            }
+            *Device = Child->Device;
+            return STATUS_SUCCESS;
+        }
+    }
+    Iterator->Reserved[0] = (PVOID)i;
+    *Device = NULL;
+    return STATUS_NO_MORE_ENTRIES;
+}
+
+VOID WdfChildListEndIteration(WDFCHILDLIST ChildList, PWDF_CHILD_LIST_ITERATOR Iterator)
+{
+    UNREFERENCED_PARAMETER(ChildList);
+    UNREFERENCED_PARAMETER(Iterator);
+}
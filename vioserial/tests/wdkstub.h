@@ -0,0 +1,683 @@
+/**********************************************************************
+ * Copyright (c) 2010-2016 Red Hat, Inc.
+ *
+ * File: wdkstub.h
+ *
+ * Minimal subset of the WDK and WDF headers needed to build the vioserial
+ * port I/O path (Port.c, Buffer.c and IsrDpc.c) as a Linux program. It is
+ * force-included ahead of the driver sources; the WDK headers and .tmh
+ * files they include resolve to empty files generated by the Makefile,
+ * and the VirtIO library headers take their OS dependencies from
+ * external_os_dep.h.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+**********************************************************************/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// basic types
+#define VOID void
+#define CONST const
+#define IN
+#define OUT
+#define _In_
+#define _In_opt_
+#define _Out_
+#define _cdecl
+#define FORCEINLINE static inline
+#define UNALIGNED
+typedef char CHAR, *PCHAR;
+typedef unsigned char UCHAR, *PUCHAR;
+typedef int16_t SHORT;
+typedef uint16_t USHORT, *PUSHORT;
+typedef uint16_t WCHAR, *PWCHAR, *PWSTR;
+typedef const uint16_t *PCWSTR;
+typedef int32_t LONG, *PLONG;
+typedef uint32_t ULONG, *PULONG;
+typedef unsigned int UINT;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG, *PULONGLONG;
+typedef intptr_t LONG_PTR;
+typedef uintptr_t ULONG_PTR;
+typedef size_t SIZE_T;
+typedef ptrdiff_t SSIZE_T;
+typedef void *PVOID;
+typedef UCHAR BOOLEAN, *PBOOLEAN;
+typedef LONG NTSTATUS;
+typedef USHORT LCID;
+
+// the VirtIO library types, sized as on Windows
+#define _LINUX_TYPES_H
+typedef uint8_t u8, __u8;
+typedef uint16_t u16, __u16, __le16;
+typedef uint32_t u32, __u32, __le32;
+typedef uint64_t u64, __u64;
+#define __bitwise__
+
+typedef union _LARGE_INTEGER
+{
+    struct
+    {
+        ULONG LowPart;
+        LONG HighPart;
+    };
+    LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER, PHYSICAL_ADDRESS, *PPHYSICAL_ADDRESS;
+
+typedef struct _UNICODE_STRING
+{
+    USHORT Length;
+    USHORT MaximumLength;
+    PWCHAR Buffer;
+} UNICODE_STRING, *PUNICODE_STRING;
+typedef const UNICODE_STRING *PCUNICODE_STRING;
+
+typedef struct _STRING
+{
+    USHORT Length;
+    USHORT MaximumLength;
+    PCHAR Buffer;
+} ANSI_STRING, *PANSI_STRING;
+
+#define DECLARE_CONST_UNICODE_STRING(_var, _string) \
+    const UNICODE_STRING _var = { sizeof(_string) - sizeof(WCHAR), sizeof(_string), (PWCHAR)(_string) }
+#define DECLARE_UNICODE_STRING_SIZE(_var, _size) \
+    WCHAR _var ## _buffer[_size];                \
+    UNICODE_STRING _var = { 0, (_size) * sizeof(WCHAR), _var ## _buffer }
+
+typedef struct _GUID
+{
+    ULONG  Data1;
+    USHORT Data2;
+    USHORT Data3;
+    UCHAR  Data4[8];
+} GUID, *LPGUID;
+typedef const GUID *LPCGUID;
+
+// only passed around by virtio_pci.h
+typedef struct _PCI_COMMON_HEADER *PPCI_COMMON_HEADER;
+
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    extern const GUID name
+
+#define TRUE  1
+#define FALSE 0
+
+#define PAGE_SIZE 0x1000
+#define PAGE_SHIFT 12
+#define BYTE_OFFSET(Va) ((ULONG)((LONG_PTR)(Va) & (PAGE_SIZE - 1)))
+#define BYTES_TO_PAGES(Size) (((Size) >> PAGE_SHIFT) + (((Size) & (PAGE_SIZE - 1)) != 0))
+#define ROUND_TO_PAGES(Size) (((ULONG_PTR)(Size) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+#define ADDRESS_AND_SIZE_TO_SPAN_PAGES(Va, Size) \
+    ((BYTE_OFFSET(Va) + ((SIZE_T)(Size)) + (PAGE_SIZE - 1)) >> PAGE_SHIFT)
+
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+#define FIELD_OFFSET(type, field) ((LONG)offsetof(type, field))
+#define CONTAINING_RECORD(address, type, field) \
+    ((type *)((PUCHAR)(address) - offsetof(type, field)))
+#define UNREFERENCED_PARAMETER(P) (void)(P)
+#define ARRAYSIZE(A) (sizeof(A) / sizeof((A)[0]))
+#define ASSERT(exp) ((void)0)
+#define PAGED_CODE()
+#define __FUNCTION__ __func__
+
+#define RtlCopyMemory(Destination, Source, Length) memcpy((Destination), (Source), (Length))
+#define RtlZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+
+// status codes
+#define NT_SUCCESS(Status) (((NTSTATUS)(Status)) >= 0)
+#define STATUS_SUCCESS                  ((NTSTATUS)0x00000000L)
+#define STATUS_PENDING                  ((NTSTATUS)0x00000103L)
+#define STATUS_OBJECT_NAME_EXISTS       ((NTSTATUS)0x40000000L)
+#define STATUS_BUFFER_OVERFLOW          ((NTSTATUS)0x80000005L)
+#define STATUS_NO_MORE_ENTRIES          ((NTSTATUS)0x8000001AL)
+#define STATUS_UNSUCCESSFUL             ((NTSTATUS)0xC0000001L)
+#define STATUS_INVALID_PARAMETER        ((NTSTATUS)0xC000000DL)
+#define STATUS_NO_SUCH_DEVICE           ((NTSTATUS)0xC000000EL)
+#define STATUS_INVALID_DEVICE_REQUEST   ((NTSTATUS)0xC0000010L)
+#define STATUS_BUFFER_TOO_SMALL         ((NTSTATUS)0xC0000023L)
+#define STATUS_OBJECT_NAME_NOT_FOUND    ((NTSTATUS)0xC0000034L)
+#define STATUS_INSUFFICIENT_RESOURCES   ((NTSTATUS)0xC000009AL)
+#define STATUS_CANCELLED                ((NTSTATUS)0xC0000120L)
+#define STATUS_INVALID_DEVICE_STATE     ((NTSTATUS)0xC0000184L)
+#define STATUS_CANT_WAIT                ((NTSTATUS)0xC00000D8L)
+#define STATUS_NOT_FOUND                ((NTSTATUS)0xC0000225L)
+#define STATUS_OBJECT_NO_LONGER_EXISTS  ((NTSTATUS)0xC0000240L)
+
+// I/O control codes
+#define FILE_DEVICE_SERIAL_PORT 0x0000001b
+#define FILE_DEVICE_UNKNOWN     0x00000022
+#define METHOD_BUFFERED         0
+#define METHOD_OUT_DIRECT       2
+#define FILE_ANY_ACCESS         0
+#define CTL_CODE(DeviceType, Function, Method, Access) \
+    (((DeviceType) << 16) | ((Access) << 14) | ((Function) << 2) | (Method))
+
+// doubly linked lists
+typedef struct _LIST_ENTRY
+{
+    struct _LIST_ENTRY *Flink;
+    struct _LIST_ENTRY *Blink;
+} LIST_ENTRY, *PLIST_ENTRY;
+
+static inline VOID InitializeListHead(PLIST_ENTRY ListHead)
+{
+    ListHead->Flink = ListHead->Blink = ListHead;
+}
+
+static inline BOOLEAN IsListEmpty(const LIST_ENTRY *ListHead)
+{
+    return ListHead->Flink == ListHead;
+}
+
+static inline BOOLEAN RemoveEntryList(PLIST_ENTRY Entry)
+{
+    PLIST_ENTRY Flink = Entry->Flink;
+    PLIST_ENTRY Blink = Entry->Blink;
+
+    Blink->Flink = Flink;
+    Flink->Blink = Blink;
+    return Flink == Blink;
+}
+
+static inline PLIST_ENTRY RemoveHeadList(PLIST_ENTRY ListHead)
+{
+    PLIST_ENTRY Entry = ListHead->Flink;
+
+    RemoveEntryList(Entry);
+    return Entry;
+}
+
+static inline VOID InsertTailList(PLIST_ENTRY ListHead, PLIST_ENTRY Entry)
+{
+    PLIST_ENTRY Blink = ListHead->Blink;
+
+    Entry->Flink = ListHead;
+    Entry->Blink = Blink;
+    Blink->Flink = Entry;
+    ListHead->Blink = Entry;
+}
+
+// kernel
+typedef enum _POOL_TYPE
+{
+    NonPagedPool,
+    PagedPool
+} POOL_TYPE;
+
+typedef struct _DEVICE_OBJECT *PDEVICE_OBJECT;
+typedef struct _DRIVER_OBJECT *PDRIVER_OBJECT;
+typedef struct _FILE_OBJECT *PFILE_OBJECT;
+typedef struct _KEVENT *PKEVENT;
+
+typedef struct _TARGET_DEVICE_CUSTOM_NOTIFICATION
+{
+    USHORT Version;
+    USHORT Size;
+    GUID Event;
+    PFILE_OBJECT FileObject;
+    LONG NameBufferOffset;
+    UCHAR CustomDataBuffer[1];
+} TARGET_DEVICE_CUSTOM_NOTIFICATION, *PTARGET_DEVICE_CUSTOM_NOTIFICATION;
+
+PVOID ExAllocatePoolWithTag(POOL_TYPE PoolType, SIZE_T NumberOfBytes, ULONG Tag);
+VOID ExFreePoolWithTag(PVOID P, ULONG Tag);
+PHYSICAL_ADDRESS MmGetPhysicalAddress(PVOID BaseAddress);
+ULONGLONG KeQueryInterruptTime(VOID);
+LARGE_INTEGER KeQueryPerformanceCounter(PLARGE_INTEGER PerformanceFrequency);
+NTSTATUS IoReportTargetDeviceChangeAsynchronous(PDEVICE_OBJECT PhysicalDeviceObject,
+                                                PVOID NotificationStructure,
+                                                PVOID Callback, PVOID Context);
+
+// the format is a wide literal, which is 32 bits wide here
+NTSTATUS RtlUnicodeStringPrintf(PUNICODE_STRING DestinationString, const wchar_t *Format, ...);
+NTSTATUS RtlStringCbCopyA(PCHAR Destination, SIZE_T Size, const char *Source);
+NTSTATUS RtlAnsiStringToUnicodeString(PUNICODE_STRING DestinationString,
+                                      PANSI_STRING SourceString,
+                                      BOOLEAN AllocateDestinationString);
+VOID RtlFreeUnicodeString(PUNICODE_STRING UnicodeString);
+NTSTATUS RtlULongAdd(ULONG Augend, ULONG Addend, PULONG Result);
+
+#define PLUGPLAY_REGKEY_DEVICE 1
+#define KEY_READ 0x20019
+
+extern const UNICODE_STRING SDDL_DEVOBJ_SYS_ALL_ADM_ALL;
+
+// the sources are built as with WPP tracing, the generated .tmh files are
+// empty and trace messages are dropped
+#define TraceEvents(level, flags, message, ...) ((void)0)
+
+// WDF objects are handles of one stub object type, see wdkstub.c
+typedef struct _WDFOBJECT *WDFOBJECT, *WDFDRIVER, *WDFDEVICE, *WDFQUEUE,
+    *WDFREQUEST, *WDFMEMORY, *WDFLOOKASIDE, *WDFSPINLOCK, *WDFINTERRUPT,
+    *WDFCHILDLIST, *WDFWORKITEM, *WDFKEY, *WDFFILEOBJECT;
+typedef struct _WDFDEVICE_INIT *PWDFDEVICE_INIT;
+
+typedef enum _WDF_TRI_STATE
+{
+    WdfFalse = 0,
+    WdfTrue = 1,
+    WdfUseDefault = 2
+} WDF_TRI_STATE;
+
+typedef enum _WDF_SYNCHRONIZATION_SCOPE
+{
+    WdfSynchronizationScopeInheritFromParent,
+    WdfSynchronizationScopeDevice,
+    WdfSynchronizationScopeQueue,
+    WdfSynchronizationScopeNone
+} WDF_SYNCHRONIZATION_SCOPE;
+
+typedef enum _WDF_EXECUTION_LEVEL
+{
+    WdfExecutionLevelInheritFromParent,
+    WdfExecutionLevelPassive,
+    WdfExecutionLevelDispatch
+} WDF_EXECUTION_LEVEL;
+
+typedef enum _WDF_POWER_DEVICE_STATE
+{
+    WdfPowerDeviceInvalid,
+    WdfPowerDeviceD0,
+    WdfPowerDeviceD1,
+    WdfPowerDeviceD2,
+    WdfPowerDeviceD3,
+    WdfPowerDeviceD3Final
+} WDF_POWER_DEVICE_STATE;
+
+typedef enum _WDF_DEVICE_IO_TYPE
+{
+    WdfDeviceIoUndefined,
+    WdfDeviceIoNeither,
+    WdfDeviceIoBuffered,
+    WdfDeviceIoDirect
+} WDF_DEVICE_IO_TYPE;
+
+typedef enum _WDF_REQUEST_TYPE
+{
+    WdfRequestTypeCreate,
+    WdfRequestTypeRead = 3,
+    WdfRequestTypeWrite = 4,
+    WdfRequestTypeDeviceControl = 14
+} WDF_REQUEST_TYPE;
+
+typedef enum _WDF_IO_QUEUE_DISPATCH_TYPE
+{
+    WdfIoQueueDispatchInvalid,
+    WdfIoQueueDispatchSequential,
+    WdfIoQueueDispatchParallel,
+    WdfIoQueueDispatchManual
+} WDF_IO_QUEUE_DISPATCH_TYPE;
+
+typedef enum _WDF_IO_QUEUE_STATE
+{
+    WdfIoQueueAcceptRequests = 0x01,
+    WdfIoQueueDispatchRequests = 0x02
+} WDF_IO_QUEUE_STATE;
+
+typedef enum _WDF_REQUEST_STOP_ACTION_FLAGS
+{
+    WdfRequestStopActionSuspend = 0x01,
+    WdfRequestStopActionPurge = 0x2,
+    WdfRequestStopRequestCancelable = 0x10000000
+} WDF_REQUEST_STOP_ACTION_FLAGS;
+
+typedef enum _WDF_DEVICE_PNP_STATE
+{
+    WdfDevStatePnpInvalid = 0,
+    WdfDevStatePnpStarted = 0x119
+} WDF_DEVICE_PNP_STATE;
+
+typedef enum _WDF_CHILD_LIST_RETRIEVE_DEVICE_STATUS
+{
+    WdfChildListRetrieveDeviceUndefined,
+    WdfChildListRetrieveDeviceSuccess,
+    WdfChildListRetrieveDeviceNotYetCreated,
+    WdfChildListRetrieveDeviceNoSuchDevice
+} WDF_CHILD_LIST_RETRIEVE_DEVICE_STATUS;
+
+typedef enum _WDF_RETRIEVE_CHILDREN_FLAGS
+{
+    WdfRetrievePresentChildren = 0x1,
+    WdfRetrieveMissingChildren = 0x2,
+    WdfRetrievePendingChildren = 0x4,
+    WdfRetrieveAllChildren = 0x7
+} WDF_RETRIEVE_CHILDREN_FLAGS;
+
+#define WDF_NO_OBJECT_ATTRIBUTES NULL
+#define WDF_NO_EVENT_CALLBACK NULL
+
+// event callbacks
+typedef NTSTATUS EVT_WDF_DRIVER_DEVICE_ADD(WDFDRIVER Driver, PWDFDEVICE_INIT DeviceInit);
+typedef BOOLEAN EVT_WDF_INTERRUPT_ISR(WDFINTERRUPT Interrupt, ULONG MessageID);
+typedef VOID EVT_WDF_INTERRUPT_DPC(WDFINTERRUPT Interrupt, WDFOBJECT AssociatedObject);
+typedef NTSTATUS EVT_WDF_INTERRUPT_ENABLE(WDFINTERRUPT Interrupt, WDFDEVICE AssociatedDevice);
+typedef NTSTATUS EVT_WDF_INTERRUPT_DISABLE(WDFINTERRUPT Interrupt, WDFDEVICE AssociatedDevice);
+typedef NTSTATUS EVT_WDF_DEVICE_D0_ENTRY(WDFDEVICE Device, WDF_POWER_DEVICE_STATE PreviousState);
+typedef NTSTATUS EVT_WDF_DEVICE_D0_EXIT(WDFDEVICE Device, WDF_POWER_DEVICE_STATE TargetState);
+typedef VOID EVT_WDF_DEVICE_FILE_CREATE(WDFDEVICE Device, WDFREQUEST Request, WDFFILEOBJECT FileObject);
+typedef VOID EVT_WDF_FILE_CLOSE(WDFFILEOBJECT FileObject);
+typedef VOID EVT_WDF_FILE_CLEANUP(WDFFILEOBJECT FileObject);
+typedef VOID EVT_WDF_IO_IN_CALLER_CONTEXT(WDFDEVICE Device, WDFREQUEST Request);
+typedef VOID EVT_WDF_IO_QUEUE_IO_READ(WDFQUEUE Queue, WDFREQUEST Request, size_t Length);
+typedef VOID EVT_WDF_IO_QUEUE_IO_WRITE(WDFQUEUE Queue, WDFREQUEST Request, size_t Length);
+typedef VOID EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL(WDFQUEUE Queue, WDFREQUEST Request,
+                                                size_t OutputBufferLength,
+                                                size_t InputBufferLength,
+                                                ULONG IoControlCode);
+typedef VOID EVT_WDF_IO_QUEUE_IO_STOP(WDFQUEUE Queue, WDFREQUEST Request, ULONG ActionFlags);
+typedef VOID EVT_WDF_IO_QUEUE_IO_CANCELED_ON_QUEUE(WDFQUEUE Queue, WDFREQUEST Request);
+typedef VOID EVT_WDF_REQUEST_CANCEL(WDFREQUEST Request);
+typedef VOID EVT_WDF_OBJECT_CONTEXT_CLEANUP(WDFOBJECT Object);
+typedef VOID EVT_WDF_WORKITEM(WDFWORKITEM WorkItem);
+
+typedef EVT_WDF_DEVICE_D0_ENTRY *PFN_WDF_DEVICE_D0_ENTRY;
+typedef EVT_WDF_DEVICE_D0_EXIT *PFN_WDF_DEVICE_D0_EXIT;
+typedef EVT_WDF_DEVICE_FILE_CREATE *PFN_WDF_DEVICE_FILE_CREATE;
+typedef EVT_WDF_FILE_CLOSE *PFN_WDF_FILE_CLOSE;
+typedef EVT_WDF_FILE_CLEANUP *PFN_WDF_FILE_CLEANUP;
+typedef EVT_WDF_IO_IN_CALLER_CONTEXT *PFN_WDF_IO_IN_CALLER_CONTEXT;
+typedef EVT_WDF_IO_QUEUE_IO_READ *PFN_WDF_IO_QUEUE_IO_READ;
+typedef EVT_WDF_IO_QUEUE_IO_WRITE *PFN_WDF_IO_QUEUE_IO_WRITE;
+typedef EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL *PFN_WDF_IO_QUEUE_IO_DEVICE_CONTROL;
+typedef EVT_WDF_IO_QUEUE_IO_STOP *PFN_WDF_IO_QUEUE_IO_STOP;
+typedef EVT_WDF_IO_QUEUE_IO_CANCELED_ON_QUEUE *PFN_WDF_IO_QUEUE_IO_CANCELED_ON_QUEUE;
+typedef EVT_WDF_REQUEST_CANCEL *PFN_WDF_REQUEST_CANCEL;
+typedef EVT_WDF_OBJECT_CONTEXT_CLEANUP *PFN_WDF_OBJECT_CONTEXT_CLEANUP;
+typedef EVT_WDF_WORKITEM *PFN_WDF_WORKITEM;
+
+// object attributes and contexts, an object has a single context
+typedef struct _WDF_OBJECT_ATTRIBUTES
+{
+    ULONG Size;
+    PFN_WDF_OBJECT_CONTEXT_CLEANUP EvtCleanupCallback;
+    WDF_EXECUTION_LEVEL ExecutionLevel;
+    WDF_SYNCHRONIZATION_SCOPE SynchronizationScope;
+    WDFOBJECT ParentObject;
+    size_t ContextSize;
+} WDF_OBJECT_ATTRIBUTES, *PWDF_OBJECT_ATTRIBUTES;
+
+#define WDF_OBJECT_ATTRIBUTES_INIT(_attributes)                   \
+    (RtlZeroMemory((_attributes), sizeof(WDF_OBJECT_ATTRIBUTES)), \
+     (_attributes)->Size = sizeof(WDF_OBJECT_ATTRIBUTES))
+#define WDF_OBJECT_ATTRIBUTES_SET_CONTEXT_TYPE(_attributes, _contexttype) \
+    ((_attributes)->ContextSize = sizeof(_contexttype))
+#define WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(_attributes, _contexttype) \
+    (WDF_OBJECT_ATTRIBUTES_INIT(_attributes),                            \
+     WDF_OBJECT_ATTRIBUTES_SET_CONTEXT_TYPE(_attributes, _contexttype))
+
+PVOID WdfObjectGetContext(WDFOBJECT Handle);
+VOID WdfObjectDelete(WDFOBJECT Object);
+
+#define WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(_contexttype, _castingfunction) \
+static inline _contexttype *_castingfunction(WDFOBJECT Handle)             \
+{                                                                          \
+    return (_contexttype *)WdfObjectGetContext(Handle);                    \
+}
+
+// device
+typedef struct _WDF_PNPPOWER_EVENT_CALLBACKS
+{
+    ULONG Size;
+    PFN_WDF_DEVICE_D0_ENTRY EvtDeviceD0Entry;
+    PFN_WDF_DEVICE_D0_EXIT EvtDeviceD0Exit;
+} WDF_PNPPOWER_EVENT_CALLBACKS, *PWDF_PNPPOWER_EVENT_CALLBACKS;
+
+#define WDF_PNPPOWER_EVENT_CALLBACKS_INIT(_callbacks)                   \
+    (RtlZeroMemory((_callbacks), sizeof(WDF_PNPPOWER_EVENT_CALLBACKS)), \
+     (_callbacks)->Size = sizeof(WDF_PNPPOWER_EVENT_CALLBACKS))
+
+typedef struct _WDF_FILEOBJECT_CONFIG
+{
+    ULONG Size;
+    PFN_WDF_DEVICE_FILE_CREATE EvtDeviceFileCreate;
+    PFN_WDF_FILE_CLOSE EvtFileClose;
+    PFN_WDF_FILE_CLEANUP EvtFileCleanup;
+} WDF_FILEOBJECT_CONFIG, *PWDF_FILEOBJECT_CONFIG;
+
+#define WDF_FILEOBJECT_CONFIG_INIT(_config, _create, _close, _cleanup) \
+    (RtlZeroMemory((_config), sizeof(WDF_FILEOBJECT_CONFIG)),          \
+     (_config)->Size = sizeof(WDF_FILEOBJECT_CONFIG),                  \
+     (_config)->EvtDeviceFileCreate = (_create),                       \
+     (_config)->EvtFileClose = (_close),                               \
+     (_config)->EvtFileCleanup = (_cleanup))
+
+typedef struct _WDF_DEVICE_PNP_CAPABILITIES
+{
+    ULONG Size;
+    WDF_TRI_STATE NoDisplayInUI;
+    WDF_TRI_STATE Removable;
+    WDF_TRI_STATE EjectSupported;
+    WDF_TRI_STATE SurpriseRemovalOK;
+    ULONG Address;
+    ULONG UINumber;
+} WDF_DEVICE_PNP_CAPABILITIES, *PWDF_DEVICE_PNP_CAPABILITIES;
+
+#define WDF_DEVICE_PNP_CAPABILITIES_INIT(_caps)                        \
+    (RtlZeroMemory((_caps), sizeof(WDF_DEVICE_PNP_CAPABILITIES)),      \
+     (_caps)->Size = sizeof(WDF_DEVICE_PNP_CAPABILITIES))
+
+typedef struct _WDF_DEVICE_STATE
+{
+    ULONG Size;
+    WDF_TRI_STATE DontDisplayInUI;
+} WDF_DEVICE_STATE, *PWDF_DEVICE_STATE;
+
+#define WDF_DEVICE_STATE_INIT(_state)                                  \
+    (RtlZeroMemory((_state), sizeof(WDF_DEVICE_STATE)),                \
+     (_state)->Size = sizeof(WDF_DEVICE_STATE))
+
+VOID WdfDeviceInitSetDeviceType(PWDFDEVICE_INIT DeviceInit, ULONG DeviceType);
+VOID WdfDeviceInitSetIoType(PWDFDEVICE_INIT DeviceInit, WDF_DEVICE_IO_TYPE IoType);
+VOID WdfDeviceInitSetExclusive(PWDFDEVICE_INIT DeviceInit, BOOLEAN IsExclusive);
+NTSTATUS WdfDeviceInitAssignSDDLString(PWDFDEVICE_INIT DeviceInit, PCUNICODE_STRING SDDLString);
+VOID WdfDeviceInitSetIoInCallerContextCallback(PWDFDEVICE_INIT DeviceInit,
+                                               PFN_WDF_IO_IN_CALLER_CONTEXT EvtIoInCallerContext);
+VOID WdfDeviceInitSetFileObjectConfig(PWDFDEVICE_INIT DeviceInit,
+                                      PWDF_FILEOBJECT_CONFIG FileObjectConfig,
+                                      PWDF_OBJECT_ATTRIBUTES FileObjectAttributes);
+VOID WdfDeviceInitSetPnpPowerEventCallbacks(PWDFDEVICE_INIT DeviceInit,
+                                            PWDF_PNPPOWER_EVENT_CALLBACKS PnpPowerEventCallbacks);
+NTSTATUS WdfPdoInitAssignRawDevice(PWDFDEVICE_INIT DeviceInit, const GUID *DeviceClassGuid);
+NTSTATUS WdfPdoInitAssignDeviceID(PWDFDEVICE_INIT DeviceInit, PCUNICODE_STRING DeviceID);
+NTSTATUS WdfPdoInitAddHardwareID(PWDFDEVICE_INIT DeviceInit, PCUNICODE_STRING HardwareID);
+NTSTATUS WdfPdoInitAssignInstanceID(PWDFDEVICE_INIT DeviceInit, PCUNICODE_STRING InstanceID);
+NTSTATUS WdfPdoInitAddDeviceText(PWDFDEVICE_INIT DeviceInit, PCUNICODE_STRING DeviceDescription,
+                                 PCUNICODE_STRING DeviceLocation, LCID LocaleId);
+VOID WdfPdoInitSetDefaultLocale(PWDFDEVICE_INIT DeviceInit, LCID LocaleId);
+
+NTSTATUS WdfDeviceCreate(PWDFDEVICE_INIT *DeviceInit, PWDF_OBJECT_ATTRIBUTES DeviceAttributes,
+                         WDFDEVICE *Device);
+WDFDRIVER WdfDeviceGetDriver(WDFDEVICE Device);
+NTSTATUS WdfDeviceConfigureRequestDispatching(WDFDEVICE Device, WDFQUEUE Queue,
+                                              WDF_REQUEST_TYPE RequestType);
+VOID WdfDeviceSetPnpCapabilities(WDFDEVICE Device, PWDF_DEVICE_PNP_CAPABILITIES PnpCapabilities);
+VOID WdfDeviceSetDeviceState(WDFDEVICE Device, PWDF_DEVICE_STATE DeviceState);
+NTSTATUS WdfDeviceCreateDeviceInterface(WDFDEVICE Device, const GUID *InterfaceClassGUID,
+                                        PCUNICODE_STRING ReferenceString);
+NTSTATUS WdfDeviceCreateSymbolicLink(WDFDEVICE Device, PCUNICODE_STRING SymbolicLinkName);
+WDF_DEVICE_PNP_STATE WdfDeviceGetDevicePnpState(WDFDEVICE Device);
+PDEVICE_OBJECT WdfDeviceWdmGetPhysicalDevice(WDFDEVICE Device);
+NTSTATUS WdfDeviceOpenRegistryKey(WDFDEVICE Device, ULONG DeviceInstanceKeyType,
+                                  ULONG DesiredAccess, PWDF_OBJECT_ATTRIBUTES KeyAttributes,
+                                  WDFKEY *Key);
+NTSTATUS WdfRegistryQueryULong(WDFKEY Key, PCUNICODE_STRING ValueName, PULONG Value);
+VOID WdfRegistryClose(WDFKEY Key);
+WDFDEVICE WdfFileObjectGetDevice(WDFFILEOBJECT FileObject);
+
+// queues and requests
+typedef struct _WDF_IO_QUEUE_CONFIG
+{
+    ULONG Size;
+    WDF_IO_QUEUE_DISPATCH_TYPE DispatchType;
+    WDF_TRI_STATE PowerManaged;
+    BOOLEAN AllowZeroLengthRequests;
+    BOOLEAN DefaultQueue;
+    PFN_WDF_IO_QUEUE_IO_READ EvtIoRead;
+    PFN_WDF_IO_QUEUE_IO_WRITE EvtIoWrite;
+    PFN_WDF_IO_QUEUE_IO_DEVICE_CONTROL EvtIoDeviceControl;
+    PFN_WDF_IO_QUEUE_IO_STOP EvtIoStop;
+    PFN_WDF_IO_QUEUE_IO_CANCELED_ON_QUEUE EvtIoCanceledOnQueue;
+} WDF_IO_QUEUE_CONFIG, *PWDF_IO_QUEUE_CONFIG;
+
+#define WDF_IO_QUEUE_CONFIG_INIT(_config, _dispatchtype)     \
+    (RtlZeroMemory((_config), sizeof(WDF_IO_QUEUE_CONFIG)),  \
+     (_config)->Size = sizeof(WDF_IO_QUEUE_CONFIG),          \
+     (_config)->PowerManaged = WdfUseDefault,                \
+     (_config)->DispatchType = (_dispatchtype))
+
+NTSTATUS WdfIoQueueCreate(WDFDEVICE Device, PWDF_IO_QUEUE_CONFIG Config,
+                          PWDF_OBJECT_ATTRIBUTES QueueAttributes, WDFQUEUE *Queue);
+WDFDEVICE WdfIoQueueGetDevice(WDFQUEUE Queue);
+WDF_IO_QUEUE_STATE WdfIoQueueGetState(WDFQUEUE Queue, PULONG QueueRequests, PULONG DriverRequests);
+NTSTATUS WdfIoQueueRetrieveNextRequest(WDFQUEUE Queue, WDFREQUEST *OutRequest);
+
+NTSTATUS WdfRequestRetrieveInputBuffer(WDFREQUEST Request, size_t MinimumRequiredSize,
+                                       PVOID *Buffer, size_t *Length);
+NTSTATUS WdfRequestRetrieveOutputBuffer(WDFREQUEST Request, size_t MinimumRequiredSize,
+                                        PVOID *Buffer, size_t *Length);
+NTSTATUS WdfRequestForwardToIoQueue(WDFREQUEST Request, WDFQUEUE DestinationQueue);
+WDFQUEUE WdfRequestGetIoQueue(WDFREQUEST Request);
+VOID WdfRequestSetInformation(WDFREQUEST Request, ULONG_PTR Information);
+ULONG_PTR WdfRequestGetInformation(WDFREQUEST Request);
+NTSTATUS WdfRequestMarkCancelableEx(WDFREQUEST Request, PFN_WDF_REQUEST_CANCEL EvtRequestCancel);
+NTSTATUS WdfRequestUnmarkCancelable(WDFREQUEST Request);
+VOID WdfRequestStopAcknowledge(WDFREQUEST Request, BOOLEAN Requeue);
+VOID WdfRequestComplete(WDFREQUEST Request, NTSTATUS Status);
+VOID WdfRequestCompleteWithInformation(WDFREQUEST Request, NTSTATUS Status, ULONG_PTR Information);
+
+// memory
+NTSTATUS WdfMemoryCreateFromLookaside(WDFLOOKASIDE Lookaside, WDFMEMORY *Memory);
+PVOID WdfMemoryGetBuffer(WDFMEMORY Memory, size_t *BufferSize);
+
+// synchronization
+NTSTATUS WdfSpinLockCreate(PWDF_OBJECT_ATTRIBUTES SpinLockAttributes, WDFSPINLOCK *SpinLock);
+VOID WdfSpinLockAcquire(WDFSPINLOCK SpinLock);
+VOID WdfSpinLockRelease(WDFSPINLOCK SpinLock);
+
+// work items
+typedef struct _WDF_WORKITEM_CONFIG
+{
+    ULONG Size;
+    PFN_WDF_WORKITEM EvtWorkItemFunc;
+    BOOLEAN AutomaticSerialization;
+} WDF_WORKITEM_CONFIG, *PWDF_WORKITEM_CONFIG;
+
+#define WDF_WORKITEM_CONFIG_INIT(_config, _func)             \
+    (RtlZeroMemory((_config), sizeof(WDF_WORKITEM_CONFIG)),  \
+     (_config)->Size = sizeof(WDF_WORKITEM_CONFIG),          \
+     (_config)->EvtWorkItemFunc = (_func),                   \
+     (_config)->AutomaticSerialization = TRUE)
+
+NTSTATUS WdfWorkItemCreate(PWDF_WORKITEM_CONFIG Config, PWDF_OBJECT_ATTRIBUTES Attributes,
+                           WDFWORKITEM *WorkItem);
+VOID WdfWorkItemEnqueue(WDFWORKITEM WorkItem);
+
+// interrupts
+typedef struct _WDF_INTERRUPT_INFO
+{
+    ULONG Size;
+    ULONG Vector;
+    BOOLEAN MessageSignaled;
+} WDF_INTERRUPT_INFO, *PWDF_INTERRUPT_INFO;
+
+#define WDF_INTERRUPT_INFO_INIT(_info)                      \
+    (RtlZeroMemory((_info), sizeof(WDF_INTERRUPT_INFO)),    \
+     (_info)->Size = sizeof(WDF_INTERRUPT_INFO))
+
+WDFDEVICE WdfInterruptGetDevice(WDFINTERRUPT Interrupt);
+VOID WdfInterruptGetInfo(WDFINTERRUPT Interrupt, PWDF_INTERRUPT_INFO Info);
+BOOLEAN WdfInterruptQueueDpcForIsr(WDFINTERRUPT Interrupt);
+
+// child lists
+typedef struct _WDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER
+{
+    ULONG IdentificationDescriptionSize;
+} WDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER, *PWDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER;
+
+typedef struct _WDF_CHILD_ADDRESS_DESCRIPTION_HEADER
+{
+    ULONG AddressDescriptionSize;
+} WDF_CHILD_ADDRESS_DESCRIPTION_HEADER, *PWDF_CHILD_ADDRESS_DESCRIPTION_HEADER;
+
+#define WDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER_INIT(_header, _size) \
+    (RtlZeroMemory((_header), (_size)),                                  \
+     (_header)->IdentificationDescriptionSize = (_size))
+
+typedef struct _WDF_CHILD_LIST_ITERATOR
+{
+    ULONG Size;
+    ULONG Flags;
+    PVOID Reserved[4];
+} WDF_CHILD_LIST_ITERATOR, *PWDF_CHILD_LIST_ITERATOR;
+
+#define WDF_CHILD_LIST_ITERATOR_INIT(_iterator, _flags)      \
+    (RtlZeroMemory((_iterator), sizeof(WDF_CHILD_LIST_ITERATOR)), \
+     (_iterator)->Size = sizeof(WDF_CHILD_LIST_ITERATOR),    \
+     (_iterator)->Flags = (_flags))
+
+typedef struct _WDF_CHILD_RETRIEVE_INFO
+{
+    ULONG Size;
+    PWDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER IdentificationDescription;
+    PWDF_CHILD_ADDRESS_DESCRIPTION_HEADER AddressDescription;
+    WDF_CHILD_LIST_RETRIEVE_DEVICE_STATUS Status;
+} WDF_CHILD_RETRIEVE_INFO, *PWDF_CHILD_RETRIEVE_INFO;
+
+#define WDF_CHILD_RETRIEVE_INFO_INIT(_info, _header)         \
+    (RtlZeroMemory((_info), sizeof(WDF_CHILD_RETRIEVE_INFO)), \
+     (_info)->Size = sizeof(WDF_CHILD_RETRIEVE_INFO),        \
+     (_info)->IdentificationDescription = (_header))
+
+typedef NTSTATUS EVT_WDF_CHILD_LIST_CREATE_DEVICE(
+    WDFCHILDLIST ChildList,
+    PWDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER IdentificationDescription,
+    PWDFDEVICE_INIT ChildInit);
+typedef BOOLEAN EVT_WDF_CHILD_LIST_IDENTIFICATION_DESCRIPTION_COMPARE(
+    WDFCHILDLIST ChildList,
+    PWDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER FirstIdentificationDescription,
+    PWDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER SecondIdentificationDescription);
+typedef VOID EVT_WDF_CHILD_LIST_IDENTIFICATION_DESCRIPTION_CLEANUP(
+    WDFCHILDLIST ChildList,
+    PWDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER IdentificationDescription);
+typedef NTSTATUS EVT_WDF_CHILD_LIST_IDENTIFICATION_DESCRIPTION_DUPLICATE(
+    WDFCHILDLIST ChildList,
+    PWDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER SourceIdentificationDescription,
+    PWDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER DestinationIdentificationDescription);
+
+WDFCHILDLIST WdfFdoGetDefaultChildList(WDFDEVICE Fdo);
+NTSTATUS WdfChildListAddOrUpdateChildDescriptionAsPresent(
+    WDFCHILDLIST ChildList,
+    PWDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER IdentificationDescription,
+    PWDF_CHILD_ADDRESS_DESCRIPTION_HEADER AddressDescription);
+NTSTATUS WdfChildListUpdateChildDescriptionAsMissing(
+    WDFCHILDLIST ChildList,
+    PWDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER IdentificationDescription);
+VOID WdfChildListBeginIteration(WDFCHILDLIST ChildList, PWDF_CHILD_LIST_ITERATOR Iterator);
+NTSTATUS WdfChildListRetrieveNextDevice(WDFCHILDLIST ChildList, PWDF_CHILD_LIST_ITERATOR Iterator,
+                                        WDFDEVICE *Device, PWDF_CHILD_RETRIEVE_INFO Info);
+VOID WdfChildListEndIteration(WDFCHILDLIST ChildList, PWDF_CHILD_LIST_ITERATOR Iterator);
+
+// VirtIOWdf, the ports device only needs a place holder
+typedef struct virtio_wdf_driver
+{
+    PVOID Reserved;
+} VIRTIO_WDF_DRIVER, *PVIRTIO_WDF_DRIVER;
+
+UCHAR VirtIOWdfGetISRStatus(PVIRTIO_WDF_DRIVER pWdfDriver);
+
+// debug prints
+extern int virtioDebugLevel;
+extern int bDebugPrint;
+typedef void (*tDebugPrintFunc)(const char *format, ...);
+extern tDebugPrintFunc VirtioDebugPrintProc;
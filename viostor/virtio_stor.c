@@ -63,6 +63,11 @@ CompleteDpcRoutine(
     IN PVOID SystemArgument1,
     IN PVOID SystemArgument2
     ) ;
+
+VOID
+TraceDpcCompletions(
+    IN PVOID DeviceExtension
+    );
 #ifdef MSI_SUPPORTED
 BOOLEAN
 VirtIoMSInterruptRoutine (
@@ -739,43 +744,46 @@ VirtIoInterrupt(
     intReason = virtio_read_isr_status(&adaptExt->vdev);
     if ( intReason == 1 || adaptExt->dump_mode ) {
         isInterruptServiced = TRUE;
-        while((vbr = (pblk_req)virtqueue_get_buf(adaptExt->vq, &len)) != NULL) {
-           Srb = (PSCSI_REQUEST_BLOCK)vbr->req;
-           if (Srb) {
-              switch (vbr->status) {
-              case VIRTIO_BLK_S_OK:
-                 Srb->SrbStatus = SRB_STATUS_SUCCESS;
-                 break;
-              case VIRTIO_BLK_S_UNSUPP:
-                 Srb->SrbStatus = SRB_STATUS_INVALID_REQUEST;
-                 break;
-              default:
-                 Srb->SrbStatus = SRB_STATUS_ERROR;
-                 RhelDbgPrint(TRACE_LEVEL_ERROR, ("SRB_STATUS_ERROR\n"));
-                 break;
-              }
-           }
-           if (vbr->out_hdr.type == VIRTIO_BLK_T_FLUSH) {
-              CompleteSRB(DeviceExtension, Srb);
-           } else if (vbr->out_hdr.type == VIRTIO_BLK_T_GET_ID) {
-              adaptExt->sn_ok = TRUE;
-           } else if (Srb) {
-              srbExt = (PRHEL_SRB_EXTENSION)Srb->SrbExtension;
-              if (srbExt->fua) {
-                  RemoveEntryList(&vbr->list_entry);
-                  Srb->SrbStatus = SRB_STATUS_PENDING;
-                  Srb->ScsiStatus = SCSISTAT_GOOD;
-                  if (!RhelDoFlush(DeviceExtension, Srb, FALSE)) {
-                      Srb->SrbStatus = SRB_STATUS_ERROR;
-                      CompleteSRB(DeviceExtension, Srb);
+        virtqueue_disable_cb(adaptExt->vq);
+        do {
+            while((vbr = (pblk_req)virtqueue_get_buf(adaptExt->vq, &len)) != NULL) {
+               Srb = (PSCSI_REQUEST_BLOCK)vbr->req;
+               if (Srb) {
+                  switch (vbr->status) {
+                  case VIRTIO_BLK_S_OK:
+                     Srb->SrbStatus = SRB_STATUS_SUCCESS;
+                     break;
+                  case VIRTIO_BLK_S_UNSUPP:
+                     Srb->SrbStatus = SRB_STATUS_INVALID_REQUEST;
+                     break;
+                  default:
+                     Srb->SrbStatus = SRB_STATUS_ERROR;
+                     RhelDbgPrint(TRACE_LEVEL_ERROR, ("SRB_STATUS_ERROR\n"));
+                     break;
+                  }
+               }
+               if (vbr->out_hdr.type == VIRTIO_BLK_T_FLUSH) {
+                  CompleteSRB(DeviceExtension, Srb);
+               } else if (vbr->out_hdr.type == VIRTIO_BLK_T_GET_ID) {
+                  adaptExt->sn_ok = TRUE;
+               } else if (Srb) {
+                  srbExt = (PRHEL_SRB_EXTENSION)Srb->SrbExtension;
+                  if (srbExt->fua) {
+                      RemoveEntryList(&vbr->list_entry);
+                      Srb->SrbStatus = SRB_STATUS_PENDING;
+                      Srb->ScsiStatus = SCSISTAT_GOOD;
+                      if (!RhelDoFlush(DeviceExtension, Srb, FALSE)) {
+                          Srb->SrbStatus = SRB_STATUS_ERROR;
+                          CompleteSRB(DeviceExtension, Srb);
+                      } else {
+                          srbExt->fua = FALSE;
+                      }
                   } else {
-                      srbExt->fua = FALSE;
+                      CompleteDPC(DeviceExtension, vbr, 0);
                   }
-              } else {
-                  CompleteDPC(DeviceExtension, vbr, 0);
-              }
-           }
-        }
+               }
+            }
+        } while (!virtqueue_enable_cb(adaptExt->vq));
     } else if (intReason == 3) {
         RhelGetDiskGeometry(DeviceExtension);
         isInterruptServiced = TRUE;
@@ -831,12 +839,18 @@ VirtIoAdapterControl(
     }
     case ScsiStopAdapter: {
         RhelDbgPrint(TRACE_LEVEL_VERBOSE, ("ScsiStopAdapter\n"));
+#ifdef USE_STORPORT
+        TraceDpcCompletions(DeviceExtension);
+#endif
         RhelShutDown(DeviceExtension);
         status = ScsiAdapterControlSuccess;
         break;
     }
     case ScsiRestartAdapter: {
         RhelDbgPrint(TRACE_LEVEL_VERBOSE, ("ScsiRestartAdapter\n"));
+#ifdef USE_STORPORT
+        TraceDpcCompletions(DeviceExtension);
+#endif
         RhelShutDown(DeviceExtension);
         if (!VirtIoHwReinitialize(DeviceExtension))
         {
@@ -989,44 +1003,47 @@ VirtIoMSInterruptRoutine (
         return TRUE;
     }
 
-    while((vbr = (pblk_req)virtqueue_get_buf(adaptExt->vq, &len)) != NULL) {
-        Srb = (PSCSI_REQUEST_BLOCK)vbr->req;
-        if (Srb) {
-           switch (vbr->status) {
-           case VIRTIO_BLK_S_OK:
-              Srb->SrbStatus = SRB_STATUS_SUCCESS;
-              break;
-           case VIRTIO_BLK_S_UNSUPP:
-              Srb->SrbStatus = SRB_STATUS_INVALID_REQUEST;
-              break;
-           default:
-              Srb->SrbStatus = SRB_STATUS_ERROR;
-              RhelDbgPrint(TRACE_LEVEL_ERROR, ("SRB_STATUS_ERROR\n"));
-              break;
-           }
-        }
-        if (vbr->out_hdr.type == VIRTIO_BLK_T_FLUSH) {
-            CompleteSRB(DeviceExtension, Srb);
-        } else if (vbr->out_hdr.type == VIRTIO_BLK_T_GET_ID) {
-            adaptExt->sn_ok = TRUE;
-        } else if (Srb) {
-            srbExt   = (PRHEL_SRB_EXTENSION)Srb->SrbExtension;
-            if (srbExt->fua == TRUE) {
-               RemoveEntryList(&vbr->list_entry);
-               Srb->SrbStatus = SRB_STATUS_PENDING;
-               Srb->ScsiStatus = SCSISTAT_GOOD;
-               if (!RhelDoFlush(DeviceExtension, Srb, FALSE)) {
-                    Srb->SrbStatus = SRB_STATUS_ERROR;
-                    CompleteSRB(DeviceExtension, Srb);
+    virtqueue_disable_cb(adaptExt->vq);
+    do {
+        while((vbr = (pblk_req)virtqueue_get_buf(adaptExt->vq, &len)) != NULL) {
+            Srb = (PSCSI_REQUEST_BLOCK)vbr->req;
+            if (Srb) {
+               switch (vbr->status) {
+               case VIRTIO_BLK_S_OK:
+                  Srb->SrbStatus = SRB_STATUS_SUCCESS;
+                  break;
+               case VIRTIO_BLK_S_UNSUPP:
+                  Srb->SrbStatus = SRB_STATUS_INVALID_REQUEST;
+                  break;
+               default:
+                  Srb->SrbStatus = SRB_STATUS_ERROR;
+                  RhelDbgPrint(TRACE_LEVEL_ERROR, ("SRB_STATUS_ERROR\n"));
+                  break;
+               }
+            }
+            if (vbr->out_hdr.type == VIRTIO_BLK_T_FLUSH) {
+                CompleteSRB(DeviceExtension, Srb);
+            } else if (vbr->out_hdr.type == VIRTIO_BLK_T_GET_ID) {
+                adaptExt->sn_ok = TRUE;
+            } else if (Srb) {
+                srbExt   = (PRHEL_SRB_EXTENSION)Srb->SrbExtension;
+                if (srbExt->fua == TRUE) {
+                   RemoveEntryList(&vbr->list_entry);
+                   Srb->SrbStatus = SRB_STATUS_PENDING;
+                   Srb->ScsiStatus = SCSISTAT_GOOD;
+                   if (!RhelDoFlush(DeviceExtension, Srb, FALSE)) {
+                        Srb->SrbStatus = SRB_STATUS_ERROR;
+                        CompleteSRB(DeviceExtension, Srb);
+                    } else {
+                        srbExt->fua = FALSE;
+                    }
                 } else {
-                    srbExt->fua = FALSE;
+                    CompleteDPC(DeviceExtension, vbr, MessageID);
                 }
-            } else {
-                CompleteDPC(DeviceExtension, vbr, MessageID);
             }
+            isInterruptServiced = TRUE;
         }
-        isInterruptServiced = TRUE;
-    }
+    } while (!virtqueue_enable_cb(adaptExt->vq));
     return isInterruptServiced;
 }
 #endif
@@ -1379,12 +1396,17 @@ CompleteDpcRoutine(
 {
     STOR_LOCK_HANDLE  LockHandle;
     PADAPTER_EXTENSION adaptExt = (PADAPTER_EXTENSION)Context;
+    LIST_ENTRY         complete_list;
+    ULONG              completed = 0;
+    ULONG              bucket = 0;
 
 #ifdef MSI_SUPPORTED
     ULONG MessageID = PtrToUlong(SystemArgument1);
     ULONG OldIrql;
 #endif
 
+    InitializeListHead(&complete_list);
+
 #ifdef MSI_SUPPORTED
     if(adaptExt->msix_vectors) {
         StorPortAcquireMSISpinLock (Context, MessageID, &OldIrql);
@@ -1395,22 +1417,32 @@ CompleteDpcRoutine(
     }
 #endif
 
-    while (!IsListEmpty(&adaptExt->complete_list)) {
+    /* Detach the whole list in one go, the SRBs are completed unlocked */
+    if (!IsListEmpty(&adaptExt->complete_list)) {
+        complete_list.Flink = adaptExt->complete_list.Flink;
+        complete_list.Blink = adaptExt->complete_list.Blink;
+        complete_list.Flink->Blink = &complete_list;
+        complete_list.Blink->Flink = &complete_list;
+        InitializeListHead(&adaptExt->complete_list);
+    }
+
+#ifdef MSI_SUPPORTED
+    if(adaptExt->msix_vectors) {
+        StorPortReleaseMSISpinLock (Context, MessageID, OldIrql);
+    } else {
+#endif
+        StorPortReleaseSpinLock (Context, &LockHandle);
+#ifdef MSI_SUPPORTED
+    }
+#endif
+
+    while (!IsListEmpty(&complete_list)) {
         PSCSI_REQUEST_BLOCK Srb;
         PRHEL_SRB_EXTENSION srbExt;
         pblk_req vbr;
-        vbr  = (pblk_req) RemoveHeadList(&adaptExt->complete_list);
+        vbr  = (pblk_req) RemoveHeadList(&complete_list);
         Srb = (PSCSI_REQUEST_BLOCK)vbr->req;
         srbExt   = (PRHEL_SRB_EXTENSION)Srb->SrbExtension;
-#ifdef MSI_SUPPORTED
-        if(adaptExt->msix_vectors) {
-           StorPortReleaseMSISpinLock (Context, MessageID, OldIrql);
-        } else {
-#endif
-           StorPortReleaseSpinLock (Context, &LockHandle);
-#ifdef MSI_SUPPORTED
-        }
-#endif
         if (Srb->DataTransferLength > srbExt->Xfer) {
            Srb->DataTransferLength = srbExt->Xfer;
            Srb->SrbStatus = SRB_STATUS_DATA_OVERRUN;
@@ -1418,28 +1450,33 @@ CompleteDpcRoutine(
         ScsiPortNotification(RequestComplete,
                          Context,
                          Srb);
-#ifdef MSI_SUPPORTED
-        if(adaptExt->msix_vectors) {
-           StorPortAcquireMSISpinLock (Context, MessageID, &OldIrql);
-        } else {
-#endif
-           StorPortAcquireSpinLock ( Context, InterruptLock , NULL, &LockHandle);
-#ifdef MSI_SUPPORTED
-        }
-#endif
+        ++completed;
     }
 
-#ifdef MSI_SUPPORTED
-    if(adaptExt->msix_vectors) {
-        StorPortReleaseMSISpinLock (Context, MessageID, OldIrql);
-    } else {
-#endif
-        StorPortReleaseSpinLock (Context, &LockHandle);
-#ifdef MSI_SUPPORTED
+    if (completed) {
+        while ((completed >>= 1) != 0 && bucket < DPC_COMPLETIONS_BUCKETS - 1) {
+            ++bucket;
+        }
+        InterlockedIncrement((LONG volatile *)&adaptExt->dpc_completions[bucket]);
     }
-#endif
     return;
 }
+
+VOID
+TraceDpcCompletions(
+    IN PVOID DeviceExtension
+    )
+{
+    PADAPTER_EXTENSION adaptExt = (PADAPTER_EXTENSION)DeviceExtension;
+    ULONG              bucket;
+
+    for (bucket = 0; bucket < DPC_COMPLETIONS_BUCKETS; bucket++) {
+        ULONG count = InterlockedExchange((LONG volatile *)&adaptExt->dpc_completions[bucket], 0);
+        if (count) {
+            RhelDbgPrint(TRACE_LEVEL_INFORMATION, ("DPCs completing %d+ requests: %d\n", 1 << bucket, count));
+        }
+    }
+}
 #endif
 
 VOID
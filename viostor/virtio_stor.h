@@ -68,6 +68,10 @@ typedef struct VirtIOBufferDescriptor VIO_SG, *PVIO_SG;
 
 #define VIRTIO_MAX_SG           (3+MAX_PHYS_SEGMENTS)
 
+/* Buckets of the per-DPC completions histogram: 1, 2-3, 4-7, ... 128+,
+ * traced and reset when the adapter is stopped or restarted */
+#define DPC_COMPLETIONS_BUCKETS 8
+
 #pragma pack(1)
 typedef struct virtio_blk_config {
     /* The capacity (in 512-byte sectors). */
@@ -152,6 +156,7 @@ typedef struct _ADAPTER_EXTENSION {
     LIST_ENTRY            complete_list;
     STOR_DPC              completion_dpc;
     BOOLEAN               dpc_ok;
+    ULONG                 dpc_completions[DPC_COMPLETIONS_BUCKETS];
 #endif
 }ADAPTER_EXTENSION, *PADAPTER_EXTENSION;
 